@@ -0,0 +1,107 @@
+#include "adpcm.h"
+
+#include "convert.h"
+
+static const int16_t stepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t indexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+// Applies one code to the state, shared by encoder and decoder so both stay in step
+static inline void update(AdpcmState *s, uint8_t code) {
+    int step = stepTable[s->index];
+    int delta = step >> 3;
+    if (code & 4) {
+        delta += step;
+    }
+    if (code & 2) {
+        delta += step >> 1;
+    }
+    if (code & 1) {
+        delta += step >> 2;
+    }
+    s->predictor = saturate16((code & 8) ? s->predictor - delta : s->predictor + delta);
+
+    s->index += indexTable[code];
+    if (s->index < 0) {
+        s->index = 0;
+    } else if (s->index > 88) {
+        s->index = 88;
+    }
+}
+
+static inline uint8_t encodeSample(AdpcmState *s, int16_t sample) {
+    int step = stepTable[s->index];
+    int diff = sample - s->predictor;
+    uint8_t code = 0;
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+    }
+    if (diff >= step >> 1) {
+        code |= 2;
+        diff -= step >> 1;
+    }
+    if (diff >= step >> 2) {
+        code |= 1;
+    }
+    update(s, code);
+    return code;
+}
+
+void adpcmInit(AdpcmState *s) {
+    s->predictor = 0;
+    s->index = 0;
+}
+
+void adpcmEncodeBlock(AdpcmState *s, const int16_t *in, uint8_t *block) {
+    // block restarts from the exact first sample
+    s->predictor = in[0];
+    block[0] = in[0] & 0xff;
+    block[1] = (in[0] >> 8) & 0xff;
+    block[2] = s->index;
+    block[3] = 0;
+
+    const int16_t *sample = in + 1;
+    for (int i = 4; i < ADPCM_BLOCK_ALIGN; i++) {
+        uint8_t low = encodeSample(s, sample[0]);
+        uint8_t high = encodeSample(s, sample[1]);
+        block[i] = low | (high << 4);
+        sample += 2;
+    }
+}
+
+size_t adpcmDecodeBlock(const uint8_t *block, size_t blockSize, int16_t *out) {
+    if (blockSize < 4) {
+        return 0;
+    }
+    AdpcmState s;
+    s.predictor = (int16_t)(block[0] | (block[1] << 8));
+    s.index = block[2] > 88 ? 88 : block[2];
+    out[0] = s.predictor;
+
+    size_t count = 1;
+    for (size_t i = 4; i < blockSize; i++) {
+        update(&s, block[i] & 0x0f);
+        out[count++] = s.predictor;
+        update(&s, block[i] >> 4);
+        out[count++] = s.predictor;
+    }
+    return count;
+}
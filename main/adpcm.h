@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// IMA-ADPCM as used in WAV files (format 0x11), mono only.
+// Every block starts with a 4-byte header holding the first sample
+// and the step index, then two 4-bit codes per byte, low nibble first.
+#define ADPCM_FORMAT 0x11
+#define ADPCM_BLOCK_ALIGN 1024
+#define ADPCM_SAMPLES_PER_BLOCK(align) (((align) - 4) * 2 + 1)
+
+typedef struct {
+    int32_t predictor;
+    int index; // into the step table, carried over from block to block
+} AdpcmState;
+
+void adpcmInit(AdpcmState *s);
+
+// Encodes exactly ADPCM_SAMPLES_PER_BLOCK(ADPCM_BLOCK_ALIGN) samples into one block
+void adpcmEncodeBlock(AdpcmState *s, const int16_t *in, uint8_t *block);
+
+// Decodes a block of blockSize bytes, returns number of samples written to out
+size_t adpcmDecodeBlock(const uint8_t *block, size_t blockSize, int16_t *out);
@@ -0,0 +1,47 @@
+#include "align.h"
+
+#include <stdlib.h>
+
+void alignerInit(Aligner *a, uint32_t sampleRate) {
+    a->index = 0;
+    a->window = sampleRate * ALIGN_WINDOW_MS / 1000;
+    a->txIndex = ALIGN_UNKNOWN;
+    a->leadIn = 0;
+    a->noise = 0;
+    a->click = ALIGN_UNKNOWN;
+    a->start = ALIGN_UNKNOWN;
+}
+
+void alignerSetTx(Aligner *a, uint32_t txIndex, uint32_t leadIn) {
+    a->txIndex = txIndex;
+    a->leadIn = leadIn;
+}
+
+size_t alignerDrop(Aligner *a, const int16_t *samples, size_t count) {
+    size_t i = 0;
+    for (; i < count; i++, a->index++) {
+        if (a->start != ALIGN_UNKNOWN) {
+            if (a->index >= a->start) {
+                break;
+            }
+            continue;
+        }
+        int32_t level = abs(samples[i]);
+        if (a->txIndex == ALIGN_UNKNOWN || a->index < a->txIndex) {
+            // the room before the click
+            if (level > a->noise) {
+                a->noise = level;
+            }
+        } else if (a->index < a->txIndex + a->window) {
+            int32_t threshold = a->noise * ALIGN_CLICK_RATIO;
+            if (level > threshold && level > ALIGN_MIN_LEVEL) {
+                a->click = a->index;
+                a->start = a->click + a->leadIn;
+            }
+        } else {
+            // not heard, trust the clocks
+            a->start = a->txIndex + a->leadIn;
+        }
+    }
+    return i;
+}
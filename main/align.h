@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lines an overdub take up with the file it was played over. The player
+// starts with a click, then ALIGN_LEAD_IN_MS of silence before the file.
+// The take is recorded from before the click, so the click is in it,
+// delayed by everything between the amp DMA and the mic DMA, speaker
+// and air included. Everything up to the click plus the lead-in is
+// dropped, the take then starts with the first sample of the file.
+//
+// The click is looked for from where the clocks say it left the amp,
+// as the first sample ALIGN_CLICK_RATIO times louder than anything
+// before it. If it is not heard within ALIGN_WINDOW_MS, the clocks alone
+// decide, which misses the time the sound took to get around.
+// Nothing in here touches the hardware, so it runs the same on a host.
+#define ALIGN_LEAD_IN_MS 500
+#define ALIGN_WINDOW_MS 250
+#define ALIGN_CLICK_RATIO 4
+// quietest click that counts, about -24 dBFS
+#define ALIGN_MIN_LEVEL 2048
+#define ALIGN_UNKNOWN UINT32_MAX
+
+typedef struct {
+    uint32_t index; // samples seen
+    uint32_t window; // samples
+    uint32_t txIndex; // where the clocks put the click, ALIGN_UNKNOWN until told
+    uint32_t leadIn; // samples from the click to the file
+    int32_t noise; // loudest sample before txIndex
+    uint32_t click; // where it was heard, ALIGN_UNKNOWN if not (yet)
+    uint32_t start; // first sample of the take, ALIGN_UNKNOWN while looking
+} Aligner;
+
+void alignerInit(Aligner *a, uint32_t sampleRate);
+// Where the click left the amp by the clocks, and how many samples later the file started
+void alignerSetTx(Aligner *a, uint32_t txIndex, uint32_t leadIn);
+// Takes the next count samples of the recording, returns how many of
+// them, from the beginning, are not part of the take
+size_t alignerDrop(Aligner *a, const int16_t *samples, size_t count);
+static inline bool alignerDone(const Aligner *a) {
+    return a->start != ALIGN_UNKNOWN && a->index >= a->start;
+}
@@ -0,0 +1,112 @@
+#include "buttons.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#define EDGE_QUEUE_LENGTH 32
+// queued by buttonsWake, not a button
+#define WAKE_EDGE UINT8_MAX
+
+static const gpio_num_t *buttonPins;
+static QueueHandle_t edgeQueue;
+static Gesture gesture;
+
+// gestures already worked out but not handed out yet
+static GestureEvent pending[GESTURE_MAX_EVENTS];
+static int pendingHead;
+static int pendingCount;
+
+static inline uint32_t nowMs() {
+    return esp_timer_get_time() / 1000;
+}
+
+static void IRAM_ATTR buttonIsr(void *arg) {
+    int index = (intptr_t)arg;
+    ButtonEdge edge = {
+        .button = index,
+        .level = gpio_get_level(buttonPins[index]),
+        .timeMs = nowMs(),
+    };
+    BaseType_t woken = pdFALSE;
+    // a full queue loses the edge, the next one brings the level back in line
+    xQueueSendFromISR(edgeQueue, &edge, &woken);
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+
+bool buttonsInit(const gpio_num_t *pins, const uint8_t *flags, int count) {
+    buttonPins = pins;
+    gestureInit(&gesture, flags, count);
+    edgeQueue = xQueueCreate(EDGE_QUEUE_LENGTH, sizeof(ButtonEdge));
+    if (edgeQueue == NULL) {
+        return false;
+    }
+    if (gpio_install_isr_service(0) != ESP_OK) {
+        ESP_LOGE("buttons", "Failed to install GPIO ISR service");
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        gpio_set_direction(pins[i], GPIO_MODE_INPUT);
+        gpio_pulldown_en(pins[i]);
+        gpio_pullup_dis(pins[i]);
+        gpio_set_intr_type(pins[i], GPIO_INTR_ANYEDGE);
+        gpio_isr_handler_add(pins[i], buttonIsr, (void *)(intptr_t)i);
+        gpio_intr_enable(pins[i]);
+    }
+    return true;
+}
+
+static void queueEvents(const GestureEvent *events, int n) {
+    for (int i = 0; i < n && pendingCount < GESTURE_MAX_EVENTS; i++) {
+        pending[(pendingHead + pendingCount) % GESTURE_MAX_EVENTS] = events[i];
+        pendingCount++;
+    }
+}
+
+bool buttonsWait(GestureEvent *event, uint32_t timeoutMs) {
+    uint32_t start = nowMs();
+    GestureEvent events[GESTURE_MAX_EVENTS];
+
+    while (pendingCount == 0) {
+        uint32_t now = nowMs();
+        uint32_t elapsed = now - start;
+        if (timeoutMs != BUTTONS_FOREVER && elapsed >= timeoutMs) {
+            return false;
+        }
+        uint32_t wait = gestureTimeout(&gesture, now);
+        if (timeoutMs != BUTTONS_FOREVER && timeoutMs - elapsed < wait) {
+            wait = timeoutMs - elapsed;
+        }
+        // a deadline less than one tick away still has to wait a tick
+        TickType_t ticks = (wait == GESTURE_NO_DEADLINE) ? portMAX_DELAY : pdMS_TO_TICKS(wait) + 1;
+
+        ButtonEdge edge;
+        if (xQueueReceive(edgeQueue, &edge, ticks) == pdTRUE) {
+            if (edge.button == WAKE_EDGE) {
+                return false;
+            }
+            queueEvents(events, gestureTick(&gesture, edge.timeMs, events));
+            queueEvents(events, gestureEdge(&gesture, &edge, events));
+        } else {
+            queueEvents(events, gestureTick(&gesture, nowMs(), events));
+        }
+    }
+    *event = pending[pendingHead];
+    pendingHead = (pendingHead + 1) % GESTURE_MAX_EVENTS;
+    pendingCount--;
+    return true;
+}
+
+void buttonsWake() {
+    ButtonEdge edge = { .button = WAKE_EDGE };
+    xQueueSend(edgeQueue, &edge, portMAX_DELAY);
+}
+
+void buttonsSetFlags(int button, uint8_t flags) {
+    gestureSetFlags(&gesture, button, flags);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "driver/gpio.h"
+
+#include "gesture.h"
+
+#define BUTTONS_FOREVER UINT32_MAX
+
+// Buttons are active high. Every edge is timestamped in the GPIO
+// interrupt and queued, gestures are worked out in the waiting task.
+bool buttonsInit(const gpio_num_t *pins, const uint8_t *flags, int count);
+// Blocks until the next gesture, false if none came within timeoutMs or
+// buttonsWake was called
+bool buttonsWait(GestureEvent *event, uint32_t timeoutMs);
+// Lets the task in buttonsWait return early, or the next call if none is
+// waiting. From any task.
+void buttonsWake();
+// Changes what button index can do, see gestureSetFlags. Only from the
+// task that calls buttonsWait.
+void buttonsSetFlags(int button, uint8_t flags);
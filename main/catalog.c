@@ -0,0 +1,489 @@
+#include "catalog.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <unistd.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "esp_log.h"
+
+#include "wavparse.h"
+#include "flac.h"
+
+#define PATH_LEN 64
+
+#define JOURNAL_MAGIC "RCAT"
+#define JOURNAL_VERSION 1
+// records read from the card at once
+#define JOURNAL_READ_RECORDS 128
+
+typedef enum { JOURNAL_ADD = 1, JOURNAL_REMOVE = 2 } JournalOp;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+} JournalHeader;
+
+// one change, 32 bytes so records never straddle a sector
+typedef struct {
+    uint8_t op;
+    uint8_t format;
+    uint16_t peak;
+    char name[CATALOG_NAME_LEN - 1]; // not terminated when it is 12 characters long
+    uint32_t size;
+    uint32_t durationMs;
+    uint32_t sampleRate;
+    uint32_t crc; // of everything before it
+} JournalRecord;
+
+_Static_assert(sizeof(JournalRecord) == 32, "journal record must stay 32 bytes");
+
+static char catalogDir[PATH_LEN - CATALOG_NAME_LEN - 1];
+static char journalPath[PATH_LEN];
+static CatalogEntry *entries;
+static int count;
+static int capacity;
+static uint32_t nextNumber = 1;
+// records in the journal file, for deciding when to compact it
+static int journalRecords;
+static SemaphoreHandle_t catalogMutex;
+// every insert and remove, read without the lock
+static atomic_uint changes;
+
+static uint32_t nameNumber(const char *name) {
+    return isdigit((unsigned char)name[0]) ? strtoul(name, NULL, 10) : 0;
+}
+
+static int compare(const CatalogEntry *a, const CatalogEntry *b) {
+    if (a->number != b->number) {
+        // numbered names first, 0 means no number
+        if (a->number == 0 || b->number == 0) {
+            return a->number == 0 ? 1 : -1;
+        }
+        return a->number < b->number ? -1 : 1;
+    }
+    // FAT names do not keep their case
+    return strcasecmp(a->name, b->name);
+}
+
+static int compareQsort(const void *a, const void *b) {
+    return compare(a, b);
+}
+
+// Position of key among the first n entries, or where it would have to be inserted
+static int search(const CatalogEntry *key, int n, bool *found) {
+    int low = 0;
+    int high = n;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        int c = compare(&entries[mid], key);
+        if (c == 0) {
+            *found = true;
+            return mid;
+        }
+        if (c < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *found = false;
+    return low;
+}
+
+static bool grow() {
+    int newCapacity = capacity ? capacity * 2 : 64;
+    CatalogEntry *grown = realloc(entries, newCapacity * sizeof(CatalogEntry));
+    if (grown == NULL) {
+        ESP_LOGE("catalog", "Out of memory at %d entries", count);
+        return false;
+    }
+    entries = grown;
+    capacity = newCapacity;
+    return true;
+}
+
+static const char *baseName(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void makeEntry(const char *name, CatalogEntry *e) {
+    memset(e, 0, sizeof(CatalogEntry));
+    strncpy(e->name, name, CATALOG_NAME_LEN - 1);
+    e->number = nameNumber(name);
+    e->peak = CATALOG_PEAK_UNKNOWN;
+}
+
+static uint32_t crc32(const uint8_t *data, size_t len) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static void toRecord(JournalOp op, const CatalogEntry *e, JournalRecord *r) {
+    memset(r, 0, sizeof(JournalRecord));
+    r->op = op;
+    r->format = e->format;
+    r->peak = e->peak;
+    memcpy(r->name, e->name, sizeof(r->name));
+    r->size = e->size;
+    r->durationMs = e->durationMs;
+    r->sampleRate = e->sampleRate;
+    r->crc = crc32((const uint8_t *)r, offsetof(JournalRecord, crc));
+}
+
+static bool fromRecord(const JournalRecord *r, CatalogEntry *e) {
+    if (r->crc != crc32((const uint8_t *)r, offsetof(JournalRecord, crc)) ||
+        (r->op != JOURNAL_ADD && r->op != JOURNAL_REMOVE)) {
+        return false;
+    }
+    char name[CATALOG_NAME_LEN] = {0};
+    memcpy(name, r->name, sizeof(r->name));
+    makeEntry(name, e);
+    e->format = r->format;
+    e->peak = r->peak;
+    e->size = r->size;
+    e->durationMs = r->durationMs;
+    e->sampleRate = r->sampleRate;
+    return true;
+}
+
+static void appendRecord(JournalOp op, const CatalogEntry *e) {
+    JournalRecord r;
+    toRecord(op, e, &r);
+    FILE *f = fopen(journalPath, "a");
+    if (f == NULL || fwrite(&r, sizeof(r), 1, f) != 1) {
+        // next boot finds the difference in the directory
+        ESP_LOGE("catalog", "Cannot append to %s", journalPath);
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+    journalRecords++;
+}
+
+// Fills in format, size and duration from the file itself
+static void probe(const char *path, CatalogEntry *e) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    e->size = ftell(f);
+    rewind(f);
+
+    uint8_t head[FLAC_HEADER_SIZE];
+    if (e->size < sizeof(head) || fread(head, 1, sizeof(head), f) != sizeof(head)) {
+        // nothing written yet
+    } else if (memcmp(head, "fLaC", 4) == 0) {
+        // STREAMINFO follows the marker and its block header,
+        // rate is 20 bits at byte 10 and the sample count the last 36 bits of byte 13-17
+        const uint8_t *info = head + 8;
+        uint32_t rate = (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+        uint64_t samples = ((uint64_t)(info[13] & 0x0f) << 32) | ((uint32_t)info[14] << 24) |
+                           (info[15] << 16) | (info[16] << 8) | info[17];
+        e->format = CATALOG_FLAC;
+        e->sampleRate = rate;
+        if (rate > 0) {
+            e->durationMs = samples * 1000 / rate;
+        }
+    } else {
+        rewind(f);
+        WavInfo info;
+        if (wavParse(f, &info)) {
+            uint64_t samples;
+            e->format = CATALOG_PCM;
+            e->sampleRate = info.sampleRate;
+            if (info.format == WAVE_FORMAT_IMA_ADPCM) {
+                e->format = CATALOG_ADPCM;
+                samples = info.sampleLength ? info.sampleLength :
+                          (uint64_t)(info.dataBytes / info.blockAlign) * info.samplesPerBlock;
+            } else {
+                samples = info.dataBytes / info.blockAlign;
+            }
+            e->durationMs = samples * 1000 / info.sampleRate;
+        }
+    }
+    fclose(f);
+}
+
+// Inserts e, or replaces the entry with the same name, caller holds the lock
+static void insertLocked(const CatalogEntry *e) {
+    bool found;
+    int index = search(e, count, &found);
+    if (!found) {
+        if (count == capacity && !grow()) {
+            return;
+        }
+        // new recordings have the highest number, this moves nothing
+        memmove(&entries[index + 1], &entries[index], (count - index) * sizeof(CatalogEntry));
+        count++;
+    }
+    entries[index] = *e;
+    if (e->number >= nextNumber) {
+        nextNumber = e->number + 1;
+    }
+    atomic_fetch_add(&changes, 1);
+}
+
+static void removeLocked(const CatalogEntry *key) {
+    bool found;
+    int index = search(key, count, &found);
+    if (found) {
+        count--;
+        memmove(&entries[index], &entries[index + 1], (count - index) * sizeof(CatalogEntry));
+        atomic_fetch_add(&changes, 1);
+    }
+}
+
+// Replays the journal, false if it is missing or damaged. A record cut
+// short by a power loss at the end is dropped and only marks it dirty.
+static bool loadJournal(bool *dirty) {
+    FILE *f = fopen(journalPath, "r");
+    if (f == NULL) {
+        ESP_LOGI("catalog", "No journal");
+        return false;
+    }
+    JournalHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              memcmp(header.magic, JOURNAL_MAGIC, 4) == 0 && header.version == JOURNAL_VERSION;
+    JournalRecord *records = malloc(JOURNAL_READ_RECORDS * sizeof(JournalRecord));
+    ok = ok && records != NULL;
+    size_t n;
+    while (ok && (n = fread(records, sizeof(JournalRecord), JOURNAL_READ_RECORDS, f)) > 0) {
+        for (size_t i = 0; i < n && ok; i++) {
+            CatalogEntry e;
+            ok = fromRecord(&records[i], &e);
+            if (!ok) {
+                break;
+            }
+            if (records[i].op == JOURNAL_ADD) {
+                insertLocked(&e);
+            } else {
+                removeLocked(&e);
+            }
+            journalRecords++;
+        }
+    }
+    if (ok && ftell(f) != sizeof(header) + journalRecords * sizeof(JournalRecord)) {
+        *dirty = true;
+    }
+    free(records);
+    fclose(f);
+    if (!ok) {
+        ESP_LOGE("catalog", "Journal damaged after %d records", journalRecords);
+    }
+    return ok;
+}
+
+// Writes one record per entry to a new file and puts it in place of the old one
+static void rewriteJournal() {
+    char tmpPath[PATH_LEN];
+    strcpy(tmpPath, journalPath);
+    char *dot = strrchr(tmpPath, '.');
+    strcpy(dot ? dot : tmpPath + strlen(tmpPath), ".TMP");
+
+    FILE *f = fopen(tmpPath, "w");
+    if (f == NULL) {
+        ESP_LOGE("catalog", "Cannot write %s", tmpPath);
+        return;
+    }
+    JournalHeader header = { .version = JOURNAL_VERSION };
+    memcpy(header.magic, JOURNAL_MAGIC, 4);
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (int i = 0; i < count && ok; i++) {
+        JournalRecord r;
+        toRecord(JOURNAL_ADD, &entries[i], &r);
+        ok = fwrite(&r, sizeof(r), 1, f) == 1;
+    }
+    ok = (fclose(f) == 0) && ok;
+    // FAT cannot rename over an existing file
+    unlink(journalPath);
+    if (!ok || rename(tmpPath, journalPath) != 0) {
+        ESP_LOGE("catalog", "Failed to write journal");
+        unlink(tmpPath);
+        return;
+    }
+    journalRecords = count;
+}
+
+// Brings the loaded entries in line with the names in dir, without opening
+// files the journal already knows. Returns whether anything changed.
+static bool reconcile(DIR *d) {
+    int known = count;
+    uint8_t *seen = calloc(known ? known : 1, 1);
+    if (seen == NULL) {
+        return false;
+    }
+    bool changed = false;
+    struct dirent *f;
+    char path[PATH_LEN];
+    while ((f = readdir(d)) != NULL) {
+        if (f->d_type != DT_REG || strlen(f->d_name) >= CATALOG_NAME_LEN) {
+            continue;
+        }
+        CatalogEntry e;
+        makeEntry(f->d_name, &e);
+        bool found;
+        int index = search(&e, known, &found);
+        if (found) {
+            seen[index] = 1;
+            if (entries[index].size != 0) {
+                continue;
+            }
+            // was still being written when the power went, look again
+            e.peak = entries[index].peak;
+        }
+        snprintf(path, sizeof(path), "%s/%s", catalogDir, e.name);
+        probe(path, &e);
+        if (found) {
+            if (memcmp(&entries[index], &e, sizeof(e)) == 0) {
+                // really is empty
+                continue;
+            }
+            entries[index] = e;
+        } else {
+            // sorted below, the first known entries stay searchable meanwhile
+            if (count == capacity && !grow()) {
+                break;
+            }
+            entries[count++] = e;
+        }
+        changed = true;
+    }
+
+    // drop what was deleted behind our back, keeping the new ones at the end
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        if (i < known && !seen[i]) {
+            changed = true;
+            continue;
+        }
+        entries[kept++] = entries[i];
+    }
+    count = kept;
+    free(seen);
+    qsort(entries, count, sizeof(CatalogEntry), compareQsort);
+    nextNumber = 1;
+    for (int i = 0; i < count; i++) {
+        if (entries[i].number >= nextNumber) {
+            nextNumber = entries[i].number + 1;
+        }
+    }
+    return changed;
+}
+
+bool catalogInit(const char *dir, const char *journal) {
+    if (catalogMutex == NULL) {
+        catalogMutex = xSemaphoreCreateMutex();
+    }
+    strncpy(catalogDir, dir, sizeof(catalogDir) - 1);
+    strncpy(journalPath, journal, sizeof(journalPath) - 1);
+
+    xSemaphoreTake(catalogMutex, portMAX_DELAY);
+    count = 0;
+    journalRecords = 0;
+    bool dirty = false;
+    if (!loadJournal(&dirty)) {
+        // rebuilt from the directory alone
+        count = 0;
+        dirty = true;
+    }
+    int loaded = count;
+
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        xSemaphoreGive(catalogMutex);
+        ESP_LOGE("catalog", "Cannot open %s", dir);
+        return false;
+    }
+    if (reconcile(d)) {
+        dirty = true;
+    }
+    closedir(d);
+    // removed and updated entries pile up in an append-only file
+    if (dirty || journalRecords > 2 * count + 64) {
+        rewriteJournal();
+    }
+    xSemaphoreGive(catalogMutex);
+    ESP_LOGI("catalog", "%d recordings (%d from journal), next number %u", count, loaded, nextNumber);
+    return true;
+}
+
+int catalogCount() {
+    return count;
+}
+
+bool catalogGet(int index, CatalogEntry *entry) {
+    xSemaphoreTake(catalogMutex, portMAX_DELAY);
+    bool ok = (index >= 0 && index < count);
+    if (ok) {
+        *entry = entries[index];
+    }
+    xSemaphoreGive(catalogMutex);
+    return ok;
+}
+
+bool catalogPath(int index, char *path) {
+    CatalogEntry e;
+    if (!catalogGet(index, &e)) {
+        return false;
+    }
+    sprintf(path, "%s/%s", catalogDir, e.name);
+    return true;
+}
+
+void catalogNewPath(const char *extension, char *path) {
+    xSemaphoreTake(catalogMutex, portMAX_DELAY);
+    sprintf(path, "%s/%u.%s", catalogDir, nextNumber++, extension);
+    xSemaphoreGive(catalogMutex);
+}
+
+static void insert(const CatalogEntry *e) {
+    xSemaphoreTake(catalogMutex, portMAX_DELAY);
+    insertLocked(e);
+    appendRecord(JOURNAL_ADD, e);
+    xSemaphoreGive(catalogMutex);
+}
+
+void catalogAdd(const char *path) {
+    CatalogEntry e;
+    makeEntry(baseName(path), &e);
+    insert(&e);
+}
+
+void catalogRefresh(const char *path, uint16_t peak) {
+    CatalogEntry e;
+    makeEntry(baseName(path), &e);
+    e.peak = peak;
+    // file access stays outside the lock
+    probe(path, &e);
+    insert(&e);
+}
+
+void catalogRemove(const char *path) {
+    CatalogEntry key;
+    makeEntry(baseName(path), &key);
+    xSemaphoreTake(catalogMutex, portMAX_DELAY);
+    removeLocked(&key);
+    appendRecord(JOURNAL_REMOVE, &key);
+    xSemaphoreGive(catalogMutex);
+}
+
+uint32_t catalogChanges() {
+    return atomic_load(&changes);
+}
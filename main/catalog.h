@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Index of the recordings directory, kept in memory so the UI never
+// walks the directory itself. Entries are sorted by number ("2.wav"
+// before "10.wav"), names that do not start with a number come last in
+// name order. All functions may be called from any task.
+//
+// Every change is also appended to a journal file on the card, fixed
+// size records with a CRC each. At boot the journal is read in one go
+// and only checked against the names in the directory; headers are
+// opened only for files the journal does not know. A missing or damaged
+// journal is rebuilt from the directory, a long one is compacted.
+
+// 8.3 name and terminator, the card is mounted without long names
+#define CATALOG_NAME_LEN 13
+#define CATALOG_PEAK_UNKNOWN 0xffff
+
+typedef enum { CATALOG_UNKNOWN, CATALOG_PCM, CATALOG_ADPCM, CATALOG_FLAC } CatalogFormat;
+
+typedef struct {
+    char name[CATALOG_NAME_LEN];
+    uint8_t format; // CatalogFormat
+    uint16_t peak; // largest absolute sample, CATALOG_PEAK_UNKNOWN for files not recorded here
+    uint32_t number; // leading number of the name, 0 if there is none
+    uint32_t size; // bytes
+    uint32_t durationMs; // 0 if unknown
+    uint32_t sampleRate;
+} CatalogEntry;
+
+// Loads the journal and checks it against dir, later paths passed in must be inside dir
+bool catalogInit(const char *dir, const char *journal);
+int catalogCount();
+// Copies entry index, false if there is no such entry
+bool catalogGet(int index, CatalogEntry *entry);
+// Full path of entry index
+bool catalogPath(int index, char *path);
+// Reserves the next free number and returns its full path, the number
+// is not handed out again even if the file is never created
+void catalogNewPath(const char *extension, char *path);
+// Adds a file that is still being written, size and duration stay 0
+void catalogAdd(const char *path);
+// Adds the file or updates its size and duration from the header
+void catalogRefresh(const char *path, uint16_t peak);
+void catalogRemove(const char *path);
+// Goes up with every change to the list, indexes taken before one may
+// point at other entries now
+uint32_t catalogChanges();
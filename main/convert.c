@@ -0,0 +1,180 @@
+#include "convert.h"
+
+#include <string.h>
+
+// Mic has 18 valid bits at the top of the slot. 24 bits go through
+// the DC-blocker, the rest is shifted out to get 16-bit samples.
+#define MIC_FILTER_SHIFT 8
+#define MIC_OUTPUT_SHIFT 6
+
+static inline int16_t micSample(DcBlock *dc, int32_t slot) {
+    return saturate16(dcBlockStep(dc, slot >> MIC_FILTER_SHIFT) >> MIC_OUTPUT_SHIFT);
+}
+
+static inline void seed(const int32_t *frames, size_t frameCount, DcBlock *dc) {
+    if (!dc->seeded && frameCount > 0) {
+        dcBlockSeed(dc, frames[1] >> MIC_FILTER_SHIFT);
+    }
+}
+
+void convertMicToPcm16Ref(const int32_t *frames, size_t frameCount, int16_t *out, DcBlock *dc) {
+    seed(frames, frameCount, dc);
+    for (size_t i = 0; i < frameCount; i++) {
+        out[i] = micSample(dc, frames[2 * i + 1]);
+    }
+}
+
+void convertMicToPcm16Unrolled(const int32_t *frames, size_t frameCount, int16_t *out, DcBlock *dc) {
+    seed(frames, frameCount, dc);
+    // keeping the state in locals lets the compiler hold it in registers
+    DcBlock state = *dc;
+    size_t i = 0;
+    for (; i + 4 <= frameCount; i += 4) {
+        int32_t a = frames[1];
+        int32_t b = frames[3];
+        int32_t c = frames[5];
+        int32_t d = frames[7];
+        frames += 8;
+        out[i] = micSample(&state, a);
+        out[i + 1] = micSample(&state, b);
+        out[i + 2] = micSample(&state, c);
+        out[i + 3] = micSample(&state, d);
+    }
+    for (; i < frameCount; i++) {
+        out[i] = micSample(&state, frames[1]);
+        frames += 2;
+    }
+    *dc = state;
+}
+
+// squares of this many samples still fit 32 bits after METER_ENERGY_SHIFT
+#define METER_CHUNK 8192
+
+static inline int32_t min32(int32_t a, int32_t b) {
+    return a < b ? a : b;
+}
+
+static inline int32_t max32(int32_t a, int32_t b) {
+    return a > b ? a : b;
+}
+
+// Sample before saturation, the meter takes its extremes from these
+static inline int32_t micUnsaturated(DcBlock *dc, int32_t slot) {
+    return dcBlockStep(dc, slot >> MIC_FILTER_SHIFT) >> MIC_OUTPUT_SHIFT;
+}
+
+void convertMicToPcm16Metered(const int32_t *frames, size_t frameCount, int16_t *out, DcBlock *dc, Meter *meter) {
+    seed(frames, frameCount, dc);
+    DcBlock state = *dc;
+    int32_t lo = meter->min;
+    int32_t hi = meter->max;
+    while (frameCount > 0) {
+        size_t n = frameCount < METER_CHUNK ? frameCount : METER_CHUNK;
+        uint32_t energy = 0;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            int32_t a = micUnsaturated(&state, frames[1]);
+            int32_t b = micUnsaturated(&state, frames[3]);
+            int32_t c = micUnsaturated(&state, frames[5]);
+            int32_t d = micUnsaturated(&state, frames[7]);
+            frames += 8;
+            // saturating is monotonic, the extremes are saturated once at the end
+            lo = min32(lo, d);
+            hi = max32(hi, d);
+            int32_t level = saturate16(d);
+            out[i] = saturate16(a);
+            out[i + 1] = saturate16(b);
+            out[i + 2] = saturate16(c);
+            out[i + 3] = level;
+            energy += (uint32_t)(level * level) >> METER_ENERGY_SHIFT;
+        }
+        for (; i < n; i++) {
+            out[i] = micSample(&state, frames[1]);
+            frames += 2;
+        }
+        meter->energy += energy;
+        meter->count += n / 4;
+        out += n;
+        frameCount -= n;
+    }
+    meter->min = saturate16(lo);
+    meter->max = saturate16(hi);
+    *dc = state;
+}
+
+// One sample widened to 16 bits
+static inline int32_t wavSample(const uint8_t *p, int bits, bool isFloat) {
+    if (isFloat) {
+        float f;
+        memcpy(&f, p, sizeof(f));
+        // clip before the cast, out of range floats do not convert
+        if (f > 1.0f) {
+            f = 1.0f;
+        } else if (f < -1.0f) {
+            f = -1.0f;
+        }
+        return saturate16((int32_t)(f * 32768.0f));
+    }
+    switch (bits) {
+        case 8:
+            // the only unsigned one
+            return (p[0] - 128) * 256;
+        case 16:
+            return (int16_t)(p[0] | (p[1] << 8));
+        case 24:
+            return (int16_t)(p[1] | (p[2] << 8));
+        default:
+            return (int16_t)(p[2] | (p[3] << 8));
+    }
+}
+
+void convertWavToMono16(const uint8_t *src, size_t frameCount, int channels, int bits, bool isFloat, int16_t *out) {
+    int bytes = bits / 8;
+    if (channels == 1 && bytes == 2 && !isFloat) {
+        memcpy(out, src, frameCount * sizeof(int16_t));
+        return;
+    }
+    for (size_t i = 0; i < frameCount; i++) {
+        if (channels == 2) {
+            out[i] = (wavSample(src, bits, isFloat) + wavSample(src + bytes, bits, isFloat)) >> 1;
+        } else {
+            out[i] = wavSample(src, bits, isFloat);
+        }
+        src += channels * bytes;
+    }
+}
+
+void convertPcm16ToAmpRef(const int16_t *in, size_t count, int32_t *frames) {
+    for (size_t i = 0; i < count; i++) {
+        frames[2 * i] = 0;
+        frames[2 * i + 1] = (uint32_t)(uint16_t)in[i] << 16;
+    }
+}
+
+void convertPcm16ToAmpUnrolled(const int16_t *in, size_t count, int32_t *frames) {
+    size_t i = 0;
+    // two samples per 32-bit load when the input is word aligned,
+    // little endian so the first sample is the low half
+    if (((uintptr_t)in & 3) == 0) {
+        const uint32_t *pairs = (const uint32_t *)in;
+        for (; i + 4 <= count; i += 4) {
+            uint32_t ab = pairs[0];
+            uint32_t cd = pairs[1];
+            pairs += 2;
+            frames[0] = 0;
+            frames[1] = ab << 16;
+            frames[2] = 0;
+            frames[3] = ab & 0xffff0000;
+            frames[4] = 0;
+            frames[5] = cd << 16;
+            frames[6] = 0;
+            frames[7] = cd & 0xffff0000;
+            frames += 8;
+        }
+    }
+    for (; i < count; i++) {
+        frames[0] = 0;
+        frames[1] = (uint32_t)(uint16_t)in[i] << 16;
+        frames += 2;
+    }
+}
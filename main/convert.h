@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dcblock.h"
+
+// Conversion between the I2S frame layout and 16-bit mono PCM.
+// Both I2S channels run with two 32-bit slots per frame, the audio
+// is in the second slot (the first one is zero on output).
+//
+// Every kernel has a plain reference version and a version unrolled
+// by four, which does word-wise loads and stores only. The ESP32 core
+// has no SIMD unit and the DC-blocker is a recurrence, so there is
+// nothing to vectorize on the target. CONVERT_UNROLLED picks the one
+// used by the recorder and player.
+#define CONVERT_UNROLLED 1
+
+static inline int16_t saturate16(int32_t x) {
+    if (x > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (x < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return x;
+}
+
+// Level of everything that went through convertMicToPcm16Metered since
+// the last meterReset, from the last sample of every whole group of four.
+// A quarter of the samples is plenty for a meter over thousands of them
+// and keeps it as cheap as the plain kernel; a clip that misses all of
+// them goes unseen. Squares are pre-shifted so that a block of them adds
+// up in 32 bits, the full sum needs 64.
+#define METER_ENERGY_SHIFT 10
+
+typedef struct {
+    int16_t min;
+    int16_t max;
+    uint32_t count; // samples in energy
+    uint64_t energy; // sum of squares >> METER_ENERGY_SHIFT
+} Meter;
+
+static inline void meterReset(Meter *m) {
+    m->min = 0;
+    m->max = 0;
+    m->count = 0;
+    m->energy = 0;
+}
+
+// Mic frames to PCM, removes the offset and saturates instead of wrapping around
+void convertMicToPcm16Ref(const int32_t *frames, size_t frameCount, int16_t *out, DcBlock *dc);
+void convertMicToPcm16Unrolled(const int32_t *frames, size_t frameCount, int16_t *out, DcBlock *dc);
+// Unrolled conversion that also feeds the meter, the level comes
+// from registers the loop holds anyway instead of a second pass
+void convertMicToPcm16Metered(const int32_t *frames, size_t frameCount, int16_t *out, DcBlock *dc, Meter *meter);
+
+// Interleaved little endian WAV samples (8, 16, 24 or 32 bits, or 32-bit float)
+// to mono 16 bits, stereo is averaged. Extra bits are truncated, no dither.
+void convertWavToMono16(const uint8_t *src, size_t frameCount, int channels, int bits, bool isFloat, int16_t *out);
+
+// PCM to amplifier frames
+void convertPcm16ToAmpRef(const int16_t *in, size_t count, int32_t *frames);
+void convertPcm16ToAmpUnrolled(const int16_t *in, size_t count, int32_t *frames);
+
+static inline void convertMicToPcm16(const int32_t *frames, size_t frameCount, int16_t *out, DcBlock *dc) {
+#if CONVERT_UNROLLED
+    convertMicToPcm16Unrolled(frames, frameCount, out, dc);
+#else
+    convertMicToPcm16Ref(frames, frameCount, out, dc);
+#endif
+}
+
+static inline void convertPcm16ToAmp(const int16_t *in, size_t count, int32_t *frames) {
+#if CONVERT_UNROLLED
+    convertPcm16ToAmpUnrolled(in, count, frames);
+#else
+    convertPcm16ToAmpRef(in, count, frames);
+#endif
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// One-pole DC-blocking high-pass in integer arithmetic.
+// The mic offset is tracked by a leaky integrator with a time constant
+// of 2^DC_BLOCK_SHIFT samples and subtracted from every sample:
+//   mean = acc >> SHIFT, y = x - mean, acc += y
+// With SHIFT 10 the corner is about 7 Hz at 44.1 kHz, far below speech,
+// yet a temperature drift of the offset is followed within milliseconds.
+#define DC_BLOCK_SHIFT 10
+
+typedef struct {
+    int64_t acc; // offset estimate << DC_BLOCK_SHIFT
+    bool seeded;
+} DcBlock;
+
+static inline void dcBlockInit(DcBlock *dc) {
+    dc->acc = 0;
+    dc->seeded = false;
+}
+
+// Starts from the given offset instead of zero, so there is no settling transient
+static inline void dcBlockSeed(DcBlock *dc, int32_t x) {
+    dc->acc = (int64_t)x * (1 << DC_BLOCK_SHIFT);
+    dc->seeded = true;
+}
+
+static inline int32_t dcBlockStep(DcBlock *dc, int32_t x) {
+    int32_t y = x - (int32_t)(dc->acc >> DC_BLOCK_SHIFT);
+    dc->acc += y;
+    return y;
+}
@@ -0,0 +1,74 @@
+#include "decimator.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "convert.h"
+
+void decimatorInit(Decimator *d, int factor) {
+    if (factor < 1) {
+        factor = 1;
+    } else if (factor > DECIM_MAX_FACTOR) {
+        factor = DECIM_MAX_FACTOR;
+    }
+    d->factor = factor;
+    d->taps = factor * DECIM_TAPS_PER_PHASE;
+    d->pos = 0;
+    d->phase = 0;
+    memset(d->history, 0, sizeof(d->history));
+
+    // cutoff in cycles per input sample
+    float cutoff = DECIM_CUTOFF * 0.5f / factor;
+    float center = (d->taps - 1) / 2.0f;
+    float h[DECIM_MAX_TAPS];
+    float sum = 0;
+    for (int i = 0; i < d->taps; i++) {
+        float x = i - center;
+        float sinc = (x == 0) ? 2 * cutoff : sinf(2 * M_PI * cutoff * x) / (M_PI * x);
+        float window = 0.42f - 0.5f * cosf(2 * M_PI * i / (d->taps - 1)) + 0.08f * cosf(4 * M_PI * i / (d->taps - 1));
+        h[i] = sinc * window;
+        sum += h[i];
+    }
+    // unity gain at DC after rounding, the rounding error goes to the middle tap
+    int total = 0;
+    for (int i = 0; i < d->taps; i++) {
+        d->coefs[i] = lrintf(h[i] / sum * 32768);
+        total += d->coefs[i];
+    }
+    d->coefs[d->taps / 2] += 32768 - total;
+}
+
+size_t decimatorProcess(Decimator *d, const int16_t *in, size_t count, int16_t *out) {
+    if (d->factor == 1) {
+        if (out != in) {
+            memmove(out, in, count * sizeof(int16_t));
+        }
+        return count;
+    }
+
+    size_t produced = 0;
+    for (size_t i = 0; i < count; i++) {
+        d->history[d->pos] = in[i];
+        d->history[d->pos + d->taps] = in[i];
+        d->pos++;
+        if (d->pos == d->taps) {
+            d->pos = 0;
+        }
+
+        if (++d->phase < d->factor) {
+            continue;
+        }
+        d->phase = 0;
+
+        // oldest sample first, coefficients are symmetric so the order does not matter
+        const int16_t *x = d->history + d->pos;
+        // sum of |coefs| stays below 2^16, so 32 bits do not overflow
+        int32_t acc = 1 << 14;
+        for (int k = 0; k < d->taps; k++) {
+            acc += x[k] * d->coefs[k];
+        }
+        // written after all reads of in[i], so in place works
+        out[produced++] = saturate16(acc >> 15);
+    }
+    return produced;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Integer-factor decimator, a Blackman windowed-sinc low-pass in Q15
+// that only evaluates the outputs which are kept. That is the polyphase
+// form: every input sample costs DECIM_TAPS_PER_PHASE multiply-adds,
+// independent of the factor.
+#define DECIM_MAX_FACTOR 6
+#define DECIM_TAPS_PER_PHASE 32
+#define DECIM_MAX_TAPS (DECIM_MAX_FACTOR * DECIM_TAPS_PER_PHASE)
+// -6 dB point as a fraction of the output Nyquist frequency, chosen so the
+// transition band ends about where aliases would fold back
+#define DECIM_CUTOFF 0.84f
+
+typedef struct {
+    int factor;
+    int taps;
+    int16_t coefs[DECIM_MAX_TAPS];
+    // delay line stored twice, so the newest taps samples are always contiguous
+    int16_t history[2 * DECIM_MAX_TAPS];
+    int pos; // where the next sample goes
+    int phase; // inputs since the last output
+} Decimator;
+
+// factor 1 passes samples through untouched
+void decimatorInit(Decimator *d, int factor);
+// Returns number of output samples. out may be the same buffer as in.
+size_t decimatorProcess(Decimator *d, const int16_t *in, size_t count, int16_t *out);
@@ -4,6 +4,7 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <string.h>
 
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_vendor.h"
@@ -25,36 +26,63 @@
 #define LCD_CMD_BITS 8
 #define LCD_PARAM_BITS 8
 
+#define LCD_PAGES (LCD_V_RES / 8)
+
 // contains internal graphic buffer(s) called draw buffer(s)
 static lv_disp_draw_buf_t disp_buf; 
 // contains callback functions
 static lv_disp_drv_t disp_drv;
-
-static bool notify_lvgl_flush_ready(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx) {
-    lv_disp_drv_t *disp_driver = (lv_disp_drv_t *)user_ctx;
-    lv_disp_flush_ready(disp_driver);
-    return false;
+// LVGL renders one page (8 rows) at a time into this, one lv_color_t per pixel
+static lv_color_t drawBuffer[LCD_H_RES * 8];
+// what the panel shows, in its own layout: one byte per column and page, bit 0 on top
+static uint8_t frameBuffer[LCD_PAGES][LCD_H_RES];
+// pixel data handed to the panel, one byte per column and page
+static uint32_t bytesSent;
+static uint32_t flushUs;
+
+// Packs 8 rows of LVGL pixels into page bytes, lit where LVGL drew black
+static void packPage(const lv_color_t *src, int width, int stride, uint8_t *dst) {
+    memset(dst, 0, width);
+    for (int bit = 0; bit < 8; bit++) {
+        const lv_color_t *row = src + bit * stride;
+        for (int x = 0; x < width; x++) {
+            dst[x] |= (row[x].full == 0) << bit;
+        }
+    }
 }
 
 static void lvgl_flush_cb(lv_disp_drv_t *drv, const lv_area_t *area, lv_color_t *color_map) {
     esp_lcd_panel_handle_t panel_handle = (esp_lcd_panel_handle_t) drv->user_data;
-    int offsetx1 = area->x1;
-    int offsetx2 = area->x2;
-    int offsety1 = area->y1;
-    int offsety2 = area->y2;
-    // copy a buffer's content to a specific area of the display
-    esp_lcd_panel_draw_bitmap(panel_handle, offsetx1, offsety1, offsetx2 + 1, offsety2 + 1, color_map);
-}
-
-static void lvgl_set_px_cb(lv_disp_drv_t *disp_drv, uint8_t *buf, lv_coord_t buf_w, lv_coord_t x, lv_coord_t y, lv_color_t color, lv_opa_t opa) {
-    uint16_t byte_index = x + (( y >> 3 ) * buf_w);
-    uint8_t  bit_index  = y & 0x7;
-
-    if ((color.full == 0) && (LV_OPA_TRANSP != opa)) {
-        buf[byte_index] |= (1 << bit_index);
-    } else {
-        buf[byte_index] &= ~(1 << bit_index);
+    int64_t start = esp_timer_get_time();
+    int x1 = area->x1;
+    int width = area->x2 - area->x1 + 1;
+    uint8_t packed[LCD_H_RES];
+
+    // the rounder keeps y on page boundaries, narrow areas can span several pages
+    for (int page = area->y1 / 8; page <= area->y2 / 8; page++) {
+        packPage(color_map, width, width, packed);
+        color_map += width * 8;
+
+        // send only the columns that differ from what the panel already shows
+        uint8_t *shown = &frameBuffer[page][x1];
+        int first = 0;
+        while (first < width && packed[first] == shown[first]) {
+            first++;
+        }
+        if (first == width) {
+            continue;
+        }
+        int last = width - 1;
+        while (packed[last] == shown[last]) {
+            last--;
+        }
+        memcpy(shown + first, packed + first, last - first + 1);
+        bytesSent += last - first + 1;
+        // I2C transfers are done when this returns, so the frame buffer can change right after
+        esp_lcd_panel_draw_bitmap(panel_handle, x1 + first, page * 8, x1 + last + 1, page * 8 + 8, shown + first);
     }
+    flushUs += esp_timer_get_time() - start;
+    lv_disp_flush_ready(drv);
 }
 
 static void lvgl_rounder(lv_disp_drv_t *disp_drv, lv_area_t *area) {
@@ -85,8 +113,6 @@ lv_disp_t *getDisplay() {
         .dc_bit_offset = 6,                     // According to SSD1306 datasheet
         .lcd_cmd_bits = LCD_CMD_BITS,   // According to SSD1306 datasheet
         .lcd_param_bits = LCD_CMD_BITS, // According to SSD1306 datasheet
-        .on_color_trans_done = notify_lvgl_flush_ready,
-        .user_ctx = &disp_drv,
     };
     ESP_ERROR_CHECK(esp_lcd_new_panel_io_i2c((esp_lcd_i2c_bus_handle_t)I2C_HOST, &io_config, &io_handle));
 
@@ -102,17 +128,15 @@ lv_disp_t *getDisplay() {
     ESP_ERROR_CHECK(esp_lcd_panel_reset(panel_handle));
     ESP_ERROR_CHECK(esp_lcd_panel_init(panel_handle));
     ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(panel_handle, true));
+    // panel RAM is random after power up, make it match the empty frame buffer
+    ESP_ERROR_CHECK(esp_lcd_panel_draw_bitmap(panel_handle, 0, 0, LCD_H_RES, LCD_V_RES, frameBuffer));
 
     ESP_LOGI("oled", "Initialize LVGL library");
     lv_init();
-    // alloc draw buffers used by LVGL
-    // it's recommended to choose the size of the draw buffer(s) to be at least 1/10 screen sized
-    lv_color_t *buf1 = malloc(LCD_H_RES * 20 * sizeof(lv_color_t));
-    assert(buf1);
-    lv_color_t *buf2 = malloc(LCD_H_RES * 20 * sizeof(lv_color_t));
-    assert(buf2);
-    // initialize LVGL draw buffers
-    lv_disp_draw_buf_init(&disp_buf, buf1, buf2, LCD_H_RES * 20);
+    // a single page sized draw buffer, without set_px_cb LVGL fills and copies
+    // whole spans into it and the flush packs them into the frame buffer
+    lv_disp_draw_buf_init(&disp_buf, drawBuffer, NULL, LCD_H_RES * 8);
+    ESP_LOGI("oled", "%u bytes for drawing and the frame buffer", sizeof(drawBuffer) + sizeof(frameBuffer));
 
     ESP_LOGI("oled", "Register display driver to LVGL");
     lv_disp_drv_init(&disp_drv);
@@ -122,10 +146,15 @@ lv_disp_t *getDisplay() {
     disp_drv.draw_buf = &disp_buf;
     disp_drv.user_data = panel_handle;
     disp_drv.rounder_cb = lvgl_rounder;
-    disp_drv.set_px_cb = lvgl_set_px_cb;
     lv_disp_t *disp = lv_disp_drv_register(&disp_drv);
     
     return disp;
 }
 
+uint32_t displayBytesSent() {
+    return bytesSent;
+}
 
+uint32_t displayFlushUs() {
+    return flushUs;
+}
@@ -1,3 +1,7 @@
 #include "lvgl.h"
 
 lv_disp_t *getDisplay();
+// bytes sent to the panel since boot
+uint32_t displayBytesSent();
+// time spent in the flush callback since boot
+uint32_t displayFlushUs();
@@ -0,0 +1,703 @@
+#include "flac.h"
+
+#include <string.h>
+
+#include "convert.h"
+
+static uint8_t crc8Table[256];
+static uint16_t crc16Table[256];
+static bool crcReady = false;
+
+static void crcInit() {
+    if (crcReady) {
+        return;
+    }
+    for (int i = 0; i < 256; i++) {
+        uint8_t c8 = i;
+        uint16_t c16 = i << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : (c8 << 1);
+            c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : (c16 << 1);
+        }
+        crc8Table[i] = c8;
+        crc16Table[i] = c16;
+    }
+    crcReady = true;
+}
+
+static uint8_t crc8(const uint8_t *data, size_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc = crc8Table[crc ^ *data++];
+    }
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0;
+    while (len--) {
+        crc = (crc << 8) ^ crc16Table[(crc >> 8) ^ *data++];
+    }
+    return crc;
+}
+
+/////////////////////////////////////////////////////////////////// ENCODER
+
+typedef struct {
+    uint8_t *out;
+    size_t pos;
+    uint32_t acc;
+    int bits; // pending bits in acc, always less than 8 between calls
+} BitWriter;
+
+// n at most 24
+static inline void putBits(BitWriter *w, uint32_t value, int n) {
+    if (n == 0) {
+        return;
+    }
+    w->acc = (w->acc << n) | (value & ((1u << n) - 1));
+    w->bits += n;
+    while (w->bits >= 8) {
+        w->bits -= 8;
+        w->out[w->pos++] = w->acc >> w->bits;
+    }
+}
+
+static inline void putRice(BitWriter *w, int32_t r, int k) {
+    uint32_t u = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+    uint32_t q = u >> k;
+    while (q >= 16) {
+        putBits(w, 0, 16);
+        q -= 16;
+    }
+    // q zeros, the stop bit and the k low bits in one go
+    putBits(w, 0, q);
+    putBits(w, (1u << k) | (u & ((1u << k) - 1)), k + 1);
+}
+
+static void putUtf8(BitWriter *w, uint32_t v) {
+    if (v < 0x80) {
+        putBits(w, v, 8);
+        return;
+    }
+    int extra = (v < 0x800) ? 1 : (v < 0x10000) ? 2 : (v < 0x200000) ? 3 : (v < 0x4000000) ? 4 : 5;
+    // leading ones tell the number of bytes
+    uint32_t lead = (0xff00 >> (extra + 1)) & 0xff;
+    putBits(w, lead | (v >> (6 * extra)), 8);
+    for (int i = extra - 1; i >= 0; i--) {
+        putBits(w, 0x80 | ((v >> (6 * i)) & 0x3f), 8);
+    }
+}
+
+static void flushBits(BitWriter *w) {
+    if (w->bits > 0) {
+        putBits(w, 0, 8 - w->bits);
+    }
+}
+
+static int sampleRateCode(uint32_t rate) {
+    switch (rate) {
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        // taken from STREAMINFO
+        default: return 0;
+    }
+}
+
+static int riceParam(uint32_t n, uint64_t sum) {
+    int k = 0;
+    while (k < 14 && ((uint64_t)n << (k + 1)) < sum) {
+        k++;
+    }
+    return k;
+}
+
+static inline uint64_t riceBits(uint32_t n, uint64_t sum, int k) {
+    return (uint64_t)n * (k + 1) + (sum >> k);
+}
+
+static inline uint32_t zigzag(int32_t r) {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+void flacEncoderInit(FlacEncoder *e, uint32_t sampleRate) {
+    crcInit();
+    e->sampleRate = sampleRate;
+    e->frameNumber = 0;
+    e->totalSamples = 0;
+    e->minFrameBytes = 0;
+    e->maxFrameBytes = 0;
+}
+
+// Sums of zig-zagged residuals for each of the 2^order partitions
+static void partitionSums(const int32_t *residual, size_t count, int predOrder, int order, uint64_t *sums) {
+    size_t partSize = count >> order;
+    for (int j = 0; j < (1 << order); j++) {
+        size_t start = (j == 0) ? (size_t)predOrder : j * partSize;
+        uint64_t sum = 0;
+        for (size_t i = start; i < (j + 1) * partSize; i++) {
+            sum += zigzag(residual[i]);
+        }
+        sums[j] = sum;
+    }
+}
+
+// Returns the estimated size of the residual in bits, best partition order goes to bestOrder
+static uint64_t choosePartitionOrder(const int32_t *residual, size_t count, int predOrder, int *bestOrder) {
+    static uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+
+    // every partition must divide the block and hold more than the warm-up
+    int maxOrder = 0;
+    while (maxOrder < FLAC_MAX_PARTITION_ORDER
+           && (count % (2u << maxOrder)) == 0
+           && (count >> (maxOrder + 1)) > (size_t)predOrder) {
+        maxOrder++;
+    }
+    partitionSums(residual, count, predOrder, maxOrder, sums);
+
+    uint64_t best = UINT64_MAX;
+    for (int order = maxOrder; order >= 0; order--) {
+        int parts = 1 << order;
+        size_t partSize = count >> order;
+        uint64_t bits = 0;
+        for (int j = 0; j < parts; j++) {
+            uint32_t n = (j == 0) ? partSize - predOrder : partSize;
+            bits += 4 + riceBits(n, sums[j], riceParam(n, sums[j]));
+        }
+        if (bits < best) {
+            best = bits;
+            *bestOrder = order;
+        }
+        // merge neighbours for the next, coarser order
+        for (int j = 0; j < parts / 2; j++) {
+            sums[j] = sums[2 * j] + sums[2 * j + 1];
+        }
+    }
+    return best;
+}
+
+static void writeSubframe(FlacEncoder *e, BitWriter *w, const int16_t *in, size_t count) {
+    bool constant = true;
+    for (size_t i = 1; i < count; i++) {
+        if (in[i] != in[0]) {
+            constant = false;
+            break;
+        }
+    }
+    if (constant) {
+        putBits(w, 0x00, 8);
+        putBits(w, (uint16_t)in[0], 16);
+        return;
+    }
+
+    // one pass gives the error of all fixed predictors, take the smallest
+    int predOrder = 0;
+    if (count > 4) {
+        uint64_t err[5] = {0};
+        for (size_t i = 4; i < count; i++) {
+            int32_t e0 = in[i];
+            int32_t e1 = e0 - in[i - 1];
+            int32_t e2 = e1 - (in[i - 1] - in[i - 2]);
+            int32_t e3 = e2 - (in[i - 1] - 2 * in[i - 2] + in[i - 3]);
+            int32_t e4 = e3 - (in[i - 1] - 3 * in[i - 2] + 3 * in[i - 3] - in[i - 4]);
+            err[0] += e0 < 0 ? -e0 : e0;
+            err[1] += e1 < 0 ? -e1 : e1;
+            err[2] += e2 < 0 ? -e2 : e2;
+            err[3] += e3 < 0 ? -e3 : e3;
+            err[4] += e4 < 0 ? -e4 : e4;
+        }
+        for (int order = 1; order <= 4; order++) {
+            if (err[order] < err[predOrder]) {
+                predOrder = order;
+            }
+        }
+    }
+
+    int32_t *r = e->residual;
+    for (size_t i = predOrder; i < count; i++) {
+        switch (predOrder) {
+            case 0: r[i] = in[i]; break;
+            case 1: r[i] = in[i] - in[i - 1]; break;
+            case 2: r[i] = in[i] - 2 * in[i - 1] + in[i - 2]; break;
+            case 3: r[i] = in[i] - 3 * in[i - 1] + 3 * in[i - 2] - in[i - 3]; break;
+            default: r[i] = in[i] - 4 * in[i - 1] + 6 * in[i - 2] - 4 * in[i - 3] + in[i - 4]; break;
+        }
+    }
+
+    int partOrder = 0;
+    uint64_t bits = choosePartitionOrder(r, count, predOrder, &partOrder);
+    if (bits + 6 + 16 * predOrder >= 16 * count) {
+        // does not compress, store as it is
+        putBits(w, 0x02, 8);
+        for (size_t i = 0; i < count; i++) {
+            putBits(w, (uint16_t)in[i], 16);
+        }
+        return;
+    }
+
+    // FIXED subframe, type 001xxx, no wasted bits
+    putBits(w, (0x08 | predOrder) << 1, 8);
+    for (int i = 0; i < predOrder; i++) {
+        putBits(w, (uint16_t)in[i], 16);
+    }
+    // Rice coding with 4-bit parameters
+    putBits(w, 0, 2);
+    putBits(w, partOrder, 4);
+
+    size_t partSize = count >> partOrder;
+    for (int j = 0; j < (1 << partOrder); j++) {
+        size_t start = (j == 0) ? (size_t)predOrder : j * partSize;
+        size_t end = (j + 1) * partSize;
+        uint64_t sum = 0;
+        for (size_t i = start; i < end; i++) {
+            sum += zigzag(r[i]);
+        }
+        int k = riceParam(end - start, sum);
+        putBits(w, k, 4);
+        for (size_t i = start; i < end; i++) {
+            putRice(w, r[i], k);
+        }
+    }
+}
+
+size_t flacEncodeFrame(FlacEncoder *e, const int16_t *in, size_t count, uint8_t *out) {
+    BitWriter w = { .out = out, .pos = 0, .acc = 0, .bits = 0 };
+
+    // sync code, fixed block size stream
+    putBits(&w, 0xfff8, 16);
+    putBits(&w, (count == FLAC_BLOCK_SIZE) ? 0x0c : 0x07, 4);
+    putBits(&w, sampleRateCode(e->sampleRate), 4);
+    // mono, 16 bits per sample
+    putBits(&w, 0x0, 4);
+    putBits(&w, 0x4, 3);
+    putBits(&w, 0, 1);
+    putUtf8(&w, e->frameNumber);
+    if (count != FLAC_BLOCK_SIZE) {
+        putBits(&w, count - 1, 16);
+    }
+    putBits(&w, crc8(out, w.pos), 8);
+
+    writeSubframe(e, &w, in, count);
+    flushBits(&w);
+
+    uint16_t crc = crc16(out, w.pos);
+    putBits(&w, crc, 16);
+
+    e->frameNumber++;
+    e->totalSamples += count;
+    if (e->minFrameBytes == 0 || w.pos < e->minFrameBytes) {
+        e->minFrameBytes = w.pos;
+    }
+    if (w.pos > e->maxFrameBytes) {
+        e->maxFrameBytes = w.pos;
+    }
+    return w.pos;
+}
+
+void flacWriteHeader(const FlacEncoder *e, uint8_t *out) {
+    BitWriter w = { .out = out, .pos = 0, .acc = 0, .bits = 0 };
+
+    putBits(&w, 'f', 8);
+    putBits(&w, 'L', 8);
+    putBits(&w, 'a', 8);
+    putBits(&w, 'C', 8);
+    // last metadata block, type STREAMINFO, 34 bytes
+    putBits(&w, 0x80, 8);
+    putBits(&w, 34, 24);
+
+    putBits(&w, FLAC_BLOCK_SIZE, 16);
+    putBits(&w, FLAC_BLOCK_SIZE, 16);
+    putBits(&w, e->minFrameBytes, 24);
+    putBits(&w, e->maxFrameBytes, 24);
+    putBits(&w, e->sampleRate, 20);
+    // channels - 1, bits per sample - 1
+    putBits(&w, 0, 3);
+    putBits(&w, 15, 5);
+    putBits(&w, e->totalSamples >> 32, 4);
+    putBits(&w, (e->totalSamples >> 16) & 0xffff, 16);
+    putBits(&w, e->totalSamples & 0xffff, 16);
+    // MD5 of the audio is optional, zero means not computed
+    for (int i = 0; i < 16; i++) {
+        putBits(&w, 0, 8);
+    }
+}
+
+/////////////////////////////////////////////////////////////////// DECODER
+
+// Tops the buffer up, returns false if fewer than bytes are left in the stream
+static bool ensure(FlacDecoder *d, size_t bytes) {
+    if (d->len - d->pos >= bytes) {
+        return true;
+    }
+    memmove(d->buf, d->buf + d->pos, d->len - d->pos);
+    d->bufOffset += d->pos;
+    d->len -= d->pos;
+    d->pos = 0;
+    while (!d->eof && d->len < sizeof(d->buf)) {
+        size_t count = d->read(d->ctx, d->buf + d->len, sizeof(d->buf) - d->len);
+        if (count == 0) {
+            d->eof = true;
+        }
+        d->len += count;
+    }
+    return d->len - d->pos >= bytes;
+}
+
+// n at most 32, reading past the buffer yields zeros and sets error
+static uint32_t getBits(FlacDecoder *d, int n) {
+    uint32_t v = 0;
+    while (n > 0) {
+        if (d->pos >= d->len) {
+            d->error = true;
+            return 0;
+        }
+        int avail = 8 - d->bit;
+        int take = n < avail ? n : avail;
+        uint32_t byte = d->buf[d->pos];
+        v = (v << take) | ((byte >> (avail - take)) & ((1u << take) - 1));
+        d->bit += take;
+        n -= take;
+        if (d->bit == 8) {
+            d->bit = 0;
+            d->pos++;
+        }
+    }
+    return v;
+}
+
+static int32_t getSigned(FlacDecoder *d, int n) {
+    if (n == 0) {
+        return 0;
+    }
+    uint32_t v = getBits(d, n);
+    if (n < 32 && (v & (1u << (n - 1)))) {
+        v -= 1u << n;
+    }
+    return (int32_t)v;
+}
+
+static uint32_t getUnary(FlacDecoder *d) {
+    uint32_t q = 0;
+    while (true) {
+        if (d->pos >= d->len) {
+            d->error = true;
+            return 0;
+        }
+        // whole zero bytes at once
+        if (d->bit == 0 && d->buf[d->pos] == 0) {
+            q += 8;
+            d->pos++;
+            continue;
+        }
+        if (getBits(d, 1)) {
+            return q;
+        }
+        q++;
+    }
+}
+
+static void alignByte(FlacDecoder *d) {
+    if (d->bit != 0) {
+        d->bit = 0;
+        d->pos++;
+    }
+}
+
+static void skipBytes(FlacDecoder *d, uint32_t count) {
+    while (count > 0 && ensure(d, 1)) {
+        size_t take = d->len - d->pos;
+        if (take > count) {
+            take = count;
+        }
+        d->pos += take;
+        count -= take;
+    }
+}
+
+bool flacDecoderInit(FlacDecoder *d, FlacReadFn read, void *ctx) {
+    crcInit();
+    d->read = read;
+    d->ctx = ctx;
+    d->len = 0;
+    d->pos = 0;
+    d->bufOffset = 0;
+    d->bit = 0;
+    d->eof = false;
+    d->error = false;
+    d->frameOffset = 0;
+    d->frameSample = 0;
+    d->sampleRate = 0;
+    d->channels = 0;
+    d->bitsPerSample = 0;
+    d->totalSamples = 0;
+
+    if (!ensure(d, 4) || memcmp(d->buf, "fLaC", 4) != 0) {
+        return false;
+    }
+    d->pos = 4;
+
+    bool last = false;
+    while (!last) {
+        if (!ensure(d, 4)) {
+            return false;
+        }
+        last = getBits(d, 1);
+        int type = getBits(d, 7);
+        uint32_t length = getBits(d, 24);
+        if (type == 0 && ensure(d, 34)) {
+            getBits(d, 16); // min block size
+            uint32_t maxBlock = getBits(d, 16);
+            d->blockSize = maxBlock;
+            getBits(d, 24); // min frame size
+            getBits(d, 24); // max frame size
+            d->sampleRate = getBits(d, 20);
+            d->channels = getBits(d, 3) + 1;
+            d->bitsPerSample = getBits(d, 5) + 1;
+            d->totalSamples = (uint64_t)getBits(d, 4) << 32;
+            d->totalSamples |= getBits(d, 32);
+            skipBytes(d, 16 + length - 34);
+            if (maxBlock > FLAC_MAX_BLOCK_SIZE) {
+                return false;
+            }
+        } else {
+            skipBytes(d, length);
+        }
+    }
+    d->firstFrame = d->bufOffset + d->pos;
+    return !d->error && d->channels == 1 && d->bitsPerSample >= 4 && d->bitsPerSample <= 16;
+}
+
+static bool decodeResidual(FlacDecoder *d, int32_t *out, size_t count, int predOrder) {
+    int method = getBits(d, 2);
+    if (method > 1) {
+        return false;
+    }
+    int paramBits = method == 0 ? 4 : 5;
+    uint32_t escape = (1u << paramBits) - 1;
+    int partOrder = getBits(d, 4);
+    size_t partSize = count >> partOrder;
+    if ((partSize << partOrder) != count || partSize < (size_t)predOrder) {
+        return false;
+    }
+
+    size_t i = predOrder;
+    for (int j = 0; j < (1 << partOrder); j++) {
+        size_t end = (j + 1) * partSize;
+        uint32_t k = getBits(d, paramBits);
+        if (k == escape) {
+            int bits = getBits(d, 5);
+            for (; i < end; i++) {
+                out[i] = getSigned(d, bits);
+            }
+        } else {
+            for (; i < end; i++) {
+                uint32_t u = (getUnary(d) << k) | getBits(d, k);
+                out[i] = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+            }
+        }
+        if (d->error) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool decodeSubframe(FlacDecoder *d, int32_t *out, size_t count, int bps) {
+    getBits(d, 1);
+    int type = getBits(d, 6);
+    int wasted = 0;
+    if (getBits(d, 1)) {
+        wasted = getUnary(d) + 1;
+        bps -= wasted;
+        if (bps <= 0) {
+            return false;
+        }
+    }
+
+    if (type == 0) {
+        int32_t value = getSigned(d, bps);
+        for (size_t i = 0; i < count; i++) {
+            out[i] = value;
+        }
+    } else if (type == 1) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] = getSigned(d, bps);
+        }
+    } else if (type >= 8 && type <= 12) {
+        int order = type & 7;
+        if ((size_t)order > count) {
+            return false;
+        }
+        for (int i = 0; i < order; i++) {
+            out[i] = getSigned(d, bps);
+        }
+        if (!decodeResidual(d, out, count, order)) {
+            return false;
+        }
+        // unsigned, so a damaged frame wraps around until its CRC throws it out
+        for (size_t i = order; i < count; i++) {
+            uint32_t x = out[i];
+            switch (order) {
+                case 1: x += out[i - 1]; break;
+                case 2: x += 2u * out[i - 1] - out[i - 2]; break;
+                case 3: x += 3u * out[i - 1] - 3u * out[i - 2] + out[i - 3]; break;
+                case 4: x += 4u * out[i - 1] - 6u * out[i - 2] + 4u * out[i - 3] - out[i - 4]; break;
+            }
+            out[i] = (int32_t)x;
+        }
+    } else if (type >= 32) {
+        int order = (type & 31) + 1;
+        if ((size_t)order > count) {
+            return false;
+        }
+        for (int i = 0; i < order; i++) {
+            out[i] = getSigned(d, bps);
+        }
+        int precision = getBits(d, 4) + 1;
+        if (precision == 16) {
+            return false;
+        }
+        int shift = getSigned(d, 5);
+        if (shift < 0) {
+            return false;
+        }
+        int32_t coefs[32];
+        for (int i = 0; i < order; i++) {
+            coefs[i] = getSigned(d, precision);
+        }
+        if (!decodeResidual(d, out, count, order)) {
+            return false;
+        }
+        for (size_t i = order; i < count; i++) {
+            int64_t sum = 0;
+            for (int j = 0; j < order; j++) {
+                sum += (int64_t)coefs[j] * out[i - 1 - j];
+            }
+            out[i] = (int32_t)((uint32_t)out[i] + (uint32_t)(sum >> shift));
+        }
+    } else {
+        return false;
+    }
+
+    if (wasted > 0) {
+        for (size_t i = 0; i < count; i++) {
+            out[i] *= 1 << wasted;
+        }
+    }
+    return !d->error;
+}
+
+// Parses a frame header at the current position, returns block size or 0 if it is not a usable frame
+static size_t readFrameHeader(FlacDecoder *d, int *bps) {
+    size_t frameStart = d->pos;
+
+    bool variable = getBits(d, 16) & 1;
+    int blockCode = getBits(d, 4);
+    int rateCode = getBits(d, 4);
+    int channelCode = getBits(d, 4);
+    int sizeCode = getBits(d, 3);
+    getBits(d, 1);
+
+    // frame or sample number, UTF-8 style
+    uint32_t first = getBits(d, 8);
+    int extra = 0;
+    while (extra < 7 && (first & (0x80 >> extra))) {
+        extra++;
+    }
+    uint64_t number = first & (0x7f >> extra);
+    for (int i = 1; i < extra; i++) {
+        number = (number << 6) | (getBits(d, 8) & 0x3f);
+    }
+    d->frameSample = variable ? number : number * d->blockSize;
+
+    size_t count;
+    if (blockCode == 1) {
+        count = 192;
+    } else if (blockCode >= 2 && blockCode <= 5) {
+        count = 576 << (blockCode - 2);
+    } else if (blockCode == 6) {
+        count = getBits(d, 8) + 1;
+    } else if (blockCode == 7) {
+        count = getBits(d, 16) + 1;
+    } else if (blockCode >= 8) {
+        count = 256 << (blockCode - 8);
+    } else {
+        count = 0;
+    }
+
+    if (rateCode == 12) {
+        getBits(d, 8);
+    } else if (rateCode == 13 || rateCode == 14) {
+        getBits(d, 16);
+    }
+
+    uint8_t headerCrc = getBits(d, 8);
+    static const int sizeBits[8] = { 0, 8, 12, 0, 16, 20, 24, 0 };
+    *bps = sizeCode == 0 ? d->bitsPerSample : sizeBits[sizeCode];
+
+    if (d->error || count > FLAC_MAX_BLOCK_SIZE || channelCode != 0 || *bps == 0 || *bps > 16
+        || (d->totalSamples > 0 && d->frameSample >= d->totalSamples)
+        || crc8(d->buf + frameStart, d->pos - frameStart - 1) != headerCrc) {
+        return 0;
+    }
+    return count;
+}
+
+void flacDecoderRestart(FlacDecoder *d, uint64_t offset) {
+    d->len = 0;
+    d->pos = 0;
+    d->bit = 0;
+    d->bufOffset = offset;
+    d->eof = false;
+    d->error = false;
+}
+
+size_t flacDecodeFrame(FlacDecoder *d, int16_t *out) {
+    alignByte(d);
+    // a whole frame fits into the buffer, nothing below needs to refill
+    ensure(d, sizeof(d->buf));
+
+    size_t count = 0;
+    int bps = 0;
+    while (count == 0) {
+        // find the sync code, skipping anything that is not a frame
+        while (d->len - d->pos >= 2
+               && !(d->buf[d->pos] == 0xff && (d->buf[d->pos + 1] & 0xfe) == 0xf8)) {
+            d->pos++;
+        }
+        if (d->len - d->pos < 2) {
+            return 0;
+        }
+        d->error = false;
+        size_t frameStart = d->pos;
+        d->frameOffset = d->bufOffset + frameStart;
+        count = readFrameHeader(d, &bps);
+        // after a seek the search starts anywhere, audio data may look like a header
+        if (count > 0 && !decodeSubframe(d, d->work, count, bps)) {
+            count = 0;
+        }
+        if (count > 0) {
+            // the header CRC is only 8 bits, this one covers the whole frame
+            alignByte(d);
+            uint16_t crc = crc16(d->buf + frameStart, d->pos - frameStart);
+            if (getBits(d, 16) != crc || d->error) {
+                count = 0;
+            }
+        }
+        if (count == 0) {
+            // false sync or something we cannot play, try the next byte
+            d->pos = frameStart + 1;
+            d->bit = 0;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        out[i] = saturate16(d->work[i] * (1 << (16 - bps)));
+    }
+    return count;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal streaming FLAC for 16-bit mono recordings.
+//
+// The encoder uses only the fixed predictors (order 0-4) and partitioned
+// Rice coding, the output is a valid FLAC stream for the reference tools.
+// Its work per frame is bounded: five residual passes over the block,
+// one zig-zag pass and a partition search over at most FLAC_MAX_PARTITION_ORDER
+// levels, so the worst case does not depend on the signal. When the
+// residual would not be smaller than the input the frame is stored verbatim.
+//
+// The decoder understands what the encoder produces plus LPC subframes,
+// so mono files made by the reference encoder play as well.
+// A frame whose CRC-16 does not match is skipped like a false sync.
+
+#define FLAC_BLOCK_SIZE 4096
+#define FLAC_MAX_BLOCK_SIZE 4608
+#define FLAC_MAX_PARTITION_ORDER 8
+// "fLaC" marker followed by the STREAMINFO block
+#define FLAC_HEADER_SIZE 42
+// frame header, verbatim subframe and CRC of a full block
+#define FLAC_MAX_FRAME_BYTES (FLAC_BLOCK_SIZE * 2 + 32)
+
+typedef struct {
+    uint32_t sampleRate;
+    uint32_t frameNumber;
+    uint64_t totalSamples;
+    uint32_t minFrameBytes;
+    uint32_t maxFrameBytes;
+    int32_t residual[FLAC_BLOCK_SIZE];
+} FlacEncoder;
+
+void flacEncoderInit(FlacEncoder *e, uint32_t sampleRate);
+// Encodes count samples (at most FLAC_BLOCK_SIZE, less only for the last frame),
+// returns number of bytes written to out
+size_t flacEncodeFrame(FlacEncoder *e, const int16_t *in, size_t count, uint8_t *out);
+// Stream header with the totals known so far, FLAC_HEADER_SIZE bytes
+void flacWriteHeader(const FlacEncoder *e, uint8_t *out);
+
+typedef size_t (*FlacReadFn)(void *ctx, uint8_t *buf, size_t len);
+
+#define FLAC_DECODER_BUFFER (16 * 1024)
+
+typedef struct {
+    FlacReadFn read;
+    void *ctx;
+    uint8_t buf[FLAC_DECODER_BUFFER];
+    size_t len; // valid bytes in buf
+    size_t pos; // next byte
+    uint64_t bufOffset; // stream offset of buf[0]
+    int bit; // bits already consumed from buf[pos]
+    bool eof;
+    bool error; // ran out of data in the middle of a frame
+
+    // from STREAMINFO
+    uint32_t sampleRate;
+    int channels;
+    int bitsPerSample;
+    uint64_t totalSamples;
+    uint32_t blockSize; // largest one, what every frame but the last has in fixed block streams
+    uint64_t firstFrame; // stream offset of the first frame
+
+    // last decoded frame
+    uint64_t frameOffset;
+    uint64_t frameSample; // first sample of it
+
+    int32_t work[FLAC_MAX_BLOCK_SIZE];
+} FlacDecoder;
+
+// Reads the stream header and skips all metadata, false if it is not a supported stream
+bool flacDecoderInit(FlacDecoder *d, FlacReadFn read, void *ctx);
+// Decodes the next frame to 16 bits, returns number of samples, 0 at the end of the stream
+size_t flacDecodeFrame(FlacDecoder *d, int16_t *out);
+// Forgets the buffered data after the caller moved the stream to offset,
+// decoding goes on with the first frame found from there
+void flacDecoderRestart(FlacDecoder *d, uint64_t offset);
@@ -0,0 +1,150 @@
+#include "gesture.h"
+
+#include <string.h>
+
+typedef enum {
+    IDLE,
+    HELD, // down, nothing decided yet
+    HELD_DONE, // down, already reported, waiting for release
+    WAIT_SECOND, // released, a second press would make a double click
+} State;
+
+// true once time a is at or past b, wrap-around safe
+static inline bool reached(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) >= 0;
+}
+
+static inline void emit(GestureEvent *out, int *n, int button, GestureKind kind, uint32_t t) {
+    out[*n].button = button;
+    out[*n].kind = kind;
+    out[*n].timeMs = t;
+    (*n)++;
+}
+
+static void setDeadline(ButtonGesture *b, uint32_t when) {
+    b->timed = true;
+    b->deadline = when;
+}
+
+// Debounced level of button i changed at time t
+static void transition(ButtonGesture *b, int i, bool pressed, uint32_t t, GestureEvent *out, int *n) {
+    b->pressed = pressed;
+    b->locked = true;
+    b->lockUntil = t + GESTURE_DEBOUNCE_MS;
+
+    if (pressed) {
+        b->timed = false;
+        if (b->state == WAIT_SECOND && !(b->flags & GESTURE_DOUBLE_CLICK)) {
+            // the flags changed while it waited, the first press stands alone
+            emit(out, n, i, GESTURE_PRESS, t);
+            b->state = IDLE;
+        }
+        if (b->state == WAIT_SECOND) {
+            emit(out, n, i, GESTURE_DOUBLE, t);
+            b->state = HELD_DONE;
+        } else if (b->flags & GESTURE_REPEATS) {
+            emit(out, n, i, GESTURE_PRESS, t);
+            setDeadline(b, t + GESTURE_REPEAT_DELAY_MS);
+            b->state = HELD;
+        } else if (b->flags & (GESTURE_LONG_PRESS | GESTURE_DOUBLE_CLICK)) {
+            if (b->flags & GESTURE_LONG_PRESS) {
+                setDeadline(b, t + GESTURE_LONG_MS);
+            }
+            b->state = HELD;
+        } else {
+            emit(out, n, i, GESTURE_PRESS, t);
+            b->state = HELD_DONE;
+        }
+        return;
+    }
+
+    b->timed = false;
+    if (b->state == HELD && !(b->flags & GESTURE_REPEATS)) {
+        if (b->flags & GESTURE_DOUBLE_CLICK) {
+            setDeadline(b, t + GESTURE_DOUBLE_MS);
+            b->state = WAIT_SECOND;
+            return;
+        }
+        emit(out, n, i, GESTURE_PRESS, t);
+    }
+    b->state = IDLE;
+}
+
+void gestureInit(Gesture *g, const uint8_t *flags, int count) {
+    memset(g, 0, sizeof(Gesture));
+    g->count = count < GESTURE_MAX_BUTTONS ? count : GESTURE_MAX_BUTTONS;
+    for (int i = 0; i < g->count; i++) {
+        g->buttons[i].flags = flags[i];
+    }
+}
+
+void gestureSetFlags(Gesture *g, int button, uint8_t flags) {
+    if (button < g->count) {
+        g->buttons[button].flags = flags;
+    }
+}
+
+int gestureEdge(Gesture *g, const ButtonEdge *edge, GestureEvent *out) {
+    int n = 0;
+    if (edge->button >= g->count) {
+        return 0;
+    }
+    ButtonGesture *b = &g->buttons[edge->button];
+    b->raw = edge->level;
+    // a bounce while locked is picked up by gestureTick when the lock ends
+    if (!b->locked && b->raw != b->pressed) {
+        transition(b, edge->button, b->raw, edge->timeMs, out, &n);
+    }
+    return n;
+}
+
+int gestureTick(Gesture *g, uint32_t nowMs, GestureEvent *out) {
+    int n = 0;
+    for (int i = 0; i < g->count; i++) {
+        ButtonGesture *b = &g->buttons[i];
+        if (b->timed && reached(nowMs, b->deadline)) {
+            if (b->state == HELD && (b->flags & GESTURE_REPEATS)) {
+                emit(out, &n, i, GESTURE_REPEAT, b->deadline);
+                // a late caller gets one repeat, not a burst
+                b->deadline += GESTURE_REPEAT_MS;
+                if (reached(nowMs, b->deadline)) {
+                    b->deadline = nowMs + GESTURE_REPEAT_MS;
+                }
+            } else if (b->state == HELD) {
+                emit(out, &n, i, GESTURE_LONG, b->deadline);
+                b->state = HELD_DONE;
+                b->timed = false;
+            } else if (b->state == WAIT_SECOND) {
+                emit(out, &n, i, GESTURE_PRESS, b->deadline);
+                b->state = IDLE;
+                b->timed = false;
+            } else {
+                b->timed = false;
+            }
+        }
+        if (b->locked && reached(nowMs, b->lockUntil)) {
+            b->locked = false;
+            // level settled somewhere else than where the first edge left it
+            if (b->raw != b->pressed) {
+                transition(b, i, b->raw, b->lockUntil, out, &n);
+            }
+        }
+    }
+    return n;
+}
+
+uint32_t gestureTimeout(const Gesture *g, uint32_t nowMs) {
+    uint32_t timeout = GESTURE_NO_DEADLINE;
+    for (int i = 0; i < g->count; i++) {
+        const ButtonGesture *b = &g->buttons[i];
+        if (b->timed) {
+            uint32_t left = reached(nowMs, b->deadline) ? 0 : b->deadline - nowMs;
+            timeout = left < timeout ? left : timeout;
+        }
+        if (b->locked) {
+            uint32_t left = reached(nowMs, b->lockUntil) ? 0 : b->lockUntil - nowMs;
+            timeout = left < timeout ? left : timeout;
+        }
+    }
+    return timeout;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Turns timestamped button edges into presses, long presses, auto-repeat
+// and double clicks. Nothing in here touches the hardware, the caller
+// feeds edges and the current time, so it runs the same on a host.
+//
+// Debouncing is leading-edge: the first edge counts at once, then the
+// button is ignored for GESTURE_DEBOUNCE_MS and its level is looked at
+// again when that runs out.
+#define GESTURE_MAX_BUTTONS 4
+#define GESTURE_DEBOUNCE_MS 20
+#define GESTURE_LONG_MS 500
+#define GESTURE_DOUBLE_MS 250
+#define GESTURE_REPEAT_DELAY_MS 400
+#define GESTURE_REPEAT_MS 100
+// most events one call can produce
+#define GESTURE_MAX_EVENTS (2 * GESTURE_MAX_BUTTONS)
+#define GESTURE_NO_DEADLINE UINT32_MAX
+
+// what a button can do, without any flag it reports a press when pushed
+//
+// The flags cost latency on every press: with GESTURE_LONG_PRESS a press
+// is reported on release, with GESTURE_DOUBLE_CLICK GESTURE_DOUBLE_MS
+// after that. A button should have only the flags the screen shown needs.
+typedef enum {
+    GESTURE_REPEATS = 1, // press at once, then repeat while held
+    GESTURE_LONG_PRESS = 2, // press on release, long press when held
+    GESTURE_DOUBLE_CLICK = 4, // press is held back until no second one can follow
+} GestureFlags;
+
+typedef enum { GESTURE_PRESS, GESTURE_LONG, GESTURE_REPEAT, GESTURE_DOUBLE } GestureKind;
+
+typedef struct {
+    uint8_t button;
+    uint8_t level; // 1 pressed
+    uint32_t timeMs;
+} ButtonEdge;
+
+typedef struct {
+    uint8_t button;
+    uint8_t kind; // GestureKind
+    uint32_t timeMs; // of the edge or deadline that caused it
+} GestureEvent;
+
+typedef struct {
+    uint8_t flags;
+    uint8_t state;
+    bool raw; // level of the last edge
+    bool pressed; // debounced level
+    bool locked;
+    bool timed;
+    uint32_t lockUntil;
+    uint32_t deadline;
+} ButtonGesture;
+
+typedef struct {
+    int count;
+    ButtonGesture buttons[GESTURE_MAX_BUTTONS];
+} Gesture;
+
+void gestureInit(Gesture *g, const uint8_t *flags, int count);
+// New flags for button, from its next press on. A press under way is
+// still reported the way its old flags say, but no longer makes a
+// double click with the next one unless the new flags have it too.
+void gestureSetFlags(Gesture *g, int button, uint8_t flags);
+// Feed edges in time order, call gestureTick with the edge time first so
+// deadlines that passed before it are handled in order. Both return the
+// number of events written to out, at most GESTURE_MAX_EVENTS.
+int gestureEdge(Gesture *g, const ButtonEdge *edge, GestureEvent *out);
+int gestureTick(Gesture *g, uint32_t nowMs, GestureEvent *out);
+// Milliseconds until gestureTick has something to do, GESTURE_NO_DEADLINE if nothing is pending
+uint32_t gestureTimeout(const Gesture *g, uint32_t nowMs);
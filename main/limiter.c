@@ -0,0 +1,31 @@
+#include "limiter.h"
+
+#include <stdlib.h>
+
+void limiterInit(Limiter *l, int32_t gain, uint32_t sampleRate) {
+    l->gain = gain;
+    l->reduction = LIMITER_UNITY;
+    // release steps by 1 / 2^shift of what is left, 2^shift samples is about the time constant
+    uint32_t samples = sampleRate * LIMITER_RELEASE_MS / 1000;
+    l->releaseShift = 0;
+    while ((2u << l->releaseShift) <= samples) {
+        l->releaseShift++;
+    }
+}
+
+void limiterProcess(Limiter *l, int16_t *samples, size_t count) {
+    int32_t reduction = l->reduction;
+    for (size_t i = 0; i < count; i++) {
+        int32_t x = (samples[i] * l->gain) >> 8;
+        // Q15 is plenty for the multiply, Q30 only keeps the release from stalling short of unity
+        int32_t y = (int32_t)(((int64_t)x * (reduction >> 15)) >> 15);
+        if (abs(y) > LIMITER_THRESHOLD) {
+            // instant attack, this sample ends up on the threshold
+            reduction = ((LIMITER_THRESHOLD << 15) / abs(x)) << 15;
+            y = x < 0 ? -LIMITER_THRESHOLD : LIMITER_THRESHOLD;
+        }
+        reduction += (LIMITER_UNITY - reduction) >> l->releaseShift;
+        samples[i] = y;
+    }
+    l->reduction = reduction;
+}
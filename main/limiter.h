@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Gain followed by a peak limiter, for listening to the mic. There is no
+// look-ahead, that would add latency: a sample that would go over
+// LIMITER_THRESHOLD sets the gain so it lands on it exactly, then the
+// gain recovers with a time constant of about LIMITER_RELEASE_MS.
+// Nothing in here touches the hardware, so it runs the same on a host.
+#define LIMITER_THRESHOLD 29204 // -1 dBFS
+#define LIMITER_RELEASE_MS 50
+#define LIMITER_UNITY (1 << 30)
+
+typedef struct {
+    int32_t gain; // Q8
+    int32_t reduction; // Q30, LIMITER_UNITY when not limiting
+    int releaseShift;
+} Limiter;
+
+// gain is Q8, 256 leaves the level as it is
+void limiterInit(Limiter *l, int32_t gain, uint32_t sampleRate);
+void limiterProcess(Limiter *l, int16_t *samples, size_t count);
@@ -0,0 +1,57 @@
+#include "listview.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void listViewInit(ListView *list, ListItemFn item) {
+    memset(list, 0, sizeof(ListView));
+    list->item = item;
+    list->screen = lv_obj_create(NULL);
+    for (int i = 0; i < LIST_ROWS; i++) {
+        lv_obj_t *row = lv_label_create(list->screen);
+        // one line per row, long names are cut instead of wrapped into the next row
+        lv_label_set_long_mode(row, LV_LABEL_LONG_CLIP);
+        lv_obj_set_size(row, 128, LIST_ROW_HEIGHT);
+        lv_obj_set_pos(row, 0, i * LIST_ROW_HEIGHT);
+        lv_label_set_text(row, "");
+        list->rows[i] = row;
+    }
+}
+
+int listViewShow(ListView *list, lv_disp_t *disp, int count, int selected) {
+    // scroll only when the selection gets too close to an edge,
+    // moving inside the window changes two rows instead of all of them
+    if (selected < list->top + LIST_MARGIN) {
+        list->top = selected - LIST_MARGIN;
+    } else if (selected > list->top + LIST_ROWS - 1 - LIST_MARGIN) {
+        list->top = selected - (LIST_ROWS - 1 - LIST_MARGIN);
+    }
+    if (list->top > count - LIST_ROWS) {
+        list->top = count - LIST_ROWS;
+    }
+    if (list->top < 0) {
+        list->top = 0;
+    }
+
+    int changed = 0;
+    for (int i = 0; i < LIST_ROWS; i++) {
+        int index = list->top + i;
+        char text[LIST_TEXT_LEN] = "";
+        if (index < count) {
+            char item[LIST_TEXT_LEN - 2];
+            list->item(index, item, sizeof(item));
+            snprintf(text, sizeof(text), "%s%s", (index == selected) ? "> " : "  ", item);
+        }
+        if (strcmp(text, list->text[i]) != 0) {
+            strcpy(list->text[i], text);
+            lv_label_set_text(list->rows[i], text);
+            changed++;
+        }
+    }
+
+    if (lv_scr_act() != list->screen) {
+        lv_scr_load(list->screen);
+    }
+    lv_refr_now(disp);
+    return changed;
+}
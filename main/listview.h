@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lvgl.h"
+
+// Scrolling list on its own screen with one label per display row.
+// The labels are created once; showing the list again only sets the
+// text of rows that differ from what is already on the panel, so LVGL
+// redraws and flushes just those 8-pixel pages.
+#define LIST_ROWS 8
+#define LIST_ROW_HEIGHT 8
+// rows kept visible around the selection while scrolling
+#define LIST_MARGIN 2
+#define LIST_TEXT_LEN 24
+
+// Writes the text of item index, without the selection marker
+typedef void (*ListItemFn)(int index, char *text, size_t size);
+
+typedef struct {
+    lv_obj_t *screen;
+    lv_obj_t *rows[LIST_ROWS];
+    char text[LIST_ROWS][LIST_TEXT_LEN]; // what each row shows right now
+    int top; // item in the first row
+    ListItemFn item;
+} ListView;
+
+void listViewInit(ListView *list, ListItemFn item);
+// Brings the screen up to date and refreshes the display, returns number of rows that changed
+int listViewShow(ListView *list, lv_disp_t *disp, int count, int selected);
@@ -1,9 +1,19 @@
 #include "recplaymgr.h"
 #include "display.h"
+#include "wavwriter.h"
+#include "catalog.h"
+#include "buttons.h"
+#include "listview.h"
+#include "meterview.h"
+#include "playview.h"
+#include "peaks.h"
+#include "pipestats.h"
+#include "tasks.h"
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include "freertos/queue.h"
+#include <freertos/semphr.h>
 
 #include "driver/gpio.h"
 
@@ -13,17 +23,17 @@
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
 
-// ls snippet taken from https://stackoverflow.com/questions/13554150/implementing-the-ls-al-command-in-c
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <dirent.h>
 
 #include <string.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_console.h"
 
 #include "lvgl.h"
 
@@ -40,12 +50,80 @@
 
 #define MOUNT_POINT "/sdcard"
 #define REC_DIR MOUNT_POINT "/rec"
+// outside REC_DIR, so it does not show up as a recording
+#define CATALOG_FILE MOUNT_POINT "/CATALOG.BIN"
+
+// recording and playback screen refresh, the button wait doubles as the frame timer
+#define FRAME_MS 100
+// clip indicator stays on at least this long
+#define CLIP_HOLD_MS 1000
+// longest the player may take to stop the last file and open the next one
+#define PLAY_START_MS 2000
+// UP and DOWN skip this far back and ahead while playing
+#define SKIP_MS 5000
+// default length of the "stress" console command
+#define STRESS_SECONDS 30
 
 TaskHandle_t UITaskHandle;
 lv_disp_t *disp;
-
-typedef enum { UP, DOWN, OK, OK_LONG } ButtonEvent;
-int buttons[] = {BUTTON_UP, BUTTON_DOWN, BUTTON_OK};
+// held by whoever draws, the UI task only lets go while it waits on the file list
+static SemaphoreHandle_t displayLock;
+static int menuIndex;
+// "stress" run the console asked the UI task for, 0 when none
+static volatile uint32_t stressSeconds;
+static volatile bool stressOk;
+static SemaphoreHandle_t stressDoneSem;
+
+// file list stays alive between screens, lvPrint uses a screen of its own
+static ListView fileList;
+static MeterView meterView;
+static PlayView playView;
+static lv_obj_t *textScreen;
+static lv_obj_t *textLabel;
+// when the last button event happened, for measuring display latency
+static uint32_t lastEventMs;
+
+typedef enum { UP, DOWN, OK, OK_LONG, OK_DOUBLE } ButtonEvent;
+gpio_num_t buttons[] = {BUTTON_UP, BUTTON_DOWN, BUTTON_OK};
+#define OK_BUTTON 2
+// What OK can do on each screen, every flag makes a press later (gesture.h).
+// In the file list a press plays, a double click overdubs and a long
+// press deletes, so a press is known 250 ms after release. The settings
+// have no double click, a press counts on release. Where OK only stops
+// something it counts when pushed.
+#define OK_LIST_FLAGS (GESTURE_LONG_PRESS | GESTURE_DOUBLE_CLICK)
+#define OK_SETTINGS_FLAGS GESTURE_LONG_PRESS
+#define OK_STOP_FLAGS 0
+// UP and DOWN scroll while held
+uint8_t buttonFlags[] = {GESTURE_REPEATS, GESTURE_REPEATS, OK_LIST_FLAGS};
+
+// Settings screen, every item cycles through its values with OK
+typedef struct {
+    const char *label;
+    const char *const *values;
+    int valueCount;
+    int (*get)();
+    void (*set)(int value);
+} Setting;
+
+static const char *const formatNames[] = { "PCM", "ADPCM", "FLAC" };
+// same order as RecRate
+static const char *const rateNames[] = { "48k", "44.1k", "16k", "8k" };
+// same order as RecGate
+static const char *const gateNames[] = { "Off", "On", "Cues" };
+// same order as PlaySpeed
+static const char *const speedNames[] = { "1x", "1.25x", "1.5x", "1.75x", "2x" };
+// same order as MonitorGain
+static const char *const monitorNames[] = { "Off", "0 dB", "+6 dB", "+12 dB" };
+
+Setting settings[] = {
+    { "Format", formatNames, 3, getRecFormat, setRecFormat },
+    { "Rate", rateNames, 4, getRecRate, setRecRate },
+    { "Gate", gateNames, 3, getRecGate, setRecGate },
+    { "Speed", speedNames, 5, getPlaySpeed, setPlaySpeed },
+    { "Monitor", monitorNames, 4, getMonitor, setMonitor },
+};
+#define SETTINGS_COUNT (sizeof(settings) / sizeof(Setting))
 
 
 sdmmc_card_t *mountSD(sdmmc_host_t *host) {
@@ -54,7 +132,7 @@ sdmmc_card_t *mountSD(sdmmc_host_t *host) {
     esp_vfs_fat_sdmmc_mount_config_t mount_config = {
         .format_if_mount_failed = false,
         .max_files = 5,
-        .allocation_unit_size = 16 * 1024
+        .allocation_unit_size = SD_CLUSTER_SIZE
     };
     sdmmc_card_t *card;
 
@@ -107,146 +185,359 @@ void unmountSD(sdmmc_card_t *card, sdmmc_host_t *host) {
 }
 
 void lvPrint(lv_disp_t *disp, char *text) {
-    lv_obj_t *scr = lv_disp_get_scr_act(disp);
-    lv_obj_clean(scr);
-    lv_obj_t *label = lv_label_create(scr);
-    lv_label_set_text(label, text);
-    lv_obj_set_width(label, 128);
-    lv_obj_align(label, LV_ALIGN_TOP_MID, 0, 0);
-    //lv_obj_invalidate();
+    if (textScreen == NULL) {
+        textScreen = lv_obj_create(NULL);
+        textLabel = lv_label_create(textScreen);
+        lv_obj_set_width(textLabel, 128);
+        lv_obj_align(textLabel, LV_ALIGN_TOP_MID, 0, 0);
+    }
+    lv_label_set_text(textLabel, text);
+    if (lv_scr_act() != textScreen) {
+        lv_scr_load(textScreen);
+    }
     lv_refr_now(disp);
 }
 
+// index 0 is [Record], entry i of the catalog is index i + 1
+static void fileListItem(int index, char *text, size_t size) {
+    CatalogEntry e;
+    if (index == 0) {
+        snprintf(text, size, "[Record]");
+    } else if (!catalogGet(index - 1, &e)) {
+        text[0] = '\0';
+    } else if (e.durationMs > 0) {
+        uint32_t seconds = e.durationMs / 1000;
+        snprintf(text, size, "%-8s%2u:%02u", e.name, seconds / 60, seconds % 60);
+    } else {
+        snprintf(text, size, "%s", e.name);
+    }
+}
+
+static uint32_t nowMs() {
+    return esp_timer_get_time() / 1000;
+}
+
 int showFiles(lv_disp_t *disp, int selected) {
-    const int LINES_FIT = 8;
-    const int LINES_BEFORE = 2;
+    int count = catalogCount() + 1;
+    uint32_t bytesBefore = displayBytesSent();
+    uint32_t flushBefore = displayFlushUs();
+    int rows = listViewShow(&fileList, disp, count, selected);
+    ESP_LOGI("ui", "%d rows redrawn, %u bytes to the panel in %u us, %u ms after the button",
+             rows, displayBytesSent() - bytesBefore, displayFlushUs() - flushBefore,
+             nowMs() - lastEventMs);
+    return count;
+}
+
+void getFilenameFromIndex(char *filename, int selected) {
+    catalogPath(selected - 1, filename);
+}
     
-    DIR *dir;
-    struct dirent *f;
-    char filename[32];
+void getNewFilename(char *filename) {
+    // numbers are unique across extensions
+    catalogNewPath(getRecExtension(), filename);
+}
+
+// Removes a recording with its overview
+static void deleteRecording(const char *filename) {
+    unlink(filename);
+    catalogRemove(filename);
+    char peakFile[32];
+    peakPath(filename, peakFile, sizeof(peakFile));
+    unlink(peakFile);
+}
 
-    char buf[512] = {0};
-    dir = opendir(REC_DIR);
+
+// Waits for the next button event, false if none came within timeoutMs
+bool waitEventFor(ButtonEvent *event, uint32_t timeoutMs) {
+    GestureEvent g;
+    if (!buttonsWait(&g, timeoutMs)) {
+        return false;
+    }
+    lastEventMs = g.timeMs;
+    switch (buttons[g.button]) {
+        case BUTTON_UP:
+            *event = UP;
+            break;
+            
+        case BUTTON_DOWN:
+            *event = DOWN;
+            break;
+            
+        default:
+            if (g.kind == GESTURE_LONG) {
+                *event = OK_LONG;
+            } else {
+                *event = (g.kind == GESTURE_DOUBLE) ? OK_DOUBLE : OK;
+            }
+            break;
+    }
+    return true;
+}
+
+// Waits for the next button event, a wake from the console is left for the file list
+ButtonEvent waitEvent() {
+    ButtonEvent e;
+    while (!waitEventFor(&e, BUTTONS_FOREVER)) {
+    }
+    return e;
+}
+
+// Milliseconds to wait for the next frame, frames stay on their grid
+// and a late one is not made up for
+static uint32_t nextFrame(uint32_t *frame) {
+    uint32_t now = nowMs();
+    *frame += FRAME_MS;
+    if ((int32_t)(*frame - now) < 0) {
+        *frame = now;
+    }
+    return *frame - now;
+}
+
+// Shows the level meter at a fixed frame rate until a button is pressed
+ButtonEvent recordingScreen() {
+    RecLevel level;
+    getRecLevel(&level);
+    // clips counted before this recording do not light the indicator
+    uint32_t clips = level.clips;
+    uint32_t clipUntil = nowMs();
+    uint32_t frame = nowMs();
+    ButtonEvent e;
     
-    int index = 0;
+    buttonsSetFlags(OK_BUTTON, OK_STOP_FLAGS);
+    meterViewReset(&meterView);
     while (true) {
-        if (index == 0) {
-            strcpy(filename, "[Record]");
-        } else {
-            f = readdir(dir);
-            if (f == NULL) {
-                break;
-            }
-            if (f->d_type != DT_REG) {
-                continue;
-            }
-            strcpy(filename, f->d_name);
+        getRecLevel(&level);
+        uint32_t now = nowMs();
+        if (level.clips != clips) {
+            clips = level.clips;
+            clipUntil = now + CLIP_HOLD_MS;
         }
-            
-        if ((index >= selected - LINES_BEFORE) && (index <= selected + LINES_FIT)) {
-            strcat(buf,  (index == selected) ? "> " : "  ");
-            strcat(buf, filename);
-            strcat(buf, "\n");
+        meterViewShow(&meterView, disp, &level, (int32_t)(clipUntil - now) > 0);
+        if (waitEventFor(&e, nextFrame(&frame))) {
+            return e;
         }
-        index++;
     }
-    closedir(dir);
-    lvPrint(disp, buf);
-    return index;
 }
 
-void getFilenameFromIndex(char *filename, int selected) {
-    DIR *dir;
-    struct dirent *f;
-
-    dir = opendir(REC_DIR);
-    int index = 1;
-    while((f = readdir(dir)) != NULL) {
-        if (f->d_type != DT_REG) {
+// Plays entry selected of the file list with its waveform until it ends or a button is pressed
+void playingScreen(int selected) {
+    CatalogEntry entry;
+    char filename[32];
+    char peakFile[32];
+    if (!catalogGet(selected - 1, &entry) || !catalogPath(selected - 1, filename)) {
+        return;
+    }
+    peakPath(filename, peakFile, sizeof(peakFile));
+    // once the command is done the file plays, or it could not be opened
+    if (!waitRecPlay(startPlay(filename), PLAY_START_MS)) {
+        stopPlay();
+        return;
+    }
+    playViewOpen(&playView, entry.name, peakFile, entry.durationMs);
+    buttonsSetFlags(OK_BUTTON, OK_STOP_FLAGS);
+    
+    uint32_t frame = nowMs();
+    ButtonEvent e;
+    while (true) {
+        uint32_t position = 0;
+        if (!getPlayPosition(&position)) {
+            // ended
+            return;
+        }
+        playViewShow(&playView, disp, position);
+        if (!waitEventFor(&e, nextFrame(&frame))) {
             continue;
         }
-        if (index == selected) {
-            sprintf(filename, "%s/%s", REC_DIR, f->d_name);
-            break;
+        // held down they repeat, which makes rewind and fast forward
+        if (e == UP) {
+            seekPlay(-SKIP_MS, true);
+        } else if (e == DOWN) {
+            seekPlay(SKIP_MS, true);
+        } else {
+            stopPlay();
+            return;
         }
-        index++;
     }
-    closedir(dir);
 }
+
+// Records a take over entry selected of the file list, then mixes the two
+// into a new file. Any button ends the take, and stops the mix.
+void overdubScreen(int selected) {
+    char filename[32];
+    char takeFile[32];
+    char mixFile[32];
+    uint32_t position;
+    if (!catalogPath(selected - 1, filename)) {
+        return;
+    }
+    catalogNewPath("wav", takeFile);
+    // the file plays once the command is done, or it could not be overdubbed
+    if (!waitRecPlay(startOverdub(filename, takeFile), PLAY_START_MS) || !getPlayPosition(&position)) {
+        stopOverdub();
+        return;
+    }
+    recordingScreen();
+    waitRecPlay(stopOverdub(), PLAY_START_MS);
     
-void getNewFilename(char *filename) {
-    int index = 1;
-    do {
-        sprintf(filename, "%s/%d.wav", REC_DIR, index);
-        index++;
-    } while (access(filename, F_OK) == 0);
+    catalogNewPath("wav", mixFile);
+    if (!waitRecPlay(startMix(filename, takeFile, mixFile), PLAY_START_MS)) {
+        stopPlay();
+        return;
+    }
+    char text[32];
+    uint32_t percent;
+    ButtonEvent e;
+    while (getMixProgress(&percent)) {
+        sprintf(text, "Mixing %u%%", percent);
+        lvPrint(disp, text);
+        if (waitEventFor(&e, FRAME_MS)) {
+            stopPlay();
+            return;
+        }
+    }
 }
 
+void showSettings(lv_disp_t *disp, int selected) {
+    char buf[256] = {0};
+    char line[32];
+    
+    for (int i=0; i<SETTINGS_COUNT; i++) {
+        sprintf(line, "%s%s: %s\n", (i == selected) ? "> " : "  ",
+                settings[i].label, settings[i].values[settings[i].get()]);
+        strcat(buf, line);
+    }
+    strcat(buf, (selected == SETTINGS_COUNT) ? "> [Back]" : "  [Back]");
+    lvPrint(disp, buf);
+}
 
-ButtonEvent waitEvent() {
+void settingsMenu() {
+    int index = 0;
+    
+    buttonsSetFlags(OK_BUTTON, OK_SETTINGS_FLAGS);
     while (true) {
-        bool holding = false;
-        for (int i=0; i<(sizeof(buttons)/sizeof(int)); i++) {
-            if (gpio_get_level(buttons[i])) {
-                holding = true;
+        showSettings(disp, index);
+        switch (waitEvent()) {
+            case UP:
+                index += SETTINGS_COUNT;
+                index %= SETTINGS_COUNT + 1;
                 break;
-            }
+                
+            case DOWN:
+                index++;
+                index %= SETTINGS_COUNT + 1;
+                break;
+                
+            case OK:
+            case OK_DOUBLE:
+                if (index == SETTINGS_COUNT) {
+                    return;
+                }
+                settings[index].set((settings[index].get() + 1) % settings[index].valueCount);
+                break;
+                
+            case OK_LONG:
+                return;
         }
-        if (holding == false) {
-            break;
+    }
+}
+
+// Least free stack each task ever had
+static void printTaskStacks() {
+    static const char *const names[] = { "RECORDER", "PLAYER", "WRITER", "PREFETCH", "RECPLAYMGR", "BACKGROUND", "UI" };
+    printf("Stack never used:");
+    for (int i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        TaskHandle_t task = xTaskGetHandle(names[i]);
+        if (task != NULL) {
+            printf(" %s %u", names[i], uxTaskGetStackHighWaterMark(task));
         }
-        vTaskDelay(10/portTICK_PERIOD_MS);
+    }
+    printf(" bytes\n");
+}
+
+// Records for a while with the display redrawn as fast as it goes, every
+// frame a different screen so the whole panel is sent each time, then
+// reports what the recording lost. The recording is removed again. Runs
+// in the UI task, which holds displayLock.
+static bool stressTest(uint32_t seconds) {
+    char filename[32];
+    getNewFilename(filename);
+    pipeStatsReset(nowMs());
+    if (!waitRecPlay(startRec(filename), PLAY_START_MS)) {
+        printf("Recording did not start\n");
+        stopRec();
+        return false;
     }
     
-    bool pushed = false;
-    int i=0;
-    
-    while (!pushed) {
-        vTaskDelay(10/portTICK_PERIOD_MS);
-        for (i=0; i<(sizeof(buttons)/sizeof(int)); i++) {
-            if (gpio_get_level(buttons[i])) {
-                pushed = true;
+    uint32_t start = nowMs();
+    uint32_t flushUs = displayFlushUs();
+    uint32_t bytes = displayBytesSent();
+    uint32_t frames = 0;
+    RecLevel level;
+    char text[48];
+    while (nowMs() - start < seconds * 1000) {
+        getRecLevel(&level);
+        int count = catalogCount() + 1;
+        switch (frames % 3) {
+            case 0:
+                meterViewReset(&meterView);
+                meterViewShow(&meterView, disp, &level, frames & 1);
+                break;
+                
+            case 1:
+                listViewShow(&fileList, disp, count, frames / 3 % count);
+                break;
+                
+            default:
+                sprintf(text, "Stress test\n%u s\n%u frames", (nowMs() - start) / 1000, frames);
+                lvPrint(disp, text);
                 break;
-            }
         }
+        frames++;
     }
-    uint32_t pushTime = esp_log_timestamp();
+    uint32_t elapsed = nowMs() - start;
+    waitRecPlay(stopRec(), PLAY_START_MS);
     
-    while (esp_log_timestamp() - pushTime < 500) {
-        vTaskDelay(10/portTICK_PERIOD_MS);
-        if (gpio_get_level(buttons[i]) == 0) {
-            pushed = false;
-            break;
-        }
-    }
+    getRecLevel(&level);
+    uint32_t micOverruns = atomic_load(&pipeCounters[PIPE_MIC_OVERRUNS]);
+    uint32_t ringOverruns = atomic_load(&pipeCounters[PIPE_RING_OVERRUNS]);
+    uint32_t shortReads = atomic_load(&pipeCounters[PIPE_MIC_SHORT_READS]);
+    printf("%u frames in %u ms, %u bytes to the panel, flushing took %u ms\n", frames, elapsed,
+           displayBytesSent() - bytes, (displayFlushUs() - flushUs) / 1000);
+    printf("Recorded %u ms, %u dropouts: %u mic DMA overruns, %u ring overruns, %u short reads\n",
+           level.elapsedMs, micOverruns + ringOverruns + shortReads, micOverruns, ringOverruns, shortReads);
+    pipeStatsPrint(nowMs());
+    printTaskStacks();
     
-    ButtonEvent e = OK;
-    switch (buttons[i]) {
-        case BUTTON_UP:
-            e = UP;
-            break;
-            
-        case BUTTON_DOWN:
-            e = DOWN;
-            break;
-            
-        case BUTTON_OK:
-            e = pushed ? OK_LONG : OK;
-            break;
-    }
-    return e;
+    deleteRecording(filename);
+    return true;
 }
 
 void UITask() {
     recPlayMgrInit();
+    listViewInit(&fileList, fileListItem);
+    meterViewInit(&meterView);
+    playViewInit(&playView);
     
     ButtonEvent e;
-    int menuIndex = 0;
+    xSemaphoreTake(displayLock, portMAX_DELAY);
     int menuItemsCount = showFiles(disp, 0);
     char filename[32];
     
     while (true) {
-        e = waitEvent();
+        if (stressSeconds != 0) {
+            stressOk = stressTest(stressSeconds);
+            stressSeconds = 0;
+            xSemaphoreGive(stressDoneSem);
+            menuItemsCount = showFiles(disp, menuIndex);
+        }
+        buttonsSetFlags(OK_BUTTON, OK_LIST_FLAGS);
+        xSemaphoreGive(displayLock);
+        // woken by the console, for a stress run
+        if (!waitEventFor(&e, BUTTONS_FOREVER)) {
+            xSemaphoreTake(displayLock, portMAX_DELAY);
+            continue;
+        }
+        xSemaphoreTake(displayLock, portMAX_DELAY);
         printf("Event %d\n", e);
         switch (e) {
             case UP:
@@ -260,24 +551,25 @@ void UITask() {
                 break;
                 
             case OK:
+            case OK_DOUBLE:
                 if (menuIndex == 0) {
                     getNewFilename(filename);
                     startRec(filename);
-                    lvPrint(disp, "RECORDING...");
-                    e = waitEvent();
+                    e = recordingScreen();
                     stopRec();
+                } else if (e == OK_DOUBLE) {
+                    overdubScreen(menuIndex);
                 } else {
-                    getFilenameFromIndex(filename, menuIndex);
-                    startPlay(filename);
+                    playingScreen(menuIndex);
                 }
                 break;
                 
             case OK_LONG:
                 if (menuIndex == 0) {
-
+                    settingsMenu();
                 } else {
                     getFilenameFromIndex(filename, menuIndex);
-                    unlink(filename);
+                    deleteRecording(filename);
                     menuIndex--;
                     menuItemsCount--;
                 }
@@ -289,6 +581,71 @@ void UITask() {
 
 
 
+// "stats" prints where the audio path spends its time, "stats dump" the
+// same as one line of hex (pipestats.h), "stats reset" starts over,
+// "stats tasks" shows the stack left by every task
+static int statsCommand(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        pipeStatsReset(nowMs());
+    } else if (argc > 1 && strcmp(argv[1], "dump") == 0) {
+        static uint8_t dump[PIPE_DUMP_SIZE];
+        size_t size = pipeStatsDump(dump, sizeof(dump), nowMs());
+        for (size_t i = 0; i < size; i++) {
+            printf("%02x", dump[i]);
+        }
+        printf("\n");
+    } else if (argc > 1 && strcmp(argv[1], "tasks") == 0) {
+        printTaskStacks();
+    } else {
+        pipeStatsPrint(nowMs());
+    }
+    return 0;
+}
+
+// Has the UI task run stressTest, so the display is drawn where it always
+// is, on IO_CORE with the stack LVGL needs, and waits for it
+static int stressCommand(int argc, char **argv) {
+    uint32_t seconds = argc > 1 ? atoi(argv[1]) : STRESS_SECONDS;
+    if (seconds == 0) {
+        printf("Give the length in seconds\n");
+        return 1;
+    }
+    // free only while the UI task waits on the file list
+    if (xSemaphoreTake(displayLock, 0) != pdTRUE) {
+        printf("Display busy, go back to the file list first\n");
+        return 1;
+    }
+    stressSeconds = seconds;
+    xSemaphoreGive(displayLock);
+    buttonsWake();
+    xSemaphoreTake(stressDoneSem, portMAX_DELAY);
+    return stressOk ? 0 : 1;
+}
+
+static void startConsole() {
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t replConfig = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    replConfig.prompt = "rec>";
+    esp_console_dev_uart_config_t uartConfig = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    const esp_console_cmd_t statsCmd = {
+        .command = "stats",
+        .help = "Audio path timing and error counters",
+        .hint = "[dump|reset|tasks]",
+        .func = statsCommand,
+    };
+    const esp_console_cmd_t stressCmd = {
+        .command = "stress",
+        .help = "Record while redrawing the display nonstop, report dropouts",
+        .hint = "[seconds]",
+        .func = stressCommand,
+    };
+    if (esp_console_new_repl_uart(&uartConfig, &replConfig, &repl) != ESP_OK
+        || esp_console_cmd_register(&statsCmd) != ESP_OK || esp_console_cmd_register(&stressCmd) != ESP_OK
+        || esp_console_start_repl(repl) != ESP_OK) {
+        ESP_LOGE("main", "Console not available");
+    }
+}
+
 void app_main() {
     disp = getDisplay();
     
@@ -300,18 +657,17 @@ void app_main() {
         vTaskDelay(portMAX_DELAY);
     }
     mkdir(REC_DIR, ACCESSPERMS);
+    catalogInit(REC_DIR, CATALOG_FILE);
 
     
-    for (int i=0; i<(sizeof(buttons)/sizeof(int)); i++) {
-        // gpio_pad_select_gpio(buttons[i]);
-        gpio_set_direction(buttons[i], GPIO_MODE_INPUT);
-        gpio_pulldown_en(buttons[i]);
-        gpio_pullup_dis(buttons[i]);
-        gpio_set_intr_type(buttons[i], GPIO_INTR_ANYEDGE);
-        gpio_intr_enable(buttons[i]);
+    if (!buttonsInit(buttons, buttonFlags, sizeof(buttons) / sizeof(gpio_num_t))) {
+        ESP_LOGE("main", "Buttons not available");
     }
+    displayLock = xSemaphoreCreateMutex();
+    stressDoneSem = xSemaphoreCreateBinary();
+    startConsole();
     
-    xTaskCreate(UITask, "UI", 16384, NULL, 1, &UITaskHandle);
+    xTaskCreatePinnedToCore(UITask, "UI", UI_STACK, NULL, UI_PRIORITY, &UITaskHandle, IO_CORE);
     
     vTaskDelay(portMAX_DELAY);
     
@@ -0,0 +1,118 @@
+#include "meterview.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// an indexed canvas starts with its palette, two 32-bit colors for 1 bit
+#define HISTORY_PALETTE_BYTES 8
+// whole bytes per row, so the newest column is the lowest bit of the last one
+#define HISTORY_STRIDE (METER_HISTORY_WIDTH / 8)
+#define HISTORY_CENTER (METER_HISTORY_HEIGHT / 2)
+
+static lv_obj_t *createLabel(lv_obj_t *screen, const char *text, int x, int y) {
+    lv_obj_t *label = lv_label_create(screen);
+    lv_label_set_text(label, text);
+    lv_obj_set_pos(label, x, y);
+    return label;
+}
+
+static lv_obj_t *createBar(lv_obj_t *screen, const char *name, int y) {
+    createLabel(screen, name, 0, y);
+    lv_obj_t *bar = lv_bar_create(screen);
+    lv_obj_set_size(bar, 104, 6);
+    lv_obj_set_pos(bar, 24, y + 1);
+    lv_bar_set_range(bar, 0, METER_FLOOR_DB);
+    // outline and solid fill, the default theme's shades do not survive 1 bpp
+    lv_obj_set_style_radius(bar, 0, LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(bar, LV_OPA_TRANSP, LV_PART_MAIN);
+    lv_obj_set_style_border_width(bar, 1, LV_PART_MAIN);
+    lv_obj_set_style_border_color(bar, lv_color_black(), LV_PART_MAIN);
+    lv_obj_set_style_pad_all(bar, 1, LV_PART_MAIN);
+    lv_obj_set_style_radius(bar, 0, LV_PART_INDICATOR);
+    lv_obj_set_style_bg_color(bar, lv_color_black(), LV_PART_INDICATOR);
+    lv_obj_set_style_bg_opa(bar, LV_OPA_COVER, LV_PART_INDICATOR);
+    return bar;
+}
+
+// Level as dB above the floor, 0 at or below it
+static int levelDb(uint16_t level) {
+    if (level == 0) {
+        return 0;
+    }
+    int db = METER_FLOOR_DB + (int)lroundf(20.0f * log10f(level / 32768.0f));
+    return db < 0 ? 0 : db;
+}
+
+// Moves the history one pixel to the left and adds a column
+// reaching height pixels above and below the center line
+static void scrollHistory(MeterView *view, int height) {
+    uint8_t *pixels = view->historyBuffer + HISTORY_PALETTE_BYTES;
+    for (int y = 0; y < METER_HISTORY_HEIGHT; y++) {
+        uint8_t *row = pixels + y * HISTORY_STRIDE;
+        // leftmost pixel is the top bit
+        for (int i = 0; i < HISTORY_STRIDE - 1; i++) {
+            row[i] = (row[i] << 1) | (row[i + 1] >> 7);
+        }
+        row[HISTORY_STRIDE - 1] <<= 1;
+        if (y >= HISTORY_CENTER - height && y <= HISTORY_CENTER + height) {
+            row[HISTORY_STRIDE - 1] |= 1;
+        }
+    }
+    lv_obj_invalidate(view->history);
+}
+
+void meterViewInit(MeterView *view) {
+    memset(view, 0, sizeof(MeterView));
+    view->screen = lv_obj_create(NULL);
+    view->time = createLabel(view->screen, "", 0, 0);
+    view->clip = createLabel(view->screen, "CLIP", 96, 0);
+    lv_obj_add_flag(view->clip, LV_OBJ_FLAG_HIDDEN);
+    view->peak = createBar(view->screen, "PK", 8);
+    view->rms = createBar(view->screen, "RMS", 16);
+
+    view->history = lv_canvas_create(view->screen);
+    lv_canvas_set_buffer(view->history, view->historyBuffer, METER_HISTORY_WIDTH, METER_HISTORY_HEIGHT,
+                         LV_IMG_CF_INDEXED_1BIT);
+    // index 1 lights the pixel, like black everywhere else on this panel
+    lv_canvas_set_palette(view->history, 0, lv_color_white());
+    lv_canvas_set_palette(view->history, 1, lv_color_black());
+    lv_obj_set_pos(view->history, 0, 64 - METER_HISTORY_HEIGHT);
+    meterViewReset(view);
+}
+
+void meterViewReset(MeterView *view) {
+    memset(view->historyBuffer + HISTORY_PALETTE_BYTES, 0, sizeof(view->historyBuffer) - HISTORY_PALETTE_BYTES);
+    lv_obj_invalidate(view->history);
+    view->shownSeconds = UINT32_MAX;
+}
+
+void meterViewShow(MeterView *view, lv_disp_t *disp, const RecLevel *level, bool clipping) {
+    // labels redraw on every set, so only when the text changes
+    uint32_t seconds = level->elapsedMs / 1000;
+    if (seconds != view->shownSeconds) {
+        char text[16];
+        snprintf(text, sizeof(text), "REC %2u:%02u", seconds / 60, seconds % 60);
+        lv_label_set_text(view->time, text);
+        view->shownSeconds = seconds;
+    }
+    if (clipping != view->clipShown) {
+        if (clipping) {
+            lv_obj_clear_flag(view->clip, LV_OBJ_FLAG_HIDDEN);
+        } else {
+            lv_obj_add_flag(view->clip, LV_OBJ_FLAG_HIDDEN);
+        }
+        view->clipShown = clipping;
+    }
+
+    int peak = levelDb(level->peak);
+    // bars only invalidate when their value changes
+    lv_bar_set_value(view->peak, peak, LV_ANIM_OFF);
+    lv_bar_set_value(view->rms, levelDb(level->rms), LV_ANIM_OFF);
+    scrollHistory(view, peak * (HISTORY_CENTER - 1) / METER_FLOOR_DB);
+
+    if (lv_scr_act() != view->screen) {
+        lv_scr_load(view->screen);
+    }
+    lv_refr_now(disp);
+}
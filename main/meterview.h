@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+
+#include "recplaymgr.h"
+
+// Recording screen: elapsed time, clip indicator, peak and RMS bars and
+// a peak history scrolling in from the right. The objects are created
+// once and a frame only touches what moved. Parts of the history that
+// look the same after scrolling are not sent to the panel again.
+#define METER_FLOOR_DB 60 // bottom of the bars, in dB below full scale
+#define METER_HISTORY_WIDTH 128
+#define METER_HISTORY_HEIGHT 40
+
+typedef struct {
+    lv_obj_t *screen;
+    lv_obj_t *time;
+    lv_obj_t *clip;
+    lv_obj_t *peak;
+    lv_obj_t *rms;
+    lv_obj_t *history;
+    uint8_t historyBuffer[LV_CANVAS_BUF_SIZE_INDEXED_1BIT(METER_HISTORY_WIDTH, METER_HISTORY_HEIGHT)];
+    uint32_t shownSeconds;
+    bool clipShown;
+} MeterView;
+
+void meterViewInit(MeterView *view);
+// Starts over with an empty history, the screen is loaded by the next meterViewShow
+void meterViewReset(MeterView *view);
+// Draws one frame and refreshes the display
+void meterViewShow(MeterView *view, lv_disp_t *disp, const RecLevel *level, bool clipping);
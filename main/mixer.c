@@ -0,0 +1,60 @@
+#include "mixer.h"
+
+#include <string.h>
+
+void mixerInit(Mixer *m, MixRead readA, void *ctxA, MixRead readB, void *ctxB) {
+    m->read[0] = readA;
+    m->read[1] = readB;
+    m->ctx[0] = ctxA;
+    m->ctx[1] = ctxB;
+    m->gain[0] = MIX_LAYER_GAIN;
+    m->gain[1] = MIX_LAYER_GAIN;
+    m->ended[0] = false;
+    m->ended[1] = false;
+    m->clips = 0;
+}
+
+void mixSamples(const int16_t *a, int32_t gainA, const int16_t *b, int32_t gainB, int16_t *out, size_t count,
+                uint32_t *clips) {
+    uint32_t clipped = 0;
+    for (size_t i = 0; i < count; i++) {
+        // two Q15 products of 16-bit samples, the sum still fits 32 bits
+        int32_t y = (a[i] * gainA + b[i] * gainB + (1 << 14)) >> 15;
+        if (y > INT16_MAX) {
+            y = INT16_MAX;
+            clipped++;
+        } else if (y < INT16_MIN) {
+            y = INT16_MIN;
+            clipped++;
+        }
+        out[i] = y;
+    }
+    *clips += clipped;
+}
+
+// Fills the layer's buffer with count samples, silence after its end.
+// Returns how many came from the layer.
+static size_t fill(Mixer *m, int n, size_t count) {
+    size_t got = 0;
+    while (!m->ended[n] && got < count) {
+        size_t r = m->read[n](m->ctx[n], m->layer[n] + got, count - got);
+        if (r == 0) {
+            m->ended[n] = true;
+        }
+        got += r;
+    }
+    memset(m->layer[n] + got, 0, (count - got) * sizeof(int16_t));
+    return got;
+}
+
+size_t mixerProcess(Mixer *m, int16_t *out, size_t count) {
+    if (count > MIX_CHUNK) {
+        count = MIX_CHUNK;
+    }
+    size_t a = fill(m, 0, count);
+    size_t b = fill(m, 1, count);
+    // a short read only happens at the end, the longer layer sets the length
+    count = a > b ? a : b;
+    mixSamples(m->layer[0], m->gain[0], m->layer[1], m->gain[1], out, count, &m->clips);
+    return count;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Mixes two layers at the same rate into one, a chunk at a time, so
+// neither has to fit in memory. The layers come through read callbacks,
+// the one that ends first is continued with silence. Each layer has a
+// Q15 gain, the sum saturates and every clipped sample is counted.
+// Nothing in here touches the hardware, so it runs the same on a host.
+#define MIX_CHUNK 512
+#define MIX_UNITY 32768
+// -3 dB each, two loud layers seldom clip
+#define MIX_LAYER_GAIN 23198
+
+// Returns up to count samples, 0 at the end of the layer
+typedef size_t (*MixRead)(void *ctx, int16_t *samples, size_t count);
+
+typedef struct {
+    MixRead read[2];
+    void *ctx[2];
+    int32_t gain[2]; // Q15, at most MIX_UNITY
+    bool ended[2];
+    int16_t layer[2][MIX_CHUNK];
+    uint32_t clips;
+} Mixer;
+
+void mixerInit(Mixer *m, MixRead readA, void *ctxA, MixRead readB, void *ctxB);
+// Writes up to count (at most MIX_CHUNK) samples of the mix, fewer only
+// at the end, 0 once both layers ended
+size_t mixerProcess(Mixer *m, int16_t *out, size_t count);
+// out = a * gainA + b * gainB, saturated, clips counts the samples that were
+void mixSamples(const int16_t *a, int32_t gainA, const int16_t *b, int32_t gainB, int16_t *out, size_t count,
+                uint32_t *clips);
@@ -0,0 +1,216 @@
+#include "peaks.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char magic[4] = { 'P', 'E', 'A', 'K' };
+
+// Pairs in every level for a level 0 of the given length, returns the number of levels
+static int levelSizes(uint32_t pairs, uint32_t *sizes) {
+    int levels = 0;
+    do {
+        sizes[levels++] = pairs;
+        pairs = (pairs + PEAK_FACTOR - 1) / PEAK_FACTOR;
+    } while (sizes[levels - 1] > 1 && levels < PEAK_MAX_LEVELS);
+    return levels;
+}
+
+void peakPath(const char *recording, char *path, size_t size) {
+    const char *slash = strrchr(recording, '/');
+    const char *name = slash ? slash + 1 : recording;
+    const char *dot = strrchr(name, '.');
+    int dirLen = name - recording;
+    int nameLen = dot ? dot - name : (int)strlen(name);
+    snprintf(path, size, "%.*s" PEAK_DIR "/%.*s.PK", dirLen, recording, nameLen, name);
+}
+
+bool peakWriterOpen(PeakWriter *w, const char *path, uint32_t sampleRate) {
+    memset(w, 0, sizeof(PeakWriter));
+    w->sampleRate = sampleRate;
+    w->f = fopen(path, "w+b");
+    if (w->f == NULL) {
+        // first overview on this card
+        char dir[64];
+        const char *slash = strrchr(path, '/');
+        snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - path) : 0, path);
+        mkdir(dir, 0777);
+        w->f = fopen(path, "w+b");
+        if (w->f == NULL) {
+            return false;
+        }
+    }
+    // stays invalid until the close writes the real header
+    PeakHeader header = {0};
+    w->failed = fwrite(&header, sizeof(header), 1, w->f) != 1;
+    return true;
+}
+
+static void flush(PeakWriter *w) {
+    if (w->buffered > 0 && fwrite(w->buffer, sizeof(PeakPair), w->buffered, w->f) != w->buffered) {
+        w->failed = true;
+    }
+    w->buffered = 0;
+}
+
+static void endBucket(PeakWriter *w) {
+    // arithmetic shift, full scale both ways fits int8
+    w->buffer[w->buffered].min = w->min >> 8;
+    w->buffer[w->buffered].max = w->max >> 8;
+    w->pairs++;
+    w->fill = 0;
+    if (++w->buffered == PEAK_BUFFER_PAIRS) {
+        flush(w);
+    }
+}
+
+void peakWriterAdd(PeakWriter *w, const int16_t *samples, size_t count) {
+    w->samples += count;
+    while (count > 0) {
+        if (w->fill == 0) {
+            w->min = INT16_MAX;
+            w->max = INT16_MIN;
+        }
+        size_t n = PEAK_BUCKET - w->fill;
+        if (n > count) {
+            n = count;
+        }
+        int32_t lo = w->min;
+        int32_t hi = w->max;
+        for (size_t i = 0; i < n; i++) {
+            lo = samples[i] < lo ? samples[i] : lo;
+            hi = samples[i] > hi ? samples[i] : hi;
+        }
+        w->min = lo;
+        w->max = hi;
+        w->fill += n;
+        samples += n;
+        count -= n;
+        if (w->fill == PEAK_BUCKET) {
+            endBucket(w);
+        }
+    }
+}
+
+// Writes the level at offset to from the count pairs of the level at offset from
+static bool buildLevel(PeakWriter *w, long from, uint32_t count, long to) {
+    PeakPair out[PEAK_BUFFER_PAIRS / PEAK_FACTOR];
+    // whole groups per read, so a group never spans two reads
+    for (uint32_t done = 0; done < count; done += PEAK_BUFFER_PAIRS) {
+        uint32_t n = count - done < PEAK_BUFFER_PAIRS ? count - done : PEAK_BUFFER_PAIRS;
+        if (fseek(w->f, from + done * sizeof(PeakPair), SEEK_SET) != 0 ||
+            fread(w->buffer, sizeof(PeakPair), n, w->f) != n) {
+            return false;
+        }
+        int m = 0;
+        for (uint32_t i = 0; i < n; i += PEAK_FACTOR) {
+            PeakPair p = w->buffer[i];
+            for (uint32_t j = i + 1; j < i + PEAK_FACTOR && j < n; j++) {
+                p.min = w->buffer[j].min < p.min ? w->buffer[j].min : p.min;
+                p.max = w->buffer[j].max > p.max ? w->buffer[j].max : p.max;
+            }
+            out[m++] = p;
+        }
+        if (fseek(w->f, to + done / PEAK_FACTOR * sizeof(PeakPair), SEEK_SET) != 0 ||
+            fwrite(out, sizeof(PeakPair), m, w->f) != m) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool peakWriterClose(PeakWriter *w, const char *path) {
+    if (w->fill > 0) {
+        endBucket(w);
+    }
+    flush(w);
+
+    uint32_t sizes[PEAK_MAX_LEVELS];
+    int levels = levelSizes(w->pairs, sizes);
+    long offset = sizeof(PeakHeader);
+    for (int i = 1; i < levels && !w->failed; i++) {
+        long next = offset + sizes[i - 1] * sizeof(PeakPair);
+        w->failed = !buildLevel(w, offset, sizes[i - 1], next);
+        offset = next;
+    }
+
+    PeakHeader header = {
+        .version = PEAK_VERSION,
+        .levels = levels,
+        .bucket = PEAK_BUCKET,
+        .sampleRate = w->sampleRate,
+        .samples = w->samples,
+    };
+    memcpy(header.magic, magic, sizeof(magic));
+    if (!w->failed && (fseek(w->f, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, w->f) != 1)) {
+        w->failed = true;
+    }
+    if (fclose(w->f) != 0) {
+        w->failed = true;
+    }
+    w->f = NULL;
+    if (w->failed) {
+        unlink(path);
+        return false;
+    }
+    return true;
+}
+
+void peakWriterAbort(PeakWriter *w, const char *path) {
+    fclose(w->f);
+    w->f = NULL;
+    unlink(path);
+}
+
+// Reads and checks the header, returns the file size it implies or 0
+static long readHeader(FILE *f, PeakHeader *header, uint32_t *sizes) {
+    if (fread(header, sizeof(PeakHeader), 1, f) != 1 || memcmp(header->magic, magic, sizeof(magic)) != 0 ||
+        header->version != PEAK_VERSION || header->bucket == 0) {
+        return 0;
+    }
+    uint32_t pairs = (header->samples + header->bucket - 1) / header->bucket;
+    if (levelSizes(pairs, sizes) != header->levels) {
+        return 0;
+    }
+    long size = sizeof(PeakHeader);
+    for (int i = 0; i < header->levels; i++) {
+        size += sizes[i] * sizeof(PeakPair);
+    }
+    return size;
+}
+
+bool peakValid(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    PeakHeader header;
+    uint32_t sizes[PEAK_MAX_LEVELS];
+    long size = readHeader(f, &header, sizes);
+    fseek(f, 0, SEEK_END);
+    bool valid = size > 0 && ftell(f) == size;
+    fclose(f);
+    return valid;
+}
+
+int peakLoad(const char *path, int columns, PeakPair *out, int maxPairs, PeakHeader *header) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    uint32_t sizes[PEAK_MAX_LEVELS];
+    int n = 0;
+    if (readHeader(f, header, sizes) > 0) {
+        int level = 0;
+        long offset = sizeof(PeakHeader);
+        while (level + 1 < header->levels && sizes[level + 1] >= columns) {
+            offset += sizes[level++] * sizeof(PeakPair);
+        }
+        n = sizes[level] < maxPairs ? sizes[level] : maxPairs;
+        if (fseek(f, offset, SEEK_SET) != 0 || fread(out, sizeof(PeakPair), n, f) != n) {
+            n = 0;
+        }
+    }
+    fclose(f);
+    return n;
+}
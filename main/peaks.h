@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Waveform overview kept next to a recording, in PK/<name>.PK of the
+// recording's directory, so it does not show up as a recording itself.
+// Level 0 holds the smallest and largest sample (top 8 bits) of every
+// PEAK_BUCKET samples, each further level combines PEAK_FACTOR pairs of
+// the one below, up to a level of a single pair. A waveform of any
+// length, n columns wide, is one read of fewer than PEAK_FACTOR * n pairs.
+//
+// File: PeakHeader, then the levels from 0 up, two bytes per pair.
+// Only stdio is used, the host tool builds the very same files.
+#define PEAK_BUCKET 1024
+#define PEAK_FACTOR 4
+#define PEAK_MAX_LEVELS 12
+#define PEAK_DIR "PK"
+#define PEAK_VERSION 1
+// level 0 pairs buffered before a write
+#define PEAK_BUFFER_PAIRS 256
+
+typedef struct {
+    int8_t min;
+    int8_t max;
+} PeakPair;
+
+typedef struct {
+    char magic[4]; // "PEAK", zero until the file is complete
+    uint8_t version;
+    uint8_t levels;
+    uint16_t bucket; // samples per level 0 pair
+    uint32_t sampleRate;
+    uint32_t samples; // summarized, at sampleRate
+} PeakHeader;
+
+typedef struct {
+    FILE *f;
+    uint32_t sampleRate;
+    uint32_t samples;
+    uint32_t pairs; // level 0 pairs completed
+    int32_t min; // of the bucket being filled
+    int32_t max;
+    uint32_t fill; // samples in that bucket
+    PeakPair buffer[PEAK_BUFFER_PAIRS];
+    int buffered;
+    bool failed;
+} PeakWriter;
+
+// Overview path of a recording, "/a/b/12.WAV" becomes "/a/b/PK/12.PK"
+void peakPath(const char *recording, char *path, size_t size);
+
+// Creates the overview file, and its directory if needed
+bool peakWriterOpen(PeakWriter *w, const char *path, uint32_t sampleRate);
+void peakWriterAdd(PeakWriter *w, const int16_t *samples, size_t count);
+// Builds the upper levels from level 0 and writes the header, false if
+// anything went wrong; the file is removed then
+bool peakWriterClose(PeakWriter *w, const char *path);
+// Drops a file that will not be finished
+void peakWriterAbort(PeakWriter *w, const char *path);
+
+// True if path holds a complete overview
+bool peakValid(const char *path);
+// Reads the coarsest level with at least columns pairs, or level 0 if
+// even that one is shorter, at most maxPairs of it. Returns the number
+// of pairs read, 0 without a usable file.
+int peakLoad(const char *path, int columns, PeakPair *out, int maxPairs, PeakHeader *header);
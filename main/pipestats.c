@@ -0,0 +1,112 @@
+#include "pipestats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+atomic_uint pipeCounters[PIPE_COUNTER_COUNT];
+
+static PipeStageStats stages[PIPE_STAGE_COUNT];
+static uint32_t cyclesPerUs = 1;
+static uint32_t resetMs;
+
+// same order as PipeStage and PipeCounter
+static const char *stageNames[] = {
+    "mic wait", "mic convert", "encode", "sd write", "source read", "amp convert", "amp wait",
+};
+static const char *counterNames[] = {
+    "mic short reads", "mic overruns", "ring overruns", "sd write errors", "amp short writes", "amp underruns",
+};
+
+void pipeStatsInit(uint32_t cpuCyclesPerUs, uint32_t nowMs) {
+    cyclesPerUs = cpuCyclesPerUs > 0 ? cpuCyclesPerUs : 1;
+    pipeStatsReset(nowMs);
+}
+
+void pipeStatsReset(uint32_t nowMs) {
+    memset(stages, 0, sizeof(stages));
+    for (int i = 0; i < PIPE_COUNTER_COUNT; i++) {
+        atomic_store(&pipeCounters[i], 0);
+    }
+    resetMs = nowMs;
+}
+
+void pipeStageAdd(PipeStage stage, uint32_t cycles) {
+    PipeStageStats *s = &stages[stage];
+    // bucket k from 2^(k + shift) cycles, one count leading zeros
+    uint32_t scaled = cycles >> PIPE_BUCKET_SHIFT;
+    int bucket = scaled > 1 ? 31 - __builtin_clz(scaled) : 0;
+    if (bucket >= PIPE_BUCKETS) {
+        bucket = PIPE_BUCKETS - 1;
+    }
+    s->buckets[bucket]++;
+    s->count++;
+    s->total += (cycles + (1 << (PIPE_BUCKET_SHIFT - 1))) >> PIPE_BUCKET_SHIFT;
+    if (cycles > s->maxCycles) {
+        s->maxCycles = cycles;
+    }
+}
+
+// Microseconds at the top of bucket k
+static uint32_t bucketTopUs(int bucket) {
+    return ((uint64_t)2 << (bucket + PIPE_BUCKET_SHIFT)) / cyclesPerUs;
+}
+
+void pipeStatsPrint(uint32_t nowMs) {
+    printf("%u ms since reset, %u cycles per us\n", nowMs - resetMs, cyclesPerUs);
+    for (int i = 0; i < PIPE_STAGE_COUNT; i++) {
+        PipeStageStats *s = &stages[i];
+        if (s->count == 0) {
+            continue;
+        }
+        // the bucket 99 % of the samples are at or below
+        uint32_t below = 0;
+        int p99 = 0;
+        while (p99 < PIPE_BUCKETS - 1 && (below += s->buckets[p99]) < s->count - s->count / 100) {
+            p99++;
+        }
+        uint32_t meanUs = ((uint64_t)s->total << PIPE_BUCKET_SHIFT) / s->count / cyclesPerUs;
+        printf("%-12s %8u x, mean %6u us, p99 < %6u us, max %6u us |", stageNames[i], s->count, meanUs,
+               bucketTopUs(p99), s->maxCycles / cyclesPerUs);
+        for (int b = 0; b < PIPE_BUCKETS; b++) {
+            if (s->buckets[b] == 0) {
+                continue;
+            }
+            if (b == PIPE_BUCKETS - 1) {
+                printf(" >%u:%u", bucketTopUs(b - 1), s->buckets[b]);
+            } else {
+                printf(" <%u:%u", bucketTopUs(b), s->buckets[b]);
+            }
+        }
+        printf("\n");
+    }
+    for (int i = 0; i < PIPE_COUNTER_COUNT; i++) {
+        printf("%s%s %u", i > 0 ? ", " : "", counterNames[i], atomic_load(&pipeCounters[i]));
+    }
+    printf("\n");
+}
+
+size_t pipeStatsDump(uint8_t *out, size_t size, uint32_t nowMs) {
+    if (size < PIPE_DUMP_SIZE) {
+        return 0;
+    }
+    PipeDumpHeader header = {
+        .magic = { 'P', 'I', 'P', 'E' },
+        .version = PIPE_DUMP_VERSION,
+        .stages = PIPE_STAGE_COUNT,
+        .buckets = PIPE_BUCKETS,
+        .counters = PIPE_COUNTER_COUNT,
+        .bucketShift = PIPE_BUCKET_SHIFT,
+        .cyclesPerUs = cyclesPerUs,
+        .elapsedMs = nowMs - resetMs,
+    };
+    memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    memcpy(out, stages, sizeof(stages));
+    out += sizeof(stages);
+    for (int i = 0; i < PIPE_COUNTER_COUNT; i++) {
+        uint32_t count = atomic_load(&pipeCounters[i]);
+        memcpy(out, &count, sizeof(count));
+        out += sizeof(count);
+    }
+    return PIPE_DUMP_SIZE;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Where the time goes in the audio path, for telling which stage was at
+// fault when audio drops out. Every stage keeps a histogram of how many
+// cycles it took, one bucket per power of two, so a stage that usually
+// takes 40 us and stalled for 80 ms once shows both. Counters add up the
+// short reads and writes and the DMA queue overflows.
+//
+// Each stage is timed by one task only, readers load whole words and
+// nothing is locked; a report taken while audio runs may be one sample
+// off between its fields. Nothing in here touches the hardware, so it
+// runs the same on a host.
+#define PIPE_BUCKETS 20
+// bucket 0 counts everything below 2^(PIPE_BUCKET_SHIFT + 1) cycles, the last one everything above
+#define PIPE_BUCKET_SHIFT 8
+
+typedef enum {
+    PIPE_MIC_WAIT, // I2S read of the mic, waiting for DMA
+    PIPE_MIC_CONVERT, // to 16 bits, metering and decimation
+    PIPE_ENCODE, // ADPCM or FLAC
+    PIPE_SD_WRITE, // writes that reached the card, buffered ones do not count
+    PIPE_SOURCE_READ, // from the read-ahead, decoding included
+    PIPE_AMP_CONVERT, // stretch, resampling and conversion for the amp
+    PIPE_AMP_WAIT, // I2S write to the amp, waiting for DMA
+    PIPE_STAGE_COUNT
+} PipeStage;
+
+typedef enum {
+    PIPE_MIC_SHORT_READS, // less than a block came from the mic
+    PIPE_MIC_OVERRUNS, // mic DMA queue was full, the driver dropped a buffer
+    PIPE_RING_OVERRUNS, // capture blocks the writer had no room for
+    PIPE_SD_WRITE_ERRORS,
+    PIPE_AMP_SHORT_WRITES, // not all of a block went to the amp
+    PIPE_AMP_UNDERRUNS, // amp DMA queue ran dry
+    PIPE_COUNTER_COUNT
+} PipeCounter;
+
+typedef struct {
+    uint32_t count;
+    uint32_t maxCycles;
+    uint32_t total; // in units of 2^PIPE_BUCKET_SHIFT cycles, so it does not overflow for hours
+    uint32_t buckets[PIPE_BUCKETS];
+} PipeStageStats;
+
+// Binary dump: this header, PIPE_STAGE_COUNT PipeStageStats, then
+// PIPE_COUNTER_COUNT uint32_t counters, all little endian
+#define PIPE_DUMP_VERSION 1
+typedef struct {
+    char magic[4]; // "PIPE"
+    uint8_t version;
+    uint8_t stages;
+    uint8_t buckets;
+    uint8_t counters;
+    uint8_t bucketShift;
+    uint8_t reserved[3];
+    uint32_t cyclesPerUs;
+    uint32_t elapsedMs; // since the last reset
+} PipeDumpHeader;
+
+#define PIPE_DUMP_SIZE (sizeof(PipeDumpHeader) + PIPE_STAGE_COUNT * sizeof(PipeStageStats) \
+                        + PIPE_COUNTER_COUNT * sizeof(uint32_t))
+
+// inline, so the I2S event callbacks can count from IRAM
+extern atomic_uint pipeCounters[PIPE_COUNTER_COUNT];
+static inline void pipeCount(PipeCounter c) {
+    atomic_fetch_add(&pipeCounters[c], 1);
+}
+
+// nowMs is only used to tell how long the figures cover
+void pipeStatsInit(uint32_t cyclesPerUs, uint32_t nowMs);
+void pipeStatsReset(uint32_t nowMs);
+void pipeStageAdd(PipeStage stage, uint32_t cycles);
+// One line per stage and one for the counters, to stdout
+void pipeStatsPrint(uint32_t nowMs);
+// Writes PIPE_DUMP_SIZE bytes to out, returns 0 if size is too small
+size_t pipeStatsDump(uint8_t *out, size_t size, uint32_t nowMs);
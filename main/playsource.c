@@ -0,0 +1,299 @@
+#include "playsource.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "adpcm.h"
+#include "convert.h"
+
+// raw PCM read at once, a whole number of frames of any supported layout
+#define PCM_READ_BYTES 2400
+// ADPCM blocks larger than this are rejected
+#define MAX_ADPCM_BLOCK 2048
+// a FLAC seek guesses a file offset at most this many times, then decodes the rest of the way
+#define FLAC_SEEK_PROBES 12
+// closer than this to the target, decoding forward beats another guess
+#define FLAC_SEEK_LINEAR 16384
+
+static uint8_t rawBuffer[PCM_READ_BYTES > MAX_ADPCM_BLOCK ? PCM_READ_BYTES : MAX_ADPCM_BLOCK];
+static int16_t blockSamples[FLAC_MAX_BLOCK_SIZE > 2 * MAX_ADPCM_BLOCK ? FLAC_MAX_BLOCK_SIZE : 2 * MAX_ADPCM_BLOCK];
+
+static size_t prefetchReadFn(void *ctx, uint8_t *buf, size_t len) {
+    return prefetchRead(ctx, buf, len);
+}
+
+bool playSourceOpen(PlaySource *s, const char *filename, Prefetch *prefetch) {
+    memset(s, 0, sizeof(PlaySource));
+    s->f = fopen(filename, "r");
+    if (s->f == NULL) {
+        ESP_LOGE("playsource", "Failed to open %s", filename);
+        return false;
+    }
+
+    char magic[4] = {0};
+    fread(magic, 1, sizeof(magic), s->f);
+    fseek(s->f, 0, SEEK_END);
+    s->fileSize = ftell(s->f);
+    rewind(s->f);
+    if (memcmp(magic, "fLaC", 4) == 0) {
+        s->kind = SOURCE_FLAC;
+        s->flac = malloc(sizeof(FlacDecoder));
+        if (s->flac == NULL) {
+            ESP_LOGE("playsource", "Not enough memory for FLAC");
+            playSourceClose(s);
+            return false;
+        }
+        s->prefetch = prefetch;
+        prefetchStart(prefetch, s->f);
+        if (!flacDecoderInit(s->flac, prefetchReadFn, prefetch)) {
+            ESP_LOGE("playsource", "Cannot decode FLAC file");
+            playSourceClose(s);
+            return false;
+        }
+        s->sampleRate = s->flac->sampleRate;
+        s->length = s->flac->totalSamples;
+        return true;
+    }
+
+    if (!wavParse(s->f, &s->info)) {
+        playSourceClose(s);
+        return false;
+    }
+    s->sampleRate = s->info.sampleRate;
+    s->bytesLeft = s->info.dataBytes;
+    if (s->info.format == WAVE_FORMAT_IMA_ADPCM) {
+        if (s->info.blockAlign > MAX_ADPCM_BLOCK) {
+            ESP_LOGE("playsource", "Unsupported ADPCM block size %u", s->info.blockAlign);
+            playSourceClose(s);
+            return false;
+        }
+        s->kind = SOURCE_ADPCM;
+        s->samplesLeft = s->info.sampleLength ? s->info.sampleLength : UINT32_MAX;
+        s->length = s->info.sampleLength ? s->info.sampleLength
+                  : s->info.dataBytes / s->info.blockAlign * ADPCM_SAMPLES_PER_BLOCK(s->info.blockAlign);
+    } else {
+        s->kind = SOURCE_PCM;
+        s->length = s->info.dataBytes / s->info.blockAlign;
+    }
+    // file stays at the first data byte, reading ahead starts from there
+    s->prefetch = prefetch;
+    prefetchStart(prefetch, s->f);
+    ESP_LOGI("playsource", "Format 0x%x, %u channels, %u bits, %u Hz", s->info.format,
+             s->info.channels, s->info.bitsPerSample, s->info.sampleRate);
+    return true;
+}
+
+// Decodes the next ADPCM or FLAC block into blockSamples
+static void nextBlock(PlaySource *s) {
+    s->blockIndex = 0;
+    s->blockCount = 0;
+    if (s->kind == SOURCE_FLAC) {
+        s->blockCount = flacDecodeFrame(s->flac, blockSamples);
+        return;
+    }
+    size_t bytes = s->info.blockAlign < s->bytesLeft ? s->info.blockAlign : s->bytesLeft;
+    bytes = prefetchRead(s->prefetch, rawBuffer, bytes);
+    s->bytesLeft -= bytes;
+    size_t count = adpcmDecodeBlock(rawBuffer, bytes, blockSamples);
+    s->blockCount = count < s->samplesLeft ? count : s->samplesLeft;
+    s->samplesLeft -= s->blockCount;
+}
+
+size_t playSourceRead(PlaySource *s, int16_t *out, size_t count) {
+    if (s->kind == SOURCE_PCM) {
+        size_t frameBytes = s->info.blockAlign;
+        size_t frames = PCM_READ_BYTES / frameBytes;
+        if (frames > count) {
+            frames = count;
+        }
+        if (frames > s->bytesLeft / frameBytes) {
+            frames = s->bytesLeft / frameBytes;
+        }
+        frames = prefetchRead(s->prefetch, rawBuffer, frames * frameBytes) / frameBytes;
+        s->bytesLeft -= frames * frameBytes;
+        convertWavToMono16(rawBuffer, frames, s->info.channels, s->info.bitsPerSample,
+                           s->info.format == WAVE_FORMAT_IEEE_FLOAT, out);
+        s->position += frames;
+        return frames;
+    }
+
+    if (s->blockIndex == s->blockCount) {
+        nextBlock(s);
+    }
+    size_t available = s->blockCount - s->blockIndex;
+    if (count > available) {
+        count = available;
+    }
+    memcpy(out, blockSamples + s->blockIndex, count * sizeof(int16_t));
+    s->blockIndex += count;
+    s->position += count;
+    return count;
+}
+
+// Restarts the read-ahead at a file offset, the prefetcher's first read
+// ends at the next cluster boundary, so this costs at most one cluster
+static bool moveTo(PlaySource *s, uint32_t offset) {
+    prefetchStop(s->prefetch);
+    bool moved = fseek(s->f, offset, SEEK_SET) == 0;
+    prefetchStart(s->prefetch, s->f);
+    return moved;
+}
+
+// The decoder reads straight from the file while seeking, the read-ahead
+// would fetch a second cluster behind every guess that is thrown away.
+// Reads stop at cluster boundaries like the read-ahead's.
+static size_t fileReadFn(void *ctx, uint8_t *buf, size_t len) {
+    PlaySource *s = ctx;
+    size_t room = s->prefetch->blockSize - ftell(s->f) % s->prefetch->blockSize;
+    return fread(buf, 1, len < room ? len : room, s->f);
+}
+
+// Points the decoder at a file offset, reading directly
+static bool restartAt(PlaySource *s, uint32_t offset) {
+    if (fseek(s->f, offset, SEEK_SET) != 0) {
+        return false;
+    }
+    flacDecoderRestart(s->flac, offset);
+    return true;
+}
+
+// Frames carry their first sample number but nothing points to them, so
+// the frame holding the sample is searched for: guesses interpolate from
+// the bitrate between the known frames around it, a guess that did not
+// pay off is followed by halving the range, which bounds the search for
+// files whose bitrate swings a lot. Guesses go to cluster boundaries, so
+// each costs one cluster read.
+static bool seekFlac(PlaySource *s, uint32_t sample) {
+    FlacDecoder *d = s->flac;
+    uint32_t cluster = s->prefetch->blockSize;
+    prefetchStop(s->prefetch);
+    d->read = fileReadFn;
+    d->ctx = s;
+    bool moved = true;
+
+    uint32_t lo = d->firstFrame;
+    uint32_t loSample = 0;
+    uint32_t hi = s->fileSize;
+    uint32_t hiSample = s->length;
+    // the decoder's current frame is the one at lo
+    bool atLo = false;
+    bool found = false;
+    bool interpolate = true;
+    // the frame decoded last bounds the search from one side, skips stay close to it
+    if (d->frameOffset > lo && d->frameSample <= sample) {
+        lo = d->frameOffset;
+        loSample = d->frameSample;
+    } else if (d->frameOffset > lo) {
+        hi = d->frameOffset;
+        hiSample = d->frameSample;
+    }
+    if (s->length > 0 && sample >= s->length) {
+        // nothing left to play, the decoder only has to find the end
+        moved = restartAt(s, s->fileSize);
+        found = true;
+    }
+    for (int probe = 0; !found && probe < FLAC_SEEK_PROBES && sample - loSample > FLAC_SEEK_LINEAR
+                        && hi - lo > cluster; probe++) {
+        uint32_t range = hi - lo;
+        uint32_t offset = lo + range / 2;
+        if (interpolate && hiSample > sample) {
+            offset = lo + (uint64_t)(sample - loSample) * range / (hiSample - loSample);
+        }
+        // the range is longer than a cluster, so it holds a boundary
+        offset -= offset % cluster;
+        if (offset <= lo) {
+            offset += cluster;
+        }
+        if (!(moved = restartAt(s, offset))) {
+            break;
+        }
+        nextBlock(s);
+        atLo = false;
+        if (s->blockCount == 0 || d->frameSample > sample) {
+            // no frame before the end, or only later ones
+            hi = offset;
+            hiSample = s->blockCount == 0 ? hiSample : d->frameSample;
+        } else if (sample < d->frameSample + s->blockCount) {
+            s->blockIndex = sample - d->frameSample;
+            found = true;
+        } else {
+            lo = d->frameOffset;
+            loSample = d->frameSample;
+            atLo = true;
+        }
+        // a guess that did not even halve the range is followed by a plain halving
+        interpolate = !interpolate || hi - lo <= range / 2;
+    }
+
+    if (!found && !atLo && moved && (moved = restartAt(s, lo))) {
+        nextBlock(s);
+    }
+    if (!found && moved) {
+        while (s->blockCount > 0 && d->frameSample + s->blockCount <= sample) {
+            nextBlock(s);
+        }
+        s->blockIndex = s->blockCount > 0 && sample > d->frameSample ? sample - d->frameSample : 0;
+    }
+    // the decoder goes on with what it has buffered, the read-ahead from where that ends
+    d->read = prefetchReadFn;
+    d->ctx = s->prefetch;
+    prefetchStart(s->prefetch, s->f);
+    return moved;
+}
+
+bool playSourceSeek(PlaySource *s, uint32_t sample) {
+    if (s->length > 0 && sample > s->length) {
+        sample = s->length;
+    }
+    s->position = sample;
+    s->blockIndex = 0;
+    s->blockCount = 0;
+    if (s->kind == SOURCE_FLAC) {
+        return seekFlac(s, sample);
+    }
+
+    if (s->kind == SOURCE_PCM) {
+        uint32_t offset = sample * s->info.blockAlign;
+        if (offset > s->info.dataBytes) {
+            offset = s->info.dataBytes;
+        }
+        s->bytesLeft = s->info.dataBytes - offset;
+        return moveTo(s, s->info.dataOffset + offset);
+    }
+
+    // ADPCM blocks decode on their own, start with the one holding the sample
+    uint32_t perBlock = ADPCM_SAMPLES_PER_BLOCK(s->info.blockAlign);
+    uint32_t block = sample / perBlock;
+    uint32_t offset = block * s->info.blockAlign;
+    if (offset > s->info.dataBytes) {
+        offset = s->info.dataBytes;
+    }
+    s->bytesLeft = s->info.dataBytes - offset;
+    if (s->info.sampleLength) {
+        s->samplesLeft = s->info.sampleLength - block * perBlock;
+    }
+    if (!moveTo(s, s->info.dataOffset + offset)) {
+        return false;
+    }
+    if (s->bytesLeft > 0) {
+        nextBlock(s);
+        uint32_t skip = sample - block * perBlock;
+        s->blockIndex = skip < s->blockCount ? skip : s->blockCount;
+    }
+    return true;
+}
+
+void playSourceClose(PlaySource *s) {
+    if (s->prefetch != NULL) {
+        prefetchStop(s->prefetch);
+        s->prefetch = NULL;
+    }
+    free(s->flac);
+    s->flac = NULL;
+    if (s->f != NULL) {
+        fclose(s->f);
+        s->f = NULL;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "wavparse.h"
+#include "flac.h"
+#include "prefetch.h"
+
+typedef enum { SOURCE_PCM, SOURCE_ADPCM, SOURCE_FLAC } SourceKind;
+
+// A file opened for playback, read as mono 16-bit samples at the file's
+// own rate. Decoding uses static buffers, so only one source can be
+// open at a time. Only the FLAC decoder is allocated, once per file.
+// Audio data comes through the prefetcher, the file is only read
+// directly for the WAV header and while seeking.
+typedef struct {
+    FILE *f;
+    Prefetch *prefetch; // NULL until the header is parsed
+    SourceKind kind;
+    WavInfo info;
+    uint32_t sampleRate;
+    uint32_t bytesLeft; // PCM and ADPCM data still in the file
+    uint32_t samplesLeft; // ADPCM, the last block is padded
+    FlacDecoder *flac;
+    uint32_t fileSize; // FLAC, upper bound of the seek search
+    uint32_t length; // in samples, 0 if the file does not tell
+    uint32_t position; // of the next sample read
+    // decoded block of ADPCM or FLAC
+    size_t blockIndex;
+    size_t blockCount;
+} PlaySource;
+
+bool playSourceOpen(PlaySource *s, const char *filename, Prefetch *prefetch);
+// Returns up to count samples, 0 at the end of the file
+size_t playSourceRead(PlaySource *s, int16_t *out, size_t count);
+// Moves to the given sample, the next read starts exactly there. Past the
+// end the next read returns 0. False if the file could not be repositioned.
+bool playSourceSeek(PlaySource *s, uint32_t sample);
+void playSourceClose(PlaySource *s);
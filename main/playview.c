@@ -0,0 +1,112 @@
+#include "playview.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// an indexed canvas starts with its palette, two 32-bit colors for 1 bit
+#define WAVE_PALETTE_BYTES 8
+#define WAVE_STRIDE (PLAY_WAVE_WIDTH / 8)
+#define WAVE_TOP 8
+
+// the coarsest level that fills the width has fewer than this many pairs
+static PeakPair pairs[PEAK_FACTOR * PLAY_WAVE_WIDTH];
+
+static inline uint8_t *waveRow(PlayView *view, int y) {
+    return view->waveBuffer + WAVE_PALETTE_BYTES + y * WAVE_STRIDE;
+}
+
+// Row of the canvas a sample of the overview falls on
+static int waveY(int8_t value) {
+    int y = PLAY_WAVE_HEIGHT / 2 - value * (PLAY_WAVE_HEIGHT / 2) / 128;
+    return y < PLAY_WAVE_HEIGHT ? y : PLAY_WAVE_HEIGHT - 1;
+}
+
+// Flips the columns from a up to b, in either order
+static void invertColumns(PlayView *view, int a, int b) {
+    int from = a < b ? a : b;
+    int to = a < b ? b : a;
+    if (from == to) {
+        return;
+    }
+    for (int y = 0; y < PLAY_WAVE_HEIGHT; y++) {
+        uint8_t *row = waveRow(view, y);
+        for (int x = from; x < to; x++) {
+            row[x / 8] ^= 0x80 >> (x % 8);
+        }
+    }
+    lv_area_t area = { from, WAVE_TOP, to - 1, WAVE_TOP + PLAY_WAVE_HEIGHT - 1 };
+    lv_obj_invalidate_area(view->wave, &area);
+}
+
+void playViewInit(PlayView *view) {
+    memset(view, 0, sizeof(PlayView));
+    view->screen = lv_obj_create(NULL);
+    view->name = lv_label_create(view->screen);
+    lv_label_set_long_mode(view->name, LV_LABEL_LONG_CLIP);
+    lv_obj_set_size(view->name, 88, 8);
+    lv_obj_set_pos(view->name, 0, 0);
+    view->time = lv_label_create(view->screen);
+    lv_obj_set_pos(view->time, 88, 0);
+
+    view->wave = lv_canvas_create(view->screen);
+    lv_canvas_set_buffer(view->wave, view->waveBuffer, PLAY_WAVE_WIDTH, PLAY_WAVE_HEIGHT, LV_IMG_CF_INDEXED_1BIT);
+    // index 1 lights the pixel, like black everywhere else on this panel
+    lv_canvas_set_palette(view->wave, 0, lv_color_white());
+    lv_canvas_set_palette(view->wave, 1, lv_color_black());
+    lv_obj_set_pos(view->wave, 0, WAVE_TOP);
+}
+
+void playViewOpen(PlayView *view, const char *name, const char *peakFile, uint32_t lengthMs) {
+    lv_label_set_text(view->name, name);
+    lv_label_set_text(view->time, "");
+    view->shownSeconds = UINT32_MAX;
+    view->played = 0;
+    view->lengthMs = lengthMs;
+    memset(view->waveBuffer + WAVE_PALETTE_BYTES, 0, sizeof(view->waveBuffer) - WAVE_PALETTE_BYTES);
+
+    PeakHeader header;
+    int n = peakLoad(peakFile, PLAY_WAVE_WIDTH, pairs, sizeof(pairs) / sizeof(PeakPair), &header);
+    if (n > 0 && header.sampleRate > 0) {
+        view->lengthMs = (uint64_t)header.samples * 1000 / header.sampleRate;
+    }
+    for (int x = 0; x < PLAY_WAVE_WIDTH && n > 0; x++) {
+        // several pairs per column for long files, one stretched over several for short ones
+        int first = x * n / PLAY_WAVE_WIDTH;
+        int last = (x + 1) * n / PLAY_WAVE_WIDTH;
+        if (last <= first) {
+            last = first + 1;
+        }
+        int8_t lo = pairs[first].min;
+        int8_t hi = pairs[first].max;
+        for (int i = first + 1; i < last; i++) {
+            lo = pairs[i].min < lo ? pairs[i].min : lo;
+            hi = pairs[i].max > hi ? pairs[i].max : hi;
+        }
+        for (int y = waveY(hi); y <= waveY(lo); y++) {
+            waveRow(view, y)[x / 8] |= 0x80 >> (x % 8);
+        }
+    }
+    lv_obj_invalidate(view->wave);
+}
+
+void playViewShow(PlayView *view, lv_disp_t *disp, uint32_t positionMs) {
+    uint32_t seconds = positionMs / 1000;
+    if (seconds != view->shownSeconds) {
+        char text[8];
+        snprintf(text, sizeof(text), "%2u:%02u", seconds / 60, seconds % 60);
+        lv_label_set_text(view->time, text);
+        view->shownSeconds = seconds;
+    }
+    int played = 0;
+    if (view->lengthMs > 0) {
+        played = (uint64_t)positionMs * PLAY_WAVE_WIDTH / view->lengthMs;
+        played = played < PLAY_WAVE_WIDTH ? played : PLAY_WAVE_WIDTH;
+    }
+    invertColumns(view, view->played, played);
+    view->played = played;
+
+    if (lv_scr_act() != view->screen) {
+        lv_scr_load(view->screen);
+    }
+    lv_refr_now(disp);
+}
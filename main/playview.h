@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lvgl.h"
+
+#include "peaks.h"
+
+// Playback screen: name, position and the waveform of the whole file
+// from its overview, with the part already played shown inverted.
+// Moving the position only inverts the columns it passed.
+#define PLAY_WAVE_WIDTH 128
+#define PLAY_WAVE_HEIGHT 56
+
+typedef struct {
+    lv_obj_t *screen;
+    lv_obj_t *name;
+    lv_obj_t *time;
+    lv_obj_t *wave;
+    uint8_t waveBuffer[LV_CANVAS_BUF_SIZE_INDEXED_1BIT(PLAY_WAVE_WIDTH, PLAY_WAVE_HEIGHT)];
+    uint32_t lengthMs;
+    int played; // columns shown inverted
+    uint32_t shownSeconds;
+} PlayView;
+
+void playViewInit(PlayView *view);
+// Draws the waveform from peakFile, blank if there is no overview yet,
+// lengthMs is used when there is none
+void playViewOpen(PlayView *view, const char *name, const char *peakFile, uint32_t lengthMs);
+// Moves the position and refreshes the display
+void playViewShow(PlayView *view, lv_disp_t *disp, uint32_t positionMs);
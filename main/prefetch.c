@@ -0,0 +1,133 @@
+#include "prefetch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <freertos/task.h>
+
+#include "esp_log.h"
+
+#define PREFETCH_STACK 3072
+
+static void prefetchTask(void *pvParameters) {
+    Prefetch *p = pvParameters;
+
+    while (true) {
+        xSemaphoreTake(p->startSem, portMAX_DELAY);
+        bool eof = false;
+        size_t size = p->firstSize;
+        while (!eof) {
+            xSemaphoreTake(p->freeSem, portMAX_DELAY);
+            if (p->stop) {
+                break;
+            }
+            int i = p->readIndex;
+            p->fill[i] = fread(p->blocks[i], 1, size, p->f);
+            eof = (p->fill[i] < size);
+            p->last[i] = eof;
+            size = p->blockSize;
+            p->readIndex = (i + 1) % p->depth;
+            xSemaphoreGive(p->fullSem);
+        }
+        xSemaphoreGive(p->idleSem);
+    }
+}
+
+bool prefetchInit(Prefetch *p, int depth, size_t blockSize, UBaseType_t priority, BaseType_t core) {
+    memset(p, 0, sizeof(Prefetch));
+    if (depth < 2) {
+        depth = 2;
+    } else if (depth > PREFETCH_MAX_DEPTH) {
+        depth = PREFETCH_MAX_DEPTH;
+    }
+    p->depth = depth;
+    p->blockSize = blockSize;
+    for (int i = 0; i < depth; i++) {
+        p->blocks[i] = malloc(blockSize);
+        if (p->blocks[i] == NULL) {
+            ESP_LOGE("prefetch", "Failed to allocate block %d", i);
+            return false;
+        }
+    }
+    p->startSem = xSemaphoreCreateBinary();
+    p->idleSem = xSemaphoreCreateBinary();
+    p->freeSem = xSemaphoreCreateCounting(depth + 1, 0);
+    p->fullSem = xSemaphoreCreateCounting(depth, 0);
+    ESP_LOGI("prefetch", "%d blocks of %u bytes", depth, blockSize);
+    return xTaskCreatePinnedToCore(prefetchTask, "PREFETCH", PREFETCH_STACK, p, priority, NULL, core) == pdPASS;
+}
+
+void prefetchStart(Prefetch *p, FILE *f) {
+    p->f = f;
+    p->firstSize = p->blockSize - ftell(f) % p->blockSize;
+    p->stop = false;
+    p->readIndex = 0;
+    p->useIndex = 0;
+    p->usePos = 0;
+    p->holding = false;
+    p->eof = false;
+    p->started = false;
+    atomic_store(&p->underruns, 0);
+    atomic_store(&p->maxWait, 0);
+    for (int i = 0; i < p->depth; i++) {
+        xSemaphoreGive(p->freeSem);
+    }
+    xSemaphoreGive(p->startSem);
+}
+
+size_t prefetchRead(Prefetch *p, void *dst, size_t len) {
+    uint8_t *out = dst;
+    size_t done = 0;
+    while (done < len && !p->eof) {
+        if (!p->holding) {
+            if (xSemaphoreTake(p->fullSem, 0) != pdTRUE) {
+                // the very first block is always waited for, that is not an underrun
+                TickType_t start = xTaskGetTickCount();
+                xSemaphoreTake(p->fullSem, portMAX_DELAY);
+                if (p->started) {
+                    unsigned wait = xTaskGetTickCount() - start;
+                    atomic_fetch_add(&p->underruns, 1);
+                    if (wait > atomic_load(&p->maxWait)) {
+                        atomic_store(&p->maxWait, wait);
+                    }
+                }
+            }
+            p->started = true;
+            p->holding = true;
+            p->usePos = 0;
+        }
+
+        size_t fill = p->fill[p->useIndex];
+        size_t count = fill - p->usePos;
+        if (count > len - done) {
+            count = len - done;
+        }
+        memcpy(out + done, p->blocks[p->useIndex] + p->usePos, count);
+        p->usePos += count;
+        done += count;
+
+        if (p->usePos == fill) {
+            if (p->last[p->useIndex]) {
+                p->eof = true;
+            } else {
+                p->holding = false;
+                p->useIndex = (p->useIndex + 1) % p->depth;
+                xSemaphoreGive(p->freeSem);
+            }
+        }
+    }
+    return done;
+}
+
+void prefetchStop(Prefetch *p) {
+    p->stop = true;
+    // wakes the reader if it waits for a free block
+    xSemaphoreGive(p->freeSem);
+    xSemaphoreTake(p->idleSem, portMAX_DELAY);
+    // leave both counts at zero for the next file
+    while (xSemaphoreTake(p->freeSem, 0) == pdTRUE) {
+    }
+    while (xSemaphoreTake(p->fullSem, 0) == pdTRUE) {
+    }
+    p->f = NULL;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Reads a file ahead of the player in its own task. The reader fills
+// up to `depth` blocks while the player is still busy with older ones,
+// so a slow SD access only empties the read-ahead instead of the I2S DMA.
+// Reads never cross a multiple of blockSize in the file: the first one
+// only goes up to the next boundary, so with cluster sized blocks every
+// read after it is one whole cluster, wherever playback started.
+#define PREFETCH_MAX_DEPTH 8
+
+typedef struct {
+    uint8_t *blocks[PREFETCH_MAX_DEPTH];
+    size_t fill[PREFETCH_MAX_DEPTH]; // valid bytes
+    bool last[PREFETCH_MAX_DEPTH]; // block reached the end of the file
+    int depth;
+    size_t blockSize;
+    size_t firstSize; // of the first read after prefetchStart
+
+    FILE *f;
+    atomic_bool stop;
+    SemaphoreHandle_t startSem;
+    SemaphoreHandle_t idleSem;
+    SemaphoreHandle_t freeSem; // blocks the reader may fill
+    SemaphoreHandle_t fullSem; // blocks the player may read
+
+    // reader side
+    int readIndex;
+    // player side
+    int useIndex;
+    size_t usePos;
+    bool holding; // useIndex was taken from fullSem and not given back yet
+    bool eof;
+    bool started; // first block arrived
+
+    // times the player found no block ready and had to wait
+    atomic_uint underruns;
+    // longest such wait in ticks
+    atomic_uint maxWait;
+} Prefetch;
+
+// Allocates the blocks and starts the reader task on the given core
+bool prefetchInit(Prefetch *p, int depth, size_t blockSize, UBaseType_t priority, BaseType_t core);
+// Reading continues from the current position of f, f must not be used until prefetchStop.
+// Seeking is prefetchStop, fseek and prefetchStart again.
+void prefetchStart(Prefetch *p, FILE *f);
+// Copies len bytes, fewer only at the end of the file. Waits for the reader if needed.
+size_t prefetchRead(Prefetch *p, void *dst, size_t len);
+// Returns once the reader has let go of the file
+void prefetchStop(Prefetch *p);
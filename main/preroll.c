@@ -0,0 +1,70 @@
+#include "preroll.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+
+bool preRollInit(PreRoll *p, size_t samples) {
+    p->inPsram = true;
+    p->data = heap_caps_malloc(samples * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+    if (p->data == NULL) {
+        p->inPsram = false;
+        p->data = heap_caps_malloc(samples * sizeof(int16_t), MALLOC_CAP_8BIT);
+    }
+    if (p->data == NULL) {
+        p->size = 0;
+        return false;
+    }
+    p->size = samples;
+    preRollClear(p);
+    return true;
+}
+
+void preRollFree(PreRoll *p) {
+    heap_caps_free(p->data);
+    p->data = NULL;
+    p->size = 0;
+}
+
+void preRollClear(PreRoll *p) {
+    p->head = 0;
+    p->count = 0;
+}
+
+void preRollPush(PreRoll *p, const int16_t *src, size_t count) {
+    if (count >= p->size) {
+        // only the newest part fits
+        src += count - p->size;
+        count = p->size;
+    }
+    size_t first = p->size - p->head;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(p->data + p->head, src, first * sizeof(int16_t));
+    memcpy(p->data, src + first, (count - first) * sizeof(int16_t));
+
+    p->head = (p->head + count) % p->size;
+    p->count += count;
+    if (p->count > p->size) {
+        p->count = p->size;
+    }
+}
+
+size_t preRollRead(const PreRoll *p, size_t offset, int16_t *dst, size_t count) {
+    if (offset >= p->count) {
+        return 0;
+    }
+    if (count > p->count - offset) {
+        count = p->count - offset;
+    }
+    // oldest sample sits count samples behind head
+    size_t start = (p->head + p->size - p->count + offset) % p->size;
+    size_t first = p->size - start;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(dst, p->data + start, first * sizeof(int16_t));
+    memcpy(dst + first, p->data, (count - first) * sizeof(int16_t));
+    return count;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Keeps the last `size` converted samples while nothing is being recorded.
+// New samples overwrite the oldest ones. Not thread safe, the owner
+// has to make sure only one task touches it at a time.
+typedef struct {
+    int16_t *data;
+    size_t size; // capacity in samples
+    size_t head; // next sample to be overwritten
+    size_t count; // valid samples, at most size
+    bool inPsram;
+} PreRoll;
+
+// Uses PSRAM when there is some, internal RAM otherwise
+bool preRollInit(PreRoll *p, size_t samples);
+void preRollFree(PreRoll *p);
+void preRollClear(PreRoll *p);
+void preRollPush(PreRoll *p, const int16_t *src, size_t count);
+// Copies up to count samples starting offset samples after the oldest one
+size_t preRollRead(const PreRoll *p, size_t offset, int16_t *dst, size_t count);
@@ -8,6 +8,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
 #include <freertos/semphr.h> 
+#include <freertos/queue.h>
 
 // SD card
 #include <sys/unistd.h>
@@ -15,10 +16,34 @@
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
 #include <string.h>
+#include <stdlib.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
 
 #include "wav.h"
+#include "spscring.h"
+#include "wavwriter.h"
+#include "preroll.h"
+#include "convert.h"
+#include "adpcm.h"
+#include "flac.h"
+#include "decimator.h"
+#include "playsource.h"
+#include "resampler.h"
+#include "stretch.h"
+#include "vad.h"
+#include "limiter.h"
+#include "align.h"
+#include "mixer.h"
+#include "prefetch.h"
+#include "catalog.h"
+#include "peaks.h"
+#include "streamctl.h"
+#include "pipestats.h"
+#include "tasks.h"
 
 #define MIC_DOUT GPIO_NUM_16
 #define MIC_BCLK GPIO_NUM_17
@@ -30,36 +55,251 @@
 
 #define LED_PIN GPIO_NUM_26
 
-#define SAMPLING_RATE 44100
+// the SPH0645 mic needs a 32-64 kHz clock, lower rates are decimated from 48 kHz
+typedef struct {
+    uint32_t rate; // of the file
+    uint32_t micRate;
+    int decimation;
+} RateProfile;
+
+static const RateProfile rateProfiles[] = {
+    [RATE_48K] = { 48000, 48000, 1 },
+    [RATE_44K] = { 44100, 44100, 1 },
+    [RATE_16K] = { 16000, 48000, 3 },
+    [RATE_8K] = { 8000, 48000, 6 },
+};
+#define MAX_SAMPLING_RATE 48000
+// amp always runs at this rate, other files are resampled
+#define AMP_RATE 44100
 #define BUFFER_SIZE 1024
 #define WAV_BUFFER_COUNT (BUFFER_SIZE / 4 / sizeof(int16_t))
+// one mic DMA buffer per read, so a block is handed over as soon as it is
+// complete; as many of them as the default 6 x 240 frames hold
+#define MIC_DMA_FRAMES (BUFFER_SIZE / 8)
+#define MIC_DMA_DESC 12
 #define RECORDING_SAMPLES 65536 * 4
 
 #define FILENAME_LEN 32
 
-#define TASK_STACK 4096
+// samples buffered between capture and SD writer (32768 samples is ~0.74 s)
+#define CAPTURE_RING_SAMPLES 32768
+// writer wakes up once this many samples are waiting and writes them at once
+#define WRITER_CHUNK_SAMPLES 4096
+
+// audio kept from before the record button was pressed, 0 disables pre-roll
+#define PREROLL_MS 1000
+// a gated recording keeps this much of the silence before speech
+#define GATE_PREROLL_MS 250
+// gaps marked in one file, later ones are still removed
+#define GATE_MAX_CUES 512
+
+// the manager task carries out commands one at a time, in the order they came
+#define COMMAND_QUEUE_LEN 8
+// a command that cannot be queued for this long is dropped
+#define COMMAND_SEND_MS 2000
+// longer than one I2S block plus one source chunk, a stream that takes this long is stuck
+#define STOP_TIMEOUT_MS 500
+// the recorder may have to wait for the last file to be closed
+#define START_TIMEOUT_MS 1000
 
-typedef enum { RECORD, PLAY, REC_STOP, PLAY_STOP, END } CmdType;
+typedef enum { RECORD, PLAY, REC_STOP, PLAY_STOP, END, OVERDUB, MIX } CmdType;
 typedef struct {
     CmdType type;
     char filename[FILENAME_LEN];
+    char take[FILENAME_LEN]; // OVERDUB and MIX
+    char mix[FILENAME_LEN]; // MIX
 } RecPlayCommand;
 
-QueueHandle_t recPlayQueue;
+CommandQueue recPlayQueue;
 TaskHandle_t recPlayManagerTaskHandle;
 
-SemaphoreHandle_t recSem;
-SemaphoreHandle_t playSem;
+// both streams can run at the same time, only the manager starts and stops them
+static StreamControl recorder;
+static StreamControl player;
 
 volatile bool recPlayMgrError = false;
 
+// set by the manager while the stream is idle
 static char recFileName[FILENAME_LEN];
 static char playFileName[FILENAME_LEN];
-static volatile bool recContinue;
-static volatile bool playContinue;
 
-static char buffer[BUFFER_SIZE];
-static int16_t wavBuffer[WAV_BUFFER_COUNT];
+// An overdub plays a file while a take is recorded over it, at the file's
+// rate. The recorder starts first, then the player sends a click and
+// ALIGN_LEAD_IN_MS of silence ahead of the file, and the writer finds the
+// click in the take to line it up (align.h).
+// set by the manager while both streams are idle, each copies it when started
+static volatile bool overdub;
+static volatile RecRate overdubRate;
+// the recorder runs, the player may start the amp
+static SemaphoreHandle_t overdubGoSem;
+// when the click left the amp, low 32 bits of esp_timer with bit 0 set, 0 until then
+static atomic_uint overdubTxTime;
+// samples of the file's rate from the click to the first sample of the file
+static atomic_uint overdubLeadIn;
+// sample of the take that was coming in when the click left the amp, by the clocks
+static atomic_uint overdubTxIndex;
+#define OVERDUB_CLICK_FRAMES 44
+#define OVERDUB_CLICK_LEVEL 24000
+
+// a mix of a file and the take recorded over it is rendered by the
+// background task; names set by the manager while the mix stream is idle
+static StreamControl mixStream;
+static char mixSourceName[FILENAME_LEN];
+static char mixTakeName[FILENAME_LEN];
+static char mixFileName[FILENAME_LEN];
+static Mixer mixer;
+static int16_t mixBuffer[MIX_CHUNK];
+// of the mix in progress, for the UI
+static volatile bool mixing;
+static atomic_uint mixedPercent;
+
+static SpscRing captureRing;
+static TaskHandle_t writerTaskHandle;
+SemaphoreHandle_t writerStartSem;
+SemaphoreHandle_t writerIdleSem;
+// set by the capture task after its last write to the ring
+static volatile bool captureDone;
+// set by the capture task before it starts the writer
+static char writerFileName[FILENAME_LEN];
+static bool writerOverdub;
+static Aligner aligner;
+static int16_t writerBuffer[WRITER_CHUNK_SAMPLES];
+// samples waiting in writerBuffer
+static size_t writerFill;
+// largest absolute sample of the file being written
+static uint16_t writerPeak;
+// waveform overview written along with the file, NULL if it could not be created
+static PeakWriter writerPeakFile;
+static PeakWriter *writerPeaks;
+
+// the writer leaves silence out of gated recordings
+static volatile RecGate recGate = GATE_OFF;
+static Vad vad;
+static int16_t gateFrame[VAD_MAX_FRAME];
+// the closed gate's last samples, written when it opens again
+static PreRoll gatePreRoll;
+// samples since the gate closed, those not in gatePreRoll any more are left out
+static uint32_t gateSkipped;
+static uint32_t gateRemoved;
+static uint32_t gateCues[GATE_MAX_CUES];
+static int gateCueCount;
+static int gateGaps;
+
+static volatile RecFormat recFormat = REC_PCM;
+static volatile RecRate recRate = RATE_44K;
+// rate the capture task runs at, only changed while nothing is recorded
+static volatile RecRate captureRate = RATE_44K;
+static Decimator decimator;
+static AdpcmState adpcmState;
+static uint8_t adpcmBlock[ADPCM_BLOCK_ALIGN];
+// FLAC state is big, it is only allocated while a FLAC file is open
+static FlacEncoder *flacEncoder;
+static uint8_t *flacFrame;
+static uint8_t flacHeader[FLAC_HEADER_SIZE];
+
+// read-ahead for playback, in blocks of one cluster
+#define PREFETCH_DEPTH 2
+
+static Prefetch prefetch;
+// I2S ran out of data to send, counted in the driver callback
+static atomic_uint ampUnderruns;
+
+// player reads the file in chunks of this many samples at the file's rate
+#define SOURCE_CHUNK 256
+static int16_t sourceBuffer[SOURCE_CHUNK];
+// sped up audio, still at the file's rate
+static int16_t stretchBuffer[SOURCE_CHUNK];
+static Stretch stretch;
+static Resampler resampler;
+static volatile PlaySpeed playSpeed = SPEED_100;
+
+// monitoring sends the mic to the amp while recording: the capture task
+// puts every block in a short ring at the mic rate, the player drains it
+#define MONITOR_RING_SAMPLES 1024
+#define MONITOR_CHUNK (BUFFER_SIZE / 8)
+// mic and amp clocks drift apart, more than this waiting is dropped down to one block
+#define MONITOR_MAX_FILL (4 * MONITOR_CHUNK)
+// amp DMA while monitoring, 3 x 64 frames is 4.4 ms where playback has 33 ms
+#define MONITOR_DMA_DESC 3
+#define MONITOR_DMA_FRAMES 64
+// how often the monitoring player looks whether it still should
+#define MONITOR_POLL_MS 50
+#define MONITOR_REPORT_MS 5000
+// same order as MonitorGain, Q8
+static const int32_t monitorGains[] = { 0, 256, 511, 1019 };
+static volatile MonitorGain monitorGain = MONITOR_OFF;
+static SpscRing monitorRing;
+// set by the player while it monitors, the capture task only fills the ring then
+static volatile bool monitorOn;
+// of the capture task's last block, low 32 bits of esp_timer
+static atomic_uint monitorReadTime; // I2S read returned
+static atomic_uint monitorPushTime; // block went into the ring
+static int16_t monitorIn[MONITOR_CHUNK];
+static Resampler monitorResampler;
+static Limiter limiter;
+static TaskHandle_t playerTaskHandle;
+
+// the background task builds missing overviews while nothing is played or recorded
+#define PEAK_SCAN_MS 2000
+static PeakWriter scanPeakFile;
+static int16_t scanBuffer[SOURCE_CHUNK];
+// next catalog entry to look at, -1 once every entry was looked at
+static int peakScanIndex;
+// catalogChanges() when the scan last started over
+static uint32_t peakScanChanges;
+// only one file can be open for playback (playsource.h), whoever opens one holds this
+static SemaphoreHandle_t sourceLock;
+
+// playback position for the UI, in samples of the file
+static volatile bool playing;
+static volatile uint32_t playRate;
+static atomic_uint playedSamples;
+
+// seeks asked for by the UI, the player applies all waiting ones at once
+#define SEEK_QUEUE_LEN 8
+typedef struct {
+    int32_t ms;
+    bool relative;
+    int64_t time; // when it was asked for
+} SeekCommand;
+static QueueHandle_t seekQueue;
+
+// where recently stopped files were left, only the player task uses this
+#define RESUME_SLOTS 8
+typedef struct {
+    char fileName[FILENAME_LEN];
+    uint32_t length; // a new recording under the same name starts from the beginning
+    uint32_t sample;
+    uint32_t lastUsed; // 0 for a free slot
+} ResumePoint;
+static ResumePoint resumePoints[RESUME_SLOTS];
+static uint32_t resumeClock;
+
+static PreRoll preRoll;
+// set by the capture task when recording starts, the writer clears it once the pre-roll is on the card
+static volatile bool preRollBusy;
+
+// removes the mic offset, only used by the capture task
+static DcBlock dcBlock;
+// when the last I2S read returned, low 32 bits of esp_timer
+static uint32_t captureReadTime;
+// this recording is an overdub take
+static bool captureOverdub;
+
+// the capture task meters every block and publishes one window at a time,
+// readers only ever load whole words, so nothing is locked
+#define METER_WINDOW_MS 50
+static Meter meter;
+static atomic_uint meterLevel; // peak << 16 | rms of the last window
+static atomic_uint meterClips; // windows that reached full scale
+static atomic_uint recordedSamples; // of the recording in progress, at the file's rate
+
+// each stream has its own buffers, so recording and playback never share one;
+// the I2S ones stay in internal RAM, where the driver can copy from them fastest
+static DMA_ATTR int32_t micBuffer[BUFFER_SIZE / sizeof(int32_t)];
+static int16_t micSamples[WAV_BUFFER_COUNT];
+static DMA_ATTR int32_t ampBuffer[BUFFER_SIZE / sizeof(int32_t)];
+static int16_t ampSamples[WAV_BUFFER_COUNT];
 
 // .wav_size and .data_bytes still needed
 wav_header WAVHeader = {
@@ -71,8 +311,8 @@ wav_header WAVHeader = {
     .fmt_chunk_size = 16,
     .audio_format = 1,
     .num_channels = 1,
-    .sample_rate = SAMPLING_RATE,
-    .byte_rate = SAMPLING_RATE * 2,
+    .sample_rate = 0, // to be rewritten
+    .byte_rate = 0, // to be rewritten
     .sample_alignment = 2,
     .bit_depth = 16,
     // Data
@@ -80,13 +320,57 @@ wav_header WAVHeader = {
     .data_bytes = 0 // to be rewritten
 };
 
+wav_ima_header WAVImaHeader = {
+    .riff_header = { 'R', 'I', 'F', 'F' },
+    .wave_header = { 'W', 'A', 'V', 'E' },
+    .wav_size = 0, // to be rewritten
+    // Format Header
+    .fmt_header = { 'f', 'm', 't', ' ' },
+    .fmt_chunk_size = 20,
+    .audio_format = ADPCM_FORMAT,
+    .num_channels = 1,
+    .sample_rate = 0, // to be rewritten
+    .byte_rate = 0, // to be rewritten
+    .sample_alignment = ADPCM_BLOCK_ALIGN,
+    .bit_depth = 4,
+    .extra_size = 2,
+    .samples_per_block = ADPCM_SAMPLES_PER_BLOCK(ADPCM_BLOCK_ALIGN),
+    // Fact
+    .fact_header = { 'f', 'a', 'c', 't' },
+    .fact_chunk_size = 4,
+    .sample_length = 0, // to be rewritten
+    // Data
+    .data_header = { 'd', 'a', 't', 'a' },
+    .data_bytes = 0 // to be rewritten
+};
+
+// Cycle counters are per core, a stage that moved to the other one is not counted
+typedef struct {
+    uint32_t cycles;
+    int core;
+} StageClock;
+
+static inline void stageStart(StageClock *c) {
+    c->core = esp_cpu_get_core_id();
+    c->cycles = esp_cpu_get_cycle_count();
+}
+
+static inline void stageEnd(StageClock *c, PipeStage stage) {
+    uint32_t cycles = esp_cpu_get_cycle_count() - c->cycles;
+    if (esp_cpu_get_core_id() == c->core) {
+        pipeStageAdd(stage, cycles);
+    }
+}
+
 i2s_chan_handle_t getMic() {
     i2s_chan_handle_t rx_handle;
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = MIC_DMA_DESC;
+    chan_cfg.dma_frame_num = MIC_DMA_FRAMES;
     i2s_new_channel(&chan_cfg, NULL, &rx_handle);
 
     i2s_std_config_t std_cfg = {
-        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(SAMPLING_RATE),
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(rateProfiles[captureRate].micRate),
         .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_STEREO),
         
         .gpio_cfg = {
@@ -107,13 +391,20 @@ i2s_chan_handle_t getMic() {
     return rx_handle;
 }
 
-i2s_chan_handle_t getAmp() {
+// A short DMA queue for monitoring, the default one for playback
+i2s_chan_handle_t getAmp(bool monitor) {
     i2s_chan_handle_t tx_handle;
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    if (monitor) {
+        chan_cfg.dma_desc_num = MONITOR_DMA_DESC;
+        chan_cfg.dma_frame_num = MONITOR_DMA_FRAMES;
+        // running dry plays silence instead of the last few ms again
+        chan_cfg.auto_clear = true;
+    }
     i2s_new_channel(&chan_cfg, &tx_handle, NULL);
 
     i2s_std_config_t std_cfg = {
-        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(SAMPLING_RATE),
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(AMP_RATE),
         .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_STEREO),
         
         .gpio_cfg = {
@@ -134,85 +425,546 @@ i2s_chan_handle_t getAmp() {
     return tx_handle;
 }
 
+static uint32_t squareRoot(uint32_t x) {
+    uint32_t root = 0;
+    for (uint32_t bit = 1u << 30; bit != 0; bit >>= 2) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+// Turns the finished meter window into one word for the UI
+static void publishLevel() {
+    uint32_t peak = meter.max > -meter.min ? meter.max : -meter.min;
+    uint32_t rms = squareRoot((uint32_t)(meter.energy / meter.count) << METER_ENERGY_SHIFT);
+    atomic_store(&meterLevel, (peak << 16) | rms);
+    if (meter.max == INT16_MAX || meter.min == INT16_MIN) {
+        atomic_fetch_add(&meterClips, 1);
+    }
+    meterReset(&meter);
+}
+
+// Reads one I2S block into micSamples, returns number of samples at the file's rate
+static int captureBlock(i2s_chan_handle_t micHandle) {
+    size_t bytesRead = 0;
+    StageClock clock;
+    stageStart(&clock);
+    i2s_channel_read(micHandle, micBuffer, BUFFER_SIZE, &bytesRead, 1000);
+    stageEnd(&clock, PIPE_MIC_WAIT);
+    stageStart(&clock);
+    uint32_t readTime = esp_timer_get_time();
+    captureReadTime = readTime;
+    if (bytesRead < BUFFER_SIZE) {
+        pipeCount(PIPE_MIC_SHORT_READS);
+    }
+    // one frame is two 32-bit slots
+    int count = bytesRead / 8;
+    convertMicToPcm16Metered(micBuffer, count, micSamples, &dcBlock, &meter);
+    // meter counts every fourth sample at the mic rate
+    if (meter.count * 4 >= rateProfiles[captureRate].micRate * METER_WINDOW_MS / 1000) {
+        publishLevel();
+    }
+    if (monitorOn) {
+        // never blocks either, a full ring drops the block
+        spscRingWrite(&monitorRing, micSamples, count);
+        atomic_store(&monitorReadTime, readTime);
+        atomic_store(&monitorPushTime, (uint32_t)esp_timer_get_time());
+        xTaskNotifyGive(playerTaskHandle);
+    }
+    count = decimatorProcess(&decimator, micSamples, count, micSamples);
+    stageEnd(&clock, PIPE_MIC_CONVERT);
+    return count;
+}
+
+// Sizes the pre-roll for PREROLL_MS at the given rate, so a voice rate
+// does not hold on to the memory a music rate needs. Only the capture
+// task calls it, never while the writer is saving the pre-roll.
+static void sizePreRoll(RecRate rate) {
+    size_t samples = rateProfiles[rate].rate * PREROLL_MS / 1000;
+    if (PREROLL_MS == 0 || (preRoll.data != NULL && preRoll.size == samples)) {
+        preRollClear(&preRoll);
+        return;
+    }
+    // the old one goes first, a larger one may only fit where it was
+    preRollFree(&preRoll);
+    if (!preRollInit(&preRoll, samples)) {
+        // recordings start when the button is pressed then
+        ESP_LOGE("recorder", "Failed to allocate pre-roll, recording without");
+    } else {
+        ESP_LOGI("recorder", "Pre-roll %d ms uses %u bytes of %s", PREROLL_MS, samples * sizeof(int16_t),
+                 preRoll.inPsram ? "PSRAM" : "internal RAM");
+    }
+}
+
+// Switches the capture side to the given rate, must not run while recording
+static void applyRecRate(i2s_chan_handle_t micHandle, RecRate rate) {
+    if (rateProfiles[rate].micRate != rateProfiles[captureRate].micRate) {
+        i2s_std_clk_config_t clkCfg = I2S_STD_CLK_DEFAULT_CONFIG(rateProfiles[rate].micRate);
+        i2s_channel_disable(micHandle);
+        i2s_channel_reconfig_std_clock(micHandle, &clkCfg);
+        i2s_channel_enable(micHandle);
+    }
+    decimatorInit(&decimator, rateProfiles[rate].decimation);
+    dcBlockInit(&dcBlock);
+    // samples at the old rate would play back at the wrong speed
+    sizePreRoll(rate);
+    captureRate = rate;
+    ESP_LOGI("recorder", "Recording at %u Hz", rateProfiles[rate].rate);
+}
+
+// Once the player started the amp, works out which sample of the take
+// was coming in at that moment, from when the last read returned
+static void markOverdubTx(uint32_t recorded) {
+    uint32_t txTime = atomic_load(&overdubTxTime);
+    int32_t since = captureReadTime - txTime;
+    if (txTime == 0 || since < 0) {
+        return;
+    }
+    uint32_t back = (uint64_t)since * rateProfiles[captureRate].rate / 1000000;
+    // the decimator holds back half its length
+    uint32_t held = decimator.factor > 1 ? decimator.taps / 2 / decimator.factor : 0;
+    atomic_store(&overdubTxIndex, recorded + held > back ? recorded + held - back : 0);
+}
+
+static bool IRAM_ATTR onMicOverrun(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx) {
+    pipeCount(PIPE_MIC_OVERRUNS);
+    return false;
+}
+
 void recorderTask(void *pvParameters) {
     gpio_set_direction(LED_PIN, GPIO_MODE_OUTPUT);
     
     i2s_chan_handle_t micHandle = getMic();
-    size_t bytesRead = 0;
+    i2s_event_callbacks_t callbacks = {
+        .on_recv_q_ovf = onMicOverrun,
+    };
+    i2s_channel_register_event_callback(micHandle, &callbacks, NULL);
     
     // Read and discard, so we can get stable value
     printf("Starting mic\n");
     i2s_channel_enable(micHandle);
+    
+    dcBlockInit(&dcBlock);
+    decimatorInit(&decimator, rateProfiles[captureRate].decimation);
+    meterReset(&meter);
 
     while (true) {
-        // wait until called for
-        xSemaphoreTake(recSem, portMAX_DELAY);
-        recContinue = true;
+        // writer may still be saving the previous pre-roll
+        if (recRate != captureRate && !preRollBusy) {
+            applyRecRate(micHandle, recRate);
+        }
+        if (preRoll.data == NULL) {
+            // no pre-roll, wait until called for
+            streamWaitStart(&recorder, portMAX_DELAY);
+        } else if (!streamWaitStart(&recorder, 0)) {
+            // mic keeps running, the last PREROLL_MS go to the pre-roll ring
+            int count = captureBlock(micHandle);
+            // writer may still be saving the previous pre-roll
+            if (!preRollBusy) {
+                preRollPush(&preRoll, micSamples, count);
+            }
+            continue;
+        }
         
-        ESP_LOGI("recorder", "Opening file %s", recFileName);
-        FILE *f = fopen(recFileName, "w");
-        if (f == NULL) {
-            ESP_LOGE("recorder", "Failed to open file for writing");
-            return;
+        // previous file has to be closed before the ring can be reused
+        xSemaphoreTake(writerIdleSem, portMAX_DELAY);
+        captureOverdub = overdub;
+        // a take is recorded at the rate of the file it is played over
+        RecRate rate = captureOverdub ? overdubRate : recRate;
+        if (rate != captureRate) {
+            applyRecRate(micHandle, rate);
         }
-        // Leave some place for header
-        fseek(f, sizeof(wav_header), SEEK_SET);
+        strcpy(writerFileName, recFileName);
+        writerOverdub = captureOverdub;
+        atomic_store(&overdubTxIndex, ALIGN_UNKNOWN);
+        spscRingReset(&captureRing);
+        captureDone = false;
+        atomic_store(&recordedSamples, 0);
+        // pre-roll is frozen from now on and goes to the file first, a take starts with the click instead
+        preRollBusy = preRoll.data != NULL && !captureOverdub;
+        xSemaphoreGive(writerStartSem);
         
-        // time to get average value, which can be subtracted later
-        int64_t bias = 0;
-        const int time = 100;
-        for (int i=0; i < (SAMPLING_RATE * 8 * time / BUFFER_SIZE / 1000); i++) {
-            i2s_channel_read(micHandle, buffer, BUFFER_SIZE, &bytesRead, 1000);
-            
-            int bufferIndex = 0;
-            while (bufferIndex < bytesRead) {
-                int32_t *ptr = (int32_t *)(buffer + bufferIndex + 4);
-                bias += *ptr;
-                bufferIndex += 8;
-            }
+        if (preRoll.data == NULL) {
+            // filters were not running while idle, start again from the first sample
+            dcBlockInit(&dcBlock);
+            decimatorInit(&decimator, rateProfiles[captureRate].decimation);
         }
-        bias /= SAMPLING_RATE * time / 1000;
-        printf("Bias: %lld\n", bias);
         
         ESP_LOGI("recorder", "Starting recording");
         gpio_set_level(LED_PIN, 1);
+        uint32_t recorded = 0;
+        streamRunning(&recorder);
+        // the idle player may have to monitor now
+        xTaskNotifyGive(playerTaskHandle);
         
-        int wavTotalSamples = 0;
-        while (recContinue) {
-            i2s_channel_read(micHandle, buffer, BUFFER_SIZE, &bytesRead, 1000);
-            
-            int bufferIndex = 0;
-            int wavBufferIndex = 0;
-            while (bufferIndex < bytesRead) {
-                // get pointer to the left channel 32-bit sample
-                int32_t *ptr = (int32_t *)(buffer + bufferIndex + 4);
-                // do the magic
-                int16_t sample = (*ptr - bias) >> 14;
-                wavBuffer[wavBufferIndex] = sample;
-                // skip 4 bytes for each channel
-                bufferIndex += 8;
-                wavBufferIndex++;
+        // stops within one I2S block of being told to
+        while (recorder.run) {
+            int count = captureBlock(micHandle);
+            recorded += count;
+            // before the block reaches the writer, which looks for the click from there
+            if (captureOverdub && atomic_load(&overdubTxIndex) == ALIGN_UNKNOWN) {
+                markOverdubTx(recorded);
+            }
+            // never blocks, if the writer falls behind the block is dropped and counted
+            if (spscRingWrite(&captureRing, micSamples, count) < count) {
+                pipeCount(PIPE_RING_OVERRUNS);
+            }
+            atomic_store(&recordedSamples, recorded);
+            if (spscRingFill(&captureRing) >= WRITER_CHUNK_SAMPLES) {
+                xTaskNotifyGive(writerTaskHandle);
             }
-            fwrite(wavBuffer, sizeof(wavBuffer), 1, f);
-            wavTotalSamples += wavBufferIndex;
         }
         ESP_LOGI("recorder", "Ending recording");
         gpio_set_level(LED_PIN, 0);
         
-        rewind(f);
-        
-        WAVHeader.data_bytes = 2 * wavTotalSamples;
-        WAVHeader.wav_size = WAVHeader.data_bytes + sizeof(WAVHeader) - 8; 
-        fwrite(&WAVHeader, sizeof(WAVHeader), 1, f);
-        fclose(f);
+        captureDone = true;
+        xTaskNotifyGive(writerTaskHandle);
+        // the writer finishes the file on its own
+        streamStopped(&recorder);
     }
     // this will never happen but whatever
     i2s_channel_disable(micHandle);
     i2s_del_channel(micHandle);
 }
 
+// Encodes writerBuffer in the given format and passes it to the file,
+// wav is NULL when the file could not be opened and the data is dropped
+static void storeSamples(WavWriter *wav, RecFormat format) {
+    bool ok = true;
+    for (size_t i = 0; i < writerFill; i++) {
+        int level = abs(writerBuffer[i]);
+        if (level > writerPeak) {
+            writerPeak = level;
+        }
+    }
+    if (writerPeaks != NULL) {
+        peakWriterAdd(writerPeaks, writerBuffer, writerFill);
+    }
+    StageClock clock;
+    stageStart(&clock);
+    const void *data = writerBuffer;
+    size_t bytes = writerFill * sizeof(int16_t);
+    if (wav == NULL) {
+        // nowhere to write
+        bytes = 0;
+    } else if (format == REC_FLAC) {
+        bytes = flacEncodeFrame(flacEncoder, writerBuffer, writerFill, flacFrame);
+        data = flacFrame;
+        stageEnd(&clock, PIPE_ENCODE);
+    } else if (format == REC_ADPCM) {
+        // last block of the file may be short, pad it with the last sample
+        int samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(ADPCM_BLOCK_ALIGN);
+        for (int i = writerFill; i < samplesPerBlock; i++) {
+            writerBuffer[i] = writerFill > 0 ? writerBuffer[writerFill - 1] : 0;
+        }
+        adpcmEncodeBlock(&adpcmState, writerBuffer, adpcmBlock);
+        data = adpcmBlock;
+        bytes = ADPCM_BLOCK_ALIGN;
+        stageEnd(&clock, PIPE_ENCODE);
+    }
+    if (bytes > 0) {
+        uint32_t filePos = wav->filePos;
+        uint32_t allocated = wav->allocated;
+        stageStart(&clock);
+        ok = wavWriterWrite(wav, data, bytes);
+        // most writes only fill the writer's block
+        if (wav->filePos != filePos || wav->allocated != allocated) {
+            stageEnd(&clock, PIPE_SD_WRITE);
+        }
+    }
+    writerFill = 0;
+    if (!ok) {
+        ESP_LOGE("writer", "Write failed");
+        pipeCount(PIPE_SD_WRITE_ERRORS);
+        recPlayMgrError = true;
+    }
+}
+
+// Appends to writerBuffer, storing every chunk that gets full
+static void writeSamples(WavWriter *wav, RecFormat format, size_t chunk, const int16_t *samples, size_t count,
+                         uint32_t *totalSamples) {
+    while (count > 0) {
+        size_t n = chunk - writerFill < count ? chunk - writerFill : count;
+        memcpy(writerBuffer + writerFill, samples, n * sizeof(int16_t));
+        writerFill += n;
+        *totalSamples += n;
+        samples += n;
+        count -= n;
+        if (writerFill == chunk) {
+            storeSamples(wav, format);
+        }
+    }
+}
+
+// Passes gateFrame on while the gate is open; a short last frame goes
+// wherever the frame before it went
+static void gateSamples(WavWriter *wav, RecFormat format, size_t chunk, size_t count, uint32_t sampleRate,
+                        uint32_t *totalSamples) {
+    bool open = (count == vad.frame) ? vadProcess(&vad, gateFrame) : vad.open;
+    if (!open) {
+        preRollPush(&gatePreRoll, gateFrame, count);
+        gateSkipped += count;
+        return;
+    }
+    if (gateSkipped > 0) {
+        // just opened, the onset is in the pre-roll
+        size_t wanted = sampleRate * GATE_PREROLL_MS / 1000;
+        size_t offset = gatePreRoll.count > wanted ? gatePreRoll.count - wanted : 0;
+        uint32_t removed = gateSkipped - (gatePreRoll.count - offset);
+        if (removed > 0) {
+            if (gateCueCount < GATE_MAX_CUES) {
+                gateCues[gateCueCount++] = *totalSamples;
+            }
+            gateRemoved += removed;
+            gateGaps++;
+        }
+        size_t n;
+        while ((n = preRollRead(&gatePreRoll, offset, writerBuffer + writerFill, chunk - writerFill)) > 0) {
+            offset += n;
+            writerFill += n;
+            *totalSamples += n;
+            if (writerFill == chunk) {
+                storeSamples(wav, format);
+            }
+        }
+        preRollClear(&gatePreRoll);
+        gateSkipped = 0;
+    }
+    writeSamples(wav, format, chunk, gateFrame, count, totalSamples);
+}
+
+// Appends a cue chunk with a point at every gap, after the audio data
+static bool writeCues(WavWriter *wav, RecFormat format) {
+    wav_cue_header header = {
+        .cue_header = { 'c', 'u', 'e', ' ' },
+        .cue_chunk_size = 4 + gateCueCount * sizeof(wav_cue_point),
+        .num_cue_points = gateCueCount,
+    };
+    bool ok = wavWriterWrite(wav, &header, sizeof(header));
+    for (int i = 0; i < gateCueCount && ok; i++) {
+        wav_cue_point point = {
+            .id = i + 1,
+            .position = gateCues[i],
+            .data_chunk = { 'd', 'a', 't', 'a' },
+            .sample_offset = gateCues[i],
+        };
+        if (format == REC_ADPCM) {
+            uint32_t samplesPerBlock = ADPCM_SAMPLES_PER_BLOCK(ADPCM_BLOCK_ALIGN);
+            point.block_start = gateCues[i] / samplesPerBlock * ADPCM_BLOCK_ALIGN;
+            point.sample_offset = gateCues[i] % samplesPerBlock;
+        }
+        ok = wavWriterWrite(wav, &point, sizeof(point));
+    }
+    return ok;
+}
+
+// Drops what an overdub take has before the file started, returns the
+// number of samples left at the front of samples
+static size_t alignTake(int16_t *samples, size_t count) {
+    uint32_t txIndex = atomic_load(&overdubTxIndex);
+    if (aligner.txIndex == ALIGN_UNKNOWN && txIndex != ALIGN_UNKNOWN) {
+        alignerSetTx(&aligner, txIndex, atomic_load(&overdubLeadIn));
+    }
+    size_t drop = alignerDrop(&aligner, samples, count);
+    if (alignerDone(&aligner)) {
+        uint32_t rate = rateProfiles[captureRate].rate;
+        if (aligner.click != ALIGN_UNKNOWN) {
+            uint32_t trip = aligner.click - aligner.txIndex;
+            ESP_LOGI("writer", "Take aligned by the click, round trip %u samples (%u us)", trip,
+                     (uint32_t)((uint64_t)trip * 1000000 / rate));
+        } else {
+            ESP_LOGI("writer", "Click not heard, take aligned by the clocks");
+        }
+    }
+    memmove(samples, samples + drop, (count - drop) * sizeof(int16_t));
+    return count - drop;
+}
+
+// Drains the capture ring to the SD card in large chunks,
+// so that card latency spikes never stall the I2S reads.
+void writerTask(void *pvParameters) {
+    char fileName[FILENAME_LEN];
+    char peakFile[FILENAME_LEN];
+    
+    while (true) {
+        xSemaphoreTake(writerStartSem, portMAX_DELAY);
+        strcpy(fileName, writerFileName);
+        bool take = writerOverdub;
+        // a take gets mixed, keep it simple
+        RecFormat format = take ? REC_PCM : recFormat;
+        // capture does not change its rate while a file is open
+        uint32_t sampleRate = rateProfiles[captureRate].rate;
+        // compressed formats are written one whole block at a time
+        size_t chunk = WRITER_CHUNK_SAMPLES;
+        size_t headerSize = sizeof(wav_header);
+        if (format == REC_ADPCM) {
+            chunk = ADPCM_SAMPLES_PER_BLOCK(ADPCM_BLOCK_ALIGN);
+            headerSize = sizeof(wav_ima_header);
+            adpcmInit(&adpcmState);
+        } else if (format == REC_FLAC) {
+            flacEncoder = malloc(sizeof(FlacEncoder));
+            flacFrame = malloc(FLAC_MAX_FRAME_BYTES);
+            if (flacEncoder == NULL || flacFrame == NULL) {
+                // better than nothing
+                ESP_LOGE("writer", "Not enough memory for FLAC, recording PCM");
+                free(flacEncoder);
+                free(flacFrame);
+                format = REC_PCM;
+            } else {
+                chunk = FLAC_BLOCK_SIZE;
+                headerSize = FLAC_HEADER_SIZE;
+                flacEncoderInit(flacEncoder, sampleRate);
+            }
+        }
+        uint32_t totalSamples = 0;
+        writerFill = 0;
+        writerPeak = 0;
+        RecGate gate = gatePreRoll.data != NULL && !take ? recGate : GATE_OFF;
+        alignerInit(&aligner, sampleRate);
+        bool aligned = !take;
+        vadInit(&vad, sampleRate);
+        preRollClear(&gatePreRoll);
+        gateSkipped = 0;
+        gateRemoved = 0;
+        gateCueCount = 0;
+        gateGaps = 0;
+        
+        ESP_LOGI("writer", "Opening file %s", fileName);
+        WavWriter wavFile;
+        WavWriter *wav = &wavFile;
+        if (!wavWriterOpen(wav, fileName, headerSize)) {
+            wav = NULL;
+            // keep draining, so the capture side does not notice
+            ESP_LOGE("writer", "Failed to open file for writing");
+            recPlayMgrError = true;
+        } else {
+            // shows up in the list right away, size and length follow on close
+            catalogAdd(fileName);
+            peakPath(fileName, peakFile, sizeof(peakFile));
+            writerPeaks = &writerPeakFile;
+            if (!peakWriterOpen(writerPeaks, peakFile, sampleRate)) {
+                // the recording changes the catalog, so the background task looks at it once the writer is idle
+                ESP_LOGE("writer", "Failed to create %s", peakFile);
+                writerPeaks = NULL;
+            }
+        }
+        
+        if (preRollBusy) {
+            // capture does not touch the pre-roll until preRollBusy is cleared
+            size_t wanted = sampleRate * PREROLL_MS / 1000;
+            size_t offset = preRoll.count > wanted ? preRoll.count - wanted : 0;
+            size_t start = offset;
+            size_t count;
+            while ((count = preRollRead(&preRoll, offset, writerBuffer + writerFill, chunk - writerFill)) > 0) {
+                offset += count;
+                writerFill += count;
+                totalSamples += count;
+                if (writerFill == chunk) {
+                    storeSamples(wav, format);
+                }
+            }
+            ESP_LOGI("writer", "Pre-roll %u ms saved", (offset - start) * 1000 / sampleRate);
+            // it is in the file now, next recording must not repeat it
+            preRollClear(&preRoll);
+            preRollBusy = false;
+        }
+        
+        while (true) {
+            // read the flag first, everything captured before it was set is in the ring
+            bool done = captureDone;
+            size_t fill;
+            if (gate != GATE_OFF) {
+                // one detector frame at a time
+                while ((fill = spscRingFill(&captureRing)) >= vad.frame || (done && fill > 0)) {
+                    size_t count = spscRingRead(&captureRing, gateFrame, vad.frame);
+                    gateSamples(wav, format, chunk, count, sampleRate, &totalSamples);
+                }
+            } else {
+                while ((fill = spscRingFill(&captureRing)) >= chunk - writerFill || (done && fill > 0)) {
+                    size_t count = spscRingRead(&captureRing, writerBuffer + writerFill, chunk - writerFill);
+                    if (!aligned) {
+                        count = alignTake(writerBuffer + writerFill, count);
+                        aligned = alignerDone(&aligner);
+                    }
+                    writerFill += count;
+                    totalSamples += count;
+                    if (writerFill == chunk) {
+                        storeSamples(wav, format);
+                    }
+                }
+            }
+            if (done) {
+                break;
+            }
+            ulTaskNotifyTake(pdTRUE, 100 / portTICK_PERIOD_MS);
+        }
+        if (writerFill > 0) {
+            storeSamples(wav, format);
+        }
+        
+        ESP_LOGI("writer", "Ring high water %u/%u samples, %u overruns, %u samples dropped",
+                 atomic_load(&captureRing.highWater), captureRing.size,
+                 atomic_load(&captureRing.overruns), atomic_load(&captureRing.droppedSamples));
+        if (gate != GATE_OFF) {
+            // what is still skipped at the end is left out as well
+            uint32_t removed = gateRemoved + gateSkipped;
+            ESP_LOGI("writer", "Gate kept %u of %u ms, %d gaps removed",
+                     (uint32_t)((uint64_t)totalSamples * 1000 / sampleRate),
+                     (uint32_t)((uint64_t)(totalSamples + removed) * 1000 / sampleRate), gateGaps);
+        }
+        
+        if (wav != NULL) {
+            // audio only, cues come after it
+            uint32_t dataBytes = wav->dataBytes;
+            if (gate == GATE_CUES && format != REC_FLAC && gateCueCount > 0 && !writeCues(wav, format)) {
+                ESP_LOGE("writer", "Failed to write cues");
+                recPlayMgrError = true;
+            }
+            void *header = &WAVHeader;
+            if (format == REC_FLAC) {
+                flacWriteHeader(flacEncoder, flacHeader);
+                header = flacHeader;
+            } else if (format == REC_ADPCM) {
+                WAVImaHeader.sample_rate = sampleRate;
+                WAVImaHeader.byte_rate = sampleRate * ADPCM_BLOCK_ALIGN / ADPCM_SAMPLES_PER_BLOCK(ADPCM_BLOCK_ALIGN);
+                WAVImaHeader.sample_length = totalSamples;
+                WAVImaHeader.data_bytes = dataBytes;
+                WAVImaHeader.wav_size = wav->dataBytes + sizeof(WAVImaHeader) - 8;
+                header = &WAVImaHeader;
+            } else {
+                WAVHeader.sample_rate = sampleRate;
+                WAVHeader.byte_rate = sampleRate * 2;
+                WAVHeader.data_bytes = dataBytes;
+                WAVHeader.wav_size = wav->dataBytes + sizeof(WAVHeader) - 8; 
+            }
+            if (!wavWriterClose(wav, header)) {
+                ESP_LOGE("writer", "Failed to finish file");
+                recPlayMgrError = true;
+            }
+            catalogRefresh(fileName, writerPeak);
+        }
+        if (writerPeaks != NULL) {
+            if (!peakWriterClose(writerPeaks, peakFile)) {
+                // built again by the background task, which waits for the writer
+                ESP_LOGE("writer", "Failed to finish %s", peakFile);
+            }
+            writerPeaks = NULL;
+        }
+        if (format == REC_FLAC) {
+            free(flacEncoder);
+            free(flacFrame);
+        }
+        xSemaphoreGive(writerIdleSem);
+    }
+}
+
 void printBuffer(void *pvParameters) {
-    char *currentBuffer = buffer;
+    char *currentBuffer = (char *)micBuffer;
     for (int i=0; i<BUFFER_SIZE; i++) {
         if (i % 8 == 0) {
             printf("\n");
@@ -228,82 +980,846 @@ void printBuffer(void *pvParameters) {
 }
 
 
+static bool IRAM_ATTR onAmpUnderrun(i2s_chan_handle_t handle, i2s_event_data_t *event, void *ctx) {
+    atomic_fetch_add(&ampUnderruns, 1);
+    pipeCount(PIPE_AMP_UNDERRUNS);
+    return false;
+}
+
+// True when background work should make way, a stream is starting or running, a command is on its
+// way or the writer is still finishing a recording
+static bool playerWanted() {
+    return player.state != STREAM_IDLE || recorder.state != STREAM_IDLE || mixStream.state != STREAM_IDLE
+        || commandPending(&recPlayQueue) > 0 || uxSemaphoreGetCount(writerIdleSem) == 0;
+}
+
+// Writes the overview of a recording from its audio, gives up as soon
+// as something is to be played or recorded
+static bool buildPeaks(const char *fileName, const char *peakFile) {
+    PlaySource source;
+    if (!playSourceOpen(&source, fileName, &prefetch)) {
+        return false;
+    }
+    if (!peakWriterOpen(&scanPeakFile, peakFile, source.sampleRate)) {
+        playSourceClose(&source);
+        return false;
+    }
+    size_t count;
+    bool wanted = false;
+    while (!wanted && (count = playSourceRead(&source, scanBuffer, SOURCE_CHUNK)) > 0) {
+        peakWriterAdd(&scanPeakFile, scanBuffer, count);
+        wanted = playerWanted();
+    }
+    playSourceClose(&source);
+    if (wanted) {
+        peakWriterAbort(&scanPeakFile, peakFile);
+        return false;
+    }
+    return peakWriterClose(&scanPeakFile, peakFile);
+}
+
+// Looks for recordings without a valid overview and builds them,
+// returns early when the player is needed and goes on next time
+static void scanPeaks() {
+    char fileName[FILENAME_LEN];
+    char peakFile[FILENAME_LEN];
+    while (!playerWanted()) {
+        if (!catalogPath(peakScanIndex, fileName)) {
+            peakScanIndex = -1;
+            return;
+        }
+        peakPath(fileName, peakFile, sizeof(peakFile));
+        if (!peakValid(peakFile)) {
+            ESP_LOGI("background", "Building overview of %s", fileName);
+            int64_t start = esp_timer_get_time();
+            if (buildPeaks(fileName, peakFile)) {
+                ESP_LOGI("background", "Overview done in %u ms", (uint32_t)((esp_timer_get_time() - start) / 1000));
+            } else if (playerWanted()) {
+                // same file again next time
+                return;
+            } else {
+                ESP_LOGE("background", "Cannot build overview of %s", fileName);
+            }
+        }
+        peakScanIndex++;
+    }
+}
+
+// Slot of the file, or if create is set the least recently used one taken over for it
+static ResumePoint *findResume(const char *fileName, bool create) {
+    ResumePoint *oldest = &resumePoints[0];
+    for (int i = 0; i < RESUME_SLOTS; i++) {
+        if (resumePoints[i].lastUsed != 0 && strcmp(resumePoints[i].fileName, fileName) == 0) {
+            return &resumePoints[i];
+        }
+        if (resumePoints[i].lastUsed < oldest->lastUsed) {
+            oldest = &resumePoints[i];
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+    strcpy(oldest->fileName, fileName);
+    return oldest;
+}
+
+// Takes the seek already received and all others waiting, moves the
+// source to where they add up to, relative ones count from current.
+// Returns when the seek was asked for, the first one if there were several.
+static int64_t applySeeks(PlaySource *source, SeekCommand *seek, uint32_t current) {
+    int64_t asked = seek->time;
+    int64_t target = current;
+    do {
+        int64_t samples = (int64_t)seek->ms * source->sampleRate / 1000;
+        target = seek->relative ? target + samples : samples;
+    } while (xQueueReceive(seekQueue, seek, 0) == pdTRUE);
+    if (target < 0) {
+        target = 0;
+    } else if (target > UINT32_MAX) {
+        target = UINT32_MAX;
+    }
+    if (!playSourceSeek(source, target)) {
+        ESP_LOGE("player", "Cannot seek to sample %u", (uint32_t)target);
+    }
+    return asked;
+}
+
+static i2s_chan_handle_t openAmp(bool monitor) {
+    i2s_chan_handle_t ampHandle = getAmp(monitor);
+    i2s_event_callbacks_t callbacks = {
+        .on_send_q_ovf = onAmpUnderrun,
+    };
+    i2s_channel_register_event_callback(ampHandle, &callbacks, NULL);
+    return ampHandle;
+}
+
+// True when the mic should be heard: recording, monitor on and nothing to play
+static bool monitorWanted() {
+    return monitorGain != MONITOR_OFF && monitorRing.data != NULL
+        && recorder.state == STREAM_RUNNING && !streamStartPending(&player);
+}
+
+// Where the time goes between a sound reaching the mic and the amp, the
+// worst of each stage since the last report. DMA queues are the most
+// they can hold, the rest is measured.
+typedef struct {
+    uint32_t captureUs; // I2S read returned to block in the ring
+    uint32_t handoffUs; // block in the ring to the player awake
+    uint32_t ringUs; // older samples still waiting in the ring
+    uint32_t processUs; // player awake to first write
+    uint32_t dropped; // samples
+} MonitorLatency;
+
+static void reportMonitor(MonitorLatency *m, uint32_t micRate) {
+    uint32_t micDmaUs = (uint64_t)MIC_DMA_FRAMES * 1000000 / micRate;
+    uint32_t ampDmaUs = (uint64_t)MONITOR_DMA_DESC * MONITOR_DMA_FRAMES * 1000000 / AMP_RATE;
+    ESP_LOGI("monitor", "Latency up to %u us: mic DMA %u, capture %u, handoff %u, ring %u, process %u, amp DMA %u",
+             micDmaUs + m->captureUs + m->handoffUs + m->ringUs + m->processUs + ampDmaUs,
+             micDmaUs, m->captureUs, m->handoffUs, m->ringUs, m->processUs, ampDmaUs);
+    ESP_LOGI("monitor", "%u samples dropped, %u I2S underruns", m->dropped, atomic_load(&ampUnderruns));
+    memset(m, 0, sizeof(MonitorLatency));
+}
+
+// Sends the mic to the amp for as long as monitorWanted, with the short
+// amp DMA queue. Nothing here waits for the card or slows down capture.
+static void monitorMic(i2s_chan_handle_t *ampHandle) {
+    i2s_del_channel(*ampHandle);
+    *ampHandle = openAmp(true);
+    // capture does not change its rate while recording
+    uint32_t micRate = rateProfiles[captureRate].micRate;
+    resamplerInit(&monitorResampler, micRate, AMP_RATE);
+    MonitorGain gain = monitorGain;
+    limiterInit(&limiter, monitorGains[gain], micRate);
+    spscRingReset(&monitorRing);
+    MonitorLatency latency = { 0 };
+    uint32_t reported = esp_timer_get_time();
+    size_t bytesWritten = 0;
+    
+    ESP_LOGI("monitor", "Monitoring the mic");
+    atomic_store(&ampUnderruns, 0);
+    i2s_channel_enable(*ampHandle);
+    monitorOn = true;
+    while (monitorWanted()) {
+        if (monitorGain != gain) {
+            gain = monitorGain;
+            limiter.gain = monitorGains[gain];
+        }
+        if (ulTaskNotifyTake(pdTRUE, MONITOR_POLL_MS / portTICK_PERIOD_MS) == 0) {
+            continue;
+        }
+        uint32_t wake = esp_timer_get_time();
+        uint32_t pushTime = atomic_load(&monitorPushTime);
+        uint32_t captureUs = pushTime - atomic_load(&monitorReadTime);
+        uint32_t handoffUs = wake - pushTime;
+        size_t fill = spscRingFill(&monitorRing);
+        if (fill > MONITOR_MAX_FILL) {
+            // the amp runs slower than the mic, catch up to the newest block
+            while (fill > MONITOR_CHUNK) {
+                size_t n = spscRingRead(&monitorRing, monitorIn, fill - MONITOR_CHUNK < MONITOR_CHUNK ? fill - MONITOR_CHUNK : MONITOR_CHUNK);
+                latency.dropped += n;
+                fill -= n;
+            }
+        }
+        uint32_t ringUs = fill > MONITOR_CHUNK ? (uint64_t)(fill - MONITOR_CHUNK) * 1000000 / micRate : 0;
+        
+        bool first = true;
+        size_t count;
+        while ((count = spscRingRead(&monitorRing, monitorIn, MONITOR_CHUNK)) > 0) {
+            limiterProcess(&limiter, monitorIn, count);
+            size_t index = 0;
+            while (index < count) {
+                size_t used = count - index;
+                size_t n = resamplerProcess(&monitorResampler, monitorIn + index, &used, ampSamples, WAV_BUFFER_COUNT);
+                index += used;
+                if (n == 0) {
+                    continue;
+                }
+                convertPcm16ToAmp(ampSamples, n, ampBuffer);
+                if (first) {
+                    uint32_t processUs = esp_timer_get_time() - wake;
+                    latency.processUs = processUs > latency.processUs ? processUs : latency.processUs;
+                    first = false;
+                }
+                i2s_channel_write(*ampHandle, ampBuffer, n * 8, &bytesWritten, 100);
+                if (bytesWritten < n * 8) {
+                    pipeCount(PIPE_AMP_SHORT_WRITES);
+                }
+            }
+        }
+        latency.captureUs = captureUs > latency.captureUs ? captureUs : latency.captureUs;
+        latency.handoffUs = handoffUs > latency.handoffUs ? handoffUs : latency.handoffUs;
+        latency.ringUs = ringUs > latency.ringUs ? ringUs : latency.ringUs;
+        if (wake - reported >= MONITOR_REPORT_MS * 1000) {
+            reportMonitor(&latency, micRate);
+            reported = wake;
+        }
+    }
+    monitorOn = false;
+    reportMonitor(&latency, micRate);
+    i2s_channel_disable(*ampHandle);
+    i2s_del_channel(*ampHandle);
+    *ampHandle = openAmp(false);
+}
+
+// Starts the amp for an overdub as soon as the recorder runs. A click is
+// preloaded, so it leaves the moment the channel is enabled, then follows
+// the rest of the lead-in as silence. The amp is enabled in any case.
+static void playCountIn(i2s_chan_handle_t ampHandle, uint32_t fileRate) {
+    while (xSemaphoreTake(overdubGoSem, MONITOR_POLL_MS / portTICK_PERIOD_MS) != pdTRUE) {
+        if (!player.run) {
+            i2s_channel_enable(ampHandle);
+            return;
+        }
+    }
+    // the file goes through the resampler, which delays it
+    uint32_t leadIn = ALIGN_LEAD_IN_MS * fileRate / 1000;
+    if (fileRate != AMP_RATE) {
+        leadIn += RESAMPLE_DELAY;
+    }
+    atomic_store(&overdubLeadIn, leadIn);
+    
+    // about 1 ms of 2 kHz square wave
+    memset(ampSamples, 0, sizeof(ampSamples));
+    for (int i = 0; i < OVERDUB_CLICK_FRAMES; i++) {
+        ampSamples[i] = (i * 4000 / AMP_RATE) % 2 ? -OVERDUB_CLICK_LEVEL : OVERDUB_CLICK_LEVEL;
+    }
+    convertPcm16ToAmp(ampSamples, WAV_BUFFER_COUNT, ampBuffer);
+    size_t loaded = 0;
+    i2s_channel_preload_data(ampHandle, ampBuffer, WAV_BUFFER_COUNT * 8, &loaded);
+    i2s_channel_enable(ampHandle);
+    atomic_store(&overdubTxTime, (uint32_t)esp_timer_get_time() | 1);
+    
+    memset(ampSamples, 0, sizeof(ampSamples));
+    convertPcm16ToAmp(ampSamples, WAV_BUFFER_COUNT, ampBuffer);
+    size_t silence = ALIGN_LEAD_IN_MS * AMP_RATE / 1000 - loaded / 8;
+    size_t bytesWritten = 0;
+    while (silence > 0 && player.run) {
+        size_t n = silence < WAV_BUFFER_COUNT ? silence : WAV_BUFFER_COUNT;
+        i2s_channel_write(ampHandle, ampBuffer, n * 8, &bytesWritten, 1000);
+        silence -= n;
+    }
+}
+
+// Reads the take being mixed, 16-bit mono PCM
+static size_t readTake(void *ctx, int16_t *samples, size_t count) {
+    return fread(samples, sizeof(int16_t), count, (FILE *)ctx);
+}
+
+static size_t readLayer(void *ctx, int16_t *samples, size_t count) {
+    return playSourceRead((PlaySource *)ctx, samples, count);
+}
+
+// Renders the file and the take recorded over it into a new file, a
+// chunk at a time. Runs as the mix stream, so it can be stopped like one.
+static void mixDown() {
+    // the take may still be finishing
+    while (xSemaphoreTake(writerIdleSem, MONITOR_POLL_MS / portTICK_PERIOD_MS) != pdTRUE) {
+        if (!mixStream.run) {
+            streamStopped(&mixStream);
+            return;
+        }
+    }
+    xSemaphoreGive(writerIdleSem);
+    
+    PlaySource source;
+    if (!playSourceOpen(&source, mixSourceName, &prefetch)) {
+        ESP_LOGE("mixer", "Cannot read %s", mixSourceName);
+        streamStopped(&mixStream);
+        return;
+    }
+    WavInfo info;
+    FILE *take = fopen(mixTakeName, "rb");
+    if (take == NULL || !wavParse(take, &info) || info.format != WAVE_FORMAT_PCM || info.channels != 1
+        || info.bitsPerSample != 16 || info.sampleRate != source.sampleRate) {
+        ESP_LOGE("mixer", "Cannot mix %s into %s", mixTakeName, mixSourceName);
+        if (take != NULL) {
+            fclose(take);
+        }
+        playSourceClose(&source);
+        streamStopped(&mixStream);
+        return;
+    }
+    WavWriter wav;
+    if (!wavWriterOpen(&wav, mixFileName, sizeof(wav_header))) {
+        ESP_LOGE("mixer", "Failed to open %s for writing", mixFileName);
+        recPlayMgrError = true;
+        fclose(take);
+        playSourceClose(&source);
+        streamStopped(&mixStream);
+        return;
+    }
+    catalogAdd(mixFileName);
+    char peakFile[FILENAME_LEN];
+    peakPath(mixFileName, peakFile, sizeof(peakFile));
+    bool peaks = peakWriterOpen(&scanPeakFile, peakFile, source.sampleRate);
+    
+    // the longer of the two sets the length
+    uint32_t length = info.dataBytes / 2 > source.length ? info.dataBytes / 2 : source.length;
+    uint32_t mixed = 0;
+    uint16_t peak = 0;
+    bool ok = true;
+    bool stopped = false;
+    mixerInit(&mixer, readLayer, &source, readTake, take);
+    atomic_store(&mixedPercent, 0);
+    mixing = true;
+    streamRunning(&mixStream);
+    
+    int64_t start = esp_timer_get_time();
+    size_t count;
+    while (ok && (count = mixerProcess(&mixer, mixBuffer, MIX_CHUNK)) > 0) {
+        if (!mixStream.run) {
+            stopped = true;
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            int level = abs(mixBuffer[i]);
+            if (level > peak) {
+                peak = level;
+            }
+        }
+        if (peaks) {
+            peakWriterAdd(&scanPeakFile, mixBuffer, count);
+        }
+        ok = wavWriterWrite(&wav, mixBuffer, count * sizeof(int16_t));
+        mixed += count;
+        if (length > 0) {
+            atomic_store(&mixedPercent, (uint64_t)mixed * 100 / length);
+        }
+    }
+    fclose(take);
+    playSourceClose(&source);
+    
+    wav_header header = WAVHeader;
+    header.sample_rate = source.sampleRate;
+    header.byte_rate = source.sampleRate * 2;
+    header.data_bytes = wav.dataBytes;
+    header.wav_size = wav.dataBytes + sizeof(header) - 8;
+    bool closed = wavWriterClose(&wav, &header);
+    if (!ok || !closed || stopped) {
+        // half a mix is no use
+        if (!ok || !closed) {
+            ESP_LOGE("mixer", "Failed to write %s", mixFileName);
+            recPlayMgrError = true;
+        }
+        unlink(mixFileName);
+        catalogRemove(mixFileName);
+        if (peaks) {
+            peakWriterAbort(&scanPeakFile, peakFile);
+        }
+    } else {
+        catalogRefresh(mixFileName, peak);
+        if (peaks && !peakWriterClose(&scanPeakFile, peakFile)) {
+            ESP_LOGE("mixer", "Failed to finish %s", peakFile);
+        }
+        ESP_LOGI("mixer", "Mixed %u ms in %u ms, %u samples clipped",
+                 (uint32_t)((uint64_t)mixed * 1000 / source.sampleRate),
+                 (uint32_t)((esp_timer_get_time() - start) / 1000), mixer.clips);
+    }
+    mixing = false;
+    streamStopped(&mixStream);
+}
+
+// Renders mixes when started as the mix stream, and in between works
+// through the recordings without an overview whenever the streams are
+// idle, stopping at the next chunk when one is wanted, and looks again
+// after every change to the catalog. Runs on IO_CORE
+// below the writer, the SD card is what it mostly waits for.
+static void backgroundTask(void *pvParameters) {
+    while (true) {
+        if (streamWaitStart(&mixStream, PEAK_SCAN_MS / portTICK_PERIOD_MS)) {
+            // the player lets go once the manager has stopped it
+            xSemaphoreTake(sourceLock, portMAX_DELAY);
+            mixDown();
+            xSemaphoreGive(sourceLock);
+            continue;
+        }
+        // recordings, deletions and mixes change the catalog and may move entries,
+        // the scan starts over rather than going on from an index
+        uint32_t changes = catalogChanges();
+        if (changes != peakScanChanges) {
+            peakScanChanges = changes;
+            peakScanIndex = 0;
+        }
+        if (peakScanIndex >= 0 && !playerWanted() && xSemaphoreTake(sourceLock, 0) == pdTRUE) {
+            scanPeaks();
+            xSemaphoreGive(sourceLock);
+        }
+    }
+}
+
 void playerTask() {
-    i2s_chan_handle_t ampHandle = getAmp();
+    i2s_chan_handle_t ampHandle = openAmp(false);
+    // woken by a start, by the monitor turned on and by a recording starting
+    streamNotifyStarts(&player);
     
     while (1) {
-        xSemaphoreTake(playSem, portMAX_DELAY);
-        playContinue = true;
+        if (monitorWanted()) {
+            monitorMic(&ampHandle);
+            continue;
+        }
+        if (!streamWaitStart(&player, 0)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        // the background task lets go within a chunk once it sees the stream starting
+        xSemaphoreTake(sourceLock, portMAX_DELAY);
+        // the take is lined up with the file as it is, from the start and at its speed
+        bool overdubbing = overdub;
         
         ESP_LOGI("sdcard", "Opening file %s", playFileName);
-        FILE *f = fopen(playFileName, "r");
-        if (f == NULL) {
-            ESP_LOGE("sdcard", "Failed to open file for reading");
-            return;
+        PlaySource source;
+        if (!playSourceOpen(&source, playFileName, &prefetch)) {
+            ESP_LOGE("player", "Cannot play %s", playFileName);
+            xSemaphoreGive(sourceLock);
+            streamStopped(&player);
+            continue;
+        }
+        // amp clock stays fixed, everything is converted to its rate
+        resamplerInit(&resampler, source.sampleRate, AMP_RATE);
+        // speeds go up in steps of 25 %
+        stretchInit(&stretch, source.sampleRate, STRETCH_MIN_SPEED + 25 * (overdubbing ? SPEED_100 : playSpeed));
+        ResumePoint *resume = findResume(playFileName, false);
+        if (resume != NULL && !overdubbing && resume->length == source.length && resume->sample > 0) {
+            ESP_LOGI("player", "Resuming at %u ms", (uint32_t)((uint64_t)resume->sample * 1000 / source.sampleRate));
+            playSourceSeek(&source, resume->sample);
         }
-        wav_header fileHeader;
-        fread(&fileHeader, sizeof(wav_header), 1, f);
-        // check header compatible
+        // seeks meant for an earlier file
+        xQueueReset(seekQueue);
+        atomic_store(&playedSamples, source.position);
+        playRate = source.sampleRate;
+        playing = true;
+        streamRunning(&player);
 
-        memset(buffer, 0, BUFFER_SIZE);
         size_t bytesWritten = 0;
-        int samplesRead = 0;
+        size_t sourceIndex = 0;
+        size_t sourceCount = 0;
+        size_t stretchIndex = 0;
+        size_t stretchCount = 0;
+        bool ended = false;
+        SeekCommand seek;
+        // when the seek being carried out was asked for, 0 if none is
+        int64_t seekAsked = 0;
+        StageClock clock;
         
         ESP_LOGI("player", "Starting playback");
-        i2s_channel_enable(ampHandle);
-        while (playContinue) {
-            samplesRead = fread(wavBuffer, sizeof(int16_t), WAV_BUFFER_COUNT, f);
-            if (samplesRead == 0) {
-                break;
+        atomic_store(&ampUnderruns, 0);
+        if (overdubbing) {
+            playCountIn(ampHandle, source.sampleRate);
+        } else {
+            i2s_channel_enable(ampHandle);
+        }
+        // stops within one I2S block and one source chunk of being told to
+        while (player.run) {
+            if (xQueueReceive(seekQueue, &seek, 0) == pdTRUE) {
+                // what is left of the chunk was never played
+                seekAsked = applySeeks(&source, &seek, source.position - (sourceCount - sourceIndex));
+                sourceIndex = sourceCount = 0;
+                stretchIndex = stretchCount = 0;
+                stretchReset(&stretch);
+                atomic_store(&playedSamples, source.position);
+            }
+            if (stretchIndex == stretchCount) {
+                if (sourceIndex == sourceCount) {
+                    stageStart(&clock);
+                    sourceCount = playSourceRead(&source, sourceBuffer, SOURCE_CHUNK);
+                    stageEnd(&clock, PIPE_SOURCE_READ);
+                    sourceIndex = 0;
+                    if (sourceCount == 0) {
+                        ended = true;
+                        break;
+                    }
+                    atomic_store(&playedSamples, source.position);
+                }
+                size_t used = sourceCount - sourceIndex;
+                stageStart(&clock);
+                stretchCount = stretchProcess(&stretch, sourceBuffer + sourceIndex, &used, stretchBuffer, SOURCE_CHUNK);
+                stageEnd(&clock, PIPE_AMP_CONVERT);
+                sourceIndex += used;
+                stretchIndex = 0;
+                continue;
+            }
+            size_t used = stretchCount - stretchIndex;
+            stageStart(&clock);
+            size_t count = resamplerProcess(&resampler, stretchBuffer + stretchIndex, &used, ampSamples, WAV_BUFFER_COUNT);
+            stretchIndex += used;
+            if (count == 0) {
+                continue;
+            }
+            convertPcm16ToAmp(ampSamples, count, ampBuffer);
+            stageEnd(&clock, PIPE_AMP_CONVERT);
+            stageStart(&clock);
+            i2s_channel_write(ampHandle, ampBuffer, count * 8, &bytesWritten, 1000);
+            stageEnd(&clock, PIPE_AMP_WAIT);
+            if (bytesWritten < count * 8) {
+                pipeCount(PIPE_AMP_SHORT_WRITES);
             }
-            int bufferIndex = 0;
-            int wavBufferIndex = 0;
-            while (wavBufferIndex < samplesRead) {
-                int16_t *ptr = (int16_t *)(buffer + bufferIndex + 6);
-                *ptr = wavBuffer[wavBufferIndex];
-                bufferIndex += 8;
-                wavBufferIndex++;
+            if (seekAsked != 0) {
+                ESP_LOGI("player", "Seek to %u ms took %u us", (uint32_t)((uint64_t)source.position * 1000 / source.sampleRate),
+                         (uint32_t)(esp_timer_get_time() - seekAsked));
+                seekAsked = 0;
             }
-            i2s_channel_write(ampHandle, buffer, BUFFER_SIZE, &bytesWritten, 1000);
         }
         i2s_channel_disable(ampHandle);
-        fclose(f);
-        ESP_LOGI("player", "Playback ended");
+        // a file played to the end starts over next time, a stopped one where it was left
+        resume = overdubbing ? NULL : findResume(playFileName, !ended);
+        if (resume != NULL && ended) {
+            resume->lastUsed = 0;
+        } else if (resume != NULL) {
+            resume->length = source.length;
+            resume->sample = source.position - (sourceCount - sourceIndex);
+            resume->lastUsed = ++resumeClock;
+        }
+        playing = false;
+        // the amp is quiet, closing the file may wait for the card and does not count as stopping
+        streamStopped(&player);
+        playSourceClose(&source);
+        xSemaphoreGive(sourceLock);
+        ESP_LOGI("player", "Playback ended, %u read-ahead underruns (longest %u ticks), %u I2S underruns",
+                 atomic_load(&prefetch.underruns), atomic_load(&prefetch.maxWait), atomic_load(&ampUnderruns));
     }
     i2s_del_channel(ampHandle);
 }
 
+// Stops a stream and reports how long that took, false if it is stuck
+static bool stopStream(StreamControl *s, const char *name) {
+    if (s->state == STREAM_IDLE) {
+        return true;
+    }
+    int64_t start = esp_timer_get_time();
+    if (!streamStop(s, STOP_TIMEOUT_MS / portTICK_PERIOD_MS)) {
+        ESP_LOGE("recplaymgr", "%s did not stop within %d ms", name, STOP_TIMEOUT_MS);
+        recPlayMgrError = true;
+        return false;
+    }
+    ESP_LOGI("recplaymgr", "%s stopped in %u us", name, (uint32_t)(esp_timer_get_time() - start));
+    return true;
+}
+
+// Plays cmd's file and records a take over it, both stopped first
+static void startOverdubStreams(RecPlayCommand *cmd) {
+    if (!stopStream(&recorder, "Recording") || !stopStream(&player, "Playback") || !stopStream(&mixStream, "Mix")) {
+        return;
+    }
+    overdub = true;
+    atomic_store(&overdubTxTime, 0);
+    xSemaphoreTake(overdubGoSem, 0);
+    strcpy(playFileName, cmd->filename);
+    strcpy(recFileName, cmd->take);
+    // the player opens the file and finds its rate, then waits for the recorder
+    if (streamStart(&player, START_TIMEOUT_MS / portTICK_PERIOD_MS)) {
+        int rate = 0;
+        while (rate < sizeof(rateProfiles) / sizeof(rateProfiles[0]) && rateProfiles[rate].rate != playRate) {
+            rate++;
+        }
+        if (rate == sizeof(rateProfiles) / sizeof(rateProfiles[0])) {
+            ESP_LOGE("recplaymgr", "Cannot overdub a %u Hz file", playRate);
+            stopStream(&player, "Playback");
+        } else {
+            overdubRate = rate;
+            if (streamStart(&recorder, START_TIMEOUT_MS / portTICK_PERIOD_MS)) {
+                xSemaphoreGive(overdubGoSem);
+            } else {
+                ESP_LOGE("recplaymgr", "Recording did not start");
+                stopStream(&player, "Playback");
+            }
+        }
+    }
+    overdub = false;
+}
+
+// Owns both streams. Every command is carried out before the next one is
+// taken, so a sender that waits for it knows where the streams are.
+static void recPlayManagerTask(void *pvParameters) {
+    RecPlayCommand cmd;
+    while (true) {
+        uint32_t id = commandReceive(&recPlayQueue, &cmd, portMAX_DELAY);
+        switch (cmd.type) {
+            case RECORD:
+                // a new file ends the one being recorded, playback goes on
+                if (stopStream(&recorder, "Recording")) {
+                    strcpy(recFileName, cmd.filename);
+                    if (!streamStart(&recorder, START_TIMEOUT_MS / portTICK_PERIOD_MS)) {
+                        ESP_LOGE("recplaymgr", "Recording did not start");
+                    }
+                }
+                break;
+                
+            case PLAY:
+                // a mix holds the only source there is
+                if (stopStream(&player, "Playback") && stopStream(&mixStream, "Mix")) {
+                    strcpy(playFileName, cmd.filename);
+                    // a file that cannot be opened was reported by the player
+                    streamStart(&player, START_TIMEOUT_MS / portTICK_PERIOD_MS);
+                }
+                break;
+                
+            case REC_STOP:
+                stopStream(&recorder, "Recording");
+                break;
+                
+            case PLAY_STOP:
+                stopStream(&player, "Playback");
+                stopStream(&mixStream, "Mix");
+                break;
+                
+            case END:
+                stopStream(&recorder, "Recording");
+                stopStream(&player, "Playback");
+                stopStream(&mixStream, "Mix");
+                break;
+                
+            case OVERDUB:
+                startOverdubStreams(&cmd);
+                break;
+                
+            case MIX:
+                // the background task renders it, PLAY_STOP stops it like a playback
+                if (stopStream(&player, "Playback") && stopStream(&mixStream, "Mix")) {
+                    strcpy(mixSourceName, cmd.filename);
+                    strcpy(mixTakeName, cmd.take);
+                    strcpy(mixFileName, cmd.mix);
+                    streamStart(&mixStream, START_TIMEOUT_MS / portTICK_PERIOD_MS);
+                }
+                break;
+        }
+        commandDone(&recPlayQueue, id);
+    }
+}
 
 void recPlayMgrInit() {
-    recSem = xSemaphoreCreateBinary();
-    playSem = xSemaphoreCreateBinary();
+    pipeStatsInit(esp_rom_get_cpu_ticks_per_us(), esp_timer_get_time() / 1000);
+    if (!commandQueueInit(&recPlayQueue, COMMAND_QUEUE_LEN, sizeof(RecPlayCommand))
+        || !streamInit(&recorder) || !streamInit(&player) || !streamInit(&mixStream)) {
+        ESP_LOGE("recplaymgr", "Failed to create command queue");
+        recPlayMgrError = true;
+        return;
+    }
+    seekQueue = xQueueCreate(SEEK_QUEUE_LEN, sizeof(SeekCommand));
+    writerStartSem = xSemaphoreCreateBinary();
+    writerIdleSem = xSemaphoreCreateBinary();
+    xSemaphoreGive(writerIdleSem);
+    overdubGoSem = xSemaphoreCreateBinary();
+    sourceLock = xSemaphoreCreateMutex();
+    
+    if (!spscRingInit(&captureRing, CAPTURE_RING_SAMPLES)) {
+        ESP_LOGE("recplaymgr", "Failed to allocate capture ring");
+        recPlayMgrError = true;
+        return;
+    }
+    ESP_LOGI("recplaymgr", "Capture ring uses %u bytes", CAPTURE_RING_SAMPLES * sizeof(int16_t));
+    
+    // resized by the capture task when the rate changes
+    sizePreRoll(captureRate);
+    
+    if (!prefetchInit(&prefetch, PREFETCH_DEPTH, SD_CLUSTER_SIZE, PREFETCH_PRIORITY, IO_CORE)) {
+        ESP_LOGE("recplaymgr", "Failed to start read-ahead");
+        recPlayMgrError = true;
+        return;
+    }
+    ESP_LOGI("recplaymgr", "Read-ahead uses %u bytes", PREFETCH_DEPTH * SD_CLUSTER_SIZE);
+    
+    if (!spscRingInit(&monitorRing, MONITOR_RING_SAMPLES)) {
+        // the mic is never monitored then
+        ESP_LOGE("recplaymgr", "Failed to allocate monitor ring");
+    }
+    
+    size_t gateRollSamples = MAX_SAMPLING_RATE * GATE_PREROLL_MS / 1000;
+    if (!preRollInit(&gatePreRoll, gateRollSamples)) {
+        // recordings are never gated then
+        ESP_LOGE("recplaymgr", "Failed to allocate gate pre-roll");
+    } else {
+        ESP_LOGI("recplaymgr", "Gate pre-roll %d ms uses %u bytes of %s", GATE_PREROLL_MS,
+                 gateRollSamples * sizeof(int16_t), gatePreRoll.inPsram ? "PSRAM" : "internal RAM");
+    }
     
-    xTaskCreate(recorderTask, "RECORDER", TASK_STACK, NULL, 1, NULL);
-    xTaskCreate(playerTask, "PLAYER", TASK_STACK, NULL, 1, NULL);
+    // see tasks.h
+    xTaskCreatePinnedToCore(writerTask, "WRITER", WRITER_STACK, NULL, WRITER_PRIORITY, &writerTaskHandle, IO_CORE);
+    xTaskCreatePinnedToCore(recorderTask, "RECORDER", CAPTURE_STACK, NULL, CAPTURE_PRIORITY, NULL, AUDIO_CORE);
+    xTaskCreatePinnedToCore(playerTask, "PLAYER", PLAYER_STACK, NULL, PLAYER_PRIORITY, &playerTaskHandle, AUDIO_CORE);
+    xTaskCreatePinnedToCore(recPlayManagerTask, "RECPLAYMGR", MANAGER_STACK, NULL, MANAGER_PRIORITY,
+                            &recPlayManagerTaskHandle, IO_CORE);
+    xTaskCreatePinnedToCore(backgroundTask, "BACKGROUND", BACKGROUND_STACK, NULL, BACKGROUND_PRIORITY, NULL, IO_CORE);
+}
+
+// Queues a command for the manager, returns its id or 0 if it was dropped
+static uint32_t queueCommand(RecPlayCommand *cmd) {
+    uint32_t id = commandSend(&recPlayQueue, cmd, COMMAND_SEND_MS / portTICK_PERIOD_MS);
+    if (id == 0) {
+        ESP_LOGE("recplaymgr", "Command queue full, command %d dropped", cmd->type);
+        recPlayMgrError = true;
+    }
+    return id;
 }
 
-void startRec(char *filename) {
+static uint32_t sendCommand(CmdType type, const char *filename) {
+    RecPlayCommand cmd = { .type = type };
+    if (filename != NULL) {
+        strcpy(cmd.filename, filename);
+    }
+    return queueCommand(&cmd);
+}
+
+uint32_t startRec(char *filename) {
     ESP_LOGI("recplaymgr", "Starting recording '%s'", filename);
-    playContinue = false;
-    recContinue = false;
-    strcpy(recFileName, filename);
-    xSemaphoreGive(recSem);
+    return sendCommand(RECORD, filename);
 }
 
-void startPlay(char *filename) {
+uint32_t startPlay(char *filename) {
     ESP_LOGI("recplaymgr", "Replaying '%s'", filename);
-    playContinue = false;
-    recContinue = false;
-    strcpy(playFileName, filename);
-    xSemaphoreGive(playSem);
+    return sendCommand(PLAY, filename);
 }
 
-void stopRec() {
+uint32_t stopRec() {
     ESP_LOGI("recplaymgr", "Ending recording");
-    recContinue = false;
+    return sendCommand(REC_STOP, NULL);
 }
     
-void stopPlay() {
+uint32_t stopPlay() {
     ESP_LOGI("recplaymgr", "Ending playback");
-    playContinue = false;
+    return sendCommand(PLAY_STOP, NULL);
+}
+
+uint32_t startOverdub(char *filename, char *take) {
+    ESP_LOGI("recplaymgr", "Overdubbing '%s' into '%s'", filename, take);
+    RecPlayCommand cmd = { .type = OVERDUB };
+    strcpy(cmd.filename, filename);
+    strcpy(cmd.take, take);
+    return queueCommand(&cmd);
+}
+
+uint32_t stopOverdub() {
+    ESP_LOGI("recplaymgr", "Ending overdub");
+    return sendCommand(END, NULL);
+}
+
+uint32_t startMix(char *filename, char *take, char *mix) {
+    ESP_LOGI("recplaymgr", "Mixing '%s' and '%s' into '%s'", filename, take, mix);
+    RecPlayCommand cmd = { .type = MIX };
+    strcpy(cmd.filename, filename);
+    strcpy(cmd.take, take);
+    strcpy(cmd.mix, mix);
+    return queueCommand(&cmd);
+}
+
+bool getMixProgress(uint32_t *percent) {
+    *percent = atomic_load(&mixedPercent);
+    return mixing;
+}
+
+bool waitRecPlay(uint32_t id, uint32_t timeoutMs) {
+    return id != 0 && commandWait(&recPlayQueue, id, timeoutMs / portTICK_PERIOD_MS);
+}
+
+void seekPlay(int32_t ms, bool relative) {
+    if (!playing) {
+        return;
+    }
+    SeekCommand seek = { .ms = ms, .relative = relative, .time = esp_timer_get_time() };
+    // a full queue means the player is busy seeking already, this one is dropped
+    xQueueSend(seekQueue, &seek, 0);
+}
+
+void setRecFormat(int format) {
+    recFormat = format;
+}
+
+int getRecFormat() {
+    return recFormat;
+}
+
+const char *getRecExtension() {
+    // FAT without long names, so three letters only
+    return (recFormat == REC_FLAC) ? "fla" : "wav";
+}
+
+void setRecRate(int rate) {
+    recRate = rate;
+}
+
+int getRecRate() {
+    return recRate;
+}
+
+void setRecGate(int gate) {
+    recGate = gate;
+}
+
+int getRecGate() {
+    return recGate;
+}
+
+void setMonitor(int gain) {
+    monitorGain = gain;
+    // the idle player sleeps until woken, it may have to monitor now
+    if (playerTaskHandle != NULL) {
+        xTaskNotifyGive(playerTaskHandle);
+    }
+}
+
+int getMonitor() {
+    return monitorGain;
+}
+
+void setPlaySpeed(int speed) {
+    playSpeed = speed;
+}
+
+int getPlaySpeed() {
+    return playSpeed;
+}
+
+bool getPlayPosition(uint32_t *positionMs) {
+    if (!playing) {
+        return false;
+    }
+    *positionMs = (uint64_t)atomic_load(&playedSamples) * 1000 / playRate;
+    return true;
+}
+
+void getRecLevel(RecLevel *level) {
+    uint32_t packed = atomic_load(&meterLevel);
+    level->peak = packed >> 16;
+    level->rms = packed & 0xffff;
+    level->clips = atomic_load(&meterClips);
+    level->elapsedMs = (uint64_t)atomic_load(&recordedSamples) * 1000 / rateProfiles[captureRate].rate;
 }
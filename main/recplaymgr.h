@@ -1,7 +1,76 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum { REC_PCM, REC_ADPCM, REC_FLAC } RecFormat;
+typedef enum { RATE_48K, RATE_44K, RATE_16K, RATE_8K } RecRate;
+typedef enum { GATE_OFF, GATE_ON, GATE_CUES } RecGate;
+typedef enum { SPEED_100, SPEED_125, SPEED_150, SPEED_175, SPEED_200 } PlaySpeed;
+typedef enum { MONITOR_OFF, MONITOR_0DB, MONITOR_6DB, MONITOR_12DB } MonitorGain;
+
 
 void recPlayMgrInit();
 
-void startRec(char *filename);
-void stopRec();
-void startPlay(char *filename);
-void stopPlay();
+// Recording and playback are commands carried out in order by the
+// manager task, they can run at the same time. Each call queues one and
+// returns its id at once, 0 if it had to be dropped. Starting a stream
+// that runs already first stops the file it is on.
+uint32_t startRec(char *filename);
+uint32_t stopRec();
+uint32_t startPlay(char *filename);
+uint32_t stopPlay();
+// True once the command and all before it were carried out, false after
+// timeoutMs. A started stream is running by then, or could not start; a
+// stopped one is quiet. Only one task at a time may wait.
+bool waitRecPlay(uint32_t id, uint32_t timeoutMs);
+// Plays filename from its start and records a take over it into take,
+// at the file's rate. The take is lined up to start with the file's first
+// sample, from a click played ahead of it. stopOverdub ends both.
+uint32_t startOverdub(char *filename, char *take);
+uint32_t stopOverdub();
+// Mixes filename and a take recorded over it into mix, without loading
+// either, until done or stopPlay. The mix is removed if it does not finish.
+uint32_t startMix(char *filename, char *take, char *mix);
+// True while a mix is being rendered, percent of it done so far
+bool getMixProgress(uint32_t *percent);
+// Position of the playback in progress, false while nothing plays
+bool getPlayPosition(uint32_t *positionMs);
+// Moves the playback in progress by ms, or to ms from the start when not
+// relative. Seeks past the end finish the file. Never blocks.
+// A file stopped before its end resumes where it was left next time.
+void seekPlay(int32_t ms, bool relative);
+
+// takes effect with the next recording
+void setRecFormat(int format);
+int getRecFormat();
+// file extension for the current format, without the dot
+const char *getRecExtension();
+
+// takes effect with the next recording, the pre-roll starts over
+void setRecRate(int rate);
+int getRecRate();
+
+// takes effect with the next recording; with the gate on silence is left
+// out of the file, GATE_CUES also marks every gap in a WAV cue chunk
+void setRecGate(int gate);
+int getRecGate();
+
+// takes effect right away; while recording and nothing plays, the mic is
+// heard on the amp with this gain and a limiter, the latency is logged
+void setMonitor(int gain);
+int getMonitor();
+
+// takes effect with the next playback, faster speeds keep the pitch
+void setPlaySpeed(int speed);
+int getPlaySpeed();
+
+typedef struct {
+    uint16_t peak; // largest absolute sample of the last 50 ms, of every fourth one (convert.h)
+    uint16_t rms;
+    uint32_t clips; // times the input reached full scale, only ever grows
+    uint32_t elapsedMs; // of the recording in progress, or the last one
+} RecLevel;
+
+// Latest mic level, also while not recording. Never blocks, safe to poll from the UI.
+void getRecLevel(RecLevel *level);
@@ -0,0 +1,100 @@
+#include "resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "convert.h"
+
+void resamplerInit(Resampler *r, uint32_t inRate, uint32_t outRate) {
+    r->bypass = (inRate == outRate);
+    uint64_t step = ((uint64_t)inRate << 32) / outRate;
+    r->stepInt = step >> 32;
+    r->stepFrac = (uint32_t)step;
+    r->frac = 0;
+    r->need = 1;
+    r->pos = 0;
+    memset(r->history, 0, sizeof(r->history));
+    if (r->bypass) {
+        return;
+    }
+
+    // cutoff in cycles per input sample
+    float cutoff = RESAMPLE_CUTOFF * 0.5f;
+    if (outRate < inRate) {
+        cutoff = cutoff * outRate / inRate;
+    }
+    float half = RESAMPLE_TAPS / 2;
+    for (int phase = 0; phase <= RESAMPLE_PHASES; phase++) {
+        // output lies phase / RESAMPLE_PHASES after the middle of the window
+        float offset = (float)phase / RESAMPLE_PHASES;
+        float h[RESAMPLE_TAPS];
+        float sum = 0;
+        for (int k = 0; k < RESAMPLE_TAPS; k++) {
+            float x = half - 1 - k + offset;
+            float sinc = (x == 0) ? 2 * cutoff : sinf(2 * M_PI * cutoff * x) / (M_PI * x);
+            float window = 0.42f + 0.5f * cosf(M_PI * x / half) + 0.08f * cosf(2 * M_PI * x / half);
+            h[k] = sinc * window;
+            sum += h[k];
+        }
+        // unity gain at DC for every phase, so slow phase changes do not modulate
+        int16_t *coefs = r->coefs + phase * RESAMPLE_TAPS;
+        int total = 0;
+        for (int k = 0; k < RESAMPLE_TAPS; k++) {
+            coefs[k] = lrintf(h[k] / sum * 32768);
+            total += coefs[k];
+        }
+        coefs[(int)half - 1 + (phase > RESAMPLE_PHASES / 2)] += 32768 - total;
+    }
+}
+
+static inline int32_t dot(const int16_t *x, const int16_t *coefs) {
+    // sum of |coefs| stays below 2^16, so 32 bits do not overflow
+    int32_t acc = 0;
+    for (int k = 0; k < RESAMPLE_TAPS; k++) {
+        acc += x[k] * coefs[k];
+    }
+    return acc;
+}
+
+size_t resamplerProcess(Resampler *r, const int16_t *in, size_t *inCount, int16_t *out, size_t outCount) {
+    if (r->bypass) {
+        size_t count = *inCount < outCount ? *inCount : outCount;
+        memcpy(out, in, count * sizeof(int16_t));
+        *inCount = count;
+        return count;
+    }
+
+    size_t used = 0;
+    size_t produced = 0;
+    while (produced < outCount) {
+        while (r->need > 0 && used < *inCount) {
+            r->history[r->pos] = in[used];
+            r->history[r->pos + RESAMPLE_TAPS] = in[used];
+            used++;
+            r->pos++;
+            if (r->pos == RESAMPLE_TAPS) {
+                r->pos = 0;
+            }
+            r->need--;
+        }
+        if (r->need > 0) {
+            break;
+        }
+
+        // top bits pick the phase, the next 15 interpolate towards the following one
+        uint32_t phase = r->frac >> (32 - RESAMPLE_PHASE_BITS);
+        int32_t t = (r->frac >> (32 - RESAMPLE_PHASE_BITS - 15)) & 0x7fff;
+        const int16_t *x = r->history + r->pos;
+        const int16_t *coefs = r->coefs + phase * RESAMPLE_TAPS;
+        int32_t a = dot(x, coefs);
+        int32_t b = dot(x, coefs + RESAMPLE_TAPS);
+        int32_t y = a + (int32_t)(((int64_t)(b - a) * t) >> 15);
+        out[produced++] = saturate16((y + (1 << 14)) >> 15);
+
+        uint32_t frac = r->frac + r->stepFrac;
+        r->need = r->stepInt + (frac < r->frac);
+        r->frac = frac;
+    }
+    *inCount = used;
+    return produced;
+}
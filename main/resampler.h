@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming sample rate converter for any pair of rates. Each output
+// sample is a RESAMPLE_TAPS windowed-sinc dot product; the filter is kept
+// in Q15 for RESAMPLE_PHASES fractional positions and the two nearest
+// phases are interpolated. When downsampling the cutoff moves down with
+// the output Nyquist frequency. Equal rates pass through untouched.
+#define RESAMPLE_TAPS 16
+#define RESAMPLE_PHASE_BITS 7
+#define RESAMPLE_PHASES (1 << RESAMPLE_PHASE_BITS)
+// -6 dB point relative to the lower of the two Nyquist frequencies
+#define RESAMPLE_CUTOFF 0.9f
+// unless the rates are equal, output lags the input by this many input samples
+#define RESAMPLE_DELAY (RESAMPLE_TAPS / 2)
+
+typedef struct {
+    bool bypass;
+    // input advance per output sample, integer part and 32-bit fraction
+    uint32_t stepInt;
+    uint32_t stepFrac;
+    uint32_t frac;
+    // input samples still to be taken before the next output
+    uint32_t need;
+    // delay line stored twice, so the newest taps samples are always contiguous
+    int16_t history[2 * RESAMPLE_TAPS];
+    int pos;
+    // one extra phase, so interpolation never wraps
+    int16_t coefs[(RESAMPLE_PHASES + 1) * RESAMPLE_TAPS];
+} Resampler;
+
+void resamplerInit(Resampler *r, uint32_t inRate, uint32_t outRate);
+// Takes up to *inCount samples and sets *inCount to the number used,
+// returns number of samples written to out (at most outCount)
+size_t resamplerProcess(Resampler *r, const int16_t *in, size_t *inCount, int16_t *out, size_t outCount);
@@ -0,0 +1,89 @@
+#include "spscring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+bool spscRingInit(SpscRing *ring, size_t size) {
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return false;
+    }
+    ring->data = malloc(size * sizeof(int16_t));
+    if (ring->data == NULL) {
+        return false;
+    }
+    ring->size = size;
+    spscRingReset(ring);
+    return true;
+}
+
+void spscRingFree(SpscRing *ring) {
+    free(ring->data);
+    ring->data = NULL;
+    ring->size = 0;
+}
+
+void spscRingReset(SpscRing *ring) {
+    atomic_store(&ring->head, 0);
+    atomic_store(&ring->tail, 0);
+    atomic_store(&ring->highWater, 0);
+    atomic_store(&ring->overruns, 0);
+    atomic_store(&ring->droppedSamples, 0);
+}
+
+size_t spscRingFill(SpscRing *ring) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    return head - tail;
+}
+
+size_t spscRingWrite(SpscRing *ring, const int16_t *src, size_t count) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    // tail acquire pairs with the consumer's release, the slots it freed are ours now
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t fill = head - tail;
+
+    if (count > ring->size - fill) {
+        atomic_fetch_add_explicit(&ring->overruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&ring->droppedSamples, count, memory_order_relaxed);
+        return 0;
+    }
+
+    size_t start = head & (ring->size - 1);
+    size_t first = ring->size - start;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(ring->data + start, src, first * sizeof(int16_t));
+    memcpy(ring->data, src + first, (count - first) * sizeof(int16_t));
+
+    // publish the samples only after they are in place
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+
+    fill += count;
+    if (fill > atomic_load_explicit(&ring->highWater, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->highWater, fill, memory_order_relaxed);
+    }
+    return count;
+}
+
+size_t spscRingRead(SpscRing *ring, int16_t *dst, size_t count) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t fill = head - tail;
+
+    if (count > fill) {
+        count = fill;
+    }
+
+    size_t start = tail & (ring->size - 1);
+    size_t first = ring->size - start;
+    if (first > count) {
+        first = count;
+    }
+    memcpy(dst, ring->data + start, first * sizeof(int16_t));
+    memcpy(dst + first, ring->data, (count - first) * sizeof(int16_t));
+
+    // hand the slots back to the producer only after copying them out
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lock-free ring of 16-bit samples for exactly one producer and one consumer.
+// Producer only moves head, consumer only moves tail, so no locking is needed.
+// Only plain C11 atomics are used, so it also builds on the host under pthreads.
+typedef struct {
+    int16_t *data;
+    size_t size; // capacity in samples, power of two
+    atomic_size_t head; // total samples written (producer)
+    atomic_size_t tail; // total samples read (consumer)
+
+    // statistics, updated by the producer
+    atomic_size_t highWater; // max fill level seen, in samples
+    atomic_uint overruns; // writes rejected because the ring was full
+    atomic_size_t droppedSamples; // samples lost by those writes
+} SpscRing;
+
+// size must be a power of two, data is allocated with malloc
+bool spscRingInit(SpscRing *ring, size_t size);
+void spscRingFree(SpscRing *ring);
+
+// Empties the ring and clears statistics. Neither side may be active.
+void spscRingReset(SpscRing *ring);
+
+// Producer side. Writes all samples or none of them, a rejected write
+// is counted as an overrun. Returns number of samples written.
+size_t spscRingWrite(SpscRing *ring, const int16_t *src, size_t count);
+
+// Consumer side. Returns number of samples read, at most count.
+size_t spscRingRead(SpscRing *ring, int16_t *dst, size_t count);
+
+// Number of samples waiting to be read. Safe to call from both sides.
+size_t spscRingFill(SpscRing *ring);
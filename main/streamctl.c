@@ -0,0 +1,144 @@
+#include "streamctl.h"
+
+// Ids count up and skip 0, which means none
+static uint32_t nextId(uint32_t *counter) {
+    if (++*counter == 0) {
+        ++*counter;
+    }
+    return *counter;
+}
+
+bool commandQueueInit(CommandQueue *q, size_t length, size_t itemSize) {
+    q->queue = xQueueCreate(length, itemSize);
+    q->sendLock = xSemaphoreCreateMutex();
+    q->doneSem = xSemaphoreCreateBinary();
+    q->sent = 0;
+    q->received = 0;
+    atomic_store(&q->done, 0);
+    return q->queue != NULL && q->sendLock != NULL && q->doneSem != NULL;
+}
+
+uint32_t commandSend(CommandQueue *q, const void *cmd, TickType_t wait) {
+    xSemaphoreTake(q->sendLock, portMAX_DELAY);
+    uint32_t id = 0;
+    if (xQueueSend(q->queue, cmd, wait) == pdTRUE) {
+        id = nextId(&q->sent);
+    }
+    xSemaphoreGive(q->sendLock);
+    return id;
+}
+
+uint32_t commandReceive(CommandQueue *q, void *cmd, TickType_t wait) {
+    if (xQueueReceive(q->queue, cmd, wait) != pdTRUE) {
+        return 0;
+    }
+    // same order as they were sent, so the same id
+    return nextId(&q->received);
+}
+
+void commandDone(CommandQueue *q, uint32_t id) {
+    atomic_store(&q->done, id);
+    xSemaphoreGive(q->doneSem);
+}
+
+bool commandWait(CommandQueue *q, uint32_t id, TickType_t wait) {
+    TickType_t start = xTaskGetTickCount();
+    // ids wrap around, compared by difference
+    while ((int32_t)(atomic_load(&q->done) - id) < 0) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        if (wait != portMAX_DELAY && waited >= wait) {
+            return false;
+        }
+        // given for an older command, or one already seen, just looks again
+        xSemaphoreTake(q->doneSem, wait == portMAX_DELAY ? portMAX_DELAY : wait - waited);
+    }
+    return true;
+}
+
+size_t commandPending(CommandQueue *q) {
+    return uxQueueMessagesWaiting(q->queue);
+}
+
+bool streamInit(StreamControl *s) {
+    s->startSem = xSemaphoreCreateBinary();
+    s->ackSem = xSemaphoreCreateBinary();
+    s->state = STREAM_IDLE;
+    s->run = false;
+    s->task = NULL;
+    return s->startSem != NULL && s->ackSem != NULL;
+}
+
+// Takes one ack, false if wait ran out since start
+static bool waitAck(StreamControl *s, TickType_t start, TickType_t wait) {
+    TickType_t waited = xTaskGetTickCount() - start;
+    if (wait != portMAX_DELAY && waited >= wait) {
+        return false;
+    }
+    // an ack may be left from a change already seen, the state is what counts
+    xSemaphoreTake(s->ackSem, wait == portMAX_DELAY ? portMAX_DELAY : wait - waited);
+    return true;
+}
+
+static void wakeStream(StreamControl *s) {
+    TaskHandle_t task = s->task;
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
+
+bool streamStart(StreamControl *s, TickType_t wait) {
+    if (s->state != STREAM_IDLE) {
+        return false;
+    }
+    s->state = STREAM_STARTING;
+    s->run = true;
+    xSemaphoreGive(s->startSem);
+    wakeStream(s);
+    TickType_t start = xTaskGetTickCount();
+    while (s->state == STREAM_STARTING) {
+        if (!waitAck(s, start, wait)) {
+            s->run = false;
+            // never taken, the stream will not see it
+            if (xSemaphoreTake(s->startSem, 0) == pdTRUE) {
+                s->state = STREAM_IDLE;
+                // it may have left other work for the start
+                wakeStream(s);
+            }
+            return false;
+        }
+    }
+    return s->state == STREAM_RUNNING;
+}
+
+bool streamStop(StreamControl *s, TickType_t wait) {
+    s->run = false;
+    TickType_t start = xTaskGetTickCount();
+    while (s->state != STREAM_IDLE) {
+        if (!waitAck(s, start, wait)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool streamWaitStart(StreamControl *s, TickType_t wait) {
+    return xSemaphoreTake(s->startSem, wait) == pdTRUE;
+}
+
+void streamNotifyStarts(StreamControl *s) {
+    s->task = xTaskGetCurrentTaskHandle();
+}
+
+bool streamStartPending(StreamControl *s) {
+    return uxSemaphoreGetCount(s->startSem) > 0;
+}
+
+void streamRunning(StreamControl *s) {
+    s->state = STREAM_RUNNING;
+    xSemaphoreGive(s->ackSem);
+}
+
+void streamStopped(StreamControl *s) {
+    s->state = STREAM_IDLE;
+    xSemaphoreGive(s->ackSem);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+// Plumbing of the record/play manager. Only FreeRTOS primitives are
+// used, so it also runs on the host against a pthread shim.
+//
+// A CommandQueue carries commands to one task in the order they were
+// sent. Every command gets an id, the task reports it done once carried
+// out and a sender may wait for that.
+typedef struct {
+    QueueHandle_t queue;
+    SemaphoreHandle_t sendLock; // ids go into the queue in order
+    SemaphoreHandle_t doneSem; // given for every command done
+    uint32_t sent; // senders, under sendLock
+    uint32_t received; // receiving task only
+    atomic_uint done; // id of the last command done
+} CommandQueue;
+
+bool commandQueueInit(CommandQueue *q, size_t length, size_t itemSize);
+// Returns the id of the queued command, 0 if the queue stayed full for wait
+uint32_t commandSend(CommandQueue *q, const void *cmd, TickType_t wait);
+// Returns the id of the command copied to cmd, 0 if none came within wait
+uint32_t commandReceive(CommandQueue *q, void *cmd, TickType_t wait);
+void commandDone(CommandQueue *q, uint32_t id);
+// True once the command and all before it are done, false after wait.
+// Only one task at a time may wait.
+bool commandWait(CommandQueue *q, uint32_t id, TickType_t wait);
+// Commands sent but not received yet
+size_t commandPending(CommandQueue *q);
+
+// Start/stop handshake between the manager and one stream task. The
+// manager starts and stops, the stream acknowledges both, so once the
+// manager returns from streamStop the stream no longer touches anything
+// it shares. A stream may also stop by itself, at the end of a file.
+typedef enum { STREAM_IDLE, STREAM_STARTING, STREAM_RUNNING } StreamState;
+
+typedef struct {
+    SemaphoreHandle_t startSem; // manager to stream
+    SemaphoreHandle_t ackSem; // stream to manager, state tells what happened
+    _Atomic StreamState state;
+    atomic_bool run; // cleared by the manager to stop the stream
+    TaskHandle_t task; // notified of starts too, NULL unless streamNotifyStarts
+} StreamControl;
+
+bool streamInit(StreamControl *s);
+
+// Manager side. Starts an idle stream and waits until it is running or
+// gave up, returns true if it is running. When wait runs out first, a
+// start the stream has not taken yet is withdrawn and the stream is idle
+// again. One it has taken stays STARTING, told to stop as soon as it
+// runs; streamStop waits for that before the stream can be started again.
+bool streamStart(StreamControl *s, TickType_t wait);
+// Returns true once the stream is idle, false if it did not stop within wait
+bool streamStop(StreamControl *s, TickType_t wait);
+
+// Stream side. True when started within wait.
+bool streamWaitStart(StreamControl *s, TickType_t wait);
+// Every start, and every start withdrawn, also gives the calling task a
+// notification. A stream that waits for other things as well sleeps in
+// ulTaskNotifyTake and looks at streamWaitStart(s, 0) when woken.
+void streamNotifyStarts(StreamControl *s);
+// A start is waiting to be taken, the stream should drop other work
+bool streamStartPending(StreamControl *s);
+// After setting up, tells the manager the stream is running
+void streamRunning(StreamControl *s);
+// Exactly once per start, also when setting up failed, after the last
+// access to anything the manager may hand to the next start
+void streamStopped(StreamControl *s);
@@ -0,0 +1,170 @@
+#include "stretch.h"
+
+#include <math.h>
+#include <string.h>
+
+void stretchReset(Stretch *s) {
+    s->fill = 0;
+    s->started = false;
+    s->prev = 0;
+    s->nominal = 0;
+    s->frameIndex = 0;
+    s->frameCount = 0;
+}
+
+void stretchInit(Stretch *s, uint32_t sampleRate, int speed) {
+    if (speed < STRETCH_MIN_SPEED) {
+        speed = STRETCH_MIN_SPEED;
+    } else if (speed > STRETCH_MAX_SPEED) {
+        speed = STRETCH_MAX_SPEED;
+    }
+    // faster files just get shorter windows
+    if (sampleRate > STRETCH_MAX_RATE) {
+        sampleRate = STRETCH_MAX_RATE;
+    }
+    s->bypass = (speed == STRETCH_MIN_SPEED);
+    s->overlap = sampleRate * STRETCH_OVERLAP_MS / 1000;
+    s->seek = sampleRate * STRETCH_SEEK_MS / 1000;
+    s->stride = sampleRate / STRETCH_STRIDE_RATE;
+    if (s->stride < 1) {
+        s->stride = 1;
+    }
+    s->hop = ((uint32_t)s->overlap << 8) * speed / 100;
+    for (int i = 0; i < s->overlap; i++) {
+        long w = lrintf(32768 * 0.5f * (1 - cosf(M_PI * (i + 0.5f) / s->overlap)));
+        s->fade[i] = w > 32767 ? 32767 : w;
+    }
+    stretchReset(s);
+}
+
+static inline int32_t correlate(const int16_t *a, const int16_t *b, int count, int stride) {
+    // 12 bits each, the at most 192 products stay below 2^30
+    int32_t acc = 0;
+    for (int i = 0; i < count; i += stride) {
+        acc += (a[i] >> 4) * (b[i] >> 4);
+    }
+    return acc;
+}
+
+// Start between lo and hi whose first overlap samples are most like tail
+static int search(Stretch *s, const int16_t *tail, int lo, int hi) {
+    // coarse pass on copies with every stride-th sample, so the inner loop runs over contiguous data
+    int d = s->stride;
+    int taps = (s->overlap + d - 1) / d;
+    int shifts = (hi - lo) / d + 1;
+    for (int j = 0; j < taps; j++) {
+        s->tailDown[j] = tail[j * d] >> 4;
+    }
+    for (int k = 0; k < shifts + taps - 1; k++) {
+        s->inDown[k] = s->in[lo + k * d] >> 4;
+    }
+    int best = 0;
+    int32_t bestCorr = INT32_MIN;
+    for (int k = 0; k < shifts; k++) {
+        const int16_t *x = s->inDown + k;
+        int32_t corr = 0;
+        for (int j = 0; j < taps; j++) {
+            corr += s->tailDown[j] * x[j];
+        }
+        if (corr > bestCorr) {
+            bestCorr = corr;
+            best = k;
+        }
+    }
+    best = lo + best * d;
+
+    // then the shifts in between, next to the best one
+    int from = best - d + 1 > lo ? best - d + 1 : lo;
+    int to = best + d - 1 < hi ? best + d - 1 : hi;
+    int coarse = best;
+    for (int c = from; c <= to; c++) {
+        if (c == coarse) {
+            continue;
+        }
+        int32_t corr = correlate(tail, s->in + c, s->overlap, d);
+        if (corr > bestCorr) {
+            bestCorr = corr;
+            best = c;
+        }
+    }
+    return best;
+}
+
+// Samples that must be in the buffer for the next step
+static int needed(const Stretch *s) {
+    if (!s->started) {
+        return s->overlap;
+    }
+    int tailEnd = s->prev + 2 * s->overlap;
+    int searchEnd = (s->nominal >> 8) + s->seek + s->overlap;
+    return tailEnd > searchEnd ? tailEnd : searchEnd;
+}
+
+// Makes the next overlap samples of output and drops the input no step needs any more
+static void step(Stretch *s) {
+    int n = s->overlap;
+    if (!s->started) {
+        // nothing to fade from yet
+        memcpy(s->frame, s->in, n * sizeof(int16_t));
+        s->started = true;
+    } else {
+        const int16_t *tail = s->in + s->prev + n;
+        int center = s->nominal >> 8;
+        int start = search(s, tail, center - s->seek, center + s->seek);
+        const int16_t *next = s->in + start;
+        for (int i = 0; i < n; i++) {
+            // the two gains add up to 1, so this fits 32 bits
+            s->frame[i] = (tail[i] * (32768 - s->fade[i]) + next[i] * s->fade[i]) >> 15;
+        }
+        s->prev = start;
+    }
+    s->nominal += s->hop;
+    s->frameIndex = 0;
+    s->frameCount = n;
+
+    int keep = (s->nominal >> 8) - s->seek;
+    if (keep > s->prev + n) {
+        keep = s->prev + n;
+    }
+    memmove(s->in, s->in + keep, (s->fill - keep) * sizeof(int16_t));
+    s->fill -= keep;
+    s->prev -= keep;
+    s->nominal -= keep << 8;
+}
+
+size_t stretchProcess(Stretch *s, const int16_t *in, size_t *inCount, int16_t *out, size_t outCount) {
+    if (s->bypass) {
+        size_t count = *inCount < outCount ? *inCount : outCount;
+        memcpy(out, in, count * sizeof(int16_t));
+        *inCount = count;
+        return count;
+    }
+
+    size_t used = 0;
+    size_t produced = 0;
+    while (produced < outCount) {
+        if (s->frameIndex < s->frameCount) {
+            size_t count = s->frameCount - s->frameIndex;
+            if (count > outCount - produced) {
+                count = outCount - produced;
+            }
+            memcpy(out + produced, s->frame + s->frameIndex, count * sizeof(int16_t));
+            s->frameIndex += count;
+            produced += count;
+            continue;
+        }
+        size_t count = STRETCH_BUFFER - s->fill;
+        if (count > *inCount - used) {
+            count = *inCount - used;
+        }
+        memcpy(s->in + s->fill, in + used, count * sizeof(int16_t));
+        s->fill += count;
+        used += count;
+        if (s->fill < needed(s)) {
+            break;
+        }
+        step(s);
+    }
+    *inCount = used;
+    return produced;
+}
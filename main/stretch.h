@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Faster playback at the original pitch (WSOLA). The output is made of
+// segments 2 * overlap long, each faded in over the second half of the
+// one before, so every output sample is a crossfade of two. A segment
+// starts near where the speed says it should, shifted by at most seek
+// samples to where it looks most like the audio that would have
+// followed the last one, so the crossfade does not break the waveform.
+//
+// The search is a cross-correlation of every stride-th sample at every
+// stride-th shift, then refined around the best one. The stride keeps
+// the search at about STRETCH_STRIDE_RATE whatever the file's rate, so
+// the work per second of output is about the same at any rate and does
+// not depend on the signal. Everything is static, the buffers are sized
+// for STRETCH_MAX_RATE.
+#define STRETCH_MAX_RATE 48000
+#define STRETCH_OVERLAP_MS 12
+#define STRETCH_SEEK_MS 6
+// the search looks at every sample up to this rate, one in n at n times it
+#define STRETCH_STRIDE_RATE 8000
+#define STRETCH_MAX_OVERLAP (STRETCH_MAX_RATE * STRETCH_OVERLAP_MS / 1000)
+#define STRETCH_MAX_SEEK (STRETCH_MAX_RATE * STRETCH_SEEK_MS / 1000)
+// the most one segment needs at 2x, with room for input to arrive
+#define STRETCH_BUFFER (4 * STRETCH_MAX_OVERLAP + 2 * STRETCH_MAX_SEEK)
+#define STRETCH_MIN_SPEED 100
+#define STRETCH_MAX_SPEED 200
+
+typedef struct {
+    bool bypass;
+    int overlap;
+    int seek;
+    int stride;
+    uint32_t hop; // input advance per segment, Q8
+    int16_t fade[STRETCH_MAX_OVERLAP]; // rising half of a Hann window, Q15
+
+    int16_t in[STRETCH_BUFFER];
+    int fill;
+    bool started; // first segment was handed out
+    int prev; // start of the last segment, relative to `in`, its first half may be dropped already
+    int32_t nominal; // where the next segment starts before the search, Q8
+    // every stride-th sample of the tail and of the searched input, shifted to 12 bits
+    int16_t tailDown[STRETCH_MAX_OVERLAP];
+    int16_t inDown[2 * STRETCH_MAX_SEEK + STRETCH_MAX_OVERLAP];
+
+    // crossfade made by the last step, handed out from index
+    int16_t frame[STRETCH_MAX_OVERLAP];
+    int frameIndex;
+    int frameCount;
+} Stretch;
+
+// speed in percent, STRETCH_MIN_SPEED plays the input untouched
+void stretchInit(Stretch *s, uint32_t sampleRate, int speed);
+// Drops everything buffered, for a jump in the input
+void stretchReset(Stretch *s);
+// Takes up to *inCount samples and sets *inCount to the number used,
+// returns number of samples written to out (at most outCount). Up to
+// about 3 * overlap + 2 * seek samples stay buffered at the end of the input.
+size_t stretchProcess(Stretch *s, const int16_t *in, size_t *inCount, int16_t *out, size_t outCount);
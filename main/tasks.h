@@ -0,0 +1,39 @@
+#pragma once
+
+// Where every task runs and how much it may use. Audio that has to keep
+// up with I2S runs on AUDIO_CORE above anything else there. The card is
+// read and written on IO_CORE, by the writer, the read-ahead and the
+// background task, and the display is drawn there, so a slow card or a
+// full redraw never stands between a DMA buffer and its task. The player
+// still opens, seeks and closes its files on AUDIO_CORE, and waits for
+// the card while it does.
+// Drivers put their interrupts on the core that installs them: the I2S
+// channels are created by the audio tasks, the SD card and the display
+// by app_main, which runs on core 0.
+#define AUDIO_CORE 1
+#define IO_CORE 0
+
+// higher runs first; capture cannot get a block back, the amp plays
+// silence when it runs dry, so capture comes first
+#define CAPTURE_PRIORITY 10
+#define PLAYER_PRIORITY 9
+#define MANAGER_PRIORITY 7
+#define PREFETCH_PRIORITY 6
+#define WRITER_PRIORITY 5
+#define UI_PRIORITY 1
+// mixes and overviews of old recordings; level with the UI, so time
+// slicing keeps the screen going while it decodes
+#define BACKGROUND_PRIORITY 1
+
+// bytes, the read-ahead keeps its own (prefetch.c). The sizes are
+// provisional, none has been set from the device's figures yet. "stress"
+// on the console records while the UI task redraws nonstop, then prints
+// the least stack each task ever had left; "stats tasks" prints the same
+// after normal use. Until then the writer and player keep 4096.
+#define CAPTURE_STACK 4096
+#define PLAYER_STACK 4096
+#define MANAGER_STACK 3072
+#define WRITER_STACK 4096
+#define BACKGROUND_STACK 4096
+// LVGL renders on it
+#define UI_STACK 16384
@@ -0,0 +1,48 @@
+#include "vad.h"
+
+void vadInit(Vad *v, uint32_t sampleRate) {
+    v->frame = sampleRate * VAD_FRAME_MS / 1000;
+    if (v->frame > VAD_MAX_FRAME) {
+        v->frame = VAD_MAX_FRAME;
+    }
+    // a tone of f Hz crosses zero 2 f times a second
+    v->fricativeCrossings = 2 * VAD_FRICATIVE_HZ * VAD_FRAME_MS / 1000;
+    v->noise = VAD_NOISE_INIT;
+    v->onset = 0;
+    v->hangover = 0;
+    v->open = false;
+}
+
+bool vadProcess(Vad *v, const int16_t *samples) {
+    uint64_t sum = 0;
+    uint32_t crossings = 0;
+    int16_t last = samples[0];
+    for (uint32_t i = 0; i < v->frame; i++) {
+        int32_t x = samples[i];
+        sum += x * x;
+        crossings += (x ^ last) < 0;
+        last = x;
+    }
+    uint32_t energy = sum / v->frame;
+
+    uint32_t quiet = v->noise > VAD_MIN_ENERGY ? v->noise : VAD_MIN_ENERGY;
+    // divided rather than multiplied, a loud floor would overflow
+    bool speech = energy / VAD_SPEECH_RATIO > quiet
+               || (energy / VAD_FRICATIVE_RATIO > quiet && crossings > v->fricativeCrossings);
+
+    if (energy < v->noise) {
+        v->noise -= (v->noise - energy) >> 3;
+    } else {
+        // about 1 dB a second
+        v->noise += (v->noise >> 9) + 1;
+    }
+
+    v->onset = speech ? v->onset + 1 : 0;
+    if (v->onset >= VAD_ONSET_FRAMES || (v->open && speech)) {
+        v->open = true;
+        v->hangover = VAD_HANGOVER_MS / VAD_FRAME_MS;
+    } else if (v->open && --v->hangover <= 0) {
+        v->open = false;
+    }
+    return v->open;
+}
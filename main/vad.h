@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Tells speech from silence, one VAD_FRAME_MS frame at a time, for
+// recordings that should only keep what was said. Nothing in here
+// touches the hardware, so it runs the same on a host.
+//
+// A frame is speech when its mean square is VAD_SPEECH_RATIO times the
+// noise floor, or VAD_FRICATIVE_RATIO times with a zero-crossing rate
+// above VAD_FRICATIVE_HZ (s, f, sh are quiet but busy). The floor falls
+// quickly to quieter frames and creeps up otherwise, so it follows the
+// room without being dragged up by speech. The gate opens after
+// VAD_ONSET_FRAMES speech frames in a row and closes VAD_HANGOVER_MS
+// after the last one; the caller keeps a short pre-roll of the closed
+// time, so the onset that opened it is not lost.
+#define VAD_FRAME_MS 10
+// the longest frame, at 48 kHz
+#define VAD_MAX_FRAME 480
+#define VAD_SPEECH_RATIO 4
+#define VAD_FRICATIVE_RATIO 2
+#define VAD_FRICATIVE_HZ 2000
+// quietest speech, mean square of 8 (about -72 dBFS)
+#define VAD_MIN_ENERGY 64
+// floor to start from, about -60 dBFS; a louder room keeps the gate open until the floor got there
+#define VAD_NOISE_INIT 1024
+#define VAD_ONSET_FRAMES 2
+#define VAD_HANGOVER_MS 600
+
+typedef struct {
+    uint32_t frame; // samples
+    uint32_t fricativeCrossings; // per frame, VAD_FRICATIVE_HZ
+    uint32_t noise; // floor, mean square
+    int onset; // speech frames in a row
+    int hangover; // frames until the gate closes
+    bool open;
+} Vad;
+
+void vadInit(Vad *v, uint32_t sampleRate);
+// Looks at the next v->frame samples, returns true while the gate is open
+bool vadProcess(Vad *v, const int16_t *samples);
@@ -25,3 +25,48 @@ typedef struct wav_header {
     uint32_t data_bytes; // Number of bytes in data. Number of samples * num_channels * sample byte size
     // uint8_t bytes[]; // Remainder of wave file is bytes
 } wav_header;
+
+// IMA-ADPCM needs a longer format chunk and a fact chunk with the sample count
+typedef struct wav_ima_header {
+    // RIFF Header
+    char riff_header[4]; // Contains "RIFF"
+    uint32_t wav_size; // File size - 8
+    char wave_header[4]; // Contains "WAVE"
+    
+    // Format Header
+    char fmt_header[4]; // Contains "fmt "
+    uint32_t fmt_chunk_size; // 20 for IMA-ADPCM
+    uint16_t audio_format; // 0x11
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate; // sample_rate * sample_alignment / samples_per_block
+    uint16_t sample_alignment; // Bytes per block
+    uint16_t bit_depth; // 4
+    uint16_t extra_size; // 2, size of the fields below
+    uint16_t samples_per_block;
+    
+    // Fact
+    char fact_header[4]; // Contains "fact"
+    uint32_t fact_chunk_size; // 4
+    uint32_t sample_length; // Number of samples, the last block may be padded
+    
+    // Data
+    char data_header[4]; // Contains "data"
+    uint32_t data_bytes;
+} wav_ima_header;
+
+// Optional chunk after the data, marks sample positions
+typedef struct wav_cue_header {
+    char cue_header[4]; // Contains "cue "
+    uint32_t cue_chunk_size; // 4 + 24 * num_cue_points
+    uint32_t num_cue_points;
+} wav_cue_header;
+
+typedef struct wav_cue_point {
+    uint32_t id;
+    uint32_t position; // sample number
+    char data_chunk[4]; // Contains "data"
+    uint32_t chunk_start; // 0, there is only one data chunk
+    uint32_t block_start; // byte offset of the block holding the sample in the data, 0 for PCM
+    uint32_t sample_offset; // sample number in that block, for PCM the sample number
+} wav_cue_point;
@@ -0,0 +1,122 @@
+#include "wavparse.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+
+// fmt chunk up to the EXTENSIBLE sub-format code
+#define FMT_READ_SIZE 26
+
+static uint16_t get16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool parseFmt(const uint8_t *fmt, uint32_t size, WavInfo *info) {
+    if (size < 16) {
+        ESP_LOGE("wavparse", "fmt chunk too short");
+        return false;
+    }
+    info->format = get16(fmt);
+    info->channels = get16(fmt + 2);
+    info->sampleRate = get32(fmt + 4);
+    info->blockAlign = get16(fmt + 12);
+    info->bitsPerSample = get16(fmt + 14);
+    if (info->format == WAVE_FORMAT_EXTENSIBLE) {
+        if (size < FMT_READ_SIZE) {
+            ESP_LOGE("wavparse", "EXTENSIBLE fmt chunk too short");
+            return false;
+        }
+        // first two bytes of the sub-format GUID are the plain format code
+        info->format = get16(fmt + 24);
+    }
+    if (info->format == WAVE_FORMAT_IMA_ADPCM && size >= 20) {
+        info->samplesPerBlock = get16(fmt + 18);
+    }
+    return true;
+}
+
+static bool supported(const WavInfo *info) {
+    if (info->sampleRate < 1000 || info->sampleRate > 192000) {
+        ESP_LOGE("wavparse", "Unsupported rate %u", info->sampleRate);
+        return false;
+    }
+    if (info->channels < 1 || info->channels > 2) {
+        ESP_LOGE("wavparse", "Unsupported channel count %u", info->channels);
+        return false;
+    }
+    switch (info->format) {
+        case WAVE_FORMAT_PCM:
+            if (info->bitsPerSample != 8 && info->bitsPerSample != 16 &&
+                info->bitsPerSample != 24 && info->bitsPerSample != 32) {
+                break;
+            }
+            return info->blockAlign == info->channels * info->bitsPerSample / 8;
+        case WAVE_FORMAT_IEEE_FLOAT:
+            return info->bitsPerSample == 32 && info->blockAlign == info->channels * 4;
+        case WAVE_FORMAT_IMA_ADPCM:
+            // decoder is mono only
+            return info->channels == 1 && info->bitsPerSample == 4 && info->blockAlign > 4;
+    }
+    ESP_LOGE("wavparse", "Unsupported format 0x%x, %u bits", info->format, info->bitsPerSample);
+    return false;
+}
+
+bool wavParse(FILE *f, WavInfo *info) {
+    memset(info, 0, sizeof(WavInfo));
+    uint8_t riff[12];
+    if (fread(riff, 1, sizeof(riff), f) != sizeof(riff) ||
+        memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+        ESP_LOGE("wavparse", "Not a WAV file");
+        return false;
+    }
+
+    bool haveFmt = false;
+    uint32_t pos = sizeof(riff);
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), f) == sizeof(chunk)) {
+        uint32_t size = get32(chunk + 4);
+        pos += sizeof(chunk);
+
+        if (memcmp(chunk, "data", 4) == 0) {
+            if (!haveFmt) {
+                ESP_LOGE("wavparse", "data chunk before fmt chunk");
+                return false;
+            }
+            fseek(f, 0, SEEK_END);
+            uint32_t available = ftell(f) - pos;
+            fseek(f, pos, SEEK_SET);
+            info->dataOffset = pos;
+            info->dataBytes = (size == 0 || size > available) ? available : size;
+            return supported(info);
+        }
+
+        uint32_t used = 0;
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t fmt[FMT_READ_SIZE];
+            used = size < sizeof(fmt) ? size : sizeof(fmt);
+            if (fread(fmt, 1, used, f) != used || !parseFmt(fmt, size, info)) {
+                return false;
+            }
+            haveFmt = true;
+        } else if (memcmp(chunk, "fact", 4) == 0 && size >= 4) {
+            uint8_t fact[4];
+            used = sizeof(fact);
+            if (fread(fact, 1, used, f) != used) {
+                return false;
+            }
+            info->sampleLength = get32(fact);
+        }
+        // chunks are padded to an even size
+        uint32_t next = pos + size + (size & 1);
+        if (next < pos || fseek(f, next - pos - used, SEEK_CUR) != 0) {
+            break;
+        }
+        pos = next;
+    }
+    ESP_LOGE("wavparse", "No data chunk");
+    return false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_IMA_ADPCM 0x0011
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+// What the player needs to know about a WAV file. EXTENSIBLE files
+// report their sub-format, so format is one of the three above.
+typedef struct {
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sampleRate;
+    uint16_t blockAlign; // bytes per frame, or per block for ADPCM
+    uint16_t bitsPerSample;
+    uint16_t samplesPerBlock; // ADPCM only
+    uint32_t sampleLength; // from the fact chunk, 0 if there is none
+    uint32_t dataOffset;
+    uint32_t dataBytes;
+} WavInfo;
+
+// Walks the RIFF chunks up to "data", skipping everything it does not know.
+// Returns false for anything the player cannot play, f is left at the
+// first data byte otherwise. A data size of 0 or one past the end of the
+// file (recording that was never closed) is cut to what is in the file.
+bool wavParse(FILE *f, WavInfo *info);
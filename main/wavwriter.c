@@ -0,0 +1,110 @@
+#include "wavwriter.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "esp_heap_caps.h"
+
+// Reserves space for the next extent. Seeking past the end of a file opened
+// for writing makes FAT allocate the whole cluster chain at once,
+// instead of one FAT update per cluster as the data comes.
+static bool reserve(WavWriter *w) {
+    uint32_t end = w->allocated + WAV_WRITER_EXTENT;
+    if (lseek(w->fd, end, SEEK_SET) != end) {
+        return false;
+    }
+    if (lseek(w->fd, w->filePos, SEEK_SET) != w->filePos) {
+        return false;
+    }
+    w->allocated = end;
+    return true;
+}
+
+static bool flushBlock(WavWriter *w) {
+    if (w->filePos + w->blockFill > w->allocated) {
+        // not fatal, the file just grows cluster by cluster
+        reserve(w);
+    }
+    if (write(w->fd, w->block, w->blockFill) != w->blockFill) {
+        return false;
+    }
+    w->filePos += w->blockFill;
+    w->blockFill = 0;
+    return true;
+}
+
+bool wavWriterOpen(WavWriter *w, const char *filename, size_t headerSize) {
+    w->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (w->fd < 0) {
+        return false;
+    }
+    // DMA capable, so the SPI driver sends it as it is instead of copying it
+    // through a bounce buffer a sector at a time
+    w->block = heap_caps_malloc(SD_CLUSTER_SIZE, MALLOC_CAP_DMA);
+    if (w->block == NULL) {
+        close(w->fd);
+        return false;
+    }
+    // header goes to the start of the first block, data follows right after it
+    memset(w->block, 0, headerSize);
+    w->blockFill = headerSize;
+    w->filePos = 0;
+    w->allocated = 0;
+    w->headerSize = headerSize;
+    w->dataBytes = 0;
+    reserve(w);
+    return true;
+}
+
+bool wavWriterWrite(WavWriter *w, const void *data, size_t len) {
+    const uint8_t *src = data;
+    w->dataBytes += len;
+
+    while (len > 0) {
+        size_t count = SD_CLUSTER_SIZE - w->blockFill;
+        if (count > len) {
+            count = len;
+        }
+        memcpy(w->block + w->blockFill, src, count);
+        w->blockFill += count;
+        src += count;
+        len -= count;
+
+        if (w->blockFill == SD_CLUSTER_SIZE && !flushBlock(w)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool wavWriterClose(WavWriter *w, const void *header) {
+    bool ok = true;
+
+    // if the first block was not written yet, header goes out with it
+    bool headerInBlock = (w->filePos == 0);
+    if (headerInBlock) {
+        memcpy(w->block, header, w->headerSize);
+    }
+    if (w->blockFill > 0) {
+        ok = flushBlock(w);
+    }
+    // drop the unused part of the last extent
+    if (ftruncate(w->fd, w->filePos) != 0) {
+        ok = false;
+    }
+    if (!headerInBlock) {
+        if (lseek(w->fd, 0, SEEK_SET) != 0 || write(w->fd, header, w->headerSize) != w->headerSize) {
+            ok = false;
+        }
+    }
+
+    heap_caps_free(w->block);
+    w->block = NULL;
+    if (close(w->fd) != 0) {
+        ok = false;
+    }
+    return ok;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// FAT allocation unit the card is mounted with, blocks are written in this size
+#define SD_CLUSTER_SIZE (16 * 1024)
+// file space is reserved ahead of the data in steps of this size
+#define WAV_WRITER_EXTENT (64 * SD_CLUSTER_SIZE)
+
+// Buffers the data into cluster sized blocks, so every write to the card
+// is one whole cluster at a cluster aligned file offset. The header is the
+// beginning of the first block and is filled in on close.
+// Only POSIX file calls are used, so it also works on the host, with
+// tools/esp_heap_caps.h for the buffer.
+typedef struct {
+    int fd;
+    uint8_t *block;
+    size_t blockFill; // bytes waiting in block
+    uint32_t filePos; // bytes already written to the file
+    uint32_t allocated; // bytes reserved in the file
+    size_t headerSize;
+    uint32_t dataBytes; // bytes passed to wavWriterWrite
+} WavWriter;
+
+bool wavWriterOpen(WavWriter *w, const char *filename, size_t headerSize);
+bool wavWriterWrite(WavWriter *w, const void *data, size_t len);
+// writes header (headerSize bytes), trims the reserved space and closes the file
+bool wavWriterClose(WavWriter *w, const void *header);
@@ -0,0 +1,122 @@
+// Round-trips recordings through the IMA-ADPCM codec (main/adpcm.h) on
+// the host, a block at a time as the writer and the player do, and
+// reports the signal to noise ratio and how many samples per second the
+// encoder and the decoder get through.
+//
+//   cc -O2 -Itools -Imain -o adpcmtest tools/adpcmtest.c main/adpcm.c
+//      main/wavparse.c main/convert.c -lm
+//   ./adpcmtest doc/recordings/*.WAV
+//
+// Takes PCM and float WAV. Fails a recording below MIN_SNR_DB.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "adpcm.h"
+#include "convert.h"
+#include "wavparse.h"
+
+#define SAMPLES_PER_BLOCK ADPCM_SAMPLES_PER_BLOCK(ADPCM_BLOCK_ALIGN)
+// the sample recordings give 33 to 38 dB, a broken codec far less
+#define MIN_SNR_DB 25
+// recordings are short, timing is over this many passes
+#define BENCH_PASSES 20
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Whole recording as mono 16 bits, padded with silence to whole blocks, NULL if it cannot be read
+static int16_t *load(const char *recording, size_t *count) {
+    FILE *f = fopen(recording, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", recording);
+        return NULL;
+    }
+    WavInfo info;
+    if (!wavParse(f, &info) || info.format == WAVE_FORMAT_IMA_ADPCM) {
+        fprintf(stderr, "%s: not a PCM WAV file\n", recording);
+        fclose(f);
+        return NULL;
+    }
+    uint32_t frames = info.dataBytes / info.blockAlign;
+    size_t padded = (frames + SAMPLES_PER_BLOCK - 1) / SAMPLES_PER_BLOCK * SAMPLES_PER_BLOCK;
+    uint8_t *raw = malloc(info.dataBytes);
+    int16_t *samples = calloc(padded + 1, sizeof(int16_t));
+    if (raw != NULL && samples != NULL) {
+        frames = fread(raw, info.blockAlign, frames, f);
+        convertWavToMono16(raw, frames, info.channels, info.bitsPerSample,
+                           info.format == WAVE_FORMAT_IEEE_FLOAT, samples);
+    }
+    free(raw);
+    fclose(f);
+    *count = frames;
+    return samples;
+}
+
+static bool process(const char *recording) {
+    size_t count;
+    int16_t *samples = load(recording, &count);
+    if (samples == NULL) {
+        return false;
+    }
+    size_t blocks = (count + SAMPLES_PER_BLOCK - 1) / SAMPLES_PER_BLOCK;
+    uint8_t *encoded = malloc(blocks * ADPCM_BLOCK_ALIGN + 1);
+    int16_t *decoded = malloc(blocks * SAMPLES_PER_BLOCK * sizeof(int16_t) + 1);
+
+    AdpcmState state;
+    double start = now();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        adpcmInit(&state);
+        for (size_t b = 0; b < blocks; b++) {
+            adpcmEncodeBlock(&state, samples + b * SAMPLES_PER_BLOCK, encoded + b * ADPCM_BLOCK_ALIGN);
+        }
+    }
+    double encodeTime = now() - start;
+
+    bool ok = true;
+    start = now();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        for (size_t b = 0; b < blocks; b++) {
+            size_t n = adpcmDecodeBlock(encoded + b * ADPCM_BLOCK_ALIGN, ADPCM_BLOCK_ALIGN,
+                                        decoded + b * SAMPLES_PER_BLOCK);
+            ok = ok && n == SAMPLES_PER_BLOCK;
+        }
+    }
+    double decodeTime = now() - start;
+
+    double signal = 0, noise = 0;
+    for (size_t i = 0; i < count; i++) {
+        double e = decoded[i] - samples[i];
+        signal += (double)samples[i] * samples[i];
+        noise += e * e;
+    }
+    double snr = 10 * log10(signal / (noise > 0 ? noise : 1));
+    double total = (double)blocks * SAMPLES_PER_BLOCK * BENCH_PASSES;
+    printf("%s: %zu samples, SNR %.1f dB, encode %.1f M samples/s, decode %.1f M samples/s\n", recording, count, snr,
+           total / encodeTime * 1e-6, total / decodeTime * 1e-6);
+    if (!ok) {
+        printf("%s: a block did not decode to %d samples\n", recording, SAMPLES_PER_BLOCK);
+    }
+    free(samples);
+    free(encoded);
+    free(decoded);
+    return ok && snr >= MIN_SNR_DB;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s recording...\n", argv[0]);
+        return 2;
+    }
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        failed += !process(argv[i]);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,265 @@
+// Checks on the host that an overdub take ends up lined up with the file
+// it was played over (main/align.h). Every trial plays a recording the
+// way the player does, click and lead-in first, through a simulated room
+// with a random delay, gain and noise into the mic at the capture rate,
+// decimates it like the recorder and lines it up with the aligner, fed in
+// random chunks and told about the click late, as the writer is. Then
+// the take is cross-correlated with the recording, it should peak at 0,
+// or next to it where the room delay is not a whole number of samples.
+// The same is done with the click too quiet to be heard, where the clocks
+// alone decide and the take is late by the round trip.
+//
+//   cc -O2 -Itools -Imain -o aligntest tools/aligntest.c main/align.c
+//      main/resampler.c main/decimator.c main/wavparse.c main/convert.c -lm
+//   ./aligntest doc/recordings/*.WAV
+//
+// Takes PCM and float WAV. Recordings are overdubbed at 44.1 kHz and,
+// converted first, at 16 kHz.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "align.h"
+#include "convert.h"
+#include "decimator.h"
+#include "resampler.h"
+#include "wavparse.h"
+
+// same as the device
+#define AMP_RATE 44100
+#define CLICK_FRAMES 44
+#define CLICK_LEVEL 24000
+
+#ifndef TRIALS
+#define TRIALS 25
+#endif
+// compared after the lag, enough to leave no doubt
+#define COMPARE_MS 2000
+#define MAX_LAG_MS 20
+
+typedef struct {
+    uint32_t rate;
+    uint32_t micRate;
+    int decimation;
+} Profile;
+
+static const Profile profiles[] = {
+    { 44100, 44100, 1 },
+    { 16000, 48000, 3 },
+};
+
+static Resampler resampler;
+static Decimator decimator;
+static Aligner aligner;
+static uint32_t seed = 1;
+
+static uint32_t randomBelow(uint32_t n) {
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % n;
+}
+
+// Whole recording as mono 16 bits, NULL if it cannot be read
+static int16_t *load(const char *recording, WavInfo *info) {
+    FILE *f = fopen(recording, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", recording);
+        return NULL;
+    }
+    if (!wavParse(f, info) || info->format == WAVE_FORMAT_IMA_ADPCM) {
+        fprintf(stderr, "%s: not a PCM WAV file\n", recording);
+        fclose(f);
+        return NULL;
+    }
+    uint32_t frames = info->dataBytes / info->blockAlign;
+    uint8_t *raw = malloc(info->dataBytes);
+    int16_t *samples = malloc(frames * sizeof(int16_t) + 1);
+    if (raw != NULL && samples != NULL) {
+        frames = fread(raw, info->blockAlign, frames, f);
+        convertWavToMono16(raw, frames, info->channels, info->bitsPerSample,
+                           info->format == WAVE_FORMAT_IEEE_FLOAT, samples);
+        info->dataBytes = frames * sizeof(int16_t);
+    }
+    free(raw);
+    fclose(f);
+    return samples;
+}
+
+// Converts in to outRate into out, in small steps like the player, returns the count
+static size_t resample(const int16_t *in, size_t count, uint32_t inRate, uint32_t outRate, int16_t *out,
+                       size_t outCount) {
+    resamplerInit(&resampler, inRate, outRate);
+    size_t used = 0;
+    size_t made = 0;
+    while (used < count && made < outCount) {
+        size_t n = count - used < 256 ? count - used : 256;
+        made += resamplerProcess(&resampler, in + used, &n, out + made, outCount - made);
+        used += n;
+    }
+    return made;
+}
+
+// Lag at which take matches old best, within MAX_LAG_MS
+static int bestLag(const int16_t *take, size_t takeCount, const int16_t *old, size_t oldCount, uint32_t rate) {
+    int maxLag = rate * MAX_LAG_MS / 1000;
+    size_t n = rate * COMPARE_MS / 1000;
+    if (n + 2 * maxLag > oldCount) {
+        n = oldCount - 2 * maxLag;
+    }
+    if (n + 2 * maxLag > takeCount) {
+        n = takeCount - 2 * maxLag;
+    }
+    int best = 0;
+    double bestSum = -1e300;
+    for (int lag = -maxLag; lag <= maxLag; lag++) {
+        double sum = 0;
+        for (size_t i = maxLag; i < n + maxLag; i++) {
+            sum += (double)take[i + lag] * old[i];
+        }
+        if (sum > bestSum) {
+            bestSum = sum;
+            best = lag;
+        }
+    }
+    return best;
+}
+
+typedef struct {
+    int heard;
+    int exact;
+    int worstLag;
+    int worstMiss; // of the lag the clocks alone should give
+} Result;
+
+// One overdub of old at p->rate, gain in percent. Returns the lag of the take.
+static int overdub(const Profile *p, const int16_t *old, size_t oldCount, int gain, int *expectedLag, bool *heard) {
+    // what the amp sends: click, lead-in and the file at the amp rate
+    size_t leadIn = ALIGN_LEAD_IN_MS * AMP_RATE / 1000;
+    size_t ampCount = leadIn + (uint64_t)oldCount * AMP_RATE / p->rate + AMP_RATE / 10;
+    int16_t *amp = calloc(ampCount, sizeof(int16_t));
+    for (int i = 0; i < CLICK_FRAMES; i++) {
+        amp[i] = (i * 4000 / AMP_RATE) % 2 ? -CLICK_LEVEL : CLICK_LEVEL;
+    }
+    if (p->rate == AMP_RATE) {
+        memcpy(amp + leadIn, old, oldCount * sizeof(int16_t));
+    } else {
+        resample(old, oldCount, p->rate, AMP_RATE, amp + leadIn, ampCount - leadIn);
+    }
+
+    // the room, at the amp rate: the recorder started up to 300 ms before
+    // the amp, the sound takes 0.5 to 10 ms to come back
+    size_t before = AMP_RATE / 10 + randomBelow(AMP_RATE / 5);
+    size_t delay = AMP_RATE / 2000 + randomBelow(AMP_RATE / 100);
+    size_t airCount = before + delay + ampCount;
+    int16_t *air = malloc(airCount * sizeof(int16_t));
+    for (size_t i = 0; i < airCount; i++) {
+        int32_t x = (int32_t)randomBelow(201) - 100;
+        if (i >= before + delay) {
+            x += amp[i - before - delay] * gain / 100;
+        }
+        air[i] = x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : x;
+    }
+
+    // the mic at its rate, then the recorder's decimator
+    size_t micCount = (uint64_t)airCount * p->micRate / AMP_RATE + 64;
+    int16_t *take = malloc(micCount * sizeof(int16_t));
+    micCount = resample(air, airCount, AMP_RATE, p->micRate, take, micCount);
+    decimatorInit(&decimator, p->decimation);
+    size_t takeCount = decimatorProcess(&decimator, take, micCount, take);
+
+    // the clocks put the click up to 10 ms early, never late, the
+    // recorder adds what the decimator holds back
+    uint32_t txIndex = (uint64_t)before * p->rate / AMP_RATE;
+    uint32_t held = p->decimation > 1 ? decimator.taps / 2 / p->decimation : 0;
+    uint32_t clockTx = txIndex + held - randomBelow(p->rate / 100);
+    uint32_t fileLeadIn = ALIGN_LEAD_IN_MS * p->rate / 1000 + (p->rate != AMP_RATE ? RESAMPLE_DELAY : 0);
+    // lined up with the clocks only, the take starts early by the round
+    // trip: the room, the mic's resampler here and the decimator
+    double trip = (delay + (p->micRate != AMP_RATE ? RESAMPLE_DELAY : 0)) * (double)p->rate / AMP_RATE
+        + (decimator.taps - 1) / 2.0 / p->decimation * (p->decimation > 1);
+    *expectedLag = (int)(txIndex + trip - clockTx + 0.5);
+
+    // the writer: chunks as they come, told about the click one block before it
+    alignerInit(&aligner, p->rate);
+    size_t kept = 0;
+    size_t index = 0;
+    while (index < takeCount) {
+        size_t n = 1 + randomBelow(600);
+        n = n < takeCount - index ? n : takeCount - index;
+        if (aligner.txIndex == ALIGN_UNKNOWN && index + n + 128 > clockTx) {
+            alignerSetTx(&aligner, clockTx, fileLeadIn);
+        }
+        size_t drop = alignerDrop(&aligner, take + index, n);
+        memmove(take + kept, take + index + drop, (n - drop) * sizeof(int16_t));
+        kept += n - drop;
+        index += n;
+    }
+    *heard = aligner.click != ALIGN_UNKNOWN;
+    int lag = bestLag(take, kept, old, oldCount, p->rate);
+    free(amp);
+    free(air);
+    free(take);
+    return lag;
+}
+
+static bool process(const char *recording) {
+    WavInfo info;
+    int16_t *samples = load(recording, &info);
+    if (samples == NULL) {
+        return false;
+    }
+    if (info.sampleRate != AMP_RATE) {
+        fprintf(stderr, "%s: not %u Hz\n", recording, AMP_RATE);
+        free(samples);
+        return false;
+    }
+    size_t count = info.dataBytes / sizeof(int16_t);
+    bool ok = true;
+    for (int i = 0; i < sizeof(profiles) / sizeof(profiles[0]); i++) {
+        const Profile *p = &profiles[i];
+        size_t oldCount = (uint64_t)count * p->rate / AMP_RATE + 64;
+        int16_t *old = malloc(oldCount * sizeof(int16_t));
+        oldCount = resample(samples, count, AMP_RATE, p->rate, old, oldCount);
+
+        Result heard = { 0 };
+        Result quiet = { 0 };
+        for (int t = 0; t < TRIALS; t++) {
+            int expected;
+            bool clickHeard;
+            // speaker 30 to 90 % loud at the mic
+            int lag = overdub(p, old, oldCount, 30 + randomBelow(61), &expected, &clickHeard);
+            heard.heard += clickHeard;
+            heard.exact += clickHeard && lag == 0;
+            if (abs(lag) > abs(heard.worstLag)) {
+                heard.worstLag = lag;
+            }
+            // too quiet to reach ALIGN_MIN_LEVEL
+            lag = overdub(p, old, oldCount, 5, &expected, &clickHeard);
+            quiet.heard += clickHeard;
+            if (abs(lag - expected) > abs(quiet.worstMiss)) {
+                quiet.worstMiss = lag - expected;
+            }
+        }
+        printf("%s at %u Hz: click heard %d/%d, lag 0 in %d, worst %+d samples; "
+               "not heard %d/%d, worst %+d samples off the round trip\n",
+               recording, p->rate, heard.heard, TRIALS, heard.exact, heard.worstLag,
+               TRIALS - quiet.heard, TRIALS, quiet.worstMiss);
+        // a room delay that is not a whole number of samples may round either way
+        ok = ok && heard.heard == TRIALS && abs(heard.worstLag) <= 1 && quiet.heard == 0 && abs(quiet.worstMiss) <= 1;
+        free(old);
+    }
+    free(samples);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s recording...\n", argv[0]);
+        return 2;
+    }
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        failed += !process(argv[i]);
+    }
+    return failed ? 1 : 0;
+}
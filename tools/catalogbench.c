@@ -0,0 +1,253 @@
+// Times the recording catalog (main/catalog.h) on the host with a
+// directory of 10,000 recordings: the scan at mount, looking entries up
+// as the list screen does, and handing out names for new recordings.
+// Checks that the index comes out in number order with every file's
+// length, and that new names start above the highest number. Then boots
+// the catalog again from its journal, after the changes it has to cope
+// with, and counts the recordings whose headers it opened.
+//
+//   cc -O2 -Itools -Imain -o catalogbench tools/catalogbench.c main/catalog.c
+//      main/wavparse.c tools/freertos.c -lpthread -Wl,--wrap=fopen
+//   ./catalogbench /tmp
+//
+// Makes catalogbench-rec, full of short WAV files, and CATALOG.BIN in
+// the given directory and removes them again. A host file system opens
+// a file much faster than FAT on a card, the scan takes longer on the
+// device.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "catalog.h"
+// after the catalog, it brings the integer types
+#include "wav.h"
+
+#define FILES 10000
+#define LOOKUPS 100000
+#define NEW_RECORDINGS 1000
+#define RATE 16000
+// what the catalog writes before the records, and each record
+#define JOURNAL_HEADER 8
+#define JOURNAL_RECORD 32
+
+static char dir[256];
+static char journal[256];
+// recordings opened by the catalog since the last boot
+static int opened;
+
+FILE *__real_fopen(const char *path, const char *mode);
+
+// Every fopen of main/catalog.c lands here
+FILE *__wrap_fopen(const char *path, const char *mode) {
+    opened += strncmp(path, dir, strlen(dir)) == 0;
+    return __real_fopen(path, mode);
+}
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Length of recording number, so every file has its own
+static uint32_t samplesOf(int number) {
+    return number % 100 * RATE / 10;
+}
+
+static bool writeRecording(int number) {
+    char path[300];
+    snprintf(path, sizeof(path), "%s/%d.WAV", dir, number);
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    uint32_t dataBytes = samplesOf(number) * sizeof(int16_t);
+    wav_header h = {
+        .riff_header = { 'R', 'I', 'F', 'F' },
+        .wav_size = sizeof(wav_header) - 8 + dataBytes,
+        .wave_header = { 'W', 'A', 'V', 'E' },
+        .fmt_header = { 'f', 'm', 't', ' ' },
+        .fmt_chunk_size = 16,
+        .audio_format = 1,
+        .num_channels = 1,
+        .sample_rate = RATE,
+        .byte_rate = RATE * sizeof(int16_t),
+        .sample_alignment = sizeof(int16_t),
+        .bit_depth = 16,
+        .data_header = { 'd', 'a', 't', 'a' },
+        .data_bytes = dataBytes,
+    };
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    // only the size counts, the samples can be a hole
+    ok = ok && fseek(f, dataBytes, SEEK_CUR) == 0 && fputc(0, f) != EOF;
+    return (fclose(f) == 0) && ok;
+}
+
+static void removeAll() {
+    DIR *d = opendir(dir);
+    struct dirent *f;
+    char path[600];
+    while (d != NULL && (f = readdir(d)) != NULL) {
+        if (f->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", dir, f->d_name);
+            unlink(path);
+        }
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+    rmdir(dir);
+    unlink(journal);
+}
+
+static void removeRecording(int number) {
+    char path[300];
+    snprintf(path, sizeof(path), "%s/%d.WAV", dir, number);
+    unlink(path);
+}
+
+// the journal is rewritten to a new file and renamed, that gives it a new inode
+static bool journalStat(long *size, ino_t *inode) {
+    struct stat st;
+    bool ok = stat(journal, &st) == 0;
+    *size = ok ? st.st_size : -1;
+    *inode = ok ? st.st_ino : 0;
+    return ok;
+}
+
+// Entries in number order, with the length their files have, numbers in gaps are missing
+static bool checkIndex(int expected, int gapFrom, int gapTo) {
+    int wrong = 0;
+    uint32_t number = 1;
+    for (int i = 0; i < catalogCount(); i++, number++) {
+        if (number == gapFrom) {
+            number = gapTo + 1;
+        }
+        CatalogEntry e;
+        catalogGet(i, &e);
+        uint32_t ms = (uint64_t)samplesOf(e.number) * 1000 / RATE;
+        wrong += e.number != number || e.format != CATALOG_PCM || e.durationMs != ms || e.sampleRate != RATE;
+    }
+    printf("%d entries, %d wrong\n", catalogCount(), wrong);
+    return catalogCount() == expected && wrong == 0;
+}
+
+// Boots the catalog from the journal; it has to open opens recordings and,
+// unless the journal was fine, leave it holding exactly the live entries
+static bool boot(const char *what, int expected, int gapFrom, int gapTo, int opens, bool rewrite) {
+    long before, after;
+    ino_t inodeBefore, inodeAfter;
+    journalStat(&before, &inodeBefore);
+    opened = 0;
+    double start = now();
+    bool ok = catalogInit(dir, journal);
+    double took = (now() - start) * 1000;
+    journalStat(&after, &inodeAfter);
+    bool rewritten = inodeAfter != inodeBefore;
+    bool journalOk = rewritten == rewrite &&
+                     (rewritten ? after == JOURNAL_HEADER + (long)catalogCount() * JOURNAL_RECORD : after == before);
+    printf("boot %s: %.1f ms, read %d headers, journal %s, ", what, took, opened,
+           rewritten ? "rewritten" : "untouched");
+    ok = checkIndex(expected, gapFrom, gapTo) && ok;
+    return ok && opened == opens && journalOk;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s directory\n", argv[0]);
+        return 2;
+    }
+    snprintf(dir, sizeof(dir), "%s/catalogbench-rec", argv[1]);
+    snprintf(journal, sizeof(journal), "%s/CATALOG.BIN", argv[1]);
+    if (mkdir(dir, 0755) != 0 || access(journal, F_OK) == 0) {
+        fprintf(stderr, "%s or %s is in the way\n", dir, journal);
+        return 2;
+    }
+    for (int i = 1; i <= FILES; i++) {
+        if (!writeRecording(i)) {
+            fprintf(stderr, "cannot write %s/%d.WAV\n", dir, i);
+            removeAll();
+            return 1;
+        }
+    }
+
+    // no journal, every header is read
+    double start = now();
+    bool ok = catalogInit(dir, journal);
+    printf("scan of %d files: %.1f ms, ", FILES, (now() - start) * 1000);
+    ok = checkIndex(FILES, 0, 0) && ok;
+
+    start = now();
+    uint64_t total = 0;
+    for (int i = 0; i < LOOKUPS; i++) {
+        CatalogEntry e;
+        catalogGet(i % FILES, &e);
+        total += e.durationMs;
+    }
+    printf("%d lookups: %.2f ms (%llu ms of audio)\n", LOOKUPS, (now() - start) * 1000, (unsigned long long)total);
+
+    char path[300];
+    char expected[300];
+    start = now();
+    for (int i = 0; i < NEW_RECORDINGS; i++) {
+        catalogNewPath("WAV", path);
+        catalogAdd(path);
+        snprintf(expected, sizeof(expected), "%s/%d.WAV", dir, FILES + 1 + i);
+        ok = ok && strcmp(path, expected) == 0;
+    }
+    printf("%d new recordings: %.2f ms, %d entries, last %s\n", NEW_RECORDINGS, (now() - start) * 1000,
+           catalogCount(), path);
+    ok = ok && catalogCount() == FILES + NEW_RECORDINGS;
+
+    // the new recordings were never written, their entries go
+    ok = boot("after recordings that were never made", FILES, 0, 0, 0, true) && ok;
+    ok = boot("with nothing changed", FILES, 0, 0, 0, false) && ok;
+
+    // files deleted and copied onto the card by a computer
+    for (int i = 101; i <= 110; i++) {
+        removeRecording(i);
+    }
+    for (int i = FILES + 1; i <= FILES + 5; i++) {
+        writeRecording(i);
+    }
+    ok = boot("after 10 deletions and 5 copies", FILES - 5, 101, 110, 5, true) && ok;
+
+    // power lost before the writer could refresh the entry
+    catalogNewPath("WAV", path);
+    catalogAdd(path);
+    writeRecording(FILES + 6);
+    ok = boot("after an unfinished recording", FILES - 4, 101, 110, 1, true) && ok;
+
+    // power lost in the middle of an append
+    FILE *f = fopen(journal, "ab");
+    fwrite("torn", 1, 4, f);
+    fclose(f);
+    ok = boot("after a torn record", FILES - 4, 101, 110, 0, true) && ok;
+
+    // a damaged record, nothing after it can be trusted
+    f = fopen(journal, "r+b");
+    fseek(f, JOURNAL_HEADER + 5000 * JOURNAL_RECORD + 20, SEEK_SET);
+    fputc(0x55, f);
+    fclose(f);
+    ok = boot("after a damaged record", FILES - 4, 101, 110, FILES - 4, true) && ok;
+
+    // the same file refreshed until the journal is more than twice as long as it has to be
+    catalogPath(0, path);
+    for (int i = 0; i < FILES; i++) {
+        catalogRefresh(path, CATALOG_PEAK_UNKNOWN);
+    }
+    ok = boot("after 10,000 updates", FILES - 4, 101, 110, 0, false) && ok;
+    for (int i = 0; i < 100; i++) {
+        catalogRefresh(path, CATALOG_PEAK_UNKNOWN);
+    }
+    ok = boot("after 10,100 updates", FILES - 4, 101, 110, 0, true) && ok;
+
+    removeAll();
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+// Checks on the host that the unrolled I2S conversion kernels
+// (main/convert.h) give exactly what the reference ones do, that the
+// metered one also gets the level right, and reports how many samples
+// per second each of them converts and what metering adds.
+//
+//   cc -O2 -Itools -Imain -o convbench tools/convbench.c main/convert.c
+//   ./convbench
+//
+// Inputs are random, full scale included, in blocks of every length up
+// to a few hundred and at odd offsets, so the tails and the unaligned
+// paths are compared too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#endif
+
+// what one I2S read holds on the device
+#define BLOCK_FRAMES 128
+#define MAX_FRAMES 300
+#define BENCH_PASSES 200000
+#define METER_RUNS 9
+
+static uint32_t seed = 1;
+
+static uint32_t randomWord() {
+    seed = seed * 1664525 + 1013904223;
+    return seed ^ (seed >> 15) * 2654435761u;
+}
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Random mic frames, now and then at the ends of the range so saturation is hit
+static void randomFrames(int32_t *frames, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t r = randomWord();
+        frames[2 * i] = randomWord();
+        frames[2 * i + 1] = r % 16 == 0 ? INT32_MIN : r % 16 == 1 ? INT32_MAX : (int32_t)r;
+    }
+}
+
+static bool compareMic() {
+    static int32_t frames[2 * MAX_FRAMES];
+    static int16_t ref[MAX_FRAMES];
+    static int16_t out[MAX_FRAMES];
+    size_t mismatches = 0;
+    for (int round = 0; round < 20; round++) {
+        DcBlock dcRef, dcOut;
+        dcBlockInit(&dcRef);
+        dcBlockInit(&dcOut);
+        // a run of blocks, so the filter state is carried across them
+        for (size_t n = 0; n <= MAX_FRAMES; n++) {
+            randomFrames(frames, n);
+            convertMicToPcm16Ref(frames, n, ref, &dcRef);
+            convertMicToPcm16Unrolled(frames, n, out, &dcOut);
+            mismatches += memcmp(ref, out, n * sizeof(int16_t)) != 0 || dcRef.acc != dcOut.acc;
+        }
+    }
+    printf("mic to PCM: %zu blocks differ\n", mismatches);
+    return mismatches == 0;
+}
+
+// The metered kernel converts like the reference one, its meter is worked out here the long way
+static bool compareMetered() {
+    static int32_t frames[2 * MAX_FRAMES];
+    static int16_t ref[MAX_FRAMES];
+    static int16_t out[MAX_FRAMES];
+    size_t mismatches = 0;
+    size_t meterMismatches = 0;
+    for (int round = 0; round < 20; round++) {
+        DcBlock dcRef, dcOut;
+        dcBlockInit(&dcRef);
+        dcBlockInit(&dcOut);
+        Meter meter, expected;
+        meterReset(&meter);
+        meterReset(&expected);
+        for (size_t n = 0; n <= MAX_FRAMES; n++) {
+            randomFrames(frames, n);
+            convertMicToPcm16Ref(frames, n, ref, &dcRef);
+            convertMicToPcm16Metered(frames, n, out, &dcOut, &meter);
+            mismatches += memcmp(ref, out, n * sizeof(int16_t)) != 0 || dcRef.acc != dcOut.acc;
+            // the last sample of each whole group of four goes into the meter
+            uint32_t energy = 0;
+            for (size_t i = 3; i < n; i += 4) {
+                expected.min = ref[i] < expected.min ? ref[i] : expected.min;
+                expected.max = ref[i] > expected.max ? ref[i] : expected.max;
+                energy += (uint32_t)(ref[i] * ref[i]) >> METER_ENERGY_SHIFT;
+            }
+            expected.energy += energy;
+            expected.count += n / 4;
+            meterMismatches += memcmp(&meter, &expected, sizeof(Meter)) != 0;
+            // now and then a new window, as the recorder starts one every 50 ms
+            if (n % 37 == 0) {
+                meterReset(&meter);
+                meterReset(&expected);
+            }
+        }
+    }
+    printf("mic to PCM, metered: %zu blocks differ, %zu meters differ\n", mismatches, meterMismatches);
+    return mismatches == 0 && meterMismatches == 0;
+}
+
+static bool compareAmp() {
+    // one more sample, so the input can start at an odd offset
+    static int16_t in[MAX_FRAMES + 1];
+    static int32_t ref[2 * MAX_FRAMES];
+    static int32_t out[2 * MAX_FRAMES];
+    size_t mismatches = 0;
+    for (int offset = 0; offset < 2; offset++) {
+        for (size_t n = 0; n <= MAX_FRAMES; n++) {
+            for (size_t i = 0; i <= n; i++) {
+                uint32_t r = randomWord();
+                in[i] = r % 8 == 0 ? INT16_MIN : r % 8 == 1 ? INT16_MAX : (int16_t)r;
+            }
+            memset(out, 0x55, sizeof(out));
+            convertPcm16ToAmpRef(in + offset, n, ref);
+            convertPcm16ToAmpUnrolled(in + offset, n, out);
+            mismatches += memcmp(ref, out, 2 * n * sizeof(int32_t)) != 0;
+        }
+    }
+    printf("PCM to amp: %zu blocks differ\n", mismatches);
+    return mismatches == 0;
+}
+
+// 8-bit WAV is the only unsigned format, it has to span the whole range
+static bool compareWav8() {
+    uint8_t bytes[] = { 0, 1, 127, 128, 129, 255 };
+    int16_t expected[] = { -32768, -32512, -256, 0, 256, 32512 };
+    int16_t out[sizeof(bytes)];
+    convertWavToMono16(bytes, sizeof(bytes), 1, 8, false, out);
+    bool ok = memcmp(out, expected, sizeof(out)) == 0;
+    printf("8-bit WAV: %s\n", ok ? "full range" : "wrong");
+    return ok;
+}
+
+typedef enum { MIC_REF, MIC_UNROLLED, MIC_METERED, AMP_REF, AMP_UNROLLED } Variant;
+
+// Runs the kernel over one block BENCH_PASSES times, returns samples per
+// second and the cycles each sample took, where the host can count them
+static double measure(Variant variant, double *cyclesPerSample) {
+    static int32_t frames[2 * BLOCK_FRAMES];
+    static int16_t samples[BLOCK_FRAMES];
+    randomFrames(frames, BLOCK_FRAMES);
+    for (size_t i = 0; i < BLOCK_FRAMES; i++) {
+        samples[i] = randomWord();
+    }
+    DcBlock dc;
+    dcBlockInit(&dc);
+    Meter meter;
+    meterReset(&meter);
+    double start = now();
+#ifdef CYCLES
+    uint64_t cycles = CYCLES();
+#endif
+    for (int i = 0; i < BENCH_PASSES; i++) {
+        switch (variant) {
+            case MIC_REF:
+                convertMicToPcm16Ref(frames, BLOCK_FRAMES, samples, &dc);
+                break;
+            case MIC_UNROLLED:
+                convertMicToPcm16Unrolled(frames, BLOCK_FRAMES, samples, &dc);
+                break;
+            case MIC_METERED:
+                convertMicToPcm16Metered(frames, BLOCK_FRAMES, samples, &dc, &meter);
+                break;
+            case AMP_REF:
+                convertPcm16ToAmpRef(samples, BLOCK_FRAMES, frames);
+                break;
+            case AMP_UNROLLED:
+                convertPcm16ToAmpUnrolled(samples, BLOCK_FRAMES, frames);
+                break;
+        }
+        // keep the compiler from dropping passes
+        __asm__ volatile("" : : "r"(frames), "r"(samples) : "memory");
+    }
+    double count = (double)BENCH_PASSES * BLOCK_FRAMES;
+#ifdef CYCLES
+    *cyclesPerSample = (CYCLES() - cycles) / count;
+#else
+    *cyclesPerSample = 0;
+#endif
+    return count / (now() - start);
+}
+
+static void bench(const char *name, Variant variant) {
+    double cycles;
+    double rate = measure(variant, &cycles);
+    printf("%-24s %8.1f M samples/s", name, rate * 1e-6);
+#ifdef CYCLES
+    printf(", %5.2f cycles per sample", cycles);
+#endif
+    printf("\n");
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// What the meter adds to the unrolled kernel, against how much the
+// unrolled kernel differs from itself. Runs alternate, so a clock change
+// hits both.
+static void meterCost() {
+    double plain[METER_RUNS];
+    double metered[METER_RUNS];
+    double cycles;
+    for (int i = 0; i < METER_RUNS; i++) {
+        plain[i] = 1e9 / measure(MIC_UNROLLED, &cycles);
+        metered[i] = 1e9 / measure(MIC_METERED, &cycles);
+    }
+    qsort(plain, METER_RUNS, sizeof(double), compareDoubles);
+    qsort(metered, METER_RUNS, sizeof(double), compareDoubles);
+    double median = plain[METER_RUNS / 2];
+    printf("meter over %d runs: %+.3f ns per sample (%+.0f %%), unrolled alone spans %.3f ns\n", METER_RUNS,
+           metered[METER_RUNS / 2] - median, (metered[METER_RUNS / 2] / median - 1) * 100,
+           plain[METER_RUNS - 1] - plain[0]);
+}
+
+int main() {
+    bool ok = compareMic();
+    ok = compareMetered() && ok;
+    ok = compareAmp() && ok;
+    ok = compareWav8() && ok;
+
+    bench("mic to PCM, reference", MIC_REF);
+    bench("mic to PCM, unrolled", MIC_UNROLLED);
+    bench("mic to PCM, metered", MIC_METERED);
+    meterCost();
+    bench("PCM to amp, reference", AMP_REF);
+    bench("PCM to amp, unrolled", AMP_UNROLLED);
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
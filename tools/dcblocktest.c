@@ -0,0 +1,218 @@
+// Checks the mic DC-blocker (main/dcblock.h) on the host, through the
+// conversion the recorder runs it in (main/convert.h), and compares its
+// cost with the fixed offset the recorder subtracted before, as
+// '(x - bias) >> 14' after a calibration pass.
+//
+//   cc -O2 -Itools -Imain -o dcblocktest tools/dcblocktest.c main/convert.c -lm
+//   ./dcblocktest
+//
+// Mic frames are made up: a tone on a large offset, an offset that jumps
+// or drifts like it does when the mic warms up, and a full scale step.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#endif
+
+#define RATE 44100
+// what one I2S read holds on the device
+#define BLOCK_FRAMES 128
+#define BENCH_PASSES 200000
+// the mic's 18 bits sit at the top of the 32-bit slot, 16-bit sample 1 is this much
+#define SLOT_LSB (1 << 14)
+
+static int32_t *frames;
+static int16_t *out;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Mic slot for a level in 16-bit units, clipped to the 18 bits the mic has
+static int32_t slot(double level) {
+    double x = level * SLOT_LSB;
+    double top = (double)INT32_MAX - SLOT_LSB / 4 + 1;
+    x = x > top ? top : x < INT32_MIN ? INT32_MIN : x;
+    return (int32_t)x & ~(SLOT_LSB / 4 - 1);
+}
+
+// Converts count frames in blocks, as the recorder does
+static void convert(size_t count) {
+    DcBlock dc;
+    dcBlockInit(&dc);
+    for (size_t i = 0; i < count; i += BLOCK_FRAMES) {
+        size_t n = count - i < BLOCK_FRAMES ? count - i : BLOCK_FRAMES;
+        convertMicToPcm16Ref(frames + 2 * i, n, out + i, &dc);
+    }
+}
+
+static double mean(size_t from, size_t count) {
+    double sum = 0;
+    for (size_t i = from; i < from + count; i++) {
+        sum += out[i];
+    }
+    return sum / count;
+}
+
+// Gain in dB of a tone at hz, on an offset of 3000, measured over the last second
+static double gainDb(double hz, double amplitude) {
+    size_t count = 4 * RATE + (size_t)(20 * RATE / hz);
+    for (size_t i = 0; i < count; i++) {
+        frames[2 * i] = 0;
+        frames[2 * i + 1] = slot(3000 + amplitude * sin(2 * M_PI * hz * i / RATE));
+    }
+    convert(count);
+    // a whole number of periods
+    size_t periods = (size_t)(hz < 1 ? 1 : hz);
+    size_t n = (size_t)(periods * RATE / hz);
+    double in = 0, o = 0;
+    for (size_t i = count - n; i < count; i++) {
+        double x = amplitude * sin(2 * M_PI * hz * i / RATE);
+        in += x * x;
+        o += (double)out[i] * out[i];
+    }
+    return 10 * log10(o / in);
+}
+
+static bool testTone() {
+    bool ok = true;
+    static const double tones[] = { 3.5, 6.85, 20, 100, 1000, 10000 };
+    printf("gain:");
+    for (int i = 0; i < sizeof(tones) / sizeof(tones[0]); i++) {
+        double g = gainDb(tones[i], 8000);
+        printf(" %g Hz %+.2f dB", tones[i], g);
+        // corner at RATE / (2 pi 2^DC_BLOCK_SHIFT), flat from 100 Hz up
+        if (tones[i] >= 100) {
+            ok = ok && fabs(g) < 0.05;
+        } else if (tones[i] == 6.85) {
+            ok = ok && fabs(g + 3) < 0.5;
+        }
+    }
+    // the offset is gone from the first sample on
+    double offset = mean(0, RATE);
+    printf(", offset left %.2f\n", offset);
+    return ok && fabs(offset) < 1;
+}
+
+// Offset jumps by 1000 after a second, it has to be below 1 again within
+// the time the time constant gives
+static bool testStep() {
+    size_t count = 3 * RATE;
+    for (size_t i = 0; i < count; i++) {
+        frames[2 * i] = 0;
+        frames[2 * i + 1] = slot(i < RATE ? -2000 : -1000);
+    }
+    convert(count);
+    size_t settled = RATE;
+    for (size_t i = RATE; i < count; i++) {
+        if (abs(out[i]) > 1) {
+            settled = i + 1;
+        }
+    }
+    double ms = (settled - RATE) * 1000.0 / RATE;
+    printf("offset step of 1000: below 1 again after %.0f ms\n", ms);
+    // e^-t/tau from 1000 to 1 takes ln(1000) time constants
+    return ms < 1.2 * log(1000) * (1 << DC_BLOCK_SHIFT) * 1000 / RATE;
+}
+
+// Offset drifts by 2000 over 10 s, the error has to stay at the ramp times the time constant
+static bool testDrift() {
+    size_t count = 10 * RATE;
+    for (size_t i = 0; i < count; i++) {
+        frames[2 * i] = 0;
+        frames[2 * i + 1] = slot(500 + 2000.0 * i / count + 300 * sin(2 * M_PI * 440 * i / RATE));
+    }
+    convert(count);
+    double worst = 0;
+    for (size_t i = 0; i + RATE / 10 <= count; i += RATE / 10) {
+        double m = fabs(mean(i, RATE / 10));
+        worst = m > worst ? m : worst;
+    }
+    double expected = 2000.0 / count * (1 << DC_BLOCK_SHIFT);
+    printf("offset drifting by 2000 in 10 s: worst 100 ms mean %.2f, %.2f expected\n", worst, expected);
+    return worst < expected + 1;
+}
+
+// Full scale down to full scale up, the output has to clip and not wrap around
+static bool testClip() {
+    size_t count = RATE / 10;
+    for (size_t i = 0; i < count; i++) {
+        frames[2 * i] = 0;
+        frames[2 * i + 1] = slot(i < 100 ? -32768 : 32767);
+    }
+    convert(count);
+    bool wrapped = false;
+    for (size_t i = 100; i < 200; i++) {
+        wrapped = wrapped || out[i] < 0;
+    }
+    printf("full scale step: first sample after it %d, %s\n", out[100], wrapped ? "wrapped" : "clipped");
+    return out[100] == INT16_MAX && !wrapped;
+}
+
+// What the recorder did before, with the offset averaged beforehand
+static void convertFixedBias(const int32_t *frames, size_t frameCount, int16_t *out, int64_t bias) {
+    for (size_t i = 0; i < frameCount; i++) {
+        out[i] = (frames[2 * i + 1] - bias) >> 14;
+    }
+}
+
+typedef void (*Kernel)(const int32_t *frames, size_t frameCount, int16_t *out, DcBlock *dc);
+
+static void bench(const char *name, Kernel kernel) {
+    DcBlock dc;
+    dcBlockInit(&dc);
+    double start = now();
+#ifdef CYCLES
+    uint64_t cycles = CYCLES();
+#endif
+    for (int i = 0; i < BENCH_PASSES; i++) {
+        if (kernel != NULL) {
+            kernel(frames, BLOCK_FRAMES, out, &dc);
+        } else {
+            convertFixedBias(frames, BLOCK_FRAMES, out, 3000 * SLOT_LSB);
+        }
+        // keep the compiler from dropping passes
+        __asm__ volatile("" : : "r"(out) : "memory");
+    }
+#ifdef CYCLES
+    cycles = CYCLES() - cycles;
+#endif
+    double spent = now() - start;
+    double samples = (double)BENCH_PASSES * BLOCK_FRAMES;
+    printf("%-22s %6.2f ns", name, spent * 1e9 / samples);
+#ifdef CYCLES
+    printf(", %5.2f cycles", cycles / samples);
+#endif
+    printf(" per sample\n");
+}
+
+int main() {
+    frames = malloc(2 * 12 * RATE * sizeof(int32_t));
+    out = malloc(12 * RATE * sizeof(int16_t));
+    bool ok = testTone();
+    ok = testStep() && ok;
+    ok = testDrift() && ok;
+    ok = testClip() && ok;
+
+    for (size_t i = 0; i < BLOCK_FRAMES; i++) {
+        frames[2 * i] = 0;
+        frames[2 * i + 1] = slot(3000 + 8000 * sin(2 * M_PI * 1000 * i / RATE));
+    }
+    bench("fixed bias, >> 14", NULL);
+    bench("DC-blocker, reference", convertMicToPcm16Ref);
+    bench("DC-blocker, unrolled", convertMicToPcm16Unrolled);
+
+    free(frames);
+    free(out);
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+// Measures the frequency response of the recorder's decimator
+// (main/decimator.h) on the host for every voice rate, and how many
+// samples per second it gets through.
+//
+//   cc -O2 -Itools -Imain -o decimtest tools/decimtest.c main/decimator.c -lm
+//   ./decimtest
+//
+// Tones at the mic rate go through the decimator in blocks, as the
+// recorder feeds it, and the level that comes out is compared with the
+// level that went in. Above the output Nyquist frequency whatever comes
+// out is an alias, the stopband figure is the loudest of them.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "decimator.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#endif
+
+#define MIC_RATE 48000
+// what one I2S read holds on the device
+#define BLOCK_FRAMES 128
+#define TONE_MS 300
+#define LEVEL 16000
+// what the recorder relies on, speech is below PASSBAND of the output rate
+#define PASSBAND 0.3
+#define MAX_RIPPLE_DB 0.1
+#define MIN_STOPBAND_DB 60
+#define BENCH_SAMPLES (MIC_RATE * 200)
+
+static Decimator decimator;
+static int16_t in[MIC_RATE * TONE_MS / 1000];
+static int16_t out[MIC_RATE * TONE_MS / 1000];
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Output level in dB relative to the input, of a tone at hz
+static double gainDb(int factor, double hz) {
+    size_t count = sizeof(in) / sizeof(in[0]);
+    for (size_t i = 0; i < count; i++) {
+        in[i] = lrint(LEVEL * sin(2 * M_PI * hz * i / MIC_RATE));
+    }
+    decimatorInit(&decimator, factor);
+    size_t made = 0;
+    for (size_t i = 0; i < count; i += BLOCK_FRAMES) {
+        size_t n = count - i < BLOCK_FRAMES ? count - i : BLOCK_FRAMES;
+        made += decimatorProcess(&decimator, in + i, n, out + made);
+    }
+    // past the filter's start-up
+    size_t skip = decimator.taps / factor;
+    double energy = 0;
+    for (size_t i = skip; i < made; i++) {
+        energy += (double)out[i] * out[i];
+    }
+    double rms = sqrt(energy / (made - skip));
+    // the rounding noise floor is about -100 dB, keep the log finite
+    return 20 * log10((rms + 1e-3) / (LEVEL / sqrt(2)));
+}
+
+static bool response(int factor) {
+    double outRate = MIC_RATE / factor;
+    double nyquist = outRate / 2;
+    double lo = 0, hi = -1000;
+    for (double hz = 50; hz <= PASSBAND * outRate; hz += 25) {
+        double g = gainDb(factor, hz);
+        lo = g < lo ? g : lo;
+        hi = g > hi ? g : hi;
+    }
+    double cutoff = gainDb(factor, DECIM_CUTOFF * nyquist);
+    double atNyquist = gainDb(factor, nyquist);
+    double stop = -1000;
+    double stopHz = 0;
+    for (double hz = nyquist + 50; hz < MIC_RATE / 2; hz += 50) {
+        double g = gainDb(factor, hz);
+        if (g > stop) {
+            stop = g;
+            stopHz = hz;
+        }
+    }
+    // from where the alias of a tone lands above PASSBAND of the output rate
+    double stopFrom = -1000;
+    for (double hz = outRate * (1 - PASSBAND); hz < MIC_RATE / 2; hz += 50) {
+        double g = gainDb(factor, hz);
+        stopFrom = g > stopFrom ? g : stopFrom;
+    }
+    printf("%5.0f Hz: passband to %4.0f Hz %+.3f to %+.3f dB, %+.1f dB at %.0f Hz, %+.1f dB at Nyquist, "
+           "aliases at most %+.1f dB (%.0f Hz), %+.1f dB from %.0f Hz\n",
+           outRate, PASSBAND * outRate, lo, hi, cutoff, DECIM_CUTOFF * nyquist, atNyquist, stop, stopHz, stopFrom,
+           outRate * (1 - PASSBAND));
+    return hi - lo <= MAX_RIPPLE_DB && stopFrom <= -MIN_STOPBAND_DB;
+}
+
+static void bench(int factor) {
+    int16_t *samples = malloc(BENCH_SAMPLES * sizeof(int16_t));
+    for (size_t i = 0; i < BENCH_SAMPLES; i++) {
+        samples[i] = lrint(LEVEL * sin(2 * M_PI * 440.0 * i / MIC_RATE));
+    }
+    decimatorInit(&decimator, factor);
+    double start = now();
+#ifdef CYCLES
+    uint64_t cycles = CYCLES();
+#endif
+    // in place, as the recorder does
+    for (size_t i = 0; i < BENCH_SAMPLES; i += BLOCK_FRAMES) {
+        decimatorProcess(&decimator, samples + i, BLOCK_FRAMES, samples + i);
+    }
+#ifdef CYCLES
+    cycles = CYCLES() - cycles;
+#endif
+    double spent = now() - start;
+    printf("by %d: %.1f M input samples/s", factor, BENCH_SAMPLES / spent * 1e-6);
+#ifdef CYCLES
+    printf(", %.2f cycles per input sample", (double)cycles / BENCH_SAMPLES);
+#endif
+    printf("\n");
+    free(samples);
+}
+
+int main() {
+    bool ok = true;
+    for (int factor = 3; factor <= DECIM_MAX_FACTOR; factor += 3) {
+        ok = response(factor) && ok;
+    }
+    for (int factor = 3; factor <= DECIM_MAX_FACTOR; factor += 3) {
+        bench(factor);
+    }
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+// Encodes recordings to FLAC on the host with the recorder's encoder
+// (main/flac.h), decodes them again with the player's decoder and checks
+// that every sample comes back. Reports the compression and how many
+// samples per second each side gets through. Then flips single bits in
+// the encoded stream: a damaged frame has to be skipped, never played.
+//
+//   cc -O2 -Itools -Imain -o flactest tools/flactest.c main/flac.c
+//      main/wavparse.c main/convert.c
+//   ./flactest doc/recordings/*.WAV
+//
+// Takes PCM and float WAV.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flac.h"
+#include "convert.h"
+#include "wavparse.h"
+
+// recordings are short, timing is over this many passes
+#define BENCH_PASSES 20
+#define CORRUPTIONS 200
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+} Stream;
+
+static FlacEncoder encoder;
+static FlacDecoder decoder;
+static int16_t frame[FLAC_MAX_BLOCK_SIZE];
+static uint32_t seed = 1;
+
+static uint32_t randomBelow(uint32_t n) {
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % n;
+}
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static size_t readStream(void *ctx, uint8_t *buf, size_t len) {
+    Stream *s = ctx;
+    size_t n = s->size - s->pos < len ? s->size - s->pos : len;
+    memcpy(buf, s->data + s->pos, n);
+    s->pos += n;
+    return n;
+}
+
+// Whole recording as mono 16 bits, NULL if it cannot be read
+static int16_t *load(const char *recording, WavInfo *info, size_t *count) {
+    FILE *f = fopen(recording, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", recording);
+        return NULL;
+    }
+    if (!wavParse(f, info) || info->format == WAVE_FORMAT_IMA_ADPCM) {
+        fprintf(stderr, "%s: not a PCM WAV file\n", recording);
+        fclose(f);
+        return NULL;
+    }
+    uint32_t frames = info->dataBytes / info->blockAlign;
+    uint8_t *raw = malloc(info->dataBytes);
+    int16_t *samples = malloc(frames * sizeof(int16_t) + 1);
+    if (raw != NULL && samples != NULL) {
+        frames = fread(raw, info->blockAlign, frames, f);
+        convertWavToMono16(raw, frames, info->channels, info->bitsPerSample,
+                           info->format == WAVE_FORMAT_IEEE_FLOAT, samples);
+    }
+    free(raw);
+    fclose(f);
+    *count = frames;
+    return samples;
+}
+
+// Encodes the whole recording as the writer does, returns the stream size
+static size_t encode(const int16_t *samples, size_t count, uint32_t rate, uint8_t *out, size_t *frameOffsets) {
+    flacEncoderInit(&encoder, rate);
+    size_t size = FLAC_HEADER_SIZE;
+    int frames = 0;
+    for (size_t i = 0; i < count; i += FLAC_BLOCK_SIZE) {
+        size_t n = count - i < FLAC_BLOCK_SIZE ? count - i : FLAC_BLOCK_SIZE;
+        frameOffsets[frames++] = size;
+        size += flacEncodeFrame(&encoder, samples + i, n, out + size);
+    }
+    frameOffsets[frames] = size;
+    flacWriteHeader(&encoder, out);
+    return size;
+}
+
+// Decodes the stream, returns the samples that came out, or -1 if one was wrong
+static long decode(const uint8_t *data, size_t size, const int16_t *samples, size_t count) {
+    Stream s = { data, size, 0 };
+    if (!flacDecoderInit(&decoder, readStream, &s)) {
+        return -1;
+    }
+    long decoded = 0;
+    size_t n;
+    while ((n = flacDecodeFrame(&decoder, frame)) > 0) {
+        if (decoder.frameSample + n > count || memcmp(frame, samples + decoder.frameSample, n * sizeof(int16_t))) {
+            return -1;
+        }
+        decoded += n;
+    }
+    return decoded;
+}
+
+static bool process(const char *recording) {
+    WavInfo info;
+    size_t count;
+    int16_t *samples = load(recording, &info, &count);
+    if (samples == NULL) {
+        return false;
+    }
+    size_t frames = (count + FLAC_BLOCK_SIZE - 1) / FLAC_BLOCK_SIZE;
+    uint8_t *data = malloc(FLAC_HEADER_SIZE + frames * FLAC_MAX_FRAME_BYTES);
+    size_t *frameOffsets = malloc((frames + 1) * sizeof(size_t));
+
+    size_t size = 0;
+    double start = now();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        size = encode(samples, count, info.sampleRate, data, frameOffsets);
+    }
+    double encodeTime = now() - start;
+    start = now();
+    long decoded = 0;
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        decoded = decode(data, size, samples, count);
+    }
+    double decodeTime = now() - start;
+    double total = (double)count * BENCH_PASSES;
+    printf("%s: %zu samples to %.1f %% of PCM, encode %.1f M samples/s, decode %.1f M samples/s, %s\n", recording,
+           count, 100.0 * size / (2 * count), total / encodeTime * 1e-6, total / decodeTime * 1e-6,
+           decoded == (long)count ? "lossless" : "NOT LOSSLESS");
+    bool ok = decoded == (long)count;
+
+    // one bit flipped somewhere in a frame, that frame has to go and only that one
+    uint8_t *damaged = malloc(size);
+    int played = 0;
+    int lost = 0;
+    for (int i = 0; i < CORRUPTIONS; i++) {
+        memcpy(damaged, data, size);
+        size_t f = randomBelow(frames);
+        size_t byte = frameOffsets[f] + randomBelow(frameOffsets[f + 1] - frameOffsets[f]);
+        damaged[byte] ^= 1 << randomBelow(8);
+        long n = decode(damaged, size, samples, count);
+        size_t frameSamples = f + 1 < frames ? FLAC_BLOCK_SIZE : count - f * FLAC_BLOCK_SIZE;
+        played += n < 0;
+        lost += n >= 0 && n != (long)(count - frameSamples);
+    }
+    printf("%s: %d bit flips, damaged frame played %d times, other frames lost %d times\n", recording, CORRUPTIONS,
+           played, lost);
+    ok = ok && played == 0 && lost == 0;
+
+    free(damaged);
+    free(data);
+    free(frameOffsets);
+    free(samples);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s recording...\n", argv[0]);
+        return 2;
+    }
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        failed += !process(argv[i]);
+    }
+    return failed ? 1 : 0;
+}
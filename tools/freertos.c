@@ -0,0 +1,279 @@
+// The FreeRTOS calls the firmware's portable modules make, on pthreads,
+// so their tasks, queues and handshakes can be run on the host. Tasks are plain
+// threads: priorities and cores are ignored, a test that depends on
+// them does not belong here. Timeouts are honoured in 10 ms ticks.
+//
+// Build it with the module under test and -Itools -lpthread.
+
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct HostSemaphore {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned count;
+    unsigned max;
+};
+
+struct HostQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    unsigned length;
+    unsigned itemSize;
+    unsigned head;
+    unsigned count;
+    uint8_t *items;
+};
+
+struct HostTask {
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notifications;
+};
+
+typedef struct {
+    TaskFunction_t task;
+    void *parameters;
+    TaskHandle_t handle;
+} TaskStart;
+
+static __thread TaskHandle_t currentTask;
+
+// Absolute time ticks from now, for pthread_cond_timedwait
+static struct timespec deadline(TickType_t ticks) {
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    uint64_t ns = (uint64_t)ticks * portTICK_PERIOD_MS * 1000000;
+    t.tv_sec += ns / 1000000000;
+    t.tv_nsec += ns % 1000000000;
+    if (t.tv_nsec >= 1000000000) {
+        t.tv_sec++;
+        t.tv_nsec -= 1000000000;
+    }
+    return t;
+}
+
+// Waits on cond until ready says so or the ticks are up, lock held
+static bool waitFor(pthread_cond_t *cond, pthread_mutex_t *lock, bool (*ready)(void *), void *ctx, TickType_t wait) {
+    struct timespec until = deadline(wait);
+    while (!ready(ctx)) {
+        if (wait == 0) {
+            return false;
+        }
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(cond, lock);
+        } else if (pthread_cond_timedwait(cond, lock, &until) == ETIMEDOUT) {
+            return ready(ctx);
+        }
+    }
+    return true;
+}
+
+static SemaphoreHandle_t createSemaphore(unsigned max, unsigned count) {
+    SemaphoreHandle_t s = calloc(1, sizeof(struct HostSemaphore));
+    if (s != NULL) {
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->changed, NULL);
+        s->max = max;
+        s->count = count;
+    }
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return createSemaphore(1, 0);
+}
+
+// No priority inheritance and no owner, enough for mutual exclusion
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return createSemaphore(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+    return createSemaphore(maxCount, initialCount);
+}
+
+static bool semaphoreAvailable(void *ctx) {
+    return ((SemaphoreHandle_t)ctx)->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait) {
+    pthread_mutex_lock(&s->lock);
+    bool taken = waitFor(&s->changed, &s->lock, semaphoreAvailable, s, wait);
+    if (taken) {
+        s->count--;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+    pthread_mutex_lock(&s->lock);
+    bool given = s->count < s->max;
+    if (given) {
+        s->count++;
+        pthread_cond_broadcast(&s->changed);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return given ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t s) {
+    pthread_mutex_lock(&s->lock);
+    unsigned count = s->count;
+    pthread_mutex_unlock(&s->lock);
+    return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    QueueHandle_t q = calloc(1, sizeof(struct HostQueue));
+    if (q == NULL) {
+        return NULL;
+    }
+    q->items = malloc(length * itemSize);
+    if (q->items == NULL) {
+        free(q);
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->changed, NULL);
+    q->length = length;
+    q->itemSize = itemSize;
+    return q;
+}
+
+static bool queueHasRoom(void *ctx) {
+    QueueHandle_t q = ctx;
+    return q->count < q->length;
+}
+
+static bool queueHasItem(void *ctx) {
+    return ((QueueHandle_t)ctx)->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait) {
+    pthread_mutex_lock(&q->lock);
+    bool sent = waitFor(&q->changed, &q->lock, queueHasRoom, q, wait);
+    if (sent) {
+        memcpy(q->items + (q->head + q->count) % q->length * q->itemSize, item, q->itemSize);
+        q->count++;
+        pthread_cond_broadcast(&q->changed);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return sent ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait) {
+    pthread_mutex_lock(&q->lock);
+    bool received = waitFor(&q->changed, &q->lock, queueHasItem, q, wait);
+    if (received) {
+        memcpy(item, q->items + q->head * q->itemSize, q->itemSize);
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_broadcast(&q->changed);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return received ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    pthread_mutex_lock(&q->lock);
+    unsigned count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+static TaskHandle_t createTask(void) {
+    TaskHandle_t t = calloc(1, sizeof(struct HostTask));
+    if (t != NULL) {
+        pthread_mutex_init(&t->lock, NULL);
+        pthread_cond_init(&t->notified, NULL);
+    }
+    return t;
+}
+
+static void *runTask(void *arg) {
+    TaskStart start = *(TaskStart *)arg;
+    free(arg);
+    currentTask = start.handle;
+    start.task(start.parameters);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core) {
+    TaskStart *start = malloc(sizeof(TaskStart));
+    if (start == NULL) {
+        return pdFAIL;
+    }
+    start->task = task;
+    start->parameters = parameters;
+    start->handle = createTask();
+    pthread_t thread;
+    if (start->handle == NULL || pthread_create(&thread, NULL, runTask, start) != 0) {
+        free(start->handle);
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    if (created != NULL) {
+        *created = start->handle;
+    }
+    return pdPASS;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * configTICK_RATE_HZ + t.tv_nsec / (1000000000 / configTICK_RATE_HZ);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec t = { ticks / configTICK_RATE_HZ, ticks % configTICK_RATE_HZ * (1000000000 / configTICK_RATE_HZ) };
+    nanosleep(&t, NULL);
+}
+
+// Only a task ending itself, as the firmware's tasks do
+void vTaskDelete(TaskHandle_t task) {
+    pthread_exit(NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (currentTask == NULL) {
+        currentTask = createTask();
+    }
+    return currentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notifications++;
+    pthread_cond_broadcast(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+static bool notificationPending(void *ctx) {
+    return ((TaskHandle_t)ctx)->notifications > 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    pthread_mutex_lock(&task->lock);
+    waitFor(&task->notified, &task->lock, notificationPending, task, wait);
+    uint32_t count = task->notifications;
+    if (count > 0) {
+        task->notifications = clearOnExit ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return count;
+}
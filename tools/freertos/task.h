@@ -0,0 +1,19 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct HostTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+// A thread; stack size, priority and core are ignored
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+// NULL only, the calling task ends
+void vTaskDelete(TaskHandle_t task);
+// The main thread gets a handle too, the first time it asks
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+// Notifications as a counting semaphore, the way the firmware uses them
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait);
@@ -0,0 +1,226 @@
+// Feeds synthetic button edge traces to the gesture state machine
+// (main/gesture.h) on the host, the way main/buttons.c does, and checks
+// the events that come out and when. Covers bouncy presses, releases
+// inside the debounce lockout, held repeats, long presses, double clicks,
+// a late caller, flags changed between screens and the millisecond
+// counter wrapping around.
+//
+//   cc -O2 -Itools -Imain -o gesturetest tools/gesturetest.c main/gesture.c
+//   ./gesturetest
+//
+// Then prints how late each kind of button reports a short press.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gesture.h"
+
+#define MAX_EVENTS 32
+
+// buttons as main.c sets them up, OK as in the file list
+enum { UP, DOWN, OK };
+static const uint8_t deviceFlags[] = { GESTURE_REPEATS, GESTURE_REPEATS, GESTURE_LONG_PRESS | GESTURE_DOUBLE_CLICK };
+// what main.c gives OK on its other screens
+#define SETTINGS_FLAGS GESTURE_LONG_PRESS
+#define STOP_FLAGS 0
+
+typedef struct {
+    const char *name;
+    const ButtonEdge *edges;
+    int edgeCount;
+    uint32_t endMs; // time run until after the last edge
+    const GestureEvent *expected;
+    int expectedCount;
+} Trace;
+
+#define TRACE(name, edges, endMs, expected) \
+    { name, edges, sizeof(edges) / sizeof(edges[0]), endMs, expected, sizeof(expected) / sizeof(expected[0]) }
+
+static const char *const kindNames[] = { "press", "long", "repeat", "double" };
+
+// clean press and release
+static const ButtonEdge tap[] = { { OK, 1, 1000 }, { OK, 0, 1100 } };
+static const GestureEvent tapOk[] = { { OK, GESTURE_PRESS, 1100 + GESTURE_DOUBLE_MS } };
+
+// contacts bounce on the way down and up, one press
+static const ButtonEdge bouncy[] = {
+    { DOWN, 1, 0 }, { DOWN, 0, 2 }, { DOWN, 1, 5 }, { DOWN, 0, 9 }, { DOWN, 1, 12 },
+    { DOWN, 0, 200 }, { DOWN, 1, 203 }, { DOWN, 0, 207 },
+};
+static const GestureEvent bouncyOk[] = { { DOWN, GESTURE_PRESS, 0 } };
+
+// so short the button is up again when the lockout ends, then a real press
+static const ButtonEdge glitch[] = { { DOWN, 1, 0 }, { DOWN, 0, 3 }, { DOWN, 1, 50 }, { DOWN, 0, 120 } };
+static const GestureEvent glitchOk[] = { { DOWN, GESTURE_PRESS, 0 }, { DOWN, GESTURE_PRESS, 50 } };
+
+// held, repeats from GESTURE_REPEAT_DELAY_MS on every GESTURE_REPEAT_MS until released
+static const ButtonEdge held[] = { { UP, 1, 0 }, { UP, 0, 850 } };
+static const GestureEvent heldOk[] = {
+    { UP, GESTURE_PRESS, 0 }, { UP, GESTURE_REPEAT, 400 }, { UP, GESTURE_REPEAT, 500 },
+    { UP, GESTURE_REPEAT, 600 }, { UP, GESTURE_REPEAT, 700 }, { UP, GESTURE_REPEAT, 800 },
+};
+
+static const ButtonEdge longPress[] = { { OK, 1, 0 }, { OK, 0, 900 } };
+static const GestureEvent longPressOk[] = { { OK, GESTURE_LONG, GESTURE_LONG_MS } };
+
+// second press inside GESTURE_DOUBLE_MS of the first release, bouncing
+static const ButtonEdge doubleClick[] = {
+    { OK, 1, 0 }, { OK, 0, 80 }, { OK, 1, 200 }, { OK, 0, 202 }, { OK, 1, 204 }, { OK, 0, 300 },
+};
+static const GestureEvent doubleClickOk[] = { { OK, GESTURE_DOUBLE, 200 } };
+
+// second press just too late, two presses
+static const ButtonEdge twoTaps[] = { { OK, 1, 0 }, { OK, 0, 80 }, { OK, 1, 80 + GESTURE_DOUBLE_MS }, { OK, 0, 400 } };
+static const GestureEvent twoTapsOk[] = {
+    { OK, GESTURE_PRESS, 80 + GESTURE_DOUBLE_MS }, { OK, GESTURE_PRESS, 400 + GESTURE_DOUBLE_MS },
+};
+
+// DOWN held while UP is tapped, each button keeps to itself
+static const ButtonEdge together[] = { { DOWN, 1, 0 }, { UP, 1, 100 }, { UP, 0, 150 }, { DOWN, 0, 450 } };
+static const GestureEvent togetherOk[] = {
+    { DOWN, GESTURE_PRESS, 0 }, { UP, GESTURE_PRESS, 100 }, { DOWN, GESTURE_REPEAT, 400 },
+};
+
+// the millisecond counter wraps in the middle of a long press
+static const ButtonEdge wrapped[] = { { OK, 1, UINT32_MAX - 100 }, { OK, 0, 600 } };
+static const GestureEvent wrappedOk[] = { { OK, GESTURE_LONG, UINT32_MAX - 100 + GESTURE_LONG_MS } };
+
+static const Trace traces[] = {
+    TRACE("tap", tap, 1000, tapOk),
+    TRACE("bouncy press", bouncy, 1000, bouncyOk),
+    TRACE("glitch inside the lockout", glitch, 1000, glitchOk),
+    TRACE("held", held, 1000, heldOk),
+    TRACE("long press", longPress, 1000, longPressOk),
+    TRACE("double click", doubleClick, 1000, doubleClickOk),
+    TRACE("two taps", twoTaps, 1000, twoTapsOk),
+    TRACE("two buttons", together, 1000, togetherOk),
+    TRACE("wrap-around", wrapped, 1000, wrappedOk),
+};
+
+static Gesture gesture;
+
+static bool reached(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) >= 0;
+}
+
+// Ticks at every deadline before until, as the waiting task does when nothing comes in
+static int tickUntil(uint32_t *now, uint32_t until, GestureEvent *events, int n) {
+    uint32_t wait;
+    while ((wait = gestureTimeout(&gesture, *now)) != GESTURE_NO_DEADLINE && !reached(*now + wait, until)) {
+        *now += wait;
+        n += gestureTick(&gesture, *now, events + n);
+    }
+    return n;
+}
+
+// Runs edges through the gestures like buttonsWait, returns the number of events
+static int run(const uint8_t *flags, const ButtonEdge *edges, int count, uint32_t endMs, GestureEvent *events) {
+    gestureInit(&gesture, flags, sizeof(deviceFlags));
+    int n = 0;
+    uint32_t now = edges[0].timeMs;
+    for (int i = 0; i < count && n < MAX_EVENTS - 2 * GESTURE_MAX_EVENTS; i++) {
+        n = tickUntil(&now, edges[i].timeMs, events, n);
+        now = edges[i].timeMs;
+        n += gestureTick(&gesture, now, events + n);
+        n += gestureEdge(&gesture, &edges[i], events + n);
+    }
+    return tickUntil(&now, now + endMs, events, n);
+}
+
+static void printEvents(const GestureEvent *events, int n) {
+    for (int i = 0; i < n; i++) {
+        printf(" %d %s at %u", events[i].button, kindNames[events[i].kind], events[i].timeMs);
+    }
+    printf("\n");
+}
+
+static bool check(const Trace *t) {
+    GestureEvent events[MAX_EVENTS];
+    int n = run(deviceFlags, t->edges, t->edgeCount, t->endMs, events);
+    bool ok = n == t->expectedCount;
+    for (int i = 0; i < n && ok; i++) {
+        ok = events[i].button == t->expected[i].button && events[i].kind == t->expected[i].kind &&
+             events[i].timeMs == t->expected[i].timeMs;
+    }
+    printf("%s: %s\n", t->name, ok ? "ok" : "FAILED");
+    if (!ok) {
+        printf("  expected:");
+        printEvents(t->expected, t->expectedCount);
+        printf("  got:");
+        printEvents(events, n);
+    }
+    return ok;
+}
+
+// A caller that comes back late gets one repeat, not one for every interval it missed
+static bool lateCaller() {
+    GestureEvent events[MAX_EVENTS];
+    gestureInit(&gesture, deviceFlags, sizeof(deviceFlags));
+    ButtonEdge down = { UP, 1, 0 };
+    int n = gestureEdge(&gesture, &down, events);
+    n += gestureTick(&gesture, 1000, events + n);
+    n += gestureTick(&gesture, 1099, events + n);
+    n += gestureTick(&gesture, 1100, events + n);
+    bool ok = n == 3 && events[1].kind == GESTURE_REPEAT && events[1].timeMs == GESTURE_REPEAT_DELAY_MS &&
+              events[2].kind == GESTURE_REPEAT && events[2].timeMs == 1100;
+    printf("late caller: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// OK's double click is taken away while a tap still waits for a second
+// one: the tap comes out with the next press, which counts at once
+static bool changedFlags() {
+    GestureEvent events[MAX_EVENTS];
+    gestureInit(&gesture, deviceFlags, sizeof(deviceFlags));
+    ButtonEdge edges[] = { { OK, 1, 0 }, { OK, 0, 100 }, { OK, 1, 200 }, { OK, 0, 300 }, { OK, 1, 1000 } };
+    int n = 0;
+    for (int i = 0; i < 5; i++) {
+        if (i == 2) {
+            gestureSetFlags(&gesture, OK, STOP_FLAGS);
+        }
+        n += gestureTick(&gesture, edges[i].timeMs, events + n);
+        n += gestureEdge(&gesture, &edges[i], events + n);
+    }
+    bool ok = n == 3;
+    for (int i = 0; i < n && ok; i++) {
+        ok = events[i].kind == GESTURE_PRESS && events[i].timeMs == (i < 2 ? 200 : 1000);
+    }
+    printf("flags changed between screens: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// From the push to the event, for a 100 ms tap on a button with each set of flags
+static void latency() {
+    static const struct {
+        const char *name;
+        uint8_t flags;
+    } kinds[] = {
+        { "plain", 0 },
+        { "repeats", GESTURE_REPEATS },
+        { "long press", GESTURE_LONG_PRESS },
+        { "double click", GESTURE_DOUBLE_CLICK },
+        { "OK in the file list", GESTURE_LONG_PRESS | GESTURE_DOUBLE_CLICK },
+        { "OK in the settings", SETTINGS_FLAGS },
+        { "OK while recording or playing", STOP_FLAGS },
+    };
+    const ButtonEdge edges[] = { { 0, 1, 0 }, { 0, 0, 100 } };
+    printf("short press reported after, for a 100 ms tap:\n");
+    for (int i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        uint8_t flags[sizeof(deviceFlags)] = { kinds[i].flags };
+        GestureEvent events[MAX_EVENTS];
+        run(flags, edges, 2, 1000, events);
+        printf("  %-34s %3u ms\n", kinds[i].name, events[0].timeMs);
+    }
+}
+
+int main() {
+    bool ok = true;
+    for (int i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+        ok = check(&traces[i]) && ok;
+    }
+    ok = lateCaller() && ok;
+    ok = changedFlags() && ok;
+    latency();
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
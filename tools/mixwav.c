@@ -0,0 +1,142 @@
+// Mixes two recordings on the host with the mixer the device renders
+// overdubs with (main/mixer.h), streamed a chunk at a time as there, and
+// reports what it cost per output sample.
+//
+//   cc -O2 -Itools -Imain -o mixwav tools/mixwav.c main/mixer.c
+//      main/wavparse.c main/wavwriter.c main/convert.c
+//   ./mixwav out.WAV doc/recordings/1.WAV doc/recordings/5.WAV
+//
+// Takes PCM and float WAV at the same rate, the longer one sets the length.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "convert.h"
+#include "mixer.h"
+#include "wav.h"
+#include "wavparse.h"
+#include "wavwriter.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#endif
+
+// passes over one chunk for the mixing cost alone
+#define KERNEL_PASSES 20000
+
+typedef struct {
+    FILE *f;
+    WavInfo info;
+    uint32_t framesLeft;
+    uint8_t raw[MIX_CHUNK * 8];
+} Layer;
+
+static Layer layers[2];
+static Mixer mixer;
+static int16_t out[MIX_CHUNK];
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static bool openLayer(Layer *l, const char *recording) {
+    l->f = fopen(recording, "rb");
+    if (l->f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", recording);
+        return false;
+    }
+    if (!wavParse(l->f, &l->info) || l->info.format == WAVE_FORMAT_IMA_ADPCM) {
+        fprintf(stderr, "%s: not a PCM WAV file\n", recording);
+        return false;
+    }
+    l->framesLeft = l->info.dataBytes / l->info.blockAlign;
+    return true;
+}
+
+static size_t readLayer(void *ctx, int16_t *samples, size_t count) {
+    Layer *l = ctx;
+    size_t n = count < l->framesLeft ? count : l->framesLeft;
+    n = fread(l->raw, l->info.blockAlign, n, l->f);
+    convertWavToMono16(l->raw, n, l->info.channels, l->info.bitsPerSample,
+                       l->info.format == WAVE_FORMAT_IEEE_FLOAT, samples);
+    l->framesLeft -= n;
+    return n;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s out.WAV a.WAV b.WAV\n", argv[0]);
+        return 2;
+    }
+    if (!openLayer(&layers[0], argv[2]) || !openLayer(&layers[1], argv[3])) {
+        return 1;
+    }
+    uint32_t rate = layers[0].info.sampleRate;
+    if (layers[1].info.sampleRate != rate) {
+        fprintf(stderr, "%u Hz and %u Hz, the rates have to match\n", rate, layers[1].info.sampleRate);
+        return 1;
+    }
+    WavWriter wav;
+    if (!wavWriterOpen(&wav, argv[1], sizeof(wav_header))) {
+        fprintf(stderr, "%s: cannot create\n", argv[1]);
+        return 1;
+    }
+
+    mixerInit(&mixer, readLayer, &layers[0], readLayer, &layers[1]);
+    uint32_t mixed = 0;
+    bool ok = true;
+    size_t count;
+    double start = now();
+    while (ok && (count = mixerProcess(&mixer, out, MIX_CHUNK)) > 0) {
+        ok = wavWriterWrite(&wav, out, count * sizeof(int16_t));
+        mixed += count;
+    }
+    double spent = now() - start;
+    wav_header header = {
+        .riff_header = { 'R', 'I', 'F', 'F' },
+        .wav_size = sizeof(wav_header) - 8 + wav.dataBytes,
+        .wave_header = { 'W', 'A', 'V', 'E' },
+        .fmt_header = { 'f', 'm', 't', ' ' },
+        .fmt_chunk_size = 16,
+        .audio_format = 1,
+        .num_channels = 1,
+        .sample_rate = rate,
+        .byte_rate = rate * sizeof(int16_t),
+        .sample_alignment = sizeof(int16_t),
+        .bit_depth = 16,
+        .data_header = { 'd', 'a', 't', 'a' },
+        .data_bytes = wav.dataBytes,
+    };
+    ok = wavWriterClose(&wav, &header) && ok;
+    if (!ok) {
+        fprintf(stderr, "%s: cannot write\n", argv[1]);
+        return 1;
+    }
+    printf("%s: %.1f s, %u samples clipped, %.1f ns per output sample with file I/O\n", argv[1],
+           (double)mixed / rate, mixer.clips, spent * 1e9 / (mixed ? mixed : 1));
+
+    // the mixing alone, on the last layers in memory
+    uint32_t clips = 0;
+    start = now();
+#ifdef CYCLES
+    uint64_t cycles = CYCLES();
+#endif
+    for (int i = 0; i < KERNEL_PASSES; i++) {
+        mixSamples(mixer.layer[0], MIX_LAYER_GAIN, mixer.layer[1], MIX_LAYER_GAIN, out, MIX_CHUNK, &clips);
+    }
+#ifdef CYCLES
+    cycles = CYCLES() - cycles;
+#endif
+    spent = now() - start;
+    printf("mixSamples: %.2f ns", spent * 1e9 / ((double)KERNEL_PASSES * MIX_CHUNK));
+#ifdef CYCLES
+    printf(", %.2f cycles", (double)cycles / ((double)KERNEL_PASSES * MIX_CHUNK));
+#endif
+    printf(" per output sample\n");
+    return 0;
+}
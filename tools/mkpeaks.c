@@ -0,0 +1,134 @@
+// Builds the waveform overviews (main/peaks.h) of recordings on the host,
+// with the same code the recorder uses, and reports what it cost.
+//
+//   cc -O2 -Itools -Imain -o mkpeaks tools/mkpeaks.c main/peaks.c
+//      main/wavparse.c main/convert.c main/adpcm.c main/flac.c
+//   ./mkpeaks doc/recordings/*.WAV
+//
+// Supports everything the player does: PCM and float WAV, IMA-ADPCM and FLAC.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "adpcm.h"
+#include "convert.h"
+#include "flac.h"
+#include "peaks.h"
+#include "wavparse.h"
+
+#define CHUNK 4096
+
+static uint8_t raw[CHUNK * 8];
+static int16_t samples[CHUNK > FLAC_MAX_BLOCK_SIZE ? CHUNK : FLAC_MAX_BLOCK_SIZE];
+static FlacDecoder flac;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static size_t fileRead(void *ctx, uint8_t *buf, size_t len) {
+    return fread(buf, 1, len, ctx);
+}
+
+// Decodes the next samples of f, returns their number, 0 at the end
+static size_t decode(FILE *f, const WavInfo *info, bool isFlac, uint32_t *bytesLeft) {
+    if (isFlac) {
+        return flacDecodeFrame(&flac, samples);
+    }
+    if (info->format == WAVE_FORMAT_IMA_ADPCM) {
+        size_t bytes = info->blockAlign < *bytesLeft ? info->blockAlign : *bytesLeft;
+        bytes = fread(raw, 1, bytes, f);
+        *bytesLeft -= bytes;
+        return bytes > 4 ? adpcmDecodeBlock(raw, bytes, samples) : 0;
+    }
+    size_t frames = sizeof(raw) / info->blockAlign;
+    if (frames > *bytesLeft / info->blockAlign) {
+        frames = *bytesLeft / info->blockAlign;
+    }
+    frames = fread(raw, info->blockAlign, frames, f);
+    *bytesLeft -= frames * info->blockAlign;
+    convertWavToMono16(raw, frames, info->channels, info->bitsPerSample,
+                       info->format == WAVE_FORMAT_IEEE_FLOAT, samples);
+    return frames;
+}
+
+static bool build(const char *recording) {
+    FILE *f = fopen(recording, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", recording);
+        return false;
+    }
+    char magic[4] = {0};
+    fread(magic, 1, sizeof(magic), f);
+    rewind(f);
+    WavInfo info = {0};
+    bool isFlac = memcmp(magic, "fLaC", 4) == 0;
+    uint32_t rate;
+    if (isFlac) {
+        if (!flacDecoderInit(&flac, fileRead, f)) {
+            fprintf(stderr, "%s: not a supported FLAC file\n", recording);
+            fclose(f);
+            return false;
+        }
+        rate = flac.sampleRate;
+    } else if (wavParse(f, &info)) {
+        rate = info.sampleRate;
+    } else {
+        fprintf(stderr, "%s: not a supported WAV file\n", recording);
+        fclose(f);
+        return false;
+    }
+
+    char path[512];
+    peakPath(recording, path, sizeof(path));
+    static PeakWriter w;
+    if (!peakWriterOpen(&w, path, rate)) {
+        fprintf(stderr, "%s: cannot create\n", path);
+        fclose(f);
+        return false;
+    }
+    // decoding is what the player does anyway, only the overview is timed
+    double spent = 0;
+    uint32_t bytesLeft = info.dataBytes;
+    size_t count;
+    while ((count = decode(f, &info, isFlac, &bytesLeft)) > 0) {
+        double start = now();
+        peakWriterAdd(&w, samples, count);
+        spent += now() - start;
+    }
+    fclose(f);
+    uint32_t total = w.samples;
+    double start = now();
+    bool ok = peakWriterClose(&w, path);
+    double closing = now() - start;
+    if (!ok) {
+        fprintf(stderr, "%s: write failed\n", path);
+        return false;
+    }
+
+    PeakHeader header;
+    static PeakPair pairs[PEAK_FACTOR * 128];
+    int n = peakLoad(path, 128, pairs, PEAK_FACTOR * 128, &header);
+    double seconds = (double)total / rate;
+    printf("%s: %.1f s, %u levels, %d pairs for 128 columns, "
+           "%.2f ns/sample adding, %.0f us closing, %.0fx real time\n",
+           path, seconds, header.levels, n, spent * 1e9 / (total ? total : 1), closing * 1e6,
+           seconds / (spent + closing));
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s recording...\n", argv[0]);
+        return 2;
+    }
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        failed += !build(argv[i]);
+    }
+    return failed ? 1 : 0;
+}
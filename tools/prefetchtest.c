@@ -0,0 +1,171 @@
+// Runs the playback read-ahead (main/prefetch.h) on the host against a
+// file that stalls like a slow SD card, with a player that takes the
+// data at the 44.1 kHz 16-bit rate, and checks that every byte arrives
+// in order, that the player only waits when a stall outlasts the blocks
+// read ahead, and that stopping returns whatever the reader is doing.
+//
+//   cc -O2 -Itools -Imain -o prefetchtest tools/prefetchtest.c main/prefetch.c
+//      tools/freertos.c -lpthread -Wl,--wrap=fread
+//   ./prefetchtest
+//
+// Runs in real time, about 15 seconds. The linker hands the reader's
+// freads to slowFread below, which stalls them and checks that they
+// stay on cluster boundaries.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "prefetch.h"
+
+// same as the device
+#define BLOCK_SIZE (16 * 1024)
+#define BYTES_PER_SECOND (44100 * 2)
+#define FILE_BLOCKS 16
+#define FILE_SIZE (FILE_BLOCKS * BLOCK_SIZE)
+// a plain read, and one read in STALL_EVERY taking much longer
+#define READ_MS 3
+#define STALL_EVERY 8
+
+typedef struct {
+    const char *name;
+    int depth;
+    int stallMs;
+    long startAt;
+    size_t readSize;
+    bool expectUnderruns;
+} Scenario;
+
+static const Scenario scenarios[] = {
+    // a stall shorter than one block of playback is hidden by double buffering
+    { "double buffered, 150 ms stalls", 2, 150, 0, 1000, false },
+    { "double buffered, 150 ms stalls, odd reads from mid-cluster", 2, 150, 5 * BLOCK_SIZE + 4410, 997, false },
+    // one block plays for 186 ms, a longer stall empties two
+    { "double buffered, 400 ms stalls", 2, 400, 0, 1000, true },
+    { "4 blocks, 400 ms stalls", 4, 400, 0, 1000, false },
+};
+
+typedef struct {
+    int reads;
+    int stallMs;
+    int misaligned; // reads after the first that did not start on a block
+} SlowFile;
+
+static uint8_t data[FILE_SIZE];
+// one for each depth, as the reader task stays with the one it was started for
+static Prefetch prefetches[PREFETCH_MAX_DEPTH + 1];
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void sleepMs(double ms) {
+    if (ms > 0) {
+        struct timespec t = { (time_t)(ms / 1000), (long)(ms * 1e6) % 1000000000 };
+        nanosleep(&t, NULL);
+    }
+}
+
+// the file being played, there is one at a time
+static SlowFile slow;
+
+size_t __real_fread(void *buf, size_t size, size_t count, FILE *f);
+
+// Every fread of main/prefetch.c lands here
+size_t __wrap_fread(void *buf, size_t size, size_t count, FILE *f) {
+    long pos = ftell(f);
+    if (slow.reads > 0 && pos % BLOCK_SIZE != 0 && pos < FILE_SIZE) {
+        slow.misaligned++;
+    }
+    slow.reads++;
+    sleepMs(slow.reads % STALL_EVERY == 0 ? slow.stallMs : READ_MS);
+    return __real_fread(buf, size, count, f);
+}
+
+static FILE *openSlow(int stallMs) {
+    memset(&slow, 0, sizeof(SlowFile));
+    slow.stallMs = stallMs;
+    return fmemopen(data, FILE_SIZE, "rb");
+}
+
+static Prefetch *prefetchFor(int depth) {
+    Prefetch *p = &prefetches[depth];
+    if (p->depth == 0 && !prefetchInit(p, depth, BLOCK_SIZE, 6, 0)) {
+        exit(1);
+    }
+    return p;
+}
+
+// Reads len bytes at the player's pace from pos on, returns false if they are not what the file holds
+static bool play(Prefetch *p, size_t *pos, size_t len, size_t readSize) {
+    static uint8_t buf[BLOCK_SIZE];
+    size_t from = *pos;
+    bool right = true;
+    size_t n;
+    double start = now();
+    while (*pos - from < len && (n = prefetchRead(p, buf, readSize)) > 0) {
+        right = right && memcmp(buf, data + *pos, n) == 0;
+        *pos += n;
+        sleepMs((start + (double)(*pos - from) / BYTES_PER_SECOND - now()) * 1000);
+    }
+    return right;
+}
+
+static bool run(const Scenario *sc) {
+    FILE *f = openSlow(sc->stallMs);
+    fseek(f, sc->startAt, SEEK_SET);
+    Prefetch *p = prefetchFor(sc->depth);
+    prefetchStart(p, f);
+    size_t pos = sc->startAt;
+    bool right = play(p, &pos, FILE_SIZE, sc->readSize);
+    prefetchStop(p);
+    fclose(f);
+
+    unsigned underruns = atomic_load(&p->underruns);
+    unsigned maxWaitMs = atomic_load(&p->maxWait) * portTICK_PERIOD_MS;
+    bool ok = pos == FILE_SIZE && right && slow.misaligned == 0 && (underruns > 0) == sc->expectUnderruns;
+    printf("%s: %zu bytes %s, %d reads off a block boundary, %u underruns, longest wait %u ms, %s\n", sc->name,
+           pos - sc->startAt, right ? "in order" : "WRONG", slow.misaligned, underruns, maxWaitMs, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// Stopping has to return while the reader waits for a free block, and while it is stuck in a read
+static bool stopEarly() {
+    bool ok = true;
+    for (int stalled = 0; stalled < 2; stalled++) {
+        FILE *f = openSlow(500);
+        Prefetch *p = prefetchFor(2);
+        prefetchStart(p, f);
+        size_t pos = 0;
+        // both blocks get filled and the reader waits; or, past read STALL_EVERY - 1, it is in a stall
+        bool right = play(p, &pos, stalled ? (STALL_EVERY - 2) * BLOCK_SIZE + 1000 : 1000, 1000);
+        sleepMs(stalled ? 20 : 100);
+        double start = now();
+        prefetchStop(p);
+        double took = (now() - start) * 1000;
+        fclose(f);
+        bool good = right && took < slow.stallMs + 100;
+        printf("stop %s: returned in %.0f ms after %zu bytes, %s\n", stalled ? "during a stall" : "while waiting",
+               took, pos, good ? "ok" : "FAILED");
+        ok = ok && good;
+    }
+    return ok;
+}
+
+int main() {
+    uint32_t seed = 1;
+    for (size_t i = 0; i < FILE_SIZE; i++) {
+        seed = seed * 1664525 + 1013904223;
+        data[i] = seed >> 24;
+    }
+    bool ok = true;
+    for (int i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        ok = run(&scenarios[i]) && ok;
+    }
+    ok = stopEarly() && ok;
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+// Measures the playback resampler (main/resampler.h) on the host: the
+// signal to noise ratio of tones converted from every recording rate to
+// the amp rate, and how many output samples per second it makes.
+//
+//   cc -O2 -Itools -Imain -o resamptest tools/resamptest.c main/resampler.c -lm
+//   ./resamptest
+//
+// Input is fed in the player's chunk size. The tone is fitted to the
+// output, its level is the gain; what is left after taking it out counts
+// as noise, aliases and rounding alike.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "resampler.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#endif
+
+// same as the device
+#define AMP_RATE 44100
+#define SOURCE_CHUNK 256
+#define WAV_BUFFER_COUNT 128
+#define LEVEL 20000
+// tones in the band the lower of the two rates can carry
+#define MAX_TONE 0.4
+#define MIN_SNR_DB 70
+#define BENCH_SECONDS 60
+
+typedef struct {
+    uint32_t in;
+    uint32_t out;
+} RatePair;
+
+static const RatePair pairs[] = {
+    { 8000, AMP_RATE },
+    { 16000, AMP_RATE },
+    { 48000, AMP_RATE },
+    // the overdub tests take the file down to the recording rate
+    { AMP_RATE, 16000 },
+};
+static const double tones[] = { 100, 440, 1000, 3000, 6000, 12000, 17000 };
+
+static Resampler resampler;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Converts count samples like the player, returns the number made
+static size_t convert(const int16_t *in, size_t count, int16_t *out, size_t outCount) {
+    size_t used = 0;
+    size_t made = 0;
+    while (used < count && made < outCount) {
+        size_t n = count - used < SOURCE_CHUNK ? count - used : SOURCE_CHUNK;
+        size_t index = 0;
+        // the player hands out one amp block at a time
+        while (index < n && made < outCount) {
+            size_t taken = n - index;
+            size_t room = outCount - made < WAV_BUFFER_COUNT ? outCount - made : WAV_BUFFER_COUNT;
+            made += resamplerProcess(&resampler, in + used + index, &taken, out + made, room);
+            index += taken;
+        }
+        used += n;
+    }
+    return made;
+}
+
+// SNR of a tone at hz after conversion, its gain in dB goes to gain
+static double snrDb(const RatePair *p, double hz, double *gain) {
+    size_t count = p->in;
+    size_t outCount = (size_t)((uint64_t)count * p->out / p->in) + 64;
+    int16_t *in = malloc(count * sizeof(int16_t));
+    int16_t *out = malloc(outCount * sizeof(int16_t));
+    for (size_t i = 0; i < count; i++) {
+        in[i] = lrint(LEVEL * sin(2 * M_PI * hz * i / p->in));
+    }
+    resamplerInit(&resampler, p->in, p->out);
+    size_t made = convert(in, count, out, outCount);
+    // past the start-up, least squares fit of sine and cosine at hz
+    size_t first = RESAMPLE_TAPS * (p->out / p->in + 1) + 2;
+    double ss = 0, cc = 0, sc = 0, sy = 0, cy = 0;
+    for (size_t j = first; j < made; j++) {
+        double w = 2 * M_PI * hz * j / p->out;
+        double sn = sin(w), cs = cos(w);
+        ss += sn * sn;
+        cc += cs * cs;
+        sc += sn * cs;
+        sy += sn * out[j];
+        cy += cs * out[j];
+    }
+    double det = ss * cc - sc * sc;
+    double a = (sy * cc - cy * sc) / det;
+    double b = (cy * ss - sy * sc) / det;
+    double signal = 0, noise = 0;
+    for (size_t j = first; j < made; j++) {
+        double w = 2 * M_PI * hz * j / p->out;
+        double fit = a * sin(w) + b * cos(w);
+        signal += fit * fit;
+        noise += (out[j] - fit) * (out[j] - fit);
+    }
+    *gain = 20 * log10(sqrt(a * a + b * b) / LEVEL);
+    free(in);
+    free(out);
+    return 10 * log10(signal / noise);
+}
+
+static void bench(const RatePair *p) {
+    size_t count = p->in * BENCH_SECONDS;
+    size_t outCount = (size_t)((uint64_t)count * p->out / p->in) + 64;
+    int16_t *in = malloc(count * sizeof(int16_t));
+    int16_t *out = malloc(outCount * sizeof(int16_t));
+    for (size_t i = 0; i < count; i++) {
+        in[i] = lrint(LEVEL * sin(2 * M_PI * 440.0 * i / p->in));
+    }
+    resamplerInit(&resampler, p->in, p->out);
+    double start = now();
+#ifdef CYCLES
+    uint64_t cycles = CYCLES();
+#endif
+    size_t made = convert(in, count, out, outCount);
+#ifdef CYCLES
+    cycles = CYCLES() - cycles;
+#endif
+    double spent = now() - start;
+    printf("%5u to %5u Hz: %.1f M output samples/s", p->in, p->out, made / spent * 1e-6);
+#ifdef CYCLES
+    printf(", %.1f cycles per output sample", (double)cycles / made);
+#endif
+    printf("\n");
+    free(in);
+    free(out);
+}
+
+int main() {
+    bool ok = true;
+    for (int i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        const RatePair *p = &pairs[i];
+        uint32_t lower = p->in < p->out ? p->in : p->out;
+        double worst = 1000;
+        printf("%5u to %5u Hz SNR (gain):", p->in, p->out);
+        for (int t = 0; t < sizeof(tones) / sizeof(tones[0]); t++) {
+            if (tones[t] > MAX_TONE * lower) {
+                continue;
+            }
+            double gain;
+            double snr = snrDb(p, tones[t], &gain);
+            printf(" %.0f Hz %.1f dB (%+.2f)", tones[t], snr, gain);
+            worst = snr < worst ? snr : worst;
+        }
+        printf("\n");
+        ok = ok && worst >= MIN_SNR_DB;
+    }
+    for (int i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        bench(&pairs[i]);
+    }
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+// Seeks the player's sources (main/playsource.h) on the host, through the
+// read-ahead as on the device, in PCM, ADPCM and FLAC copies of a long
+// recording made from the given ones with silences of random length in
+// between, so the FLAC bitrate swings. Every seek is checked sample-exact
+// against a full decode of the same file: absolute ones, relative ones
+// from wherever playback is and ones past the end, which must end the
+// file. Then stops part way into a chunk as the player does, reopens the
+// file at the resume position and checks that it goes on with the first
+// sample that was not played.
+//
+// For each seek the file positionings and the clusters read are counted
+// up to the first new audio. The clusters include the one the read-ahead
+// fetches on its own behind the first, so they are an upper bound.
+//
+//   cc -O2 -Itools -Imain -o seektest tools/seektest.c main/playsource.c
+//      main/prefetch.c main/flac.c main/adpcm.c main/wavparse.c main/convert.c
+//      tools/freertos.c -lpthread -Wl,--wrap=fread -Wl,--wrap=fseek
+//   ./seektest doc/recordings/*.WAV
+//
+// Writes its files to /tmp. Takes PCM and float WAV.
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adpcm.h"
+#include "convert.h"
+#include "flac.h"
+#include "playsource.h"
+#include "wav.h"
+
+// same as the device
+#define CLUSTER_SIZE (16 * 1024)
+#define PREFETCH_DEPTH 2
+#define SOURCE_CHUNK 256
+// length of the test recording, and longest silence put between two recordings
+#define TEST_SECONDS 600
+#define MAX_GAP_SECONDS 3
+#define SEEKS 400
+// relative seeks go at most this far either way
+#define MAX_SKIP_SECONDS 60
+// samples compared after each seek, and at most played before the next one,
+// more than the FLAC decoder buffers, so playing on goes back to the read-ahead
+#define CHECK_SAMPLES 32768
+#define RESUMES 40
+#define SAMPLES_PER_BLOCK ADPCM_SAMPLES_PER_BLOCK(ADPCM_BLOCK_ALIGN)
+
+typedef struct {
+    int seeks;
+    int wrong;
+    int positionings;
+    int maxPositionings;
+    int clusters;
+    int maxClusters;
+} Tally;
+
+static Prefetch prefetch;
+static int16_t chunk[SOURCE_CHUNK];
+static uint32_t seed = 1;
+
+// counted while a seek is timed, the read-ahead task reads too
+static atomic_bool counting;
+static atomic_int positionings;
+static atomic_int clusters;
+// last one read, the next read going on in it costs nothing more
+static long lastCluster = -1;
+
+static uint32_t randomBelow(uint32_t n) {
+    seed = seed * 1664525 + 1013904223;
+    return (uint32_t)(((uint64_t)(seed >> 8) * n) >> 24);
+}
+
+size_t __real_fread(void *buf, size_t size, size_t count, FILE *f);
+int __real_fseek(FILE *f, long offset, int whence);
+
+// Every fread of the modules under test lands here
+size_t __wrap_fread(void *buf, size_t size, size_t count, FILE *f) {
+    long pos = ftell(f);
+    size_t n = __real_fread(buf, size, count, f);
+    if (n > 0 && atomic_load(&counting)) {
+        long first = pos / CLUSTER_SIZE;
+        long last = (pos + (long)(n * size) - 1) / CLUSTER_SIZE;
+        atomic_fetch_add(&clusters, last - first + (first != lastCluster));
+        lastCluster = last;
+    }
+    return n;
+}
+
+int __wrap_fseek(FILE *f, long offset, int whence) {
+    if (atomic_load(&counting)) {
+        atomic_fetch_add(&positionings, 1);
+        lastCluster = -1;
+    }
+    return __real_fseek(f, offset, whence);
+}
+
+// Whole recording as mono 16 bits, NULL if it cannot be read
+static int16_t *load(const char *recording, WavInfo *info, size_t *count) {
+    FILE *f = fopen(recording, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", recording);
+        return NULL;
+    }
+    if (!wavParse(f, info) || info->format == WAVE_FORMAT_IMA_ADPCM) {
+        fprintf(stderr, "%s: not a PCM WAV file\n", recording);
+        fclose(f);
+        return NULL;
+    }
+    uint32_t frames = info->dataBytes / info->blockAlign;
+    uint8_t *raw = malloc(info->dataBytes);
+    int16_t *samples = malloc(frames * sizeof(int16_t) + 1);
+    if (raw != NULL && samples != NULL) {
+        frames = fread(raw, info->blockAlign, frames, f);
+        convertWavToMono16(raw, frames, info->channels, info->bitsPerSample,
+                           info->format == WAVE_FORMAT_IEEE_FLOAT, samples);
+    }
+    free(raw);
+    fclose(f);
+    *count = frames;
+    return samples;
+}
+
+static bool writeFile(const char *name, const void *header, size_t headerSize, const void *data, size_t size) {
+    FILE *f = fopen(name, "wb");
+    bool written = f != NULL && fwrite(header, 1, headerSize, f) == headerSize && fwrite(data, 1, size, f) == size;
+    if (f != NULL) {
+        written = fclose(f) == 0 && written;
+    }
+    if (!written) {
+        fprintf(stderr, "%s: cannot write\n", name);
+    }
+    return written;
+}
+
+static bool writePcm(const char *name, const int16_t *samples, size_t count, uint32_t rate) {
+    wav_header h = {
+        .riff_header = { 'R', 'I', 'F', 'F' },
+        .wav_size = count * 2 + sizeof(wav_header) - 8,
+        .wave_header = { 'W', 'A', 'V', 'E' },
+        .fmt_header = { 'f', 'm', 't', ' ' },
+        .fmt_chunk_size = 16,
+        .audio_format = 1,
+        .num_channels = 1,
+        .sample_rate = rate,
+        .byte_rate = rate * 2,
+        .sample_alignment = 2,
+        .bit_depth = 16,
+        .data_header = { 'd', 'a', 't', 'a' },
+        .data_bytes = count * 2,
+    };
+    return writeFile(name, &h, sizeof(h), samples, count * 2);
+}
+
+// Block by block as the writer does, the last one padded with silence
+static bool writeAdpcm(const char *name, const int16_t *samples, size_t count, uint32_t rate) {
+    size_t blocks = (count + SAMPLES_PER_BLOCK - 1) / SAMPLES_PER_BLOCK;
+    uint8_t *data = malloc(blocks * ADPCM_BLOCK_ALIGN);
+    int16_t in[SAMPLES_PER_BLOCK];
+    AdpcmState state;
+    adpcmInit(&state);
+    for (size_t b = 0; b < blocks; b++) {
+        size_t n = count - b * SAMPLES_PER_BLOCK < SAMPLES_PER_BLOCK ? count - b * SAMPLES_PER_BLOCK : SAMPLES_PER_BLOCK;
+        memset(in, 0, sizeof(in));
+        memcpy(in, samples + b * SAMPLES_PER_BLOCK, n * sizeof(int16_t));
+        adpcmEncodeBlock(&state, in, data + b * ADPCM_BLOCK_ALIGN);
+    }
+    wav_ima_header h = {
+        .riff_header = { 'R', 'I', 'F', 'F' },
+        .wav_size = blocks * ADPCM_BLOCK_ALIGN + sizeof(wav_ima_header) - 8,
+        .wave_header = { 'W', 'A', 'V', 'E' },
+        .fmt_header = { 'f', 'm', 't', ' ' },
+        .fmt_chunk_size = 20,
+        .audio_format = ADPCM_FORMAT,
+        .num_channels = 1,
+        .sample_rate = rate,
+        .byte_rate = rate * ADPCM_BLOCK_ALIGN / SAMPLES_PER_BLOCK,
+        .sample_alignment = ADPCM_BLOCK_ALIGN,
+        .bit_depth = 4,
+        .extra_size = 2,
+        .samples_per_block = SAMPLES_PER_BLOCK,
+        .fact_header = { 'f', 'a', 'c', 't' },
+        .fact_chunk_size = 4,
+        .sample_length = count,
+        .data_header = { 'd', 'a', 't', 'a' },
+        .data_bytes = blocks * ADPCM_BLOCK_ALIGN,
+    };
+    bool written = writeFile(name, &h, sizeof(h), data, blocks * ADPCM_BLOCK_ALIGN);
+    free(data);
+    return written;
+}
+
+static bool writeFlac(const char *name, const int16_t *samples, size_t count, uint32_t rate) {
+    static FlacEncoder encoder;
+    size_t frames = (count + FLAC_BLOCK_SIZE - 1) / FLAC_BLOCK_SIZE;
+    uint8_t *data = malloc(frames * FLAC_MAX_FRAME_BYTES);
+    uint8_t header[FLAC_HEADER_SIZE];
+    flacEncoderInit(&encoder, rate);
+    size_t size = 0;
+    for (size_t i = 0; i < count; i += FLAC_BLOCK_SIZE) {
+        size += flacEncodeFrame(&encoder, samples + i, count - i < FLAC_BLOCK_SIZE ? count - i : FLAC_BLOCK_SIZE,
+                                data + size);
+    }
+    flacWriteHeader(&encoder, header);
+    bool written = writeFile(name, header, sizeof(header), data, size);
+    free(data);
+    return written;
+}
+
+// Reads up to count samples from the source, fewer only at its end
+static size_t readSamples(PlaySource *s, int16_t *out, size_t count) {
+    size_t done = 0;
+    size_t n;
+    while (done < count && (n = playSourceRead(s, chunk, count - done < SOURCE_CHUNK ? count - done : SOURCE_CHUNK)) > 0) {
+        memcpy(out + done, chunk, n * sizeof(int16_t));
+        done += n;
+    }
+    return done;
+}
+
+// Plays from the current position on and compares with the full decode
+static bool playsOn(PlaySource *s, const int16_t *decoded, uint32_t length, uint32_t count) {
+    static int16_t out[CHECK_SAMPLES];
+    uint32_t from = s->position;
+    uint32_t expected = from >= length ? 0 : length - from < count ? length - from : count;
+    size_t n = readSamples(s, out, count);
+    return n == expected && memcmp(out, decoded + from, n * sizeof(int16_t)) == 0 && s->position == from + n;
+}
+
+// Moves to target and plays on, counting what it takes to get the first chunk
+static bool seekTo(PlaySource *s, Tally *t, const int16_t *decoded, uint32_t length, int64_t target) {
+    uint32_t sample = target < 0 ? 0 : target > UINT32_MAX ? UINT32_MAX : target;
+    atomic_store(&positionings, 0);
+    atomic_store(&clusters, 0);
+    atomic_store(&counting, true);
+    bool moved = playSourceSeek(s, sample);
+    uint32_t position = s->position;
+    size_t first = playSourceRead(s, chunk, SOURCE_CHUNK);
+    atomic_store(&counting, false);
+    int positioned = atomic_load(&positionings);
+    int read = atomic_load(&clusters);
+
+    uint32_t expected = sample > length ? length : sample;
+    bool right = moved && position == expected;
+    if (sample >= length) {
+        right = right && first == 0;
+    } else {
+        right = right && first > 0 && memcmp(chunk, decoded + sample, first * sizeof(int16_t)) == 0
+             && playsOn(s, decoded, length, randomBelow(CHECK_SAMPLES) + 1);
+    }
+    t->seeks++;
+    t->wrong += !right;
+    t->positionings += positioned;
+    t->clusters += read;
+    t->maxPositionings = positioned > t->maxPositionings ? positioned : t->maxPositionings;
+    t->maxClusters = read > t->maxClusters ? read : t->maxClusters;
+    return right;
+}
+
+static void report(const char *format, const char *what, const Tally *t) {
+    printf("%s %s: %d seeks, %d wrong, file positioned %.1f times on average, at most %d, "
+           "%.1f clusters read on average, at most %d\n", format, what, t->seeks, t->wrong,
+           (double)t->positionings / t->seeks, t->maxPositionings, (double)t->clusters / t->seeks, t->maxClusters);
+}
+
+// Stops inside a chunk as the player does, then opens the file again at the resume position
+static bool resumes(const char *name, const int16_t *decoded, uint32_t length) {
+    int wrong = 0;
+    for (int i = 0; i < RESUMES; i++) {
+        PlaySource s;
+        if (!playSourceOpen(&s, name, &prefetch)) {
+            return false;
+        }
+        playSourceSeek(&s, randomBelow(length));
+        size_t sourceCount = playSourceRead(&s, chunk, SOURCE_CHUNK);
+        size_t sourceIndex = randomBelow(sourceCount + 1);
+        // as the player keeps it
+        uint32_t resume = s.position - (sourceCount - sourceIndex);
+        uint32_t sourceLength = s.length;
+        playSourceClose(&s);
+
+        bool right = playSourceOpen(&s, name, &prefetch) && s.length == sourceLength && playSourceSeek(&s, resume)
+                  && playsOn(&s, decoded, length, CHECK_SAMPLES);
+        playSourceClose(&s);
+        wrong += !right;
+    }
+    printf("%s: %d resumes, %d wrong\n", name, RESUMES, wrong);
+    return wrong == 0;
+}
+
+// The whole file decoded from the start, which every seek has to agree with
+static int16_t *decodeAll(const char *name, uint32_t *length) {
+    PlaySource s;
+    if (!playSourceOpen(&s, name, &prefetch)) {
+        return NULL;
+    }
+    *length = s.length;
+    int16_t *decoded = malloc(((size_t)s.length + 1) * sizeof(int16_t));
+    size_t n = readSamples(&s, decoded, s.length);
+    bool ended = playSourceRead(&s, chunk, SOURCE_CHUNK) == 0;
+    playSourceClose(&s);
+    if (n != s.length || !ended) {
+        fprintf(stderr, "%s: %zu samples decoded, %u expected\n", name, n, s.length);
+        free(decoded);
+        return NULL;
+    }
+    return decoded;
+}
+
+// Plays the test recording written as name, compares with samples where the format is lossless
+static bool test(const char *format, const char *name, const int16_t *samples, size_t count, bool lossless) {
+    uint32_t length;
+    int16_t *decoded = decodeAll(name, &length);
+    if (decoded == NULL) {
+        return false;
+    }
+    bool ok = length == count && (!lossless || memcmp(decoded, samples, count * sizeof(int16_t)) == 0);
+    if (!ok) {
+        printf("%s: full decode differs from the recording\n", name);
+    }
+
+    PlaySource s;
+    if (!playSourceOpen(&s, name, &prefetch)) {
+        free(decoded);
+        return false;
+    }
+    Tally absolute = { 0 };
+    Tally relative = { 0 };
+    Tally pastEnd = { 0 };
+    uint32_t rate = s.sampleRate;
+    for (int i = 0; i < SEEKS; i++) {
+        uint32_t kind = randomBelow(5);
+        if (kind < 2) {
+            seekTo(&s, &absolute, decoded, length, randomBelow(length));
+        } else if (kind < 4) {
+            int64_t skip = (int64_t)randomBelow(2 * MAX_SKIP_SECONDS * rate + 1) - MAX_SKIP_SECONDS * rate;
+            seekTo(&s, &relative, decoded, length, (int64_t)s.position + skip);
+        } else {
+            seekTo(&s, &pastEnd, decoded, length, (int64_t)length + randomBelow(MAX_SKIP_SECONDS * rate));
+        }
+    }
+    playSourceClose(&s);
+    report(format, "absolute", &absolute);
+    report(format, "relative", &relative);
+    report(format, "past the end", &pastEnd);
+    ok = ok && absolute.wrong == 0 && relative.wrong == 0 && pastEnd.wrong == 0;
+    ok = resumes(name, decoded, length) && ok;
+    free(decoded);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s recording...\n", argv[0]);
+        return 2;
+    }
+    int recordings = argc - 1;
+    int16_t **parts = calloc(recordings, sizeof(int16_t *));
+    size_t *partCounts = calloc(recordings, sizeof(size_t));
+    uint32_t rate = 0;
+    for (int i = 0; i < recordings; i++) {
+        WavInfo info;
+        parts[i] = load(argv[i + 1], &info, &partCounts[i]);
+        if (parts[i] == NULL || (rate != 0 && info.sampleRate != rate)) {
+            fprintf(stderr, "%s: all recordings need to have the same rate\n", argv[i + 1]);
+            return 2;
+        }
+        rate = info.sampleRate;
+    }
+
+    // the recordings over and over, a silence after each
+    size_t count = (size_t)TEST_SECONDS * rate;
+    int16_t *samples = calloc(count, sizeof(int16_t));
+    for (size_t at = 0, i = 0; at < count; i++) {
+        size_t n = partCounts[i % recordings] < count - at ? partCounts[i % recordings] : count - at;
+        memcpy(samples + at, parts[i % recordings], n * sizeof(int16_t));
+        at += n + randomBelow(MAX_GAP_SECONDS * rate);
+    }
+
+    if (!prefetchInit(&prefetch, PREFETCH_DEPTH, CLUSTER_SIZE, 6, 0)) {
+        return 1;
+    }
+    bool ok = writePcm("/tmp/seektest.wav", samples, count, rate)
+           && test("PCM", "/tmp/seektest.wav", samples, count, true);
+    ok = writeAdpcm("/tmp/seektest-adpcm.wav", samples, count, rate)
+      && test("ADPCM", "/tmp/seektest-adpcm.wav", samples, count, false) && ok;
+    ok = writeFlac("/tmp/seektest.flac", samples, count, rate)
+      && test("FLAC", "/tmp/seektest.flac", samples, count, true) && ok;
+    remove("/tmp/seektest.wav");
+    remove("/tmp/seektest-adpcm.wav");
+    remove("/tmp/seektest.flac");
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,381 @@
+// Drives the record/play manager's plumbing (main/streamctl.h) on the
+// host with rapid start/stop sequences. A manager carries out commands
+// from the queue the way recPlayManagerTask does; fake recorder and
+// player tasks take 2.9 ms blocks like the I2S streams, open files
+// slowly, sometimes fail to, end files by themselves and stall on the
+// source. The player sleeps on its task notification between files,
+// as the firmware's does. Checks that commands are carried out in
+// order, where the streams are once a command is done, that a stream
+// never sees the next file while it runs, that no start goes unseen
+// and that stopping never gets stuck. Then lets a start time out,
+// before and after the stream took it.
+//
+//   cc -O2 -Itools -Imain -o streamtest tools/streamtest.c main/streamctl.c
+//      tools/freertos.c -lpthread
+//   ./streamtest
+//
+// Runs in real time, about 30 seconds.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "streamctl.h"
+
+#include <freertos/task.h>
+
+#define BLOCK_US 2900
+#define BLOCK_SAMPLES 256
+#define QUEUE_LEN 8
+#define SEQUENTIAL_COMMANDS 1500
+#define SENDERS 4
+#define SENDER_COMMANDS 750
+// as recplaymgr.c
+#define START_TIMEOUT_MS 1000
+#define STOP_TIMEOUT_MS 500
+
+typedef enum { RECORD, PLAY, REC_STOP, PLAY_STOP, END, COMMAND_TYPES } CommandType;
+
+typedef struct {
+    CommandType type;
+    char filename[32];
+} Command;
+
+typedef struct {
+    atomic_long count;
+    atomic_long totalUs;
+    atomic_long maxUs;
+} StopTimes;
+
+static CommandQueue queue;
+static StreamControl recorder;
+static StreamControl player;
+// handed to a stream before it is started, as recplaymgr.c does
+static char recFileName[32];
+static char playFileName[32];
+static int32_t micBuffer[BLOCK_SAMPLES];
+static int32_t ampBuffer[BLOCK_SAMPLES];
+
+// streams between streamRunning and streamStopped
+static atomic_int recording;
+static atomic_int playing;
+static atomic_int outOfOrder;
+static atomic_int wrongFile;
+static atomic_int stuck;
+static atomic_int unseenStarts;
+static atomic_int corrupted;
+static atomic_long recStarts;
+static atomic_long playStarts;
+static atomic_long failedOpens;
+static atomic_long endedFiles;
+static StopTimes recStops;
+static StopTimes playStops;
+
+static uint32_t nextRandom(uint32_t *seed) {
+    *seed = *seed * 1664525 + 1013904223;
+    return *seed >> 8;
+}
+
+static long nowUs() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000L + t.tv_nsec / 1000;
+}
+
+static void sleepUs(long us) {
+    struct timespec t = { us / 1000000, us % 1000000 * 1000 };
+    nanosleep(&t, NULL);
+}
+
+// One I2S block, the buffer has to stay as written while it plays
+static void transferBlock(int32_t *buffer, int32_t value) {
+    for (int i = 0; i < BLOCK_SAMPLES; i++) {
+        buffer[i] = value + i;
+    }
+    sleepUs(BLOCK_US);
+    for (int i = 0; i < BLOCK_SAMPLES; i++) {
+        if (buffer[i] != value + i) {
+            atomic_fetch_add(&corrupted, 1);
+            return;
+        }
+    }
+}
+
+// Captures all the time, like the real one, and records while started
+static void recorderTask(void *pvParameters) {
+    uint32_t seed = 1;
+    int32_t value = 0;
+    char name[32];
+    while (true) {
+        if (!streamWaitStart(&recorder, 0)) {
+            transferBlock(micBuffer, value += 1000);
+            continue;
+        }
+        // waiting for the writer to open the file
+        sleepUs(nextRandom(&seed) % 3000);
+        strcpy(name, recFileName);
+        atomic_fetch_add(&recording, 1);
+        streamRunning(&recorder);
+        atomic_fetch_add(&recStarts, 1);
+        while (recorder.run) {
+            transferBlock(micBuffer, value += 1000);
+            atomic_fetch_add(&wrongFile, strcmp(name, recFileName) != 0);
+        }
+        atomic_fetch_sub(&recording, 1);
+        streamStopped(&recorder);
+    }
+}
+
+static void playerTask(void *pvParameters) {
+    uint32_t seed = 2;
+    int32_t value = -1000000;
+    char name[32];
+    streamNotifyStarts(&player);
+    while (true) {
+        if (!streamWaitStart(&player, 0)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        // opening the file, one in ten cannot be
+        sleepUs(nextRandom(&seed) % 20000);
+        if (nextRandom(&seed) % 10 == 0) {
+            atomic_fetch_add(&failedOpens, 1);
+            streamStopped(&player);
+            continue;
+        }
+        strcpy(name, playFileName);
+        atomic_fetch_add(&playing, 1);
+        streamRunning(&player);
+        atomic_fetch_add(&playStarts, 1);
+        int blocks = nextRandom(&seed) % 300;
+        while (player.run) {
+            if (blocks-- == 0) {
+                atomic_fetch_add(&endedFiles, 1);
+                break;
+            }
+            if (nextRandom(&seed) % 50 == 0) {
+                // the read-ahead ran dry
+                sleepUs(nextRandom(&seed) % 15000);
+            }
+            transferBlock(ampBuffer, value -= 1000);
+            atomic_fetch_add(&wrongFile, strcmp(name, playFileName) != 0);
+        }
+        atomic_fetch_sub(&playing, 1);
+        streamStopped(&player);
+        // closing the file is not part of stopping
+        sleepUs(nextRandom(&seed) % 30000);
+    }
+}
+
+static void stopStream(StreamControl *s, StopTimes *times) {
+    if (s->state == STREAM_IDLE) {
+        return;
+    }
+    long start = nowUs();
+    if (!streamStop(s, pdMS_TO_TICKS(STOP_TIMEOUT_MS))) {
+        atomic_fetch_add(&stuck, 1);
+        return;
+    }
+    long took = nowUs() - start;
+    atomic_fetch_add(&times->count, 1);
+    atomic_fetch_add(&times->totalUs, took);
+    long longest = atomic_load(&times->maxUs);
+    while (took > longest && !atomic_compare_exchange_weak(&times->maxUs, &longest, took)) {
+    }
+}
+
+static void managerTask(void *pvParameters) {
+    Command cmd;
+    uint32_t expected = 1;
+    while (true) {
+        uint32_t id = commandReceive(&queue, &cmd, portMAX_DELAY);
+        atomic_fetch_add(&outOfOrder, id != expected++);
+        switch (cmd.type) {
+            case RECORD:
+                stopStream(&recorder, &recStops);
+                strcpy(recFileName, cmd.filename);
+                streamStart(&recorder, pdMS_TO_TICKS(START_TIMEOUT_MS));
+                break;
+            case PLAY: {
+                stopStream(&player, &playStops);
+                strcpy(playFileName, cmd.filename);
+                // the player takes every start well within the timeout unless it slept through it
+                long start = nowUs();
+                if (!streamStart(&player, pdMS_TO_TICKS(START_TIMEOUT_MS)) &&
+                    nowUs() - start >= START_TIMEOUT_MS * 1000L) {
+                    atomic_fetch_add(&unseenStarts, 1);
+                }
+                break;
+            }
+            case REC_STOP:
+                stopStream(&recorder, &recStops);
+                break;
+            case PLAY_STOP:
+                stopStream(&player, &playStops);
+                break;
+            default:
+                stopStream(&recorder, &recStops);
+                stopStream(&player, &playStops);
+                break;
+        }
+        commandDone(&queue, id);
+    }
+}
+
+static uint32_t send(CommandType type, int n) {
+    Command cmd = { .type = type };
+    snprintf(cmd.filename, sizeof(cmd.filename), "%d.WAV", n);
+    return commandSend(&queue, &cmd, pdMS_TO_TICKS(2000));
+}
+
+// Where the streams have to be once cmd is done
+static bool settled(CommandType type) {
+    switch (type) {
+        case RECORD:
+            return recorder.state == STREAM_RUNNING && atomic_load(&recording) == 1;
+        case PLAY:
+            // or it could not open the file, or already played it
+            return player.state != STREAM_STARTING;
+        case REC_STOP:
+            return recorder.state == STREAM_IDLE && atomic_load(&recording) == 0;
+        case PLAY_STOP:
+            return player.state == STREAM_IDLE && atomic_load(&playing) == 0;
+        default:
+            return settled(REC_STOP) && settled(PLAY_STOP);
+    }
+}
+
+// One sender waiting for every command, like the UI
+static bool sequential() {
+    uint32_t seed = 7;
+    int wrong = 0;
+    long start = nowUs();
+    for (int i = 0; i < SEQUENTIAL_COMMANDS; i++) {
+        CommandType type = nextRandom(&seed) % COMMAND_TYPES;
+        uint32_t id = send(type, i);
+        if (!commandWait(&queue, id, pdMS_TO_TICKS(3000))) {
+            wrong++;
+            continue;
+        }
+        wrong += !settled(type);
+        if (nextRandom(&seed) % 4 == 0) {
+            sleepUs(nextRandom(&seed) % 8000);
+        }
+    }
+    printf("one sender: %d commands in %.1f s, %d found the streams wrong once done, %s\n", SEQUENTIAL_COMMANDS,
+           (nowUs() - start) * 1e-6, wrong, wrong == 0 ? "ok" : "FAILED");
+    return wrong == 0;
+}
+
+static atomic_int sent;
+static atomic_int senderFinished;
+
+static void senderTask(void *pvParameters) {
+    uint32_t seed = (uint32_t)(intptr_t)pvParameters;
+    for (int i = 0; i < SENDER_COMMANDS; i++) {
+        atomic_fetch_add(send(nextRandom(&seed) % COMMAND_TYPES, i) != 0 ? &sent : &outOfOrder, 1);
+        if (nextRandom(&seed) % 3 == 0) {
+            sleepUs(nextRandom(&seed) % 2000);
+        }
+    }
+    atomic_fetch_add(&senderFinished, 1);
+    vTaskDelete(NULL);
+}
+
+// Several senders at once and nobody waiting, then an END that is waited for
+static bool concurrent() {
+    long start = nowUs();
+    for (intptr_t i = 0; i < SENDERS; i++) {
+        xTaskCreatePinnedToCore(senderTask, "SENDER", 4096, (void *)(i + 11), 1, NULL, 0);
+    }
+    while (atomic_load(&senderFinished) < SENDERS) {
+        vTaskDelay(1);
+    }
+    bool ok = commandWait(&queue, send(END, 0), pdMS_TO_TICKS(5000)) && settled(END);
+    printf("%d senders: %d commands in %.1f s, both streams %s after END, %s\n", SENDERS, atomic_load(&sent),
+           (nowUs() - start) * 1e-6, settled(END) ? "idle" : "NOT IDLE", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static void printStops(const char *name, StopTimes *times) {
+    long count = atomic_load(&times->count);
+    printf("%s: %ld stops, %.2f ms on average, longest %.2f ms\n", name, count,
+           count > 0 ? atomic_load(&times->totalUs) * 1e-3 / count : 0.0, atomic_load(&times->maxUs) * 1e-3);
+}
+
+// A stream that takes its start only when told to, and sets up for setupMs
+static StreamControl lateStream;
+static atomic_bool takeStart;
+static atomic_int lateSetupMs;
+
+static void lateStreamTask(void *pvParameters) {
+    while (true) {
+        if (!atomic_load(&takeStart) || !streamWaitStart(&lateStream, 1)) {
+            vTaskDelay(1);
+            continue;
+        }
+        vTaskDelay(pdMS_TO_TICKS(atomic_load(&lateSetupMs)));
+        streamRunning(&lateStream);
+        while (lateStream.run) {
+            vTaskDelay(1);
+        }
+        streamStopped(&lateStream);
+    }
+}
+
+// A start nobody takes is withdrawn; one taken too late leaves a stream
+// that stops by itself, and streamStop has to wait for it
+static bool startTimeouts() {
+    if (!streamInit(&lateStream)) {
+        return false;
+    }
+    xTaskCreatePinnedToCore(lateStreamTask, "LATE", 4096, NULL, 1, NULL, 0);
+
+    bool started = streamStart(&lateStream, pdMS_TO_TICKS(100));
+    // the stream comes back, it must not start on the old start
+    atomic_store(&takeStart, true);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    bool untakenOk = !started && lateStream.state == STREAM_IDLE;
+    printf("start not taken: %s, stream %s afterwards, %s\n", started ? "STARTED" : "timed out",
+           lateStream.state == STREAM_IDLE ? "idle" : "NOT IDLE", untakenOk ? "ok" : "FAILED");
+
+    atomic_store(&lateSetupMs, 300);
+    started = streamStart(&lateStream, pdMS_TO_TICKS(100));
+    bool startingAfter = lateStream.state == STREAM_STARTING;
+    bool refused = !streamStart(&lateStream, pdMS_TO_TICKS(100));
+    long start = nowUs();
+    bool stopped = streamStop(&lateStream, pdMS_TO_TICKS(STOP_TIMEOUT_MS));
+    long tookMs = (nowUs() - start) / 1000;
+    atomic_store(&lateSetupMs, 0);
+    bool again = streamStart(&lateStream, pdMS_TO_TICKS(100)) && streamStop(&lateStream, pdMS_TO_TICKS(100));
+    bool takenOk = !started && startingAfter && refused && stopped && again;
+    printf("start taken too late: %s, %s, restart %s, stopped after %ld ms, started again %s, %s\n",
+           started ? "STARTED" : "timed out", startingAfter ? "starting" : "NOT STARTING",
+           refused ? "refused" : "ALLOWED", tookMs, again ? "yes" : "NO", takenOk ? "ok" : "FAILED");
+    return untakenOk && takenOk;
+}
+
+int main() {
+    if (!commandQueueInit(&queue, QUEUE_LEN, sizeof(Command)) || !streamInit(&recorder) || !streamInit(&player)) {
+        return 1;
+    }
+    xTaskCreatePinnedToCore(recorderTask, "RECORDER", 4096, NULL, 10, NULL, 1);
+    xTaskCreatePinnedToCore(playerTask, "PLAYER", 4096, NULL, 9, NULL, 1);
+    xTaskCreatePinnedToCore(managerTask, "MANAGER", 3072, NULL, 7, NULL, 1);
+
+    bool ok = sequential();
+    ok = concurrent() && ok;
+    printStops("recording", &recStops);
+    printStops("playback", &playStops);
+    printf("%ld recordings and %ld playbacks started, %ld files could not be opened, %ld ended by themselves\n",
+           atomic_load(&recStarts), atomic_load(&playStarts), atomic_load(&failedOpens), atomic_load(&endedFiles));
+    printf("%d commands out of order or lost, %d blocks played from the wrong file, %d starts unseen, "
+           "%d stuck stops, %d blocks overwritten\n",
+           atomic_load(&outOfOrder), atomic_load(&wrongFile), atomic_load(&unseenStarts), atomic_load(&stuck),
+           atomic_load(&corrupted));
+    ok = ok && atomic_load(&outOfOrder) == 0 && atomic_load(&wrongFile) == 0 && atomic_load(&unseenStarts) == 0 &&
+         atomic_load(&stuck) == 0 && atomic_load(&corrupted) == 0;
+    ok = startTimeouts() && ok;
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
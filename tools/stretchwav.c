@@ -0,0 +1,151 @@
+// Plays recordings faster on the host, with the same time stretch the
+// player uses (main/stretch.h), for listening tests, and reports what it
+// cost per output sample at every speed.
+//
+//   cc -O2 -Itools -Imain -o stretchwav tools/stretchwav.c main/stretch.c
+//      main/wavparse.c main/convert.c -lm
+//   ./stretchwav out doc/recordings/*.WAV
+//
+// Writes out/<name>-<speed>.WAV for every speed the player offers.
+// Takes PCM and float WAV, as recorded by the device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "convert.h"
+#include "stretch.h"
+#include "wav.h"
+#include "wavparse.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#endif
+
+// what the player feeds it at once
+#define CHUNK 256
+
+static const int speeds[] = { 125, 150, 175, 200 };
+static Stretch stretch;
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Whole recording as mono 16 bits, NULL if it cannot be read
+static int16_t *load(const char *recording, WavInfo *info) {
+    FILE *f = fopen(recording, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", recording);
+        return NULL;
+    }
+    if (!wavParse(f, info) || info->format == WAVE_FORMAT_IMA_ADPCM) {
+        fprintf(stderr, "%s: not a PCM WAV file\n", recording);
+        fclose(f);
+        return NULL;
+    }
+    uint32_t frames = info->dataBytes / info->blockAlign;
+    uint8_t *raw = malloc(info->dataBytes);
+    int16_t *samples = malloc(frames * sizeof(int16_t) + 1);
+    if (raw != NULL && samples != NULL) {
+        frames = fread(raw, info->blockAlign, frames, f);
+        convertWavToMono16(raw, frames, info->channels, info->bitsPerSample,
+                           info->format == WAVE_FORMAT_IEEE_FLOAT, samples);
+        info->dataBytes = frames * sizeof(int16_t);
+    }
+    free(raw);
+    fclose(f);
+    return samples;
+}
+
+static bool save(const char *path, const int16_t *samples, uint32_t count, uint32_t rate) {
+    wav_header header = {
+        .riff_header = { 'R', 'I', 'F', 'F' },
+        .wav_size = sizeof(wav_header) - 8 + count * sizeof(int16_t),
+        .wave_header = { 'W', 'A', 'V', 'E' },
+        .fmt_header = { 'f', 'm', 't', ' ' },
+        .fmt_chunk_size = 16,
+        .audio_format = 1,
+        .num_channels = 1,
+        .sample_rate = rate,
+        .byte_rate = rate * sizeof(int16_t),
+        .sample_alignment = sizeof(int16_t),
+        .bit_depth = 16,
+        .data_header = { 'd', 'a', 't', 'a' },
+        .data_bytes = count * sizeof(int16_t),
+    };
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(samples, sizeof(int16_t), count, f) == count;
+    return fclose(f) == 0 && ok;
+}
+
+static bool process(const char *outDir, const char *recording) {
+    WavInfo info;
+    int16_t *samples = load(recording, &info);
+    if (samples == NULL) {
+        return false;
+    }
+    uint32_t count = info.dataBytes / sizeof(int16_t);
+    int16_t *out = malloc(count * sizeof(int16_t) + 1);
+
+    const char *slash = strrchr(recording, '/');
+    const char *name = slash ? slash + 1 : recording;
+    const char *dot = strrchr(name, '.');
+    int nameLen = dot ? dot - name : (int)strlen(name);
+
+    bool ok = out != NULL;
+    for (int i = 0; ok && i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        stretchInit(&stretch, info.sampleRate, speeds[i]);
+        uint32_t used = 0;
+        uint32_t produced = 0;
+        double start = now();
+#ifdef CYCLES
+        uint64_t cycles = CYCLES();
+#endif
+        while (used < count) {
+            size_t n = count - used < CHUNK ? count - used : CHUNK;
+            // never more out than in, the speed is at least 1
+            produced += stretchProcess(&stretch, samples + used, &n, out + produced, CHUNK);
+            used += n;
+        }
+#ifdef CYCLES
+        cycles = CYCLES() - cycles;
+#endif
+        double spent = now() - start;
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%.*s-%d.WAV", outDir, nameLen, name, speeds[i]);
+        ok = save(path, out, produced, info.sampleRate);
+        printf("%s: %.2fx, %.1f s to %.1f s, %.1f ns", path, speeds[i] / 100.0, (double)count / info.sampleRate,
+               (double)produced / info.sampleRate, spent * 1e9 / (produced ? produced : 1));
+#ifdef CYCLES
+        printf(", %.1f cycles", (double)cycles / (produced ? produced : 1));
+#endif
+        printf(" per output sample\n");
+    }
+    free(out);
+    free(samples);
+    if (!ok) {
+        fprintf(stderr, "%s: cannot write\n", recording);
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s outdir recording...\n", argv[0]);
+        return 2;
+    }
+    int failed = 0;
+    for (int i = 2; i < argc; i++) {
+        failed += !process(argv[1], argv[i]);
+    }
+    return failed ? 1 : 0;
+}
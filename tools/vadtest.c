@@ -0,0 +1,310 @@
+// Runs the recording gate's voice activity detector (main/vad.h) on the
+// host over the given recordings, each at 0, -8, -16 and -24 dB, spliced
+// with gaps of 1 to 6 s of white noise, with the same noise under the
+// recordings too. The gate is worked like the writer does it: closed
+// frames are left out except for the GATE_PREROLL_MS before the gate
+// opens again. Reports how much of the speech is kept at each gain, how
+// much of the silence is removed and what share of the input is
+// written, at a quiet room's noise and at the recordings' own floor,
+// and the detector's cycles per sample where the host can count them.
+//
+// Speech is what lies within SPEECH_HANGOVER_MS of a 10 ms frame of the
+// recording, as it is on file, at least SPEECH_ABOVE_FLOOR_DB louder than
+// its floor, the tenth percentile of its frames. Silence is the gaps and
+// the rest of the recordings.
+//
+//   cc -O2 -Itools -Imain -o vadtest tools/vadtest.c main/vad.c
+//      main/wavparse.c main/convert.c -lm
+//   ./vadtest doc/recordings/*.WAV
+//
+// Takes PCM and float WAV. Fails a scenario whose speech kept or silence
+// removed fall below its thresholds.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "convert.h"
+#include "vad.h"
+#include "wavparse.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()
+#endif
+
+// same as the writer
+#define GATE_PREROLL_MS 250
+#define GAINS 4
+#define MIN_GAP_MS 1000
+#define MAX_GAP_MS 6000
+#define BENCH_PASSES 20
+// what counts as speech in the recordings
+#define SPEECH_FRAME_MS 10
+#define SPEECH_ABOVE_FLOOR_DB 10
+#define SPEECH_HANGOVER_MS 200
+
+typedef struct {
+    const char *name;
+    double noiseDb; // RMS, dBFS
+    // speech kept at each gain, at least, in %
+    double minKept[GAINS];
+    // silence removed, at least, in %
+    double minRemoved;
+} Scenario;
+
+static const int gainsDb[GAINS] = { 0, -8, -16, -24 };
+
+static const Scenario scenarios[] = {
+    { "quiet room, noise at -60 dBFS", -60, { 99, 99, 99, 99 }, 75 },
+    // the -24 dB recordings are below the noise, what is left of them does not count
+    { "noise at -48 dBFS, the recordings' own floor", -48, { 99, 99, 90, 0 }, 70 },
+};
+
+typedef struct {
+    int16_t *samples;
+    bool *speech;
+    size_t count;
+} Recording;
+
+static uint32_t seed = 1;
+
+static uint32_t randomBelow(uint32_t n) {
+    seed = seed * 1664525 + 1013904223;
+    return (uint32_t)(((uint64_t)(seed >> 8) * n) >> 24);
+}
+
+// Standard normal
+static double gaussian() {
+    double u = (randomBelow(1 << 24) + 1.0) / (1 << 24);
+    double v = randomBelow(1 << 24) / (double)(1 << 24);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int16_t saturate(double x) {
+    return x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : (int16_t)lrint(x);
+}
+
+// Marks the speech in a recording, see the top
+static int compareEnergy(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void findSpeech(Recording *r, uint32_t rate) {
+    size_t frame = rate * SPEECH_FRAME_MS / 1000;
+    size_t frames = r->count / frame;
+    double *energy = calloc(frames + 1, sizeof(double));
+    double *sorted = calloc(frames + 1, sizeof(double));
+    for (size_t f = 0; f < frames; f++) {
+        for (size_t i = f * frame; i < (f + 1) * frame; i++) {
+            energy[f] += (double)r->samples[i] * r->samples[i];
+        }
+        sorted[f] = energy[f];
+    }
+    qsort(sorted, frames, sizeof(double), compareEnergy);
+    double threshold = sorted[frames / 10] * pow(10, SPEECH_ABOVE_FLOOR_DB / 10.0);
+    size_t hangover = (size_t)rate * SPEECH_HANGOVER_MS / 1000;
+    r->speech = calloc(r->count, sizeof(bool));
+    for (size_t f = 0; f < frames; f++) {
+        if (energy[f] >= threshold) {
+            size_t from = f * frame > hangover ? f * frame - hangover : 0;
+            size_t to = (f + 1) * frame + hangover < r->count ? (f + 1) * frame + hangover : r->count;
+            memset(r->speech + from, true, to - from);
+        }
+    }
+    free(sorted);
+    free(energy);
+}
+
+// Whole recording as mono 16 bits, false if it cannot be read
+static bool load(const char *name, Recording *r, uint32_t *rate) {
+    FILE *f = fopen(name, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "%s: cannot open\n", name);
+        return false;
+    }
+    WavInfo info;
+    if (!wavParse(f, &info) || info.format == WAVE_FORMAT_IMA_ADPCM) {
+        fprintf(stderr, "%s: not a PCM WAV file\n", name);
+        fclose(f);
+        return false;
+    }
+    uint32_t frames = info.dataBytes / info.blockAlign;
+    uint8_t *raw = malloc(info.dataBytes);
+    r->samples = malloc(frames * sizeof(int16_t) + 1);
+    frames = fread(raw, info.blockAlign, frames, f);
+    convertWavToMono16(raw, frames, info.channels, info.bitsPerSample, info.format == WAVE_FORMAT_IEEE_FLOAT,
+                       r->samples);
+    free(raw);
+    fclose(f);
+    r->count = frames;
+    if (*rate != 0 && info.sampleRate != *rate) {
+        fprintf(stderr, "%s: all recordings need to have the same rate\n", name);
+        return false;
+    }
+    *rate = info.sampleRate;
+    findSpeech(r, *rate);
+    return true;
+}
+
+// Every recording at every gain, each after a gap, with noise all along.
+// label is the gain index for speech and -1 for silence.
+static size_t splice(const Recording *recordings, int count, uint32_t rate, double noiseDb, int16_t **out,
+                     int8_t **label) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        total += GAINS * (recordings[i].count + (size_t)rate * MAX_GAP_MS / 1000);
+    }
+    *out = malloc(total * sizeof(int16_t));
+    *label = malloc(total);
+    double noise = 32768 * pow(10, noiseDb / 20);
+    // the same gaps and noise every time, only the level changes
+    seed = 1;
+    size_t at = 0;
+    for (int g = 0; g < GAINS; g++) {
+        double gain = pow(10, gainsDb[g] / 20.0);
+        for (int i = 0; i < count; i++) {
+            size_t gap = (size_t)rate * (MIN_GAP_MS + randomBelow(MAX_GAP_MS - MIN_GAP_MS)) / 1000;
+            for (size_t n = 0; n < gap; n++, at++) {
+                (*out)[at] = saturate(noise * gaussian());
+                (*label)[at] = -1;
+            }
+            for (size_t n = 0; n < recordings[i].count; n++, at++) {
+                (*out)[at] = saturate(recordings[i].samples[n] * gain + noise * gaussian());
+                (*label)[at] = recordings[i].speech[n] ? g : -1;
+            }
+        }
+    }
+    return at;
+}
+
+// Gates like the writer, marks the samples that would be written
+static void gate(const int16_t *samples, size_t count, uint32_t rate, bool *kept) {
+    Vad vad;
+    vadInit(&vad, rate);
+    size_t preRoll = (size_t)rate * GATE_PREROLL_MS / 1000;
+    size_t skipped = 0;
+    size_t i = 0;
+    for (; i + vad.frame <= count; i += vad.frame) {
+        bool open = vadProcess(&vad, samples + i);
+        memset(kept + i, open, vad.frame);
+        if (!open) {
+            skipped += vad.frame;
+            continue;
+        }
+        // just opened, the onset is in the pre-roll
+        size_t back = skipped < preRoll ? skipped : preRoll;
+        memset(kept + i - back, true, back);
+        skipped = 0;
+    }
+    // a short last frame goes wherever the frame before it went
+    memset(kept + i, vad.open, count - i);
+}
+
+static bool run(const Scenario *sc, const Recording *recordings, int count, uint32_t rate) {
+    int16_t *samples;
+    int8_t *label;
+    size_t total = splice(recordings, count, rate, sc->noiseDb, &samples, &label);
+    bool *kept = malloc(total);
+    gate(samples, total, rate, kept);
+
+    size_t speech[GAINS] = { 0 };
+    size_t speechKept[GAINS] = { 0 };
+    size_t silence = 0;
+    size_t silenceKept = 0;
+    size_t written = 0;
+    for (size_t i = 0; i < total; i++) {
+        if (label[i] < 0) {
+            silence++;
+            silenceKept += kept[i];
+        } else {
+            speech[label[i]]++;
+            speechKept[label[i]] += kept[i];
+        }
+        written += kept[i];
+    }
+
+    bool ok = true;
+    printf("%s, %.0f s:\n", sc->name, (double)total / rate);
+    for (int g = 0; g < GAINS; g++) {
+        double keptPercent = 100.0 * speechKept[g] / speech[g];
+        bool good = keptPercent >= sc->minKept[g];
+        printf("  speech at %3d dB: %5.1f %% kept (at least %.0f %%)%s\n", gainsDb[g], keptPercent, sc->minKept[g],
+               good ? "" : " FAILED");
+        ok = ok && good;
+    }
+    double removed = 100.0 - 100.0 * silenceKept / silence;
+    bool good = removed >= sc->minRemoved;
+    printf("  silence: %5.1f %% removed (at least %.0f %%)%s\n", removed, sc->minRemoved, good ? "" : " FAILED");
+    printf("  written: %.1f %% of the input\n", 100.0 * written / total);
+    ok = ok && good;
+
+    free(kept);
+    free(label);
+    free(samples);
+    return ok;
+}
+
+// The detector alone over the quiet room splice, as often as it takes to time it
+static void bench(const Recording *recordings, int count, uint32_t rate) {
+    int16_t *samples;
+    int8_t *label;
+    size_t total = splice(recordings, count, rate, scenarios[0].noiseDb, &samples, &label);
+    Vad vad;
+    size_t frames = 0;
+    int open = 0;
+    double start = now();
+#ifdef CYCLES
+    uint64_t cycles = CYCLES();
+#endif
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        vadInit(&vad, rate);
+        for (size_t i = 0; i + vad.frame <= total; i += vad.frame) {
+            open += vadProcess(&vad, samples + i);
+            frames++;
+        }
+    }
+    double perSample = frames * vad.frame;
+#ifdef CYCLES
+    printf("detector: %.1f M samples/s, %.2f cycles per sample", perSample / (now() - start) * 1e-6,
+           (CYCLES() - cycles) / perSample);
+#else
+    printf("detector: %.1f M samples/s", perSample / (now() - start) * 1e-6);
+#endif
+    // keeps the loop from being optimised away
+    printf(", open in %.0f %% of the frames\n", 100.0 * open / frames);
+    free(label);
+    free(samples);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s recording...\n", argv[0]);
+        return 2;
+    }
+    int count = argc - 1;
+    Recording *recordings = calloc(count, sizeof(Recording));
+    uint32_t rate = 0;
+    for (int i = 0; i < count; i++) {
+        if (!load(argv[i + 1], &recordings[i], &rate)) {
+            return 2;
+        }
+    }
+    bool ok = true;
+    for (int i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        ok = run(&scenarios[i], recordings, count, rate) && ok;
+    }
+    bench(recordings, count, rate);
+    printf(ok ? "ok\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
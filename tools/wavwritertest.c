@@ -0,0 +1,171 @@
+// Checks on the host that the block writer (main/wavwriter.h) makes the
+// same file, byte for byte, as writing the header and then the data
+// straight through stdio, the way the recorder used to. Covers data that
+// ends inside the first block, on a block boundary either side of the
+// header, and past the first reserved extent, with the 44 byte PCM header
+// and the longer IMA-ADPCM one, fed in pieces of random size.
+//
+//   cc -O2 -Itools -Imain -o wavwritertest tools/wavwritertest.c main/wavwriter.c
+//   ./wavwritertest /tmp
+//
+// Writes its two files to the given directory and removes them again.
+// A seek past the end does not grow a file here as it does on the card's
+// FAT, so the reserved space and the trim on close are not exercised.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavwriter.h"
+// after the writer, it brings the integer types
+#include "wav.h"
+
+static uint32_t seed = 1;
+
+static uint32_t randomBelow(uint32_t n) {
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % n;
+}
+
+static void fillHeader(wav_header *h, uint32_t dataBytes) {
+    wav_header header = {
+        .riff_header = { 'R', 'I', 'F', 'F' },
+        .wav_size = sizeof(wav_header) - 8 + dataBytes,
+        .wave_header = { 'W', 'A', 'V', 'E' },
+        .fmt_header = { 'f', 'm', 't', ' ' },
+        .fmt_chunk_size = 16,
+        .audio_format = 1,
+        .num_channels = 1,
+        .sample_rate = 44100,
+        .byte_rate = 44100 * sizeof(int16_t),
+        .sample_alignment = sizeof(int16_t),
+        .bit_depth = 16,
+        .data_header = { 'd', 'a', 't', 'a' },
+        .data_bytes = dataBytes,
+    };
+    *h = header;
+}
+
+static void fillImaHeader(wav_ima_header *h, uint32_t dataBytes) {
+    wav_ima_header header = {
+        .riff_header = { 'R', 'I', 'F', 'F' },
+        .wav_size = sizeof(wav_ima_header) - 8 + dataBytes,
+        .wave_header = { 'W', 'A', 'V', 'E' },
+        .fmt_header = { 'f', 'm', 't', ' ' },
+        .fmt_chunk_size = 20,
+        .audio_format = 0x11,
+        .num_channels = 1,
+        .sample_rate = 44100,
+        .byte_rate = 44100 * 256 / 505,
+        .sample_alignment = 256,
+        .bit_depth = 4,
+        .extra_size = 2,
+        .samples_per_block = 505,
+        .fact_header = { 'f', 'a', 'c', 't' },
+        .fact_chunk_size = 4,
+        .sample_length = dataBytes / 256 * 505,
+        .data_header = { 'd', 'a', 't', 'a' },
+        .data_bytes = dataBytes,
+    };
+    *h = header;
+}
+
+// Whole file, NULL if it cannot be read
+static uint8_t *slurp(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *bytes = malloc(*size + 1);
+    *size = fread(bytes, 1, *size, f);
+    fclose(f);
+    return bytes;
+}
+
+static bool check(const char *dir, const uint8_t *data, uint32_t dataBytes, bool ima) {
+    char path[256];
+    char refPath[256];
+    snprintf(path, sizeof(path), "%s/wavwriter.WAV", dir);
+    snprintf(refPath, sizeof(refPath), "%s/reference.WAV", dir);
+    wav_ima_header imaHeader;
+    wav_header header;
+    const void *h = ima ? (const void *)&imaHeader : &header;
+    size_t headerSize = ima ? sizeof(imaHeader) : sizeof(header);
+
+    WavWriter w;
+    if (!wavWriterOpen(&w, path, headerSize)) {
+        fprintf(stderr, "%s: cannot create\n", path);
+        return false;
+    }
+    bool ok = true;
+    uint32_t written = 0;
+    while (ok && written < dataBytes) {
+        uint32_t n = 1 + randomBelow(3000);
+        n = n < dataBytes - written ? n : dataBytes - written;
+        ok = wavWriterWrite(&w, data + written, n);
+        written += n;
+    }
+    // the header is only known once the data is in
+    fillHeader(&header, w.dataBytes);
+    fillImaHeader(&imaHeader, w.dataBytes);
+    ok = wavWriterClose(&w, h) && ok;
+
+    FILE *f = fopen(refPath, "wb");
+    fwrite(h, headerSize, 1, f);
+    fwrite(data, 1, dataBytes, f);
+    fclose(f);
+
+    size_t size, refSize;
+    uint8_t *bytes = slurp(path, &size);
+    uint8_t *ref = slurp(refPath, &refSize);
+    size_t firstDiff = 0;
+    while (firstDiff < size && firstDiff < refSize && bytes[firstDiff] == ref[firstDiff]) {
+        firstDiff++;
+    }
+    ok = ok && bytes != NULL && ref != NULL && size == refSize && firstDiff == size;
+    printf("%6s header, %8u data bytes: %s", ima ? "IMA" : "PCM", dataBytes, ok ? "same\n" : "");
+    if (!ok) {
+        printf("%zu bytes, %zu expected, first difference at %zu\n", size, refSize, firstDiff);
+    }
+    free(bytes);
+    free(ref);
+    remove(path);
+    remove(refPath);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s directory\n", argv[0]);
+        return 2;
+    }
+    if (sizeof(wav_header) != 44 || sizeof(wav_ima_header) != 60) {
+        fprintf(stderr, "wav_header is %zu bytes, wav_ima_header %zu\n", sizeof(wav_header), sizeof(wav_ima_header));
+        return 1;
+    }
+    // past the first extent, so the writer reserves a second one
+    uint32_t maxBytes = WAV_WRITER_EXTENT + 3 * SD_CLUSTER_SIZE + 5;
+    uint8_t *data = malloc(maxBytes);
+    for (uint32_t i = 0; i < maxBytes; i++) {
+        data[i] = randomBelow(256);
+    }
+    int failed = 0;
+    for (int ima = 0; ima < 2; ima++) {
+        uint32_t header = ima ? sizeof(wav_ima_header) : sizeof(wav_header);
+        uint32_t sizes[] = {
+            0, 1, 1000,
+            SD_CLUSTER_SIZE - header - 1, SD_CLUSTER_SIZE - header, SD_CLUSTER_SIZE - header + 1,
+            SD_CLUSTER_SIZE, 3 * SD_CLUSTER_SIZE + 7,
+            WAV_WRITER_EXTENT - header, maxBytes,
+        };
+        for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            failed += !check(argv[1], data, sizes[i], ima);
+        }
+    }
+    free(data);
+    printf(failed ? "FAILED\n" : "ok\n");
+    return failed ? 1 : 0;
+}